@@ -11,6 +11,7 @@
 #include "CharacterControlContext.h"
 #include "Characters/NavigationManager.h"
 #include "PrimeEngine/Scene/ParticleSystem.h"
+#include "PrimeEngine/Scene/ParticleTemplates.h"
 #include "PrimeEngine/Scene/MeshInstance.h"  
 #if PE_PLAT_IS_WIN32
 #include "test.h"
@@ -271,10 +272,24 @@ namespace CharacterControl {
 			pTemplate.m_duration = 5.f;
 			pTemplate.m_looping = true;
 			pTemplate.m_size = PE::Vector2(0.03f, 0.03f);
-			pTemplate.m_shape = PE::Components::Sphere;
+			pTemplate.m_shape = PE::Components::Disc;
 			pTemplate.m_texture = "";
 			pTemplate.color = Vector3(1.0f, 1.0f, 0.0f);
 
+			// authored templates override the values above when the compiled file is there
+			PE::Components::ParticleTemplateLibrary* pTemplates = PE::Components::ParticleTemplateLibrary::Instance();
+			if (pTemplates->open("ParticleTemplates.ptpl"))
+			{
+				pTemplates->watchSource("ParticleTemplates.txt");
+				pTemplates->find("ambient_sparkle", pTemplate);
+			}
+
+			// the drizzle stops at the ground instead of sinking through the level
+			static PE::Components::ParticleColliderSet s_particleGround;
+			s_particleGround.clear();
+			s_particleGround.addPlane(Vector3(0.0f, 1.0f, 0.0f), Vector3(0.0f, 0.0f, 0.0f));
+			pTemplate.m_pColliders = &s_particleGround;
+
 			m_pContext->getMeshManager()->registerAsset(pSHandle);
 
 			//  use MeshInstance reference
@@ -289,6 +304,16 @@ namespace CharacterControl {
 
 			// particle system initiation
 			pSys->createParticleSystem(pTemplate);
+			pSys->setTemplateName("ambient_sparkle");
+
+#if PE_PARTICLE_HOT_RELOAD
+			// edits to ParticleTemplates.txt show up in the running game
+			PE::Handle hTemplateWatcher("PARTICLE_TEMPLATE_WATCHER", sizeof(PE::Components::ParticleTemplateWatcher));
+			PE::Components::ParticleTemplateWatcher* pTemplateWatcher = new(hTemplateWatcher)
+				PE::Components::ParticleTemplateWatcher(*m_pContext, m_arena, hTemplateWatcher);
+			pTemplateWatcher->addDefaultComponents();
+			m_pContext->getGameObjectManager()->addComponent(hTemplateWatcher);
+#endif
 
 			PEINFO("Particle system initialized!\n");
 			// =======================================
@@ -0,0 +1,220 @@
+#include "ParticleAffectors.h"
+
+#include <math.h>
+#include <string.h>
+
+namespace PE {
+namespace Components {
+
+ParticleAffector *ParticleAffectorStack::append(ParticleAffectorType type)
+{
+    PEASSERT(m_count < MaxAffectors, "ParticleAffectorStack holds up to %d affectors", MaxAffectors);
+    if (m_count >= MaxAffectors)
+        return NULL;
+    ParticleAffector *pAffector = &m_affectors[m_count++];
+    memset(pAffector, 0, sizeof(*pAffector));
+    pAffector->m_type = type;
+    return pAffector;
+}
+
+void ParticleAffectorStack::addGravity(const Vector3 &acceleration)
+{
+    if (ParticleAffector *pAffector = append(ParticleAffector_Gravity))
+    {
+        pAffector->m_vector[0] = acceleration.m_x;
+        pAffector->m_vector[1] = acceleration.m_y;
+        pAffector->m_vector[2] = acceleration.m_z;
+    }
+}
+
+void ParticleAffectorStack::addDrag(PrimitiveTypes::Float32 rate, const Vector3 &wind)
+{
+    if (ParticleAffector *pAffector = append(ParticleAffector_Drag))
+    {
+        pAffector->m_vector[0] = wind.m_x;
+        pAffector->m_vector[1] = wind.m_y;
+        pAffector->m_vector[2] = wind.m_z;
+        pAffector->m_strength = rate;
+    }
+}
+
+void ParticleAffectorStack::addAttractor(const Vector3 &position, PrimitiveTypes::Float32 strength, PrimitiveTypes::Float32 radius)
+{
+    if (ParticleAffector *pAffector = append(ParticleAffector_Attractor))
+    {
+        pAffector->m_vector[0] = position.m_x;
+        pAffector->m_vector[1] = position.m_y;
+        pAffector->m_vector[2] = position.m_z;
+        pAffector->m_strength = strength;
+        pAffector->m_radius = radius;
+    }
+}
+
+void ParticleAffectorStack::addVortex(const Vector3 &position, const Vector3 &axis, PrimitiveTypes::Float32 strength,
+    PrimitiveTypes::Float32 radius)
+{
+    if (ParticleAffector *pAffector = append(ParticleAffector_Vortex))
+    {
+        pAffector->m_vector[0] = position.m_x;
+        pAffector->m_vector[1] = position.m_y;
+        pAffector->m_vector[2] = position.m_z;
+        pAffector->m_axis[0] = axis.m_x;
+        pAffector->m_axis[1] = axis.m_y;
+        pAffector->m_axis[2] = axis.m_z;
+        pAffector->m_strength = strength;
+        pAffector->m_radius = radius;
+    }
+}
+
+void ParticleAffectorStack::addTurbulence(PrimitiveTypes::Float32 strength, PrimitiveTypes::Float32 scale, PrimitiveTypes::Float32 speed)
+{
+    if (ParticleAffector *pAffector = append(ParticleAffector_Turbulence))
+    {
+        pAffector->m_strength = strength;
+        pAffector->m_radius = scale;
+        pAffector->m_speed = speed;
+    }
+}
+
+void ParticleAffectorStack::addInteraction(PrimitiveTypes::Float32 radius, PrimitiveTypes::Float32 separation,
+    PrimitiveTypes::Float32 cohesion, PrimitiveTypes::Float32 alignment)
+{
+    if (ParticleAffector *pAffector = append(ParticleAffector_Interaction))
+    {
+        pAffector->m_radius = radius;
+        pAffector->m_strength = separation;
+        pAffector->m_vector[0] = cohesion;
+        pAffector->m_vector[1] = alignment;
+    }
+}
+
+bool ParticleAffectorStack::hasForces() const
+{
+    for (PrimitiveTypes::UInt32 i = 0; i < m_count; i++)
+    {
+        if (m_affectors[i].m_type != ParticleAffector_Interaction)
+            return true;
+    }
+    return false;
+}
+
+ParticleAffectorProgram::ParticleAffectorProgram()
+{
+    compile(ParticleAffectorStack(), Vector3(0.0f, 0.0f, 0.0f));
+}
+
+void ParticleAffectorProgram::compile(const ParticleAffectorStack &stack, const Vector3 &origin)
+{
+    const float twoPi = 2.0f * PrimitiveTypes::Constants::c_Pi_F32;
+    // keeps the softened forces finite for a particle right on the center
+    const float minRadius = 1e-3f;
+
+    memset(m_ops, 0, sizeof(m_ops));
+    m_opCount = 0;
+    m_acceleration[0] = m_acceleration[1] = m_acceleration[2] = 0.0f;
+    m_wind[0] = m_wind[1] = m_wind[2] = 0.0f;
+    m_dragRate = 0.0f;
+    m_dragKeep = 1.0f;
+    m_interactionRadius = 0.0f;
+    m_separation = m_cohesion = m_alignment = 0.0f;
+
+    for (PrimitiveTypes::UInt32 i = 0; i < stack.m_count; i++)
+    {
+        const ParticleAffector &affector = stack.m_affectors[i];
+        switch (affector.m_type)
+        {
+        case ParticleAffector_Gravity:
+            for (int k = 0; k < 3; k++)
+                m_acceleration[k] += affector.m_vector[k];
+            break;
+        case ParticleAffector_Drag:
+            // linear drags add up: the rates sum, the winds average weighted by rate
+            if (affector.m_strength > 0.0f)
+            {
+                for (int k = 0; k < 3; k++)
+                    m_wind[k] += affector.m_vector[k] * affector.m_strength;
+                m_dragRate += affector.m_strength;
+            }
+            break;
+        case ParticleAffector_Attractor:
+        case ParticleAffector_Vortex:
+        {
+            ParticleAffectorOp &op = m_ops[m_opCount++];
+            op.m_type = affector.m_type;
+            op.m_center[0] = origin.m_x + affector.m_vector[0];
+            op.m_center[1] = origin.m_y + affector.m_vector[1];
+            op.m_center[2] = origin.m_z + affector.m_vector[2];
+            float radius = affector.m_radius > minRadius ? affector.m_radius : minRadius;
+            op.m_radiusSquared = radius * radius;
+            op.m_strength = affector.m_strength;
+            if (affector.m_type == ParticleAffector_Vortex)
+            {
+                Vector3 axis(affector.m_axis[0], affector.m_axis[1], affector.m_axis[2]);
+                if (axis.length() == 0.0f)
+                    axis = Vector3(0.0f, 1.0f, 0.0f);
+                axis.normalize();
+                op.m_axis[0] = axis.m_x;
+                op.m_axis[1] = axis.m_y;
+                op.m_axis[2] = axis.m_z;
+                // peak strength / 2 at the radius, see the kernels
+                op.m_strength *= radius;
+            }
+            break;
+        }
+        case ParticleAffector_Turbulence:
+        {
+            if (affector.m_radius <= 0.0f)
+                break;
+            ParticleAffectorOp &op = m_ops[m_opCount++];
+            op.m_type = ParticleAffector_Turbulence;
+            // an eddy spans half a period of the flow
+            float frequency = PrimitiveTypes::Constants::c_Pi_F32 / affector.m_radius;
+            op.m_radiusSquared = frequency;
+            // each component ranges over [-2, 2]
+            op.m_strength = affector.m_strength * 0.5f;
+            op.m_speed = affector.m_speed * frequency;
+            // stacked turbulences start out of step with each other
+            for (int k = 0; k < 3; k++)
+                op.m_center[k] = fmodf((float)(k + 3 * m_opCount) * 2.1f, twoPi);
+            break;
+        }
+        case ParticleAffector_Interaction:
+            if (affector.m_radius <= 0.0f)
+                break;
+            m_interactionRadius = affector.m_radius > m_interactionRadius ? affector.m_radius : m_interactionRadius;
+            m_separation += affector.m_strength;
+            m_cohesion += affector.m_vector[0];
+            m_alignment += affector.m_vector[1];
+            break;
+        }
+    }
+
+    if (m_dragRate > 0.0f)
+    {
+        for (int k = 0; k < 3; k++)
+            m_wind[k] /= m_dragRate;
+    }
+    m_active = stack.hasForces();
+}
+
+void ParticleAffectorProgram::prepare(PrimitiveTypes::Float32 dt)
+{
+    const float twoPi = 2.0f * PrimitiveTypes::Constants::c_Pi_F32;
+    m_dragKeep = expf(-m_dragRate * dt);
+
+    // the flow repeats every 2pi of phase, wrapping keeps the kernels' sin/cos arguments small
+    for (PrimitiveTypes::UInt32 i = 0; i < m_opCount; i++)
+    {
+        ParticleAffectorOp &op = m_ops[i];
+        if (op.m_type != ParticleAffector_Turbulence)
+            continue;
+        for (int k = 0; k < 3; k++)
+        {
+            float phase = fmodf(op.m_center[k] + op.m_speed * dt, twoPi);
+            op.m_center[k] = phase < 0.0f ? phase + twoPi : phase;
+        }
+    }
+}
+
+}; // namespace Components
+}; // namespace PE
@@ -0,0 +1,114 @@
+#ifndef _PE_PARTICLE_AFFECTORS_H_
+#define _PE_PARTICLE_AFFECTORS_H_
+
+#include "ParticleCoreTypes.h"
+
+namespace PE {
+namespace Components {
+
+enum ParticleAffectorType
+{
+    ParticleAffector_Gravity,    // constant acceleration m_vector
+    ParticleAffector_Drag,       // pulls velocity toward the wind m_vector at m_strength per second
+    ParticleAffector_Attractor,  // accelerates toward m_vector, away for negative m_strength
+    ParticleAffector_Vortex,     // accelerates around the m_axis line through m_vector
+    ParticleAffector_Turbulence, // swirling divergence-free flow, see addTurbulence()
+    ParticleAffector_Interaction, // between neighboring particles within m_radius, see addInteraction()
+};
+
+// One force of a template. Positions are relative to the emitter origin, all values in
+// world units and seconds; fields a type does not use stay zero.
+struct ParticleAffector
+{
+    PrimitiveTypes::UInt32 m_type;
+    PrimitiveTypes::Float32 m_vector[3];
+    PrimitiveTypes::Float32 m_axis[3];
+    PrimitiveTypes::Float32 m_strength;
+    PrimitiveTypes::Float32 m_radius;
+    PrimitiveTypes::Float32 m_speed;
+};
+
+// The forces on a template's particles. They act on the particle velocity, which starts
+// as the spawn heading times Particle::m_speed; all of them add up, so their order does
+// not matter.
+struct ParticleAffectorStack
+{
+    enum { MaxAffectors = 8 };
+
+    ParticleAffectorStack() : m_count(0), m_affectors() {}
+
+    // extra affectors are dropped
+    void addGravity(const Vector3 &acceleration);
+    // linear drag: velocity relaxes toward wind, losing 1 - e^-rate of the difference per second
+    void addDrag(PrimitiveTypes::Float32 rate, const Vector3 &wind);
+    // strength / d^2 at distance d, softened within radius so the center stays finite
+    void addAttractor(const Vector3 &position, PrimitiveTypes::Float32 strength, PrimitiveTypes::Float32 radius);
+    // tangential, counterclockwise looking down axis, strongest (strength / 2) at radius
+    void addVortex(const Vector3 &position, const Vector3 &axis, PrimitiveTypes::Float32 strength,
+        PrimitiveTypes::Float32 radius);
+    // curl flow with eddies about scale across, drifting through the particles at speed
+    void addTurbulence(PrimitiveTypes::Float32 strength, PrimitiveTypes::Float32 scale, PrimitiveTypes::Float32 speed);
+    // pairwise between particles closer than radius, with q = 1 - distance / radius:
+    // separation * q^2 pushes them apart, cohesion * q pulls them together (they settle
+    // at radius * (1 - cohesion / separation)) and alignment * q matches their velocities.
+    // Needs the emitter's neighbor grid (ParticleNeighbors.h), rebuilt every step
+    void addInteraction(PrimitiveTypes::Float32 radius, PrimitiveTypes::Float32 separation,
+        PrimitiveTypes::Float32 cohesion, PrimitiveTypes::Float32 alignment);
+    void clear() { m_count = 0; }
+
+    // any affector besides interactions, which the integrate kernels do not apply
+    bool hasForces() const;
+
+    PrimitiveTypes::UInt32 m_count;
+    ParticleAffector m_affectors[MaxAffectors];
+
+private:
+    ParticleAffector *append(ParticleAffectorType type);
+};
+
+// a field term of a compiled stack, with world space positions and folded constants
+struct ParticleAffectorOp
+{
+    PrimitiveTypes::UInt32 m_type;          // Attractor, Vortex or Turbulence
+    PrimitiveTypes::Float32 m_center[3];    // turbulence: phase per axis, advanced by prepare()
+    PrimitiveTypes::Float32 m_axis[3];      // vortex, unit length
+    PrimitiveTypes::Float32 m_strength;
+    PrimitiveTypes::Float32 m_radiusSquared; // turbulence: spatial frequency
+    PrimitiveTypes::Float32 m_speed;         // turbulence: phase per second
+};
+
+// A stack compiled for one emitter. Gravity is summed into one acceleration and the drags
+// into one rate and wind; the position dependent forces are a flat list of ops. The
+// integrate kernels apply all of it to a particle while they have it in registers, so
+// the forces cost arithmetic only and no extra pass over the particle streams.
+// Interactions need the other particles and run in a pass of their own before those
+// kernels (ParticleInteractKernel); several of them merge into the largest radius and
+// the summed strengths.
+struct ParticleAffectorProgram
+{
+    ParticleAffectorProgram();
+
+    // origin is where the emitter sits in the world
+    void compile(const ParticleAffectorStack &stack, const Vector3 &origin);
+    // per fixed step, before the integrate kernels run: folds dt into the drag and moves
+    // the turbulence along
+    void prepare(PrimitiveTypes::Float32 dt);
+
+    // false without forces: the kernels leave the velocity alone
+    PrimitiveTypes::Bool m_active;
+    PrimitiveTypes::Float32 m_acceleration[3];
+    PrimitiveTypes::Float32 m_dragRate;
+    PrimitiveTypes::Float32 m_wind[3];
+    PrimitiveTypes::Float32 m_dragKeep; // e^(-rate * dt), set by prepare()
+    PrimitiveTypes::UInt32 m_opCount;
+    ParticleAffectorOp m_ops[ParticleAffectorStack::MaxAffectors];
+    PrimitiveTypes::Float32 m_interactionRadius; // 0 without interactions
+    PrimitiveTypes::Float32 m_separation;
+    PrimitiveTypes::Float32 m_cohesion;
+    PrimitiveTypes::Float32 m_alignment;
+};
+
+}; // namespace Components
+}; // namespace PE
+
+#endif
@@ -0,0 +1,255 @@
+#include "ParticleBatch.h"
+#include "PrimeEngine/Scene/MeshInstance.h"
+#include "PrimeEngine/Scene/MeshManager.h"
+#include "PrimeEngine/Scene/RootSceneNode.h"
+#include "PrimeEngine/Scene/SceneNode.h"
+#include "PrimeEngine/Geometry/MeshCPU/MeshCPU.h"
+#include "PrimeEngine/Geometry/PositionBufferCPU/PositionBufferCPU.h"
+
+namespace PE {
+namespace Components {
+
+PE_IMPLEMENT_CLASS1(ParticleBatch, ParticleSystem);
+
+ParticleBatch::ParticleBatch(PE::GameContext &context, PE::MemoryArena arena, Handle hMyself)
+    : ParticleSystem(context, arena, hMyself)
+    , m_emitters(context, arena, MaxEmitters)
+    , m_emitterCapacity(0)
+    , m_memberRenderMode(ParticleRenderMode_CPUExpanded)
+{
+    m_textureName[0] = '\0';
+}
+
+bool ParticleBatch::accepts(const ParticleSystem &system) const
+{
+    const ParticleSystemCPU *psysCPU = system.m_hParticleSystemCPU.getObject<ParticleSystemCPU>();
+    if (m_renderMode == ParticleRenderMode_Packed)
+    {
+        // packed coordinates only reach 64 units from the batch origin
+        Vector3 d = system.m_packedOrigin - m_packedOrigin;
+        if (d.length() > MaxPackedDistance)
+            return false;
+    }
+    // the shared streams stop at the 16-bit index limit of the mode drawn; an emitter past
+    // it goes to a batch of its own, where only its first particles fit
+    if (m_emitters.m_size > 0
+        && m_emitterCapacity + psysCPU->m_buffer.m_capacity > getMaxMeshCapacity(m_renderMode))
+        return false;
+    return system.m_renderMode == m_memberRenderMode
+        && system.m_hasColor == m_hasColor
+        && system.m_hasTexture == m_hasTexture
+        && (!m_hasTexture || strcmp(psysCPU->m_particleTemplate.m_texture, m_textureName) == 0);
+}
+
+void ParticleBatch::addEmitter(Handle hParticleSystem)
+{
+    ParticleSystem *pSystem = hParticleSystem.getObject<ParticleSystem>();
+    ParticleSystemCPU *psysCPU = pSystem->m_hParticleSystemCPU.getObject<ParticleSystemCPU>();
+    PEASSERT(psysCPU, "ParticleBatch: createParticleSystem() has to run before the emitter joins a batch");
+    PEASSERT(m_emitters.m_size < MaxEmitters, "ParticleBatch supports up to %d emitters", MaxEmitters);
+    if (!psysCPU || m_emitters.m_size >= MaxEmitters)
+        return;
+
+    if (m_emitters.m_size == 0)
+    {
+        // the first member decides what the batch draws
+        m_renderMode = pSystem->m_renderMode;
+        m_memberRenderMode = pSystem->m_renderMode;
+        m_hasColor = pSystem->m_hasColor;
+        m_hasTexture = pSystem->m_hasTexture;
+        m_packedOrigin = pSystem->m_packedOrigin;
+        strncpy(m_textureName, psysCPU->m_particleTemplate.m_texture, MaxTextureName - 1);
+        m_textureName[MaxTextureName - 1] = '\0';
+    }
+
+    m_emitters.add(hParticleSystem);
+    m_emitterCapacity += psysCPU->m_buffer.m_capacity;
+    pSystem->m_hBatch = m_hMyself;
+}
+
+void ParticleBatch::removeEmitter(Handle hParticleSystem)
+{
+    for (PrimitiveTypes::UInt32 i = 0; i < m_emitters.m_size; i++)
+    {
+        if (m_emitters[i] == hParticleSystem)
+        {
+            ParticleSystem *pSystem = hParticleSystem.getObject<ParticleSystem>();
+            m_emitterCapacity -= pSystem->m_hParticleSystemCPU.getObject<ParticleSystemCPU>()->m_buffer.m_capacity;
+            pSystem->m_hBatch = Handle();
+            m_emitters.remove(i);
+            return;
+        }
+    }
+}
+
+ParticleEmitterStats &ParticleBatch::getStats()
+{
+    return m_batchStats;
+}
+
+void ParticleBatch::do_UPDATE(Events::Event *pEvt)
+{
+    Events::Event_UPDATE* updateEvt = (Events::Event_UPDATE*)(pEvt);
+    float dt = updateEvt->m_frameTime / 1000.0f;
+
+    // all members start before any is waited on, so they overlap on the job pool
+    for (PrimitiveTypes::UInt32 i = 0; i < m_emitters.m_size; i++)
+    {
+        ParticleSystem *pSystem = m_emitters[i].getObject<ParticleSystem>();
+        ParticleSystemCPU *psysCPU = pSystem->m_hParticleSystemCPU.getObject<ParticleSystemCPU>();
+        // a reloaded template may size the member differently
+        PrimitiveTypes::UInt32 capacity = psysCPU->m_buffer.m_capacity;
+        if (pSystem->reloadTemplate())
+            m_emitterCapacity = m_emitterCapacity - capacity + psysCPU->m_buffer.m_capacity;
+        psysCPU->beginUpdate(dt);
+    }
+}
+
+void ParticleBatch::do_GATHER_DRAWCALLS(Events::Event *pEvt)
+{
+    if (m_emitters.m_size == 0)
+        return;
+
+    Events::Event_GATHER_DRAWCALLS* gatherEvt = (Events::Event_GATHER_DRAWCALLS*)(pEvt);
+
+    // one camera query for the whole batch, handed to every member
+    captureCameraViews();
+    const ParticleCameraSnapshot &view = m_cameraViews[0];
+
+    MeshCPU *mcpu = getMeshCPU();
+    resolveRenderMode();
+
+    PrimitiveTypes::UInt32 particleCount = 0;
+    {
+        PE_PARTICLE_SCOPED_TIMER(m_batchStats, ParticleTimer_Build);
+        prepareMeshBuffers(*mcpu, m_emitterCapacity);
+
+        for (PrimitiveTypes::UInt32 i = 0; i < m_emitters.m_size; i++)
+        {
+            ParticleSystem *pSystem = m_emitters[i].getObject<ParticleSystem>();
+            ParticleSystemCPU *psysCPU = pSystem->m_hParticleSystemCPU.getObject<ParticleSystemCPU>();
+
+            pSystem->setCameraViews(m_cameraViews, m_cameraViewCount);
+            if (!pSystem->prepareFrame())
+                continue;
+
+            PrimitiveTypes::UInt32 count = psysCPU->m_buffer.m_size;
+            if (count > m_meshCapacity - particleCount)
+                count = m_meshCapacity - particleCount; // shared 16-bit indices; the rest waits for room
+
+            const PrimitiveTypes::UInt32 *pOrder = psysCPU->m_particleTemplate.m_depthSort
+                ? pSystem->m_depthSorter.sort(psysCPU->m_buffer, psysCPU->m_buffer.m_size, view) : NULL;
+
+            writeParticleRange(*mcpu, *psysCPU, view, pOrder, particleCount, count);
+            particleCount += count;
+
+            PE_PARTICLE_COUNT(psysCPU->m_stats, ParticleCounter_VerticesWritten,
+                count * (m_renderMode == ParticleRenderMode_Instanced ? 1 : 4));
+            PE_PARTICLE_END_FRAME(psysCPU->m_stats);
+        }
+
+        setLiveRange(*mcpu, particleCount);
+        m_uploadStats.m_dynamicBytes = getDynamicBytes(particleCount);
+    }
+    // nothing live and the empty mesh already uploaded: the gpu copy is still right
+    if (particleCount == 0 && m_builtEmpty && m_loaded)
+    {
+        PE_PARTICLE_END_FRAME(m_batchStats);
+        return;
+    }
+    m_builtEmpty = particleCount == 0;
+    PE_PARTICLE_COUNT(m_batchStats, ParticleCounter_VerticesWritten,
+        mcpu->m_hPositionBufferCPU.getObject<PositionBufferCPU>()->m_values.m_size / 3);
+    PE_PARTICLE_COUNT(m_batchStats, ParticleCounter_BytesUploaded, m_uploadStats.m_submittedBytes);
+
+    ParticleSystem *pFirst = m_emitters[0].getObject<ParticleSystem>();
+    Handle hMaterialSetCPU = pFirst->m_hParticleSystemCPU.getObject<ParticleSystemCPU>()->m_hMaterialSetCPU;
+
+    m_pContext->getGPUScreen()->AcquireRenderContextOwnership(gatherEvt->m_threadOwnershipMask);
+    {
+        PE_PARTICLE_SCOPED_TIMER(m_batchStats, ParticleTimer_Upload);
+        uploadMeshCPU_needsRC(*mcpu, gatherEvt->m_threadOwnershipMask, hMaterialSetCPU);
+    }
+    m_pContext->getGPUScreen()->ReleaseRenderContextOwnership(gatherEvt->m_threadOwnershipMask);
+
+    PE_PARTICLE_END_FRAME(m_batchStats);
+}
+
+// ParticleBatcher implementation
+ParticleBatcher *ParticleBatcher::Instance()
+{
+    static ParticleBatcher s_instance;
+    return &s_instance;
+}
+
+ParticleBatcher::ParticleBatcher()
+    : m_batchCount(0)
+{
+}
+
+Handle ParticleBatcher::addEmitter(Handle hParticleSystem)
+{
+    ParticleSystem *pSystem = hParticleSystem.getObject<ParticleSystem>();
+    if (pSystem->m_hBatch.isValid())
+        return pSystem->m_hBatch;
+
+    for (PrimitiveTypes::UInt32 i = 0; i < m_batchCount; i++)
+    {
+        ParticleBatch *pBatch = m_batches[i].getObject<ParticleBatch>();
+        if (pBatch->m_emitters.m_size < ParticleBatch::MaxEmitters && pBatch->accepts(*pSystem))
+        {
+            pBatch->addEmitter(hParticleSystem);
+            return m_batches[i];
+        }
+    }
+
+    PEASSERT(m_batchCount < MaxBatches, "ParticleBatcher supports up to %d batches", MaxBatches);
+    if (m_batchCount >= MaxBatches)
+        return Handle();
+
+    PE::GameContext &context = *pSystem->m_pContext;
+
+    Handle hBatch("PARTICLE_BATCH", sizeof(ParticleBatch));
+    ParticleBatch *pBatch = new (hBatch) ParticleBatch(context, pSystem->m_arena, hBatch);
+    pBatch->addDefaultComponents();
+    pBatch->addEmitter(hParticleSystem);
+    // decided now so a packed batch that falls back is not placed at its origin
+    pBatch->resolveRenderMode();
+
+    context.getMeshManager()->registerAsset(hBatch);
+
+    Handle hInstance("MeshInstance", sizeof(MeshInstance));
+    MeshInstance *pInstance = new (hInstance) MeshInstance(context, pSystem->m_arena, hInstance);
+    pInstance->addDefaultComponents();
+    pInstance->initFromRegisteredAsset(hBatch);
+
+    if (pBatch->m_renderMode == ParticleRenderMode_Packed)
+    {
+        // packed vertices are relative to the batch origin; the node puts them back in the world
+        Handle hNode("SCENE_NODE", sizeof(SceneNode));
+        SceneNode *pNode = new (hNode) SceneNode(context, pSystem->m_arena, hNode);
+        pNode->addDefaultComponents();
+        pNode->m_base.setPos(pBatch->m_packedOrigin);
+        pNode->addComponent(hInstance);
+        RootSceneNode::Instance()->addComponent(hNode);
+    }
+    else
+    {
+        RootSceneNode::Instance()->addComponent(hInstance);
+    }
+
+    m_batches[m_batchCount++] = hBatch;
+    return hBatch;
+}
+
+void ParticleBatcher::removeEmitter(Handle hParticleSystem)
+{
+    ParticleSystem *pSystem = hParticleSystem.getObject<ParticleSystem>();
+    if (!pSystem->m_hBatch.isValid())
+        return;
+
+    pSystem->m_hBatch.getObject<ParticleBatch>()->removeEmitter(hParticleSystem);
+}
+
+}; // namespace Components
+}; // namespace PE
@@ -0,0 +1,68 @@
+#ifndef _PE_PARTICLE_BATCH_H_
+#define _PE_PARTICLE_BATCH_H_
+
+#include "ParticleSystem.h"
+
+namespace PE {
+namespace Components {
+
+// Draws many emitters that share a technique, color setting and texture as one mesh.
+// Members are ParticleSystems without a MeshInstance of their own: the batch runs their
+// update, captures the camera once for all of them, writes their particles back to back
+// into its streams and uploads and draws them with one render context acquire.
+// Particles are ordered per emitter only (depth sorting does not cross emitters).
+// Packed members share the first member's origin, so they must lie within MaxPackedDistance of it.
+struct ParticleBatch : public ParticleSystem
+{
+    PE_DECLARE_CLASS(ParticleBatch);
+
+    ParticleBatch(PE::GameContext &context, PE::MemoryArena arena, Handle hMyself);
+
+    virtual ~ParticleBatch() {}
+
+    // whether an emitter can share this batch's mesh and still fits in its 16-bit indices
+    bool accepts(const ParticleSystem &system) const;
+
+    void addEmitter(Handle hParticleSystem);
+    void removeEmitter(Handle hParticleSystem);
+
+    virtual ParticleEmitterStats &getStats();
+
+    virtual void do_GATHER_DRAWCALLS(Events::Event *pEvt);
+    virtual void do_UPDATE(Events::Event *pEvt);
+
+    enum { MaxEmitters = 512 };
+    enum { MaxTextureName = 64 };
+    // half the packed vertex reach, leaving the other half for the particles' own spread
+    enum { MaxPackedDistance = 32 };
+
+    Array<Handle> m_emitters;
+    // particles of all members; within getMaxMeshCapacity() unless a lone member is past it
+    PrimitiveTypes::UInt32 m_emitterCapacity;
+    ParticleRenderMode m_memberRenderMode; // what members ask for; m_renderMode may have fallen back
+    char m_textureName[MaxTextureName];
+    ParticleEmitterStats m_batchStats; // build, upload and bytes of the shared mesh
+};
+
+// Finds or creates the batch for an emitter. A new batch is registered as a mesh asset
+// and placed in the scene with its own MeshInstance, like a standalone emitter.
+struct ParticleBatcher
+{
+    static ParticleBatcher *Instance();
+
+    ParticleBatcher();
+
+    // createParticleSystem() must have been called on the emitter; returns the batch
+    Handle addEmitter(Handle hParticleSystem);
+    void removeEmitter(Handle hParticleSystem);
+
+    enum { MaxBatches = 32 };
+
+    Handle m_batches[MaxBatches];
+    PrimitiveTypes::UInt32 m_batchCount;
+};
+
+}; // namespace Components
+}; // namespace PE
+
+#endif
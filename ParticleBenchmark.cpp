@@ -0,0 +1,1343 @@
+// Headless benchmarks for the particle core: spawn, fixed-step update, mesh build, depth
+// sort and emitter churn across particle counts, emitter counts, looping and color/texture
+// settings, affector stacks, and spawn bursts per emitter shape.
+// Only built with PE_PARTICLE_HEADLESS, e.g.
+//   g++ -std=c++11 -O2 -pthread -DPE_PARTICLE_HEADLESS ParticleBenchmark.cpp ParticleSimCore.cpp ParticleSimd.cpp ParticleJobs.cpp ParticleProfiler.cpp ParticleMemoryPool.cpp ParticleCurves.cpp ParticleShapes.cpp ParticleAffectors.cpp ParticleCollision.cpp ParticleNeighbors.cpp -o particle_bench
+//   ./particle_bench [--filter=substring] [--min-time=seconds] [--workers=n]
+// Every result is one JSON object per line on stdout:
+//   {"name": ..., "iterations": ..., "particles": ..., "ns_per_particle": ...,
+//    "particles_per_sec": ..., "allocs_per_frame": ..., "bytes_per_frame": ...}
+// spawn/.../random:rand fills the emitters like spawn/.../random:particle_random, but
+// draws every value through rand() per particle as the baseline did.
+// aos_update/... and aos_build/... run the array-of-structs layout and mesh rebuild the
+// core replaced (ParticleCPU with a Matrix4x4 per particle), for comparison with update/...
+// and build/... at the same counts.
+// sort results add "ms_per_100k" and "radix_sorts", the emitter sorts that could not
+// reuse the previous order. build/.../packed:1 writes ParticlePackedVertex quads.
+// churn results add "pool_heap_allocs_per_frame" (ParticleMemoryPool trips to the heap
+// once warmed up) and "pool_high_water_bytes". burst results add "ms_per_burst".
+// affectors/... is the update with an affector stack of none, gravity and drag, or all
+// five kinds. kernels/... is a frame of update plus quad build for a few common
+// templates, with the emitter's specialized kernels (specialized:1, what the engine
+// binds) against the generic ones that test every feature per particle (specialized:0).
+// collision/... is the update of falling particles against a ground plane or a
+// heightfield with each response; it also checks the result and reports
+// "below_surface", live particles found under a collider after a frame, which has to be 0:
+// the run exits nonzero otherwise.
+// neighbors/... is the update with a particle-particle interaction (separation only, or
+// with cohesion and alignment too) against none, at a few interaction radii; it adds
+// "neighbors_per_particle", the average found within the radius after the last frame.
+// scaling/... is a fixed 60 frames of update of one large and of many small emitters at
+// every worker count from 0 up to the hardware threads; it adds "stream_hash" of the
+// particles afterwards, and the run exits nonzero unless that is the same for all counts.
+
+#ifdef PE_PARTICLE_HEADLESS
+
+#include "ParticleSimCore.h"
+#include "ParticleShapes.h"
+
+#include <chrono>
+#include <math.h>
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+// every operator new in the process is counted, through all the replaceable forms so
+// each allocation is released by the matching delete; the particle streams themselves
+// are malloc'd once per emitter in ParticleBufferCPU::reset() and never per frame
+static std::atomic<PrimitiveTypes::UInt32> s_allocCount(0);
+
+// kept out of line, GCC otherwise pairs the inlined malloc/free with new/delete and
+// reports them as mismatched
+#if defined(__GNUC__)
+#define PE_PARTICLE_BENCH_NOINLINE __attribute__((noinline))
+#else
+#define PE_PARTICLE_BENCH_NOINLINE
+#endif
+
+static PE_PARTICLE_BENCH_NOINLINE void *countedAllocate(size_t size)
+{
+    s_allocCount++;
+    return malloc(size ? size : 1);
+}
+
+static PE_PARTICLE_BENCH_NOINLINE void countedRelease(void *p)
+{
+    free(p);
+}
+
+void *operator new(size_t size)
+{
+    void *p = countedAllocate(size);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size)
+{
+    void *p = countedAllocate(size);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    return countedAllocate(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    return countedAllocate(size);
+}
+
+void operator delete(void *p) noexcept
+{
+    countedRelease(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    countedRelease(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    countedRelease(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+    countedRelease(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept
+{
+    countedRelease(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept
+{
+    countedRelease(p);
+}
+
+namespace PE {
+namespace Components {
+
+// Stand-in for the engine mesh: streams sized to the emitter capacity once, with the
+// per-frame data written through the same core writers ParticleSystem uses. Every live
+// particle is written, as into as many ParticleSystem::MaxExpandedQuads meshes as it
+// takes; those share the one static index pattern, so only that much is kept
+struct ParticleMeshSink
+{
+    std::vector<PrimitiveTypes::Float32> m_positions;
+    std::vector<ParticlePackedVertex> m_packed;
+    std::vector<PrimitiveTypes::Float32> m_colors;
+    std::vector<PrimitiveTypes::Float32> m_texCoords;
+    std::vector<PrimitiveTypes::Float32> m_normals;
+    std::vector<PrimitiveTypes::UInt16> m_indices;
+    PrimitiveTypes::Bool m_hasColor;
+    PrimitiveTypes::Bool m_hasTexture;
+    PrimitiveTypes::Bool m_packedVertices;
+    PrimitiveTypes::UInt32 m_lastCount; // quads written by the last build
+
+    ParticleMeshSink(PrimitiveTypes::UInt32 capacity, PrimitiveTypes::Bool hasColor, PrimitiveTypes::Bool hasTexture, PrimitiveTypes::Bool packed)
+        : m_hasColor(hasColor)
+        , m_hasTexture(hasTexture)
+        , m_packedVertices(packed)
+        , m_lastCount(0)
+    {
+        if (packed)
+            m_packed.resize(capacity * 4);
+        else
+            m_positions.resize(capacity * 4 * 3);
+        if (hasColor && !packed)
+            m_colors.resize(capacity * 4 * 3);
+        if (hasTexture && !packed)
+        {
+            m_texCoords.resize(capacity * 4 * 2);
+            m_normals.resize(capacity * 4 * 3);
+        }
+
+        // ParticleSystem::MaxExpandedQuads
+        PrimitiveTypes::UInt32 meshQuads = capacity < 16384 ? capacity : 16384;
+        m_indices.resize(meshQuads * 6);
+        for (PrimitiveTypes::UInt32 i = 0; i < meshQuads; i++)
+        {
+            PrimitiveTypes::UInt16 *q = &m_indices[i * 6];
+            q[0] = (PrimitiveTypes::UInt16)(i * 4 + 0); q[1] = (PrimitiveTypes::UInt16)(i * 4 + 1); q[2] = (PrimitiveTypes::UInt16)(i * 4 + 2);
+            q[3] = (PrimitiveTypes::UInt16)(i * 4 + 2); q[4] = (PrimitiveTypes::UInt16)(i * 4 + 3); q[5] = (PrimitiveTypes::UInt16)(i * 4 + 0);
+        }
+    }
+
+    // returns the bytes a mesh update would submit for this frame
+    PrimitiveTypes::UInt32 build(const ParticleEmitterCore &emitter, const ParticleCameraSnapshot &view)
+    {
+        PrimitiveTypes::UInt32 count = emitter.m_buffer.m_size;
+        m_lastCount = count;
+
+        if (m_packedVertices)
+        {
+            emitter.m_kernels.m_writePackedQuads(emitter.m_buffer, count, NULL, view, emitter.m_clock.m_alpha, emitter.m_curves,
+                m_hasColor, emitter.m_origin, &m_packed[0]);
+            return count * (4 * sizeof(ParticlePackedVertex) + 6 * sizeof(PrimitiveTypes::UInt16));
+        }
+
+        emitter.m_kernels.m_writeQuads(emitter.m_buffer, count, NULL, view, emitter.m_clock.m_alpha, emitter.m_curves,
+            &m_positions[0], m_hasColor ? &m_colors[0] : NULL);
+
+        PrimitiveTypes::UInt32 floatsPerVertex = 3 + (m_hasColor ? 3 : 0) + (m_hasTexture ? 2 + 3 : 0);
+        return count * (4 * floatsPerVertex * sizeof(PrimitiveTypes::Float32) + 6 * sizeof(PrimitiveTypes::UInt16));
+    }
+};
+
+struct ParticleBenchConfig
+{
+    PrimitiveTypes::UInt32 m_particles; // per emitter
+    PrimitiveTypes::UInt32 m_emitters;
+    PrimitiveTypes::Bool m_looping;
+    PrimitiveTypes::Bool m_color;
+    PrimitiveTypes::Bool m_texture;
+    PrimitiveTypes::Bool m_packed; // build only
+    PrimitiveTypes::UInt32 m_affectors; // update only: 0 none, 1 gravity and drag, 2 all five kinds
+    PrimitiveTypes::UInt32 m_template;  // 0 Particle defaults, 1 plain, 2 spark, see makeBenchTemplate()
+    PrimitiveTypes::Bool m_generic;     // bind the generic kernels instead of the specialized ones
+    PrimitiveTypes::Bool m_falling;     // update only: add gravity, before any m_affectors
+    PrimitiveTypes::UInt32 m_colliders; // update only: 0 none, 1 ground plane, 2 heightfield, see getBenchColliders()
+    ParticleCollisionResponse m_collision;
+    PrimitiveTypes::UInt32 m_interaction;       // update only: 0 none, 1 separation, 2 separation, cohesion and alignment
+    PrimitiveTypes::Float32 m_interactionRadius;
+    PrimitiveTypes::Bool m_randSpawn; // spawn only: draw through rand() per particle, see spawnParticlesRand()
+};
+
+struct ParticleBenchResult
+{
+    PrimitiveTypes::UInt32 m_iterations; // frames
+    double m_particles; // particles processed over all frames
+    double m_seconds;
+    PrimitiveTypes::UInt32 m_allocs;
+    double m_bytes;
+    PrimitiveTypes::UInt32 m_radixSorts; // sort bench only
+    PrimitiveTypes::UInt64 m_poolHeapAllocs; // churn bench only
+    PrimitiveTypes::UInt64 m_poolHighWaterBytes;
+    PrimitiveTypes::UInt32 m_burstParticles; // burst bench only
+    PrimitiveTypes::UInt64 m_belowSurface; // collision bench only
+    PrimitiveTypes::Bool m_collisionCheck;
+    double m_neighborsPerParticle; // neighbors bench only
+    PrimitiveTypes::UInt32 m_streamHash; // scaling bench only
+    PrimitiveTypes::Bool m_hashCheck;
+};
+
+static double s_minTime = 0.5;
+
+// the ground just under the spawn spheres of the emitters along +x: a flat plane, or
+// gentle hills a little lower, 0.1 apart
+static const ParticleColliderSet *getBenchColliders(PrimitiveTypes::UInt32 colliders)
+{
+    static ParticleColliderSet s_plane, s_hills;
+    static ParticleHeightfield s_heightfield;
+    if (s_plane.m_planeCount == 0)
+    {
+        s_plane.addPlane(Vector3(0.0f, 1.0f, 0.0f), Vector3(0.0f, -0.5f, 0.0f));
+
+        const PrimitiveTypes::UInt32 columns = 256, rows = 32;
+        std::vector<PrimitiveTypes::Float32> heights(columns * rows);
+        for (PrimitiveTypes::UInt32 z = 0; z < rows; z++)
+        {
+            for (PrimitiveTypes::UInt32 x = 0; x < columns; x++)
+                heights[z * columns + x] = -0.75f + 0.15f * sinf(x * 0.7f) * cosf(z * 0.9f);
+        }
+        s_heightfield.build(-1.6f, -1.6f, 0.1f, columns, rows, &heights[0]);
+        s_hills.m_pHeightfield = &s_heightfield;
+    }
+    return colliders == 1 ? &s_plane : colliders == 2 ? &s_hills : NULL;
+}
+
+static Particle makeBenchTemplate(const ParticleBenchConfig &config)
+{
+    // rate spawns the whole capacity up front and keeps it full while looping
+    Particle p;
+    p.m_rate = (PrimitiveTypes::Int16)(config.m_particles < 32767 ? config.m_particles : 32767);
+    p.m_duration = (PrimitiveTypes::Float32)config.m_particles / p.m_rate;
+    p.m_looping = config.m_looping;
+    p.m_texture = config.m_texture ? "bench.dds" : "";
+    // reaches the colliders within the first second
+    if (config.m_falling)
+        p.m_affectors.addGravity(Vector3(0.0f, -2.0f, 0.0f));
+    if (config.m_colliders > 0)
+    {
+        p.m_pColliders = getBenchColliders(config.m_colliders);
+        p.m_collision = config.m_collision;
+    }
+    if (config.m_template > 0)
+    {
+        // no swirl, no size pulse
+        p.m_swirlStrength = 0.0f;
+        p.m_pulseAmount = 0.0f;
+    }
+    if (config.m_template == 2)
+    {
+        // hit_spark of ParticleTemplates.txt: shrinks, slows down and falls
+        p.m_sizeOverLife.addKey(0.0f, 1.0f);
+        p.m_sizeOverLife.addKey(1.0f, 0.3f);
+        p.m_speedOverLife.addKey(0.0f, 1.0f);
+        p.m_speedOverLife.addKey(0.5f, 0.4f);
+        p.m_speedOverLife.addKey(1.0f, 0.1f);
+        p.m_affectors.addGravity(Vector3(0.0f, -1.5f, 0.0f));
+    }
+    if (config.m_affectors > 0)
+    {
+        p.m_affectors.addGravity(Vector3(0.0f, -0.5f, 0.0f));
+        p.m_affectors.addDrag(0.5f, Vector3(0.1f, 0.0f, 0.0f));
+    }
+    if (config.m_affectors > 1)
+    {
+        p.m_affectors.addAttractor(Vector3(0.0f, 1.0f, 0.0f), 0.2f, 0.25f);
+        p.m_affectors.addVortex(Vector3(0.0f, 0.0f, 0.0f), Vector3(0.0f, 1.0f, 0.0f), 0.5f, 0.5f);
+        p.m_affectors.addTurbulence(0.3f, 0.5f, 0.2f);
+    }
+    if (config.m_interaction > 0)
+    {
+        p.m_affectors.addInteraction(config.m_interactionRadius, 2.0f, config.m_interaction > 1 ? 0.5f : 0.0f,
+            config.m_interaction > 1 ? 1.0f : 0.0f);
+    }
+    return p;
+}
+
+static void createEmitters(const ParticleBenchConfig &config, std::vector<ParticleEmitterCore *> &emitters)
+{
+    Particle particle = makeBenchTemplate(config);
+    for (PrimitiveTypes::UInt32 e = 0; e < config.m_emitters; e++)
+    {
+        ParticleEmitterCore *pEmitter = new ParticleEmitterCore(particle);
+        pEmitter->m_random.seed(particle.m_seed, e);
+        pEmitter->bindKernels(config.m_generic ? (PrimitiveTypes::UInt32)ParticleKernelFeature_Generic
+            : pEmitter->getKernelFeatures(config.m_color));
+        pEmitter->start(Vector3((float)e, 0.0f, 0.0f));
+        emitters.push_back(pEmitter);
+    }
+}
+
+static void destroyEmitters(std::vector<ParticleEmitterCore *> &emitters)
+{
+    for (size_t e = 0; e < emitters.size(); e++)
+        delete emitters[e];
+    emitters.clear();
+}
+
+static double secondsSince(std::chrono::high_resolution_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// the baseline's spawn into the same streams: a disc under the origin and a drift
+// heading per particle, each value drawn by its own rand() call
+static void spawnParticlesRand(ParticleEmitterCore &emitter, PrimitiveTypes::UInt32 count, PrimitiveTypes::Float32 maxAge)
+{
+    ParticleBufferCPU &pb = emitter.m_buffer;
+    const Particle &particle = emitter.m_particleTemplate;
+    const float twoPi = 2.0f * PrimitiveTypes::Constants::c_Pi_F32;
+    const float speed = particle.m_speed * 0.02f; // s_moveScale
+    PrimitiveTypes::UInt32 begin = pb.add(count);
+    for (PrimitiveTypes::UInt32 j = begin; j < begin + count; j++)
+    {
+        float r = rand() / (float)RAND_MAX;
+        float theta = (rand() / (float)RAND_MAX) * twoPi;
+        float yOffset = (rand() / (float)RAND_MAX) * particle.m_spawnHeight;
+        pb.m_posX[j] = pb.m_prevX[j] = emitter.m_origin.m_x + cosf(theta) * particle.m_spawnRadius * r;
+        pb.m_posY[j] = pb.m_prevY[j] = emitter.m_origin.m_y + yOffset;
+        pb.m_posZ[j] = pb.m_prevZ[j] = emitter.m_origin.m_z + sinf(theta) * particle.m_spawnRadius * r;
+
+        Vector3 heading((rand() / (float)RAND_MAX) * 2.0f - 1.0f, -0.1f - (rand() / (float)RAND_MAX) * 0.1f,
+            (rand() / (float)RAND_MAX) * 2.0f - 1.0f);
+        heading.normalize();
+        pb.m_velX[j] = heading.m_x * speed;
+        pb.m_velY[j] = heading.m_y * speed;
+        pb.m_velZ[j] = heading.m_z * speed;
+
+        pb.m_age[j] = (rand() / (float)RAND_MAX) * maxAge;
+        pb.m_duration[j] = particle.m_duration;
+        pb.m_sizeX[j] = particle.m_size.m_x * emitter.m_curves.m_size[0];
+        pb.m_sizeY[j] = particle.m_size.m_y * emitter.m_curves.m_size[0];
+        pb.m_phase[j] = fmodf(j * 0.37f, twoPi);
+    }
+}
+
+// createParticleBuffer(): construct, size and fill the emitters
+static ParticleBenchResult benchSpawn(const ParticleBenchConfig &config)
+{
+    ParticleBenchResult result = {};
+    std::vector<ParticleEmitterCore *> emitters;
+    emitters.reserve(config.m_emitters);
+    Particle particle = makeBenchTemplate(config);
+    srand(particle.m_seed);
+
+    while (result.m_seconds < s_minTime)
+    {
+        PrimitiveTypes::UInt32 allocsBefore = s_allocCount;
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        if (config.m_randSpawn)
+        {
+            // start() without its spawn, then the initial particles through rand()
+            for (PrimitiveTypes::UInt32 e = 0; e < config.m_emitters; e++)
+            {
+                ParticleEmitterCore *pEmitter = new ParticleEmitterCore(particle);
+                pEmitter->m_origin = Vector3((float)e, 0.0f, 0.0f);
+                pEmitter->m_buffer.reset((PrimitiveTypes::UInt32)(particle.m_duration * particle.m_rate));
+                spawnParticlesRand(*pEmitter, pEmitter->m_buffer.m_capacity < (PrimitiveTypes::UInt32)particle.m_rate
+                    ? pEmitter->m_buffer.m_capacity : particle.m_rate, particle.m_duration);
+                emitters.push_back(pEmitter);
+            }
+        }
+        else
+        {
+            createEmitters(config, emitters);
+        }
+        result.m_seconds += secondsSince(start);
+        result.m_allocs += s_allocCount - allocsBefore;
+
+        for (size_t e = 0; e < emitters.size(); e++)
+            result.m_particles += emitters[e]->m_buffer.m_size;
+        result.m_iterations++;
+        destroyEmitters(emitters);
+    }
+    return result;
+}
+
+// live particles more than a hair under one of the emitter's colliders
+static PrimitiveTypes::UInt32 countBelowColliders(const ParticleEmitterCore &emitter)
+{
+    const ParticleBufferCPU &pb = emitter.m_buffer;
+    const ParticleColliderSet &colliders = *emitter.m_particleTemplate.m_pColliders;
+    const float tolerance = 1e-3f;
+    PrimitiveTypes::UInt32 below = 0;
+    for (PrimitiveTypes::UInt32 j = 0; j < pb.m_size; j++)
+    {
+        bool under = false;
+        for (PrimitiveTypes::UInt32 k = 0; k < colliders.m_planeCount; k++)
+        {
+            const ParticleCollisionPlane &plane = colliders.m_planes[k];
+            under |= plane.m_normal[0] * pb.m_posX[j] + plane.m_normal[1] * pb.m_posY[j]
+                + plane.m_normal[2] * pb.m_posZ[j] < plane.m_offset - tolerance;
+        }
+        if (colliders.m_pHeightfield)
+            under |= pb.m_posY[j] < colliders.m_pHeightfield->sample(pb.m_posX[j], pb.m_posZ[j]) - tolerance;
+        below += under ? 1 : 0;
+    }
+    return below;
+}
+
+struct ParticleBenchNeighborCount
+{
+    PrimitiveTypes::UInt32 m_count;
+    void operator()(PrimitiveTypes::UInt32, float, float, float, float) { m_count++; }
+};
+
+// average neighbors within the interaction radius of the emitter's particles
+static double countNeighbors(ParticleEmitterCore &emitter, PrimitiveTypes::Float32 radius)
+{
+    ParticleNeighborGrid &grid = emitter.m_neighbors;
+    grid.build(emitter.m_buffer, radius);
+    ParticleBenchNeighborCount neighbors = {};
+    for (PrimitiveTypes::UInt32 slot = 0; slot < grid.m_count; slot++)
+        grid.forEachNeighbor(slot, neighbors);
+    return grid.m_count > 0 ? (double)neighbors.m_count / grid.m_count : 0.0;
+}
+
+// updateParticleBuffer(): one 60 Hz frame of all emitters, all started before finishing
+// any so the emitters overlap on the job pool like they do in the engine
+static ParticleBenchResult benchUpdate(const ParticleBenchConfig &config)
+{
+    ParticleBenchResult result = {};
+    std::vector<ParticleEmitterCore *> emitters;
+    createEmitters(config, emitters);
+
+    const PrimitiveTypes::Float32 frameTime = 1.0f / 60.0f;
+    while (result.m_seconds < s_minTime)
+    {
+        // a burst is gone after its duration; restart it so every frame has work
+        if (!config.m_looping && emitters[0]->isFinished())
+        {
+            destroyEmitters(emitters);
+            createEmitters(config, emitters);
+        }
+
+        for (size_t e = 0; e < emitters.size(); e++)
+            result.m_particles += emitters[e]->m_buffer.m_size;
+
+        PrimitiveTypes::UInt32 allocsBefore = s_allocCount;
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        for (size_t e = 0; e < emitters.size(); e++)
+            emitters[e]->beginUpdate(frameTime);
+        for (size_t e = 0; e < emitters.size(); e++)
+            emitters[e]->finishUpdate();
+        result.m_seconds += secondsSince(start);
+        result.m_allocs += s_allocCount - allocsBefore;
+
+        if (config.m_colliders > 0)
+        {
+            result.m_collisionCheck = true;
+            for (size_t e = 0; e < emitters.size(); e++)
+                result.m_belowSurface += countBelowColliders(*emitters[e]);
+        }
+        result.m_iterations++;
+    }
+    if (config.m_interactionRadius > 0.0f)
+        result.m_neighborsPerParticle = countNeighbors(*emitters[0], config.m_interactionRadius);
+    destroyEmitters(emitters);
+    return result;
+}
+
+// FNV-1a over the live particles' positions, velocities, ages and sizes of all emitters
+static PrimitiveTypes::UInt32 hashParticleStreams(const std::vector<ParticleEmitterCore *> &emitters)
+{
+    PrimitiveTypes::UInt32 hash = 2166136261u;
+    for (size_t e = 0; e < emitters.size(); e++)
+    {
+        const ParticleBufferCPU &pb = emitters[e]->m_buffer;
+        const PrimitiveTypes::Float32 *streams[] = { pb.m_posX, pb.m_posY, pb.m_posZ, pb.m_velX, pb.m_velY, pb.m_velZ,
+            pb.m_age, pb.m_sizeX, pb.m_sizeY };
+        hash = (hash ^ pb.m_size) * 16777619u;
+        for (size_t s = 0; s < sizeof(streams) / sizeof(streams[0]); s++)
+        {
+            const unsigned char *bytes = (const unsigned char *)streams[s];
+            for (PrimitiveTypes::UInt32 b = 0; b < pb.m_size * sizeof(PrimitiveTypes::Float32); b++)
+                hash = (hash ^ bytes[b]) * 16777619u;
+        }
+    }
+    return hash;
+}
+
+// the update at the job pool's current worker count: a fixed number of frames from the
+// same seeds, so the hash of the streams afterwards must not depend on the workers
+static ParticleBenchResult benchScaling(const ParticleBenchConfig &config)
+{
+    ParticleBenchResult result = {};
+    std::vector<ParticleEmitterCore *> emitters;
+    createEmitters(config, emitters);
+
+    const PrimitiveTypes::Float32 frameTime = 1.0f / 60.0f;
+    const PrimitiveTypes::UInt32 frames = 60;
+    for (PrimitiveTypes::UInt32 frame = 0; frame < frames; frame++)
+    {
+        for (size_t e = 0; e < emitters.size(); e++)
+            result.m_particles += emitters[e]->m_buffer.m_size;
+
+        PrimitiveTypes::UInt32 allocsBefore = s_allocCount;
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        for (size_t e = 0; e < emitters.size(); e++)
+            emitters[e]->beginUpdate(frameTime);
+        for (size_t e = 0; e < emitters.size(); e++)
+            emitters[e]->finishUpdate();
+        result.m_seconds += secondsSince(start);
+        result.m_allocs += s_allocCount - allocsBefore;
+        result.m_iterations++;
+    }
+    result.m_hashCheck = true;
+    result.m_streamHash = hashParticleStreams(emitters);
+    destroyEmitters(emitters);
+    return result;
+}
+
+// loadParticle_needsRC() minus the gpu: camera-facing quads into the sink
+static ParticleBenchResult benchBuild(const ParticleBenchConfig &config)
+{
+    ParticleBenchResult result = {};
+    std::vector<ParticleEmitterCore *> emitters;
+    createEmitters(config, emitters);
+
+    // a few steps so ages, sizes and prev positions are not the spawn values
+    for (int i = 0; i < 10; i++)
+    {
+        for (size_t e = 0; e < emitters.size(); e++)
+            emitters[e]->updateParticleBuffer(1.0f / 60.0f);
+    }
+
+    std::vector<ParticleMeshSink *> sinks;
+    for (size_t e = 0; e < emitters.size(); e++)
+        sinks.push_back(new ParticleMeshSink(emitters[e]->m_buffer.m_capacity, config.m_color, config.m_texture, config.m_packed));
+
+    // stub camera looking down -z from a little above the emitters
+    ParticleCameraSnapshot view;
+    view.m_position = Vector3(0.0f, 2.0f, 10.0f);
+
+    while (result.m_seconds < s_minTime)
+    {
+        PrimitiveTypes::UInt32 allocsBefore = s_allocCount;
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        for (size_t e = 0; e < emitters.size(); e++)
+            result.m_bytes += sinks[e]->build(*emitters[e], view);
+        result.m_seconds += secondsSince(start);
+        result.m_allocs += s_allocCount - allocsBefore;
+
+        for (size_t e = 0; e < sinks.size(); e++)
+            result.m_particles += sinks[e]->m_lastCount;
+        result.m_iterations++;
+    }
+
+    for (size_t e = 0; e < sinks.size(); e++)
+        delete sinks[e];
+    destroyEmitters(emitters);
+    return result;
+}
+
+// a whole frame of one emitter as the engine runs it: the update, then the quads
+static ParticleBenchResult benchKernels(const ParticleBenchConfig &config)
+{
+    ParticleBenchResult result = {};
+    std::vector<ParticleEmitterCore *> emitters;
+    createEmitters(config, emitters);
+
+    std::vector<ParticleMeshSink *> sinks;
+    for (size_t e = 0; e < emitters.size(); e++)
+        sinks.push_back(new ParticleMeshSink(emitters[e]->m_buffer.m_capacity, config.m_color, config.m_texture, config.m_packed));
+
+    ParticleCameraSnapshot view;
+    view.m_position = Vector3(0.0f, 2.0f, 10.0f);
+
+    const PrimitiveTypes::Float32 frameTime = 1.0f / 60.0f;
+    while (result.m_seconds < s_minTime)
+    {
+        for (size_t e = 0; e < emitters.size(); e++)
+            result.m_particles += emitters[e]->m_buffer.m_size;
+
+        PrimitiveTypes::UInt32 allocsBefore = s_allocCount;
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        for (size_t e = 0; e < emitters.size(); e++)
+            emitters[e]->beginUpdate(frameTime);
+        for (size_t e = 0; e < emitters.size(); e++)
+        {
+            emitters[e]->finishUpdate();
+            result.m_bytes += sinks[e]->build(*emitters[e], view);
+        }
+        result.m_seconds += secondsSince(start);
+        result.m_allocs += s_allocCount - allocsBefore;
+
+        result.m_iterations++;
+    }
+
+    for (size_t e = 0; e < sinks.size(); e++)
+        delete sinks[e];
+    destroyEmitters(emitters);
+    return result;
+}
+
+// short-lived effects: every frame an eighth of the emitters dies and a new one of
+// another size (a quarter to all of config.m_particles) takes its place, then all of
+// them update. Emitter objects live in fixed slots, so the heap traffic left is what the
+// particle storage causes
+static ParticleBenchResult benchChurn(const ParticleBenchConfig &config)
+{
+    ParticleBenchResult result = {};
+    ParticleMemoryPool *pPool = ParticleMemoryPool::Instance();
+    const PrimitiveTypes::Float32 frameTime = 1.0f / 60.0f;
+
+    std::vector<void *> slots(config.m_emitters);
+    std::vector<ParticleEmitterCore *> emitters(config.m_emitters);
+    PrimitiveTypes::UInt32 spawned = 0;
+    for (size_t e = 0; e < slots.size(); e++)
+    {
+        slots[e] = pPool->allocate(sizeof(ParticleEmitterCore));
+        emitters[e] = NULL;
+    }
+
+    PrimitiveTypes::UInt32 churnPerFrame = config.m_emitters / 8 > 0 ? config.m_emitters / 8 : 1;
+    PrimitiveTypes::UInt32 next = 0;
+    ParticleMemoryStats before = {};
+
+    // the first frames fill the pool; every size has been freed once after 8
+    for (PrimitiveTypes::UInt32 frame = 0; result.m_seconds < s_minTime; frame++)
+    {
+        if (frame == 8)
+        {
+            before = pPool->getStats();
+            pPool->resetHighWater();
+        }
+        PrimitiveTypes::UInt32 allocsBefore = s_allocCount;
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+        for (PrimitiveTypes::UInt32 c = 0; c < churnPerFrame; c++)
+        {
+            PrimitiveTypes::UInt32 e = next++ % config.m_emitters;
+            if (emitters[e])
+                emitters[e]->~ParticleEmitterCore();
+
+            ParticleBenchConfig sized = config;
+            sized.m_particles = config.m_particles * (1 + spawned % 4) / 4;
+            Particle particle = makeBenchTemplate(sized);
+            emitters[e] = new (slots[e]) ParticleEmitterCore(particle);
+            emitters[e]->m_random.seed(particle.m_seed, spawned++);
+            emitters[e]->start(Vector3((float)e, 0.0f, 0.0f));
+        }
+
+        for (size_t e = 0; e < emitters.size(); e++)
+        {
+            if (emitters[e])
+                emitters[e]->beginUpdate(frameTime);
+        }
+        for (size_t e = 0; e < emitters.size(); e++)
+        {
+            if (emitters[e])
+                emitters[e]->finishUpdate();
+        }
+
+        if (frame < 8)
+            continue;
+        result.m_seconds += secondsSince(start);
+        result.m_allocs += s_allocCount - allocsBefore;
+        for (size_t e = 0; e < emitters.size(); e++)
+            result.m_particles += emitters[e] ? emitters[e]->m_buffer.m_size : 0;
+        result.m_iterations++;
+    }
+
+    ParticleMemoryStats after = pPool->getStats();
+    result.m_poolHeapAllocs = after.m_heapAllocations - before.m_heapAllocations;
+    result.m_poolHighWaterBytes = after.m_highWaterBytes;
+
+    for (size_t e = 0; e < slots.size(); e++)
+    {
+        if (emitters[e])
+            emitters[e]->~ParticleEmitterCore();
+        pPool->release(slots[e]);
+    }
+    return result;
+}
+
+// one frame of a camera orbiting the emitters: step the simulation (untimed), then sort
+// every emitter. coherent keeps each sorter's previous order, otherwise every sort
+// starts cold and is a full radix sort
+static ParticleBenchResult benchSort(const ParticleBenchConfig &config, PrimitiveTypes::Bool coherent)
+{
+    ParticleBenchResult result = {};
+    std::vector<ParticleEmitterCore *> emitters;
+    createEmitters(config, emitters);
+
+    // the first sort sizes the sorter to the buffer capacity; keep that out of the timing
+    std::vector<ParticleDepthSorter> sorters(emitters.size());
+    ParticleCameraSnapshot view;
+    PrimitiveTypes::Float32 angle = 0.0f;
+    for (size_t e = 0; e < emitters.size(); e++)
+        sorters[e].sort(emitters[e]->m_buffer, emitters[e]->m_buffer.m_size, view);
+
+    while (result.m_seconds < s_minTime)
+    {
+        for (size_t e = 0; e < emitters.size(); e++)
+            emitters[e]->updateParticleBuffer(1.0f / 60.0f);
+
+        // half a degree per frame
+        angle += 0.0087f;
+        view.m_front = Vector3(sinf(angle), 0.0f, cosf(angle));
+        view.m_right = Vector3(cosf(angle), 0.0f, -sinf(angle));
+
+        PrimitiveTypes::UInt32 allocsBefore = s_allocCount;
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        for (size_t e = 0; e < emitters.size(); e++)
+        {
+            if (!coherent)
+                sorters[e].invalidate();
+            sorters[e].sort(emitters[e]->m_buffer, emitters[e]->m_buffer.m_size, view);
+        }
+        result.m_seconds += secondsSince(start);
+        result.m_allocs += s_allocCount - allocsBefore;
+
+        for (size_t e = 0; e < emitters.size(); e++)
+            result.m_particles += emitters[e]->m_buffer.m_size;
+        result.m_iterations++;
+    }
+
+    for (size_t e = 0; e < sorters.size(); e++)
+        result.m_radixSorts += sorters[e].m_radixSorts - 1;
+    destroyEmitters(emitters);
+    return result;
+}
+
+// spawnParticles(): one burst into a stopped emitter, the whole capacity at once
+static ParticleBenchResult benchBurst(PrimitiveTypes::UInt32 particles, Shape shape, const ParticleShapeMesh *pMesh)
+{
+    ParticleBenchResult result = {};
+    result.m_burstParticles = particles;
+
+    Particle p;
+    p.m_rate = 10000;
+    p.m_duration = (PrimitiveTypes::Float32)particles / p.m_rate;
+    p.m_looping = false;
+    p.m_shape = shape;
+    p.m_pShapeMesh = pMesh;
+    ParticleEmitterCore emitter(p);
+    emitter.start(Vector3(1.0f, 2.0f, 3.0f));
+
+    while (result.m_seconds < s_minTime)
+    {
+        emitter.stop();
+
+        PrimitiveTypes::UInt32 allocsBefore = s_allocCount;
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        emitter.spawnParticles(emitter.m_buffer, particles, 0.0f);
+        result.m_seconds += secondsSince(start);
+        result.m_allocs += s_allocCount - allocsBefore;
+
+        result.m_particles += emitter.m_buffer.m_size;
+        result.m_iterations++;
+    }
+    return result;
+}
+
+// Reference of the array-of-structs layout the particle core replaced, kept so the
+// before/after numbers can be reproduced: ParticleCPU held a whole Matrix4x4 per particle
+// (its position plus the camera basis, rewritten for every particle every frame), and the
+// mesh was reset and refilled with every stream each frame. The matrix is a stand-in for
+// the engine's with the same size and the calls the old code made.
+struct ParticleBenchMatrix4x4
+{
+    PrimitiveTypes::Float32 m_values[4][4]; // columns u, v, n and the position
+
+    Vector3 getU() const { return Vector3(m_values[0][0], m_values[1][0], m_values[2][0]); }
+    Vector3 getV() const { return Vector3(m_values[0][1], m_values[1][1], m_values[2][1]); }
+    Vector3 getPos() const { return Vector3(m_values[0][3], m_values[1][3], m_values[2][3]); }
+    void setColumn(int c, const Vector3 &v) { m_values[0][c] = v.m_x; m_values[1][c] = v.m_y; m_values[2][c] = v.m_z; }
+    void setU(const Vector3 &u) { setColumn(0, u); }
+    void setV(const Vector3 &v) { setColumn(1, v); }
+    void setN(const Vector3 &n) { setColumn(2, n); }
+    void setPos(const Vector3 &p) { setColumn(3, p); }
+    void moveRight(PrimitiveTypes::Float32 d) { setPos(getPos() + getU() * d); }
+    void moveLeft(PrimitiveTypes::Float32 d) { setPos(getPos() - getU() * d); }
+    void moveUp(PrimitiveTypes::Float32 d) { setPos(getPos() + getV() * d); }
+    void moveDown(PrimitiveTypes::Float32 d) { setPos(getPos() - getV() * d); }
+};
+
+struct ParticleBenchAoSParticle
+{
+    ParticleBenchMatrix4x4 m_base;
+    PrimitiveTypes::Float32 m_size[2];
+    PrimitiveTypes::Float32 m_age;
+    PrimitiveTypes::Float32 m_duration;
+    Vector3 velocity;
+};
+
+// the old spawn: a disc under the origin, rand() for everything
+static void spawnAoSParticle(ParticleBenchAoSParticle &p, const Particle &particle)
+{
+    float r = rand() / (float)RAND_MAX;
+    float theta = (rand() / (float)RAND_MAX) * 2.0f * PrimitiveTypes::Constants::c_Pi_F32;
+    float yOffset = (rand() / (float)RAND_MAX) * 0.5f;
+    memset(&p.m_base, 0, sizeof(p.m_base));
+    p.m_base.m_values[0][0] = p.m_base.m_values[1][1] = p.m_base.m_values[2][2] = p.m_base.m_values[3][3] = 1.0f;
+    p.m_base.setPos(Vector3(cosf(theta) * 0.5f * r, yOffset, sinf(theta) * 0.5f * r));
+    p.m_size[0] = particle.m_size.m_x;
+    p.m_size[1] = particle.m_size.m_y;
+    p.m_age = 0.0f;
+    p.m_duration = particle.m_duration;
+
+    float rx = (rand() / (float)RAND_MAX) * 2.0f - 1.0f;
+    float rz = (rand() / (float)RAND_MAX) * 2.0f - 1.0f;
+    float vy = -0.1f - (rand() / (float)RAND_MAX) * 0.1f;
+    p.velocity = Vector3(rx, vy, rz);
+    p.velocity.normalize();
+}
+
+static void createAoSParticles(const ParticleBenchConfig &config, std::vector<ParticleBenchAoSParticle> &particles, Particle &particle)
+{
+    particle = makeBenchTemplate(config);
+    srand(particle.m_seed);
+    particles.resize(config.m_particles);
+    for (size_t i = 0; i < particles.size(); i++)
+    {
+        spawnAoSParticle(particles[i], particle);
+        particles[i].m_age = (rand() / (float)RAND_MAX) * particle.m_duration;
+    }
+}
+
+// the old ParticleSystemCPU::updateParticleBuffer() loop: respawn in place or drift,
+// swirl and pulse, then face every particle to the camera
+static void updateAoSParticles(std::vector<ParticleBenchAoSParticle> &particles, const Particle &particle,
+    const ParticleCameraSnapshot &view, PrimitiveTypes::Float32 time)
+{
+    const float moveScale = 0.02f;
+    for (size_t j = 0; j < particles.size(); j++)
+    {
+        ParticleBenchAoSParticle &p = particles[j];
+        p.m_age += time;
+        if (p.m_age >= p.m_duration)
+        {
+            spawnAoSParticle(p, particle);
+            continue;
+        }
+
+        Vector3 curPos = p.m_base.getPos();
+        Vector3 drift = p.velocity * (particle.m_speed * time * moveScale);
+        float phase = particle.m_swirlSpeed * p.m_age + j * 0.37f;
+        Vector3 swirl = Vector3(cosf(phase), 0.0f, sinf(phase)) * (particle.m_swirlStrength * time * moveScale);
+        p.m_base.setPos(curPos + drift + swirl);
+
+        float sizePulse = particle.m_pulseAmount * sinf(p.m_age * 2.0f);
+        p.m_size[0] = particle.m_size.m_x * (1.0f + sizePulse);
+        p.m_size[1] = particle.m_size.m_y * (1.0f + sizePulse);
+    }
+    for (size_t i = 0; i < particles.size(); i++)
+    {
+        particles[i].m_base.setN(view.m_front);
+        particles[i].m_base.setU(view.m_right);
+        particles[i].m_base.setV(view.m_up);
+    }
+}
+
+static ParticleBenchResult benchUpdateAoS(const ParticleBenchConfig &config)
+{
+    ParticleBenchResult result = {};
+    std::vector<ParticleBenchAoSParticle> particles;
+    Particle particle;
+    createAoSParticles(config, particles, particle);
+    ParticleCameraSnapshot view;
+
+    while (result.m_seconds < s_minTime)
+    {
+        PrimitiveTypes::UInt32 allocsBefore = s_allocCount;
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        updateAoSParticles(particles, particle, view, 1.0f / 60.0f);
+        result.m_seconds += secondsSince(start);
+        result.m_allocs += s_allocCount - allocsBefore;
+
+        result.m_particles += (double)particles.size();
+        result.m_iterations++;
+    }
+    return result;
+}
+
+// the old loadParticle_needsRC(): every stream reset to the live count and refilled,
+// four matrix copies per particle for the corners
+static ParticleBenchResult benchBuildAoS(const ParticleBenchConfig &config)
+{
+    ParticleBenchResult result = {};
+    std::vector<ParticleBenchAoSParticle> particles;
+    Particle particle;
+    createAoSParticles(config, particles, particle);
+    ParticleCameraSnapshot view;
+    view.m_position = Vector3(0.0f, 2.0f, 10.0f);
+    for (int i = 0; i < 10; i++)
+        updateAoSParticles(particles, particle, view, 1.0f / 60.0f);
+
+    const PrimitiveTypes::UInt32 count = (PrimitiveTypes::UInt32)particles.size();
+    while (result.m_seconds < s_minTime)
+    {
+        PrimitiveTypes::UInt32 allocsBefore = s_allocCount;
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        {
+            std::vector<PrimitiveTypes::Float32> positions, colors, texCoords, normals;
+            std::vector<PrimitiveTypes::UInt16> indices;
+            positions.reserve(count * 4 * 3);
+            indices.reserve(count * 6);
+            if (config.m_color)
+                colors.reserve(count * 4 * 3);
+            if (config.m_texture)
+            {
+                texCoords.reserve(count * 4 * 2);
+                normals.reserve(count * 4 * 3);
+            }
+
+            for (PrimitiveTypes::UInt32 i = 0; i < count; i++)
+            {
+                const ParticleBenchAoSParticle &p = particles[i];
+                ParticleBenchMatrix4x4 corners[4] = { p.m_base, p.m_base, p.m_base, p.m_base };
+                corners[0].moveLeft(p.m_size[0] / 2.f);
+                corners[0].moveUp(p.m_size[1] / 2.f);
+                corners[1].moveRight(p.m_size[0] / 2.f);
+                corners[1].moveUp(p.m_size[1] / 2.f);
+                corners[2].moveRight(p.m_size[0] / 2.f);
+                corners[2].moveDown(p.m_size[1] / 2.f);
+                corners[3].moveLeft(p.m_size[0] / 2.f);
+                corners[3].moveDown(p.m_size[1] / 2.f);
+                for (int c = 0; c < 4; c++)
+                {
+                    Vector3 corner = corners[c].getPos();
+                    positions.push_back(corner.m_x);
+                    positions.push_back(corner.m_y);
+                    positions.push_back(corner.m_z);
+                }
+
+                PrimitiveTypes::UInt16 quad[6] = { (PrimitiveTypes::UInt16)(i * 4 + 0), (PrimitiveTypes::UInt16)(i * 4 + 1),
+                    (PrimitiveTypes::UInt16)(i * 4 + 2), (PrimitiveTypes::UInt16)(i * 4 + 2), (PrimitiveTypes::UInt16)(i * 4 + 3),
+                    (PrimitiveTypes::UInt16)(i * 4 + 0) };
+                indices.insert(indices.end(), quad, quad + 6);
+
+                if (config.m_color)
+                {
+                    float t = p.m_age / p.m_duration;
+                    t = t < 0.0f ? 0.0f : t > 1.0f ? 1.0f : t;
+                    float brightness = t < 0.2f ? t / 0.2f : t > 0.7f ? (1.0f - t) / 0.3f : 1.0f;
+                    brightness = brightness < 0.0f ? 0.0f : brightness;
+                    for (int c = 0; c < 4; c++)
+                    {
+                        colors.push_back(particle.color.m_x * brightness);
+                        colors.push_back(particle.color.m_y * brightness);
+                        colors.push_back(particle.color.m_z * brightness);
+                    }
+                }
+                if (config.m_texture)
+                {
+                    const PrimitiveTypes::Float32 uvs[8] = { 0, 0, 1, 0, 1, 1, 0, 1 };
+                    texCoords.insert(texCoords.end(), uvs, uvs + 8);
+                    normals.insert(normals.end(), 12, 0.0f);
+                }
+            }
+            result.m_bytes += (double)(positions.size() + colors.size() + texCoords.size() + normals.size()) * sizeof(PrimitiveTypes::Float32)
+                + (double)indices.size() * sizeof(PrimitiveTypes::UInt16);
+        }
+        result.m_seconds += secondsSince(start);
+        result.m_allocs += s_allocCount - allocsBefore;
+
+        result.m_particles += count;
+        result.m_iterations++;
+    }
+    return result;
+}
+
+// a 32x32 quad grid with a bump in the middle, for the mesh_surface burst
+static void buildBenchShapeMesh(ParticleShapeMesh &mesh)
+{
+    const PrimitiveTypes::UInt32 n = 32;
+    std::vector<PrimitiveTypes::Float32> positions;
+    std::vector<PrimitiveTypes::UInt32> indices;
+    for (PrimitiveTypes::UInt32 z = 0; z <= n; z++)
+    {
+        for (PrimitiveTypes::UInt32 x = 0; x <= n; x++)
+        {
+            float fx = (float)x / n - 0.5f, fz = (float)z / n - 0.5f;
+            positions.push_back(fx);
+            positions.push_back(0.25f * expf(-16.0f * (fx * fx + fz * fz)));
+            positions.push_back(fz);
+        }
+    }
+    for (PrimitiveTypes::UInt32 z = 0; z < n; z++)
+    {
+        for (PrimitiveTypes::UInt32 x = 0; x < n; x++)
+        {
+            PrimitiveTypes::UInt32 i = z * (n + 1) + x;
+            PrimitiveTypes::UInt32 quad[6] = { i, i + n + 1, i + 1, i + 1, i + n + 1, i + n + 2 };
+            indices.insert(indices.end(), quad, quad + 6);
+        }
+    }
+    mesh.build(&positions[0], (PrimitiveTypes::UInt32)positions.size() / 3, &indices[0], (PrimitiveTypes::UInt32)indices.size() / 3);
+}
+
+static void report(const std::string &name, const ParticleBenchResult &result, PrimitiveTypes::Bool sortStats)
+{
+    double particles = result.m_particles > 0.0 ? result.m_particles : 1.0;
+    double frames = result.m_iterations > 0 ? result.m_iterations : 1;
+    double nsPerParticle = result.m_seconds * 1e9 / particles;
+    printf("{\"name\": \"%s\", \"iterations\": %u, \"particles\": %.0f, \"ns_per_particle\": %.3f, "
+        "\"particles_per_sec\": %.0f, \"allocs_per_frame\": %.3f, \"bytes_per_frame\": %.0f, \"simd\": \"%s\", \"workers\": %u",
+        name.c_str(), result.m_iterations, result.m_particles,
+        nsPerParticle, result.m_particles / (result.m_seconds > 0.0 ? result.m_seconds : 1.0),
+        result.m_allocs / frames, result.m_bytes / frames,
+        getParticleSimdLevelName(detectParticleSimdLevel()), ParticleJobPool::Instance()->getWorkerCount());
+    if (sortStats)
+        printf(", \"ms_per_100k\": %.3f, \"radix_sorts\": %u", nsPerParticle * 1e5 / 1e6, result.m_radixSorts);
+    if (result.m_burstParticles > 0)
+        printf(", \"ms_per_burst\": %.3f", nsPerParticle * result.m_burstParticles / 1e6);
+    if (result.m_collisionCheck)
+        printf(", \"below_surface\": %llu", (unsigned long long)result.m_belowSurface);
+    if (result.m_hashCheck)
+        printf(", \"stream_hash\": \"%08x\"", result.m_streamHash);
+    if (result.m_neighborsPerParticle > 0.0)
+        printf(", \"neighbors_per_particle\": %.2f", result.m_neighborsPerParticle);
+    if (result.m_poolHighWaterBytes > 0)
+        printf(", \"pool_heap_allocs_per_frame\": %.3f, \"pool_high_water_bytes\": %llu",
+            result.m_poolHeapAllocs / frames, (unsigned long long)result.m_poolHighWaterBytes);
+    printf("}\n");
+    fflush(stdout);
+}
+
+static std::string configName(const char *bench, const ParticleBenchConfig &config)
+{
+    char name[256];
+    sprintf(name, "%s/particles:%u/emitters:%u/looping:%d/color:%d/texture:%d", bench,
+        config.m_particles, config.m_emitters, config.m_looping ? 1 : 0, config.m_color ? 1 : 0, config.m_texture ? 1 : 0);
+    if (config.m_packed)
+        strcat(name, "/packed:1");
+    return name;
+}
+
+// returns the number of cases whose checks failed
+int runParticleBenchmarks(const char *filter)
+{
+    int failures = 0;
+    const PrimitiveTypes::UInt32 particleCounts[] = { 1000, 10000, 100000, 1000000 };
+    const PrimitiveTypes::UInt32 emitterCounts[] = { 1, 16 };
+
+    for (int bench = 0; bench < 5; bench++)
+    {
+        for (size_t p = 0; p < sizeof(particleCounts) / sizeof(particleCounts[0]); p++)
+        {
+            for (size_t e = 0; e < sizeof(emitterCounts) / sizeof(emitterCounts[0]); e++)
+            {
+                for (int variant = 0; variant < 5; variant++)
+                {
+                    // a million particles as one emitter only, and not churned or sorted
+                    if (particleCounts[p] > 100000 && (emitterCounts[e] > 1 || bench > 2))
+                        continue;
+
+                    ParticleBenchConfig config = {};
+                    config.m_particles = particleCounts[p];
+                    config.m_emitters = emitterCounts[e];
+                    config.m_looping = true;
+                    config.m_color = true;
+                    config.m_texture = false;
+                    config.m_packed = false;
+                    config.m_affectors = 0;
+
+                    // looping only changes the update, color/texture only the build;
+                    // the sort runs coherent (variant 0) and cold (variant 1); the last
+                    // build variant is the packed vertex format
+                    if (bench == 4)
+                    {
+                        if (variant > 0 || config.m_emitters < 16)
+                            continue;
+                        config.m_emitters = 64;
+                        std::string name = configName("churn", config);
+                        if (filter && !strstr(name.c_str(), filter))
+                            continue;
+                        report(name, benchChurn(config), false);
+                        continue;
+                    }
+                    else if (bench == 3)
+                    {
+                        if (variant > 1)
+                            continue;
+                        char name[256];
+                        sprintf(name, "sort/particles:%u/emitters:%u/coherent:%d", config.m_particles, config.m_emitters, variant == 0 ? 1 : 0);
+                        if (filter && !strstr(name, filter))
+                            continue;
+                        report(name, benchSort(config, variant == 0), true);
+                        continue;
+                    }
+                    else if (bench == 2 && variant == 4)
+                    {
+                        config.m_packed = true;
+                    }
+                    else if (bench == 2)
+                    {
+                        config.m_color = (variant & 1) != 0;
+                        config.m_texture = (variant & 2) != 0;
+                    }
+                    else if (variant < 2)
+                    {
+                        config.m_looping = variant == 0;
+                    }
+                    else
+                    {
+                        continue;
+                    }
+                    // the spawn draws through the emitter's ParticleRandom (variant 0) and
+                    // through rand() like the baseline (variant 1)
+                    if (bench == 0)
+                    {
+                        config.m_randSpawn = !config.m_looping;
+                        config.m_looping = true;
+                    }
+
+                    const char *benchName = bench == 0 ? "spawn" : bench == 1 ? "update" : "build";
+                    std::string name = configName(benchName, config);
+                    if (bench == 0)
+                        name += config.m_randSpawn ? "/random:rand" : "/random:particle_random";
+                    if (filter && !strstr(name.c_str(), filter))
+                        continue;
+
+                    ParticleBenchResult result = bench == 0 ? benchSpawn(config) : bench == 1 ? benchUpdate(config) : benchBuild(config);
+                    report(name, result, false);
+                }
+            }
+        }
+    }
+
+    // the array-of-structs reference against the update and build above, one emitter
+    for (PrimitiveTypes::UInt32 bench = 0; bench < 2; bench++)
+    {
+        for (size_t p = 0; p < sizeof(particleCounts) / sizeof(particleCounts[0]); p++)
+        {
+            ParticleBenchConfig config = {};
+            config.m_particles = particleCounts[p];
+            config.m_emitters = 1;
+            config.m_looping = true;
+            config.m_color = true;
+            std::string name = configName(bench == 0 ? "aos_update" : "aos_build", config);
+            if (filter && !strstr(name.c_str(), filter))
+                continue;
+            report(name, bench == 0 ? benchUpdateAoS(config) : benchBuildAoS(config), false);
+        }
+    }
+
+    // the same update with growing affector stacks, all applied in the one integrate pass
+    const char *stackNames[] = { "none", "gravity_drag", "all" };
+    for (PrimitiveTypes::UInt32 stack = 0; stack < 3; stack++)
+    {
+        ParticleBenchConfig config = {};
+        config.m_particles = 100000;
+        config.m_emitters = 1;
+        config.m_looping = true;
+        config.m_affectors = stack;
+        char name[256];
+        sprintf(name, "affectors/particles:%u/stack:%s", config.m_particles, stackNames[stack]);
+        if (filter && !strstr(name, filter))
+            continue;
+        report(name, benchUpdate(config), false);
+    }
+
+    // specialized against generic kernels: swirl, pulse and color (the Particle defaults),
+    // none of those, and lifetime curves with gravity
+    const char *templateNames[] = { "default", "plain", "spark" };
+    for (PrimitiveTypes::UInt32 t = 0; t < 3; t++)
+    {
+        for (int specialized = 0; specialized < 2; specialized++)
+        {
+            ParticleBenchConfig config = {};
+            config.m_particles = 100000;
+            config.m_emitters = 1;
+            config.m_looping = true;
+            config.m_color = t != 1;
+            config.m_template = t;
+            config.m_generic = specialized == 0;
+            char name[256];
+            sprintf(name, "kernels/particles:%u/template:%s/specialized:%d", config.m_particles, templateNames[t], specialized);
+            if (filter && !strstr(name, filter))
+                continue;
+            report(name, benchKernels(config), false);
+        }
+    }
+
+    // the same falling update without colliders, then against the plane and against the
+    // heightfield with each response. A particle left under a collider fails the run
+    const char *colliderNames[] = { "none", "plane", "heightfield" };
+    const char *responseNames[] = { "bounce", "stick", "kill" };
+    for (PrimitiveTypes::UInt32 c = 0; c < 7; c++)
+    {
+        ParticleBenchConfig config = {};
+        config.m_particles = 100000;
+        config.m_emitters = 1;
+        config.m_looping = true;
+        config.m_falling = true;
+        config.m_colliders = c == 0 ? 0 : c < 4 ? 1 : 2;
+        config.m_collision = c == 0 ? ParticleCollision_Bounce : (ParticleCollisionResponse)((c - 1) % 3);
+        char name[256];
+        sprintf(name, "collision/particles:%u/colliders:%s/response:%s", config.m_particles,
+            colliderNames[config.m_colliders], responseNames[config.m_collision]);
+        if (filter && !strstr(name, filter))
+            continue;
+        ParticleBenchResult result = benchUpdate(config);
+        report(name, result, false);
+        if (result.m_belowSurface > 0)
+        {
+            fprintf(stderr, "%s: %llu live particles below a collider\n", name, (unsigned long long)result.m_belowSurface);
+            failures++;
+        }
+    }
+
+    // the update with neighbor forces, the grid rebuilt every step, against the same
+    // cloud without them (which counts its neighbors but never builds a grid while running)
+    const char *interactionNames[] = { "none", "separation", "flock" };
+    const PrimitiveTypes::Float32 interactionRadii[] = { 0.02f, 0.04f };
+    for (PrimitiveTypes::UInt32 r = 0; r < 2; r++)
+    {
+        for (PrimitiveTypes::UInt32 interaction = 0; interaction < 3; interaction++)
+        {
+            ParticleBenchConfig config = {};
+            config.m_particles = 100000;
+            config.m_emitters = 1;
+            config.m_looping = true;
+            config.m_interaction = interaction;
+            config.m_interactionRadius = interactionRadii[r];
+            char name[256];
+            sprintf(name, "neighbors/particles:%u/radius:%g/interaction:%s", config.m_particles,
+                config.m_interactionRadius, interactionNames[interaction]);
+            if (filter && !strstr(name, filter))
+                continue;
+            report(name, benchUpdate(config), false);
+        }
+    }
+
+    // one large emitter, whose steps split into chunks, and many small ones, which
+    // spread over the workers as whole emitters: the job pool from no workers (all on
+    // this thread) up to one per hardware thread, at least 4 so the split is exercised
+    // on small machines too. Every worker count has to end on the same particles
+    const PrimitiveTypes::UInt32 initialWorkers = ParticleJobPool::Instance()->getWorkerCount();
+    PrimitiveTypes::UInt32 maxWorkers = std::thread::hardware_concurrency();
+    maxWorkers = maxWorkers > 4 ? maxWorkers : 4;
+    for (PrimitiveTypes::UInt32 layout = 0; layout < 2; layout++)
+    {
+        ParticleBenchConfig config = {};
+        config.m_particles = layout == 0 ? 500000 : 8000;
+        config.m_emitters = layout == 0 ? 1 : 64;
+        config.m_looping = true;
+        config.m_affectors = 2;
+        config.m_falling = true;
+        config.m_colliders = 1;
+        config.m_collision = ParticleCollision_Bounce;
+
+        // the first count run is the reference, workers:0 unless filtered out
+        PrimitiveTypes::UInt32 referenceHash = 0;
+        PrimitiveTypes::Bool haveReference = false;
+        for (PrimitiveTypes::UInt32 workers = 0; workers <= maxWorkers; workers++)
+        {
+            char name[256];
+            sprintf(name, "scaling/particles:%u/emitters:%u/workers:%u", config.m_particles, config.m_emitters, workers);
+            if (filter && !strstr(name, filter))
+                continue;
+            ParticleJobPool::Instance()->setWorkerCount(workers);
+            ParticleBenchResult result = benchScaling(config);
+            report(name, result, false);
+            if (!haveReference)
+            {
+                referenceHash = result.m_streamHash;
+                haveReference = true;
+            }
+            else if (result.m_streamHash != referenceHash)
+            {
+                fprintf(stderr, "%s: stream hash %08x differs from %08x\n", name, result.m_streamHash, referenceHash);
+                failures++;
+            }
+        }
+    }
+    ParticleJobPool::Instance()->setWorkerCount(initialWorkers);
+
+    ParticleShapeMesh shapeMesh;
+    buildBenchShapeMesh(shapeMesh);
+    const char *shapeNames[] = { "cone", "sphere", "box", "disc", "mesh_surface", "line" };
+    const PrimitiveTypes::UInt32 burstParticles = 50000;
+    for (int shape = Cone; shape <= Line; shape++)
+    {
+        char name[256];
+        sprintf(name, "burst/particles:%u/shape:%s", burstParticles, shapeNames[shape]);
+        if (filter && !strstr(name, filter))
+            continue;
+        report(name, benchBurst(burstParticles, (Shape)shape, &shapeMesh), false);
+    }
+    return failures;
+}
+
+}; // namespace Components
+}; // namespace PE
+
+int main(int argc, char **argv)
+{
+    const char *filter = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--filter=", 9) == 0)
+            filter = argv[i] + 9;
+        else if (strncmp(argv[i], "--min-time=", 11) == 0)
+            PE::Components::s_minTime = atof(argv[i] + 11);
+        else if (strncmp(argv[i], "--workers=", 10) == 0)
+            PE::Components::ParticleJobPool::Instance()->setWorkerCount((PrimitiveTypes::UInt32)atoi(argv[i] + 10));
+        else
+        {
+            fprintf(stderr, "usage: %s [--filter=substring] [--min-time=seconds] [--workers=n]\n", argv[0]);
+            return 1;
+        }
+    }
+    return PE::Components::runParticleBenchmarks(filter) > 0 ? 1 : 0;
+}
+
+#endif // PE_PARTICLE_HEADLESS
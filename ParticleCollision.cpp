@@ -0,0 +1,52 @@
+#include "ParticleCollision.h"
+
+namespace PE {
+namespace Components {
+
+ParticleHeightfield::ParticleHeightfield()
+    : m_originX(0.0f)
+    , m_originZ(0.0f)
+    , m_invCellSize(1.0f)
+    , m_columns(0)
+    , m_rows(0)
+{
+}
+
+void ParticleHeightfield::build(PrimitiveTypes::Float32 originX, PrimitiveTypes::Float32 originZ, PrimitiveTypes::Float32 cellSize,
+    PrimitiveTypes::UInt32 columns, PrimitiveTypes::UInt32 rows, const PrimitiveTypes::Float32 *pHeights)
+{
+    PEASSERT(columns >= 2 && rows >= 2 && cellSize > 0.0f, "ParticleHeightfield needs 2x2 samples and a positive cell size");
+    m_originX = originX;
+    m_originZ = originZ;
+    m_invCellSize = 1.0f / cellSize;
+    m_columns = columns;
+    m_rows = rows;
+    m_heights.assign(pHeights, pHeights + columns * rows);
+}
+
+PrimitiveTypes::Float32 ParticleHeightfield::sample(PrimitiveTypes::Float32 x, PrimitiveTypes::Float32 z) const
+{
+    PrimitiveTypes::Float32 height, slopeX, slopeZ;
+    sampleParticleHeightfield(*this, x, z, height, slopeX, slopeZ);
+    return height;
+}
+
+void ParticleColliderSet::addPlane(const Vector3 &normal, const Vector3 &point)
+{
+    PEASSERT(m_planeCount < MaxPlanes, "ParticleColliderSet holds up to %d planes", MaxPlanes);
+    if (m_planeCount >= MaxPlanes)
+        return;
+    Vector3 n = normal;
+    if (n.length() == 0.0f)
+        n = Vector3(0.0f, 1.0f, 0.0f);
+    n.normalize();
+
+    ParticleCollisionPlane &plane = m_planes[m_planeCount++];
+    plane.m_normal[0] = n.m_x;
+    plane.m_normal[1] = n.m_y;
+    plane.m_normal[2] = n.m_z;
+    plane.m_offset = n.m_x * point.m_x + n.m_y * point.m_y + n.m_z * point.m_z;
+}
+
+}; // namespace Components
+}; // namespace PE
@@ -0,0 +1,100 @@
+#ifndef _PE_PARTICLE_COLLISION_H_
+#define _PE_PARTICLE_COLLISION_H_
+
+#include "ParticleCoreTypes.h"
+
+#include <vector>
+
+namespace PE {
+namespace Components {
+
+// what a particle does when it hits a collider
+enum ParticleCollisionResponse
+{
+    ParticleCollision_Bounce, // reflects off the surface, see Particle::m_bounce and m_friction
+    ParticleCollision_Stick,  // stops on the surface
+    ParticleCollision_Kill,   // dies, it is removed with the expired particles of the step
+};
+
+// Free side of a plane: points p with dot(m_normal, p) >= m_offset. World space,
+// m_normal unit length.
+struct ParticleCollisionPlane
+{
+    PrimitiveTypes::Float32 m_normal[3];
+    PrimitiveTypes::Float32 m_offset;
+};
+
+// Terrain as heights on a regular grid over x/z, bilinear between the samples. The free
+// side is above it. Beyond the grid the edge samples carry on, so particles cannot fall
+// off its sides.
+struct ParticleHeightfield
+{
+    ParticleHeightfield();
+
+    // columns * rows heights, row-major with x along a row, sample (0, 0) at
+    // (originX, originZ) and cellSize apart; columns and rows are at least 2
+    void build(PrimitiveTypes::Float32 originX, PrimitiveTypes::Float32 originZ, PrimitiveTypes::Float32 cellSize,
+        PrimitiveTypes::UInt32 columns, PrimitiveTypes::UInt32 rows, const PrimitiveTypes::Float32 *pHeights);
+
+    // surface height at x/z, as the collision kernels see it
+    PrimitiveTypes::Float32 sample(PrimitiveTypes::Float32 x, PrimitiveTypes::Float32 z) const;
+
+    PrimitiveTypes::Float32 m_originX;
+    PrimitiveTypes::Float32 m_originZ;
+    PrimitiveTypes::Float32 m_invCellSize;
+    PrimitiveTypes::UInt32 m_columns;
+    PrimitiveTypes::UInt32 m_rows;
+    std::vector<PrimitiveTypes::Float32> m_heights;
+};
+
+// Height and slope (dh/dx, dh/dz) of a heightfield at x/z; the scalar collision kernel
+// and ParticleHeightfield::sample(). The vector kernels do the same math per lane.
+inline void sampleParticleHeightfield(const ParticleHeightfield &field, PrimitiveTypes::Float32 x, PrimitiveTypes::Float32 z,
+    PrimitiveTypes::Float32 &height, PrimitiveTypes::Float32 &slopeX, PrimitiveTypes::Float32 &slopeZ)
+{
+    // clamped to the grid, NaN to its origin
+    float gx = (x - field.m_originX) * field.m_invCellSize;
+    float gz = (z - field.m_originZ) * field.m_invCellSize;
+    gx = gx > 0.0f ? gx : 0.0f;
+    gz = gz > 0.0f ? gz : 0.0f;
+    float maxX = (float)(field.m_columns - 1), maxZ = (float)(field.m_rows - 1);
+    gx = gx < maxX ? gx : maxX;
+    gz = gz < maxZ ? gz : maxZ;
+
+    // the last row and column of samples only close the cells before them
+    float cellX = (float)(PrimitiveTypes::Int32)gx, cellZ = (float)(PrimitiveTypes::Int32)gz;
+    cellX = cellX < maxX - 1.0f ? cellX : maxX - 1.0f;
+    cellZ = cellZ < maxZ - 1.0f ? cellZ : maxZ - 1.0f;
+    float fx = gx - cellX, fz = gz - cellZ;
+
+    const PrimitiveTypes::Float32 *h = &field.m_heights[(PrimitiveTypes::Int32)(cellZ * (float)field.m_columns + cellX)];
+    float h00 = h[0], h10 = h[1], h01 = h[field.m_columns], h11 = h[field.m_columns + 1];
+    float h0 = h00 + (h10 - h00) * fx;
+    float h1 = h01 + (h11 - h01) * fx;
+    height = h0 + (h1 - h0) * fz;
+    slopeX = ((h10 - h00) + ((h11 - h01) - (h10 - h00)) * fz) * field.m_invCellSize;
+    slopeZ = (h1 - h0) * field.m_invCellSize;
+}
+
+// The scene a template's particles collide with (Particle::m_pColliders): up to
+// MaxPlanes planes and an optional heightfield. Owned by the game; the collision pass
+// reads it during the update, so change it only between updates.
+struct ParticleColliderSet
+{
+    enum { MaxPlanes = 8 };
+
+    ParticleColliderSet() : m_planeCount(0), m_planes(), m_pHeightfield(NULL) {}
+
+    // the plane through point facing normal; extra planes are dropped
+    void addPlane(const Vector3 &normal, const Vector3 &point);
+    void clear() { m_planeCount = 0; m_pHeightfield = NULL; }
+
+    PrimitiveTypes::UInt32 m_planeCount;
+    ParticleCollisionPlane m_planes[MaxPlanes];
+    const ParticleHeightfield *m_pHeightfield; // not owned, NULL for none
+};
+
+}; // namespace Components
+}; // namespace PE
+
+#endif
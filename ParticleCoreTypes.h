@@ -0,0 +1,67 @@
+#ifndef _PE_PARTICLE_CORE_TYPES_H_
+#define _PE_PARTICLE_CORE_TYPES_H_
+
+// Basic types used by the particle simulation core. Inside the engine they come from
+// PrimeEngine; with PE_PARTICLE_HEADLESS defined the core builds on its own (tools,
+// benchmarks, server-side simulation) and gets minimal stand-ins instead.
+
+#ifndef PE_PARTICLE_HEADLESS
+
+#include "PrimeEngine/Math/Vector3.h"
+#include "PrimeEngine/Utils/ErrorHandling.h"
+
+#else
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+
+namespace PrimitiveTypes {
+typedef signed char Int8;
+typedef unsigned char UInt8;
+typedef short Int16;
+typedef unsigned short UInt16;
+typedef int Int32;
+typedef unsigned int UInt32;
+typedef long long Int64;
+typedef unsigned long long UInt64;
+typedef float Float32;
+typedef bool Bool;
+
+namespace Constants {
+static const Float32 c_Pi_F32 = 3.14159265358979f;
+static const Float32 c_MaxFloat32 = 3.402823466e+38f;
+}; // namespace Constants
+}; // namespace PrimitiveTypes
+
+struct Vector3
+{
+    PrimitiveTypes::Float32 m_x, m_y, m_z;
+
+    Vector3() : m_x(0.0f), m_y(0.0f), m_z(0.0f) {}
+    Vector3(PrimitiveTypes::Float32 x, PrimitiveTypes::Float32 y, PrimitiveTypes::Float32 z) : m_x(x), m_y(y), m_z(z) {}
+
+    Vector3 operator+(const Vector3 &v) const { return Vector3(m_x + v.m_x, m_y + v.m_y, m_z + v.m_z); }
+    Vector3 operator-(const Vector3 &v) const { return Vector3(m_x - v.m_x, m_y - v.m_y, m_z - v.m_z); }
+    Vector3 operator*(PrimitiveTypes::Float32 s) const { return Vector3(m_x * s, m_y * s, m_z * s); }
+
+    PrimitiveTypes::Float32 length() const { return sqrtf(m_x * m_x + m_y * m_y + m_z * m_z); }
+    void normalize()
+    {
+        PrimitiveTypes::Float32 len = length();
+        if (len > 0.0f)
+        {
+            m_x /= len;
+            m_y /= len;
+            m_z /= len;
+        }
+    }
+};
+
+// diagnostics go to stderr so stdout stays free for tool output
+#define PEINFO(...) fprintf(stderr, __VA_ARGS__)
+#define PEASSERT(condition, ...) assert(condition)
+
+#endif // PE_PARTICLE_HEADLESS
+
+#endif
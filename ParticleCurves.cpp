@@ -0,0 +1,112 @@
+#include "ParticleCurves.h"
+#include "ParticleSimCore.h"
+
+#include <math.h>
+
+namespace PE {
+namespace Components {
+
+void ParticleCurve::addKey(PrimitiveTypes::Float32 t, PrimitiveTypes::Float32 value)
+{
+    PEASSERT(m_keyCount < MaxKeys, "ParticleCurve holds up to %d keys", MaxKeys);
+    if (m_keyCount >= MaxKeys)
+        return;
+    m_times[m_keyCount] = t;
+    m_values[m_keyCount] = value;
+    m_keyCount++;
+}
+
+PrimitiveTypes::Float32 ParticleCurve::evaluate(PrimitiveTypes::Float32 t) const
+{
+    if (m_keyCount == 0)
+        return 1.0f;
+    if (t <= m_times[0])
+        return m_values[0];
+
+    for (PrimitiveTypes::UInt32 k = 1; k < m_keyCount; k++)
+    {
+        if (t < m_times[k])
+        {
+            float span = m_times[k] - m_times[k - 1];
+            float f = span > 0.0f ? (t - m_times[k - 1]) / span : 1.0f;
+            return m_values[k - 1] + (m_values[k] - m_values[k - 1]) * f;
+        }
+    }
+    return m_values[m_keyCount - 1];
+}
+
+void ParticleGradient::addKey(PrimitiveTypes::Float32 t, const Vector3 &color)
+{
+    PEASSERT(m_keyCount < MaxKeys, "ParticleGradient holds up to %d keys", MaxKeys);
+    if (m_keyCount >= MaxKeys)
+        return;
+    m_times[m_keyCount] = t;
+    m_colors[m_keyCount][0] = color.m_x;
+    m_colors[m_keyCount][1] = color.m_y;
+    m_colors[m_keyCount][2] = color.m_z;
+    m_keyCount++;
+}
+
+Vector3 ParticleGradient::evaluate(PrimitiveTypes::Float32 t) const
+{
+    if (m_keyCount == 0)
+        return Vector3(1.0f, 1.0f, 1.0f);
+
+    PrimitiveTypes::UInt32 a = 0, b = 0;
+    float f = 0.0f;
+    if (t >= m_times[m_keyCount - 1])
+    {
+        a = b = m_keyCount - 1;
+    }
+    else if (t > m_times[0])
+    {
+        b = 1;
+        while (t >= m_times[b])
+            b++;
+        a = b - 1;
+        float span = m_times[b] - m_times[a];
+        f = span > 0.0f ? (t - m_times[a]) / span : 1.0f;
+    }
+
+    return Vector3(
+        m_colors[a][0] + (m_colors[b][0] - m_colors[a][0]) * f,
+        m_colors[a][1] + (m_colors[b][1] - m_colors[a][1]) * f,
+        m_colors[a][2] + (m_colors[b][2] - m_colors[a][2]) * f);
+}
+
+ParticleCurveTables::ParticleCurveTables()
+    : m_maxSize(1.0f)
+    , m_baseColor(1.0f, 1.0f, 1.0f)
+{
+    for (PrimitiveTypes::UInt32 s = 0; s < TableSize; s++)
+        m_size[s] = m_speed[s] = m_red[s] = m_green[s] = m_blue[s] = 1.0f;
+}
+
+void ParticleCurveTables::bake(const Particle &particle)
+{
+    m_maxSize = 0.0f;
+    m_baseColor = particle.color;
+    for (PrimitiveTypes::UInt32 s = 0; s < TableSize; s++)
+    {
+        float t = (float)s / (float)ParticleCurveSamples;
+
+        // every particle lives the template duration, so the age of a sample is known
+        float age = t * particle.m_duration;
+        float pulse = 1.0f + particle.m_pulseAmount * sinf(age * particle.m_pulseFrequency);
+        m_size[s] = particle.m_sizeOverLife.evaluate(t) * pulse;
+        if (m_size[s] > m_maxSize)
+            m_maxSize = m_size[s];
+
+        m_speed[s] = particle.m_speedOverLife.evaluate(t);
+
+        Vector3 color = particle.m_colorOverLife.evaluate(t);
+        float alpha = particle.m_alphaOverLife.evaluate(t);
+        alpha = alpha > 0.0f ? alpha : 0.0f;
+        m_red[s] = particle.color.m_x * color.m_x * alpha;
+        m_green[s] = particle.color.m_y * color.m_y * alpha;
+        m_blue[s] = particle.color.m_z * color.m_z * alpha;
+    }
+}
+
+}; // namespace Components
+}; // namespace PE
@@ -0,0 +1,97 @@
+#ifndef _PE_PARTICLE_CURVES_H_
+#define _PE_PARTICLE_CURVES_H_
+
+#include "ParticleCoreTypes.h"
+
+namespace PE {
+namespace Components {
+
+struct Particle;
+
+// A value over a particle's normalized lifetime (0 at birth, 1 at death), authored as
+// up to MaxKeys keys joined linearly and held flat before the first and after the last.
+// A curve without keys is 1 everywhere.
+struct ParticleCurve
+{
+    enum { MaxKeys = 8 };
+
+    ParticleCurve() : m_keyCount(0), m_times(), m_values() {}
+
+    // keys go in with increasing times; extra keys are dropped
+    void addKey(PrimitiveTypes::Float32 t, PrimitiveTypes::Float32 value);
+    void clear() { m_keyCount = 0; }
+
+    // exact value, for baking; per-particle code samples a ParticleCurveTables
+    PrimitiveTypes::Float32 evaluate(PrimitiveTypes::Float32 t) const;
+
+    PrimitiveTypes::UInt32 m_keyCount;
+    PrimitiveTypes::Float32 m_times[MaxKeys];
+    PrimitiveTypes::Float32 m_values[MaxKeys];
+};
+
+// rgb over normalized lifetime, the same way; white without keys
+struct ParticleGradient
+{
+    enum { MaxKeys = 8 };
+
+    ParticleGradient() : m_keyCount(0), m_times(), m_colors() {}
+
+    void addKey(PrimitiveTypes::Float32 t, const Vector3 &color);
+    void clear() { m_keyCount = 0; }
+
+    Vector3 evaluate(PrimitiveTypes::Float32 t) const;
+
+    PrimitiveTypes::UInt32 m_keyCount;
+    PrimitiveTypes::Float32 m_times[MaxKeys];
+    PrimitiveTypes::Float32 m_colors[MaxKeys][3];
+};
+
+enum { ParticleCurveSamples = 64 }; // intervals per baked curve
+
+// The over-lifetime curves of a template baked into fixed-size tables, once per emitter.
+// Every table holds ParticleCurveSamples + 1 evenly spaced samples, so a lookup is one
+// index computation and one lerp with no branches on the curve shape:
+//   m_size  - Particle::m_sizeOverLife times the size pulse (see Particle::m_pulseAmount)
+//   m_speed - Particle::m_speedOverLife, scales the drift
+//   m_red, m_green, m_blue - Particle::color times m_colorOverLife times m_alphaOverLife;
+//             alpha is premultiplied since the particle vertices carry rgb only
+// Tables sit side by side so a particle's lookups share the index and fraction.
+struct ParticleCurveTables
+{
+    enum { TableSize = ParticleCurveSamples + 1 };
+
+    ParticleCurveTables();
+
+    void bake(const Particle &particle);
+
+    PrimitiveTypes::Float32 m_size[TableSize];
+    PrimitiveTypes::Float32 m_speed[TableSize];
+    PrimitiveTypes::Float32 m_red[TableSize];
+    PrimitiveTypes::Float32 m_green[TableSize];
+    PrimitiveTypes::Float32 m_blue[TableSize];
+    PrimitiveTypes::Float32 m_maxSize; // largest m_size sample, for bounds
+    Vector3 m_baseColor;               // Particle::color, for vertices without lifetime color
+};
+
+// table position of normalized lifetime t: index in [0, ParticleCurveSamples) and the
+// fraction towards the next sample; t outside [0, 1] is clamped
+inline void locateParticleCurveSample(PrimitiveTypes::Float32 t, PrimitiveTypes::Int32 &index, PrimitiveTypes::Float32 &fraction)
+{
+    PrimitiveTypes::Float32 x = t * (PrimitiveTypes::Float32)ParticleCurveSamples;
+    x = x > 0.0f ? x : 0.0f;
+    x = x < (PrimitiveTypes::Float32)ParticleCurveSamples ? x : (PrimitiveTypes::Float32)ParticleCurveSamples;
+    index = (PrimitiveTypes::Int32)x;
+    index = index < ParticleCurveSamples - 1 ? index : ParticleCurveSamples - 1;
+    fraction = x - (PrimitiveTypes::Float32)index;
+}
+
+inline PrimitiveTypes::Float32 sampleParticleCurve(const PrimitiveTypes::Float32 *pTable, PrimitiveTypes::Int32 index,
+    PrimitiveTypes::Float32 fraction)
+{
+    return pTable[index] + (pTable[index + 1] - pTable[index]) * fraction;
+}
+
+}; // namespace Components
+}; // namespace PE
+
+#endif
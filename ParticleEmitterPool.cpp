@@ -0,0 +1,126 @@
+#include "ParticleEmitterPool.h"
+#include "PrimeEngine/Scene/MeshInstance.h"
+#include "PrimeEngine/Scene/MeshManager.h"
+#include "PrimeEngine/Scene/RootSceneNode.h"
+#include "PrimeEngine/Scene/SceneNode.h"
+
+namespace PE {
+namespace Components {
+
+ParticleEmitterPool::ParticleEmitterPool(PE::GameContext &context, PE::MemoryArena arena, const Particle &particle,
+    PrimitiveTypes::UInt32 count)
+    : m_entryCount(0)
+    , m_activeCount(0)
+    , m_freeCount(0)
+    , m_steals(0)
+{
+    PEASSERT(count <= MaxEmitters, "ParticleEmitterPool supports up to %d emitters", MaxEmitters);
+    if (count > MaxEmitters)
+        count = MaxEmitters;
+
+    for (PrimitiveTypes::UInt32 i = 0; i < count; i++)
+    {
+        Handle hSystem("PARTICLE_SYSTEM", sizeof(ParticleSystem));
+        ParticleSystem *pSystem = new (hSystem) ParticleSystem(context, arena, hSystem);
+        pSystem->addDefaultComponents();
+        pSystem->createParticleSystem(particle);
+        // decided now so a packed emitter that falls back is not placed under a node
+        pSystem->resolveRenderMode();
+        // idle until played; the first gather still loads the (empty) gpu mesh
+        pSystem->m_hParticleSystemCPU.getObject<ParticleSystemCPU>()->stop();
+
+        context.getMeshManager()->registerAsset(hSystem);
+
+        Handle hInstance("MeshInstance", sizeof(MeshInstance));
+        MeshInstance *pInstance = new (hInstance) MeshInstance(context, arena, hInstance);
+        pInstance->addDefaultComponents();
+        pInstance->initFromRegisteredAsset(hSystem);
+
+        Entry &entry = m_entries[m_entryCount];
+        entry.m_hSystem = hSystem;
+
+        if (pSystem->m_renderMode == ParticleRenderMode_Packed)
+        {
+            // packed vertices are relative to the play position; the node moves with it
+            Handle hNode("SCENE_NODE", sizeof(SceneNode));
+            SceneNode *pNode = new (hNode) SceneNode(context, arena, hNode);
+            pNode->addDefaultComponents();
+            pNode->m_base.setPos(pSystem->m_packedOrigin);
+            pNode->addComponent(hInstance);
+            RootSceneNode::Instance()->addComponent(hNode);
+            entry.m_hNode = hNode;
+        }
+        else
+        {
+            RootSceneNode::Instance()->addComponent(hInstance);
+        }
+
+        m_free[m_freeCount++] = m_entryCount++;
+    }
+}
+
+Handle ParticleEmitterPool::play(const Vector3 &position)
+{
+    if (m_entryCount == 0)
+        return Handle();
+
+    reclaim();
+
+    PrimitiveTypes::UInt32 index;
+    if (m_freeCount > 0)
+    {
+        index = m_free[--m_freeCount];
+    }
+    else
+    {
+        // every emitter is busy: cut the oldest effect short
+        index = m_active[0];
+        for (PrimitiveTypes::UInt32 i = 1; i < m_activeCount; i++)
+            m_active[i - 1] = m_active[i];
+        m_activeCount--;
+        m_steals++;
+    }
+
+    Entry &entry = m_entries[index];
+    ParticleSystem *pSystem = entry.m_hSystem.getObject<ParticleSystem>();
+    pSystem->restartParticleSystem(position);
+    if (entry.m_hNode.isValid())
+        entry.m_hNode.getObject<SceneNode>()->m_base.setPos(position);
+
+    m_active[m_activeCount++] = index;
+    return entry.m_hSystem;
+}
+
+void ParticleEmitterPool::reclaim()
+{
+    // keeps the play order of the emitters that are still running
+    PrimitiveTypes::UInt32 kept = 0;
+    for (PrimitiveTypes::UInt32 i = 0; i < m_activeCount; i++)
+    {
+        PrimitiveTypes::UInt32 index = m_active[i];
+        ParticleSystem *pSystem = m_entries[index].m_hSystem.getObject<ParticleSystem>();
+        ParticleSystemCPU *psysCPU = pSystem->m_hParticleSystemCPU.getObject<ParticleSystemCPU>();
+
+        // an update still running may be the one that empties the emitter; ask next time
+        if (psysCPU->pollUpdate() && psysCPU->isFinished())
+            m_free[m_freeCount++] = index;
+        else
+            m_active[kept++] = index;
+    }
+    m_activeCount = kept;
+}
+
+void ParticleEmitterPool::stopAll()
+{
+    for (PrimitiveTypes::UInt32 i = 0; i < m_activeCount; i++)
+    {
+        PrimitiveTypes::UInt32 index = m_active[i];
+        ParticleSystem *pSystem = m_entries[index].m_hSystem.getObject<ParticleSystem>();
+        pSystem->m_hParticleSystemCPU.getObject<ParticleSystemCPU>()->stop();
+        m_free[m_freeCount++] = index;
+    }
+    m_activeCount = 0;
+}
+
+}; // namespace Components
+}; // namespace PE
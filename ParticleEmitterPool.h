@@ -0,0 +1,55 @@
+#ifndef _PE_PARTICLE_EMITTER_POOL_H_
+#define _PE_PARTICLE_EMITTER_POOL_H_
+
+#include "ParticleSystem.h"
+
+namespace PE {
+namespace Components {
+
+// Emitters of one template created up front for short-lived effects (hit sparks,
+// impacts) that would be too expensive to set up on demand. Every emitter is created,
+// registered and placed like the one in ClientCharacterControlGame and then stopped.
+// play() restarts a free one at the requested position: the particle streams keep their
+// memory and the mesh keeps its cpu streams and gpu buffers. A non-looping emitter
+// returns to the pool once its burst has died out; nobody has to hand it back. A looping
+// one plays until stopAll() or until play() takes it for a newer effect.
+// Pooled emitters have their own MeshInstance and are not batched.
+struct ParticleEmitterPool
+{
+    ParticleEmitterPool(PE::GameContext &context, PE::MemoryArena arena, const Particle &particle,
+        PrimitiveTypes::UInt32 count);
+
+    // restarts a free emitter at position and returns its ParticleSystem. finished emitters
+    // are reclaimed first; with none free the one that has played longest starts over
+    Handle play(const Vector3 &position);
+
+    // returns finished emitters to the free list; play() calls it
+    void reclaim();
+
+    // stops every playing emitter and frees it
+    void stopAll();
+
+    PrimitiveTypes::UInt32 getActiveCount() const { return m_activeCount; }
+    PrimitiveTypes::UInt32 getFreeCount() const { return m_freeCount; }
+
+    enum { MaxEmitters = 256 };
+
+    struct Entry
+    {
+        Handle m_hSystem;
+        Handle m_hNode; // SceneNode moved to the play position, packed emitters only
+    };
+
+    Entry m_entries[MaxEmitters];
+    PrimitiveTypes::UInt32 m_entryCount;
+    PrimitiveTypes::UInt32 m_active[MaxEmitters]; // entry indices, oldest play first
+    PrimitiveTypes::UInt32 m_activeCount;
+    PrimitiveTypes::UInt32 m_free[MaxEmitters];
+    PrimitiveTypes::UInt32 m_freeCount;
+    PrimitiveTypes::UInt32 m_steals; // plays that had to restart a playing emitter
+};
+
+}; // namespace Components
+}; // namespace PE
+
+#endif
@@ -0,0 +1,174 @@
+#include "ParticleJobs.h"
+
+namespace PE {
+namespace Components {
+
+// index of the queue owned by the current thread; external threads have none
+static thread_local PrimitiveTypes::Int32 s_workerQueueIndex = -1;
+
+ParticleJobPool *ParticleJobPool::Instance()
+{
+    static ParticleJobPool s_instance;
+    return &s_instance;
+}
+
+ParticleJobPool::ParticleJobPool()
+    : m_nextQueue(0)
+    , m_queuedJobs(0)
+    , m_quit(false)
+{
+    // leave one core to the thread that dispatches the events
+    PrimitiveTypes::UInt32 hardwareThreads = std::thread::hardware_concurrency();
+    setWorkerCount(hardwareThreads > 1 ? hardwareThreads - 1 : 0);
+}
+
+ParticleJobPool::~ParticleJobPool()
+{
+    stopWorkers();
+}
+
+void ParticleJobPool::setWorkerCount(PrimitiveTypes::UInt32 count)
+{
+    stopWorkers();
+
+    m_quit = false;
+    for (PrimitiveTypes::UInt32 i = 0; i < count; i++)
+        m_queues.push_back(new WorkerQueue());
+    for (PrimitiveTypes::UInt32 i = 0; i < count; i++)
+        m_workers.push_back(std::thread(&ParticleJobPool::workerMain, this, i));
+}
+
+void ParticleJobPool::stopWorkers()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_sleepLock);
+        m_quit = true;
+    }
+    m_wakeUp.notify_all();
+
+    for (size_t i = 0; i < m_workers.size(); i++)
+        m_workers[i].join();
+    m_workers.clear();
+
+    // workers drain their queues before quitting, so nothing is lost here
+    for (size_t i = 0; i < m_queues.size(); i++)
+        delete m_queues[i];
+    m_queues.clear();
+}
+
+void ParticleJobPool::submit(const ParticleJob &job)
+{
+    job.m_pCounter->m_pending++;
+
+    if (m_queues.empty())
+    {
+        execute(job);
+        return;
+    }
+
+    // workers keep their own jobs local, other threads spread them round robin
+    PrimitiveTypes::UInt32 queueIndex = s_workerQueueIndex >= 0
+        ? (PrimitiveTypes::UInt32)s_workerQueueIndex
+        : m_nextQueue++ % (PrimitiveTypes::UInt32)m_queues.size();
+
+    {
+        std::lock_guard<std::mutex> lock(m_queues[queueIndex]->m_lock);
+        m_queues[queueIndex]->m_jobs.push_back(job);
+    }
+    m_queuedJobs++;
+
+    std::lock_guard<std::mutex> lock(m_sleepLock);
+    m_wakeUp.notify_one();
+}
+
+void ParticleJobPool::submitRange(void (*pFunc)(void *, PrimitiveTypes::UInt32, PrimitiveTypes::UInt32), void *pData,
+    PrimitiveTypes::UInt32 begin, PrimitiveTypes::UInt32 end, PrimitiveTypes::UInt32 chunkSize,
+    ParticleJobCounter &counter)
+{
+    for (PrimitiveTypes::UInt32 chunkBegin = begin; chunkBegin < end; chunkBegin += chunkSize)
+    {
+        ParticleJob job;
+        job.m_pFunc = pFunc;
+        job.m_pData = pData;
+        job.m_begin = chunkBegin;
+        job.m_end = chunkBegin + chunkSize < end ? chunkBegin + chunkSize : end;
+        job.m_pCounter = &counter;
+        submit(job);
+    }
+}
+
+void ParticleJobPool::wait(ParticleJobCounter &counter)
+{
+    PrimitiveTypes::UInt32 startQueue = s_workerQueueIndex >= 0 ? (PrimitiveTypes::UInt32)s_workerQueueIndex : 0;
+
+    while (counter.m_pending.load() > 0)
+    {
+        ParticleJob job;
+        if (!m_queues.empty() && popOrSteal(startQueue, job))
+            execute(job);
+        else
+            std::this_thread::yield();
+    }
+}
+
+bool ParticleJobPool::popOrSteal(PrimitiveTypes::UInt32 queueIndex, ParticleJob &job)
+{
+    PrimitiveTypes::UInt32 queueCount = (PrimitiveTypes::UInt32)m_queues.size();
+
+    // own queue from the back, cache-warm
+    {
+        WorkerQueue &own = *m_queues[queueIndex];
+        std::lock_guard<std::mutex> lock(own.m_lock);
+        if (!own.m_jobs.empty())
+        {
+            job = own.m_jobs.back();
+            own.m_jobs.pop_back();
+            m_queuedJobs--;
+            return true;
+        }
+    }
+
+    // steal the oldest job of someone else
+    for (PrimitiveTypes::UInt32 i = 1; i < queueCount; i++)
+    {
+        WorkerQueue &victim = *m_queues[(queueIndex + i) % queueCount];
+        std::lock_guard<std::mutex> lock(victim.m_lock);
+        if (!victim.m_jobs.empty())
+        {
+            job = victim.m_jobs.front();
+            victim.m_jobs.pop_front();
+            m_queuedJobs--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ParticleJobPool::execute(const ParticleJob &job)
+{
+    job.m_pFunc(job.m_pData, job.m_begin, job.m_end);
+    job.m_pCounter->m_pending--;
+}
+
+void ParticleJobPool::workerMain(PrimitiveTypes::UInt32 workerIndex)
+{
+    s_workerQueueIndex = (PrimitiveTypes::Int32)workerIndex;
+
+    while (true)
+    {
+        ParticleJob job;
+        if (popOrSteal(workerIndex, job))
+        {
+            execute(job);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_sleepLock);
+        if (m_quit && m_queuedJobs.load() == 0)
+            break;
+        m_wakeUp.wait(lock, [this]() { return m_quit || m_queuedJobs.load() > 0; });
+    }
+}
+
+}; // namespace Components
+}; // namespace PE
@@ -0,0 +1,83 @@
+#ifndef _PE_PARTICLE_JOBS_H_
+#define _PE_PARTICLE_JOBS_H_
+
+#include "ParticleCoreTypes.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace PE {
+namespace Components {
+
+// number of jobs of a batch still in flight
+struct ParticleJobCounter
+{
+    std::atomic<PrimitiveTypes::Int32> m_pending;
+    ParticleJobCounter() : m_pending(0) {}
+};
+
+// a range of work items [m_begin, m_end) handed to m_pFunc
+struct ParticleJob
+{
+    void (*m_pFunc)(void *pData, PrimitiveTypes::UInt32 begin, PrimitiveTypes::UInt32 end);
+    void *m_pData;
+    PrimitiveTypes::UInt32 m_begin;
+    PrimitiveTypes::UInt32 m_end;
+    ParticleJobCounter *m_pCounter;
+};
+
+// Work-stealing worker pool shared by all particle emitters.
+// Every worker owns a queue: it pops its own jobs newest first and steals the oldest
+// job of another queue when it runs dry, so a single large emitter split into chunks
+// spreads over all workers. Threads that wait on a counter execute jobs too.
+// With zero workers submit() runs the job inline on the calling thread.
+struct ParticleJobPool
+{
+    static ParticleJobPool *Instance();
+
+    ParticleJobPool();
+    ~ParticleJobPool();
+
+    // stops the current workers and starts count new ones
+    void setWorkerCount(PrimitiveTypes::UInt32 count);
+    PrimitiveTypes::UInt32 getWorkerCount() const { return (PrimitiveTypes::UInt32)m_workers.size(); }
+
+    void submit(const ParticleJob &job);
+
+    // splits [begin, end) into chunkSize ranges and submits one job per range
+    void submitRange(void (*pFunc)(void *, PrimitiveTypes::UInt32, PrimitiveTypes::UInt32), void *pData,
+        PrimitiveTypes::UInt32 begin, PrimitiveTypes::UInt32 end, PrimitiveTypes::UInt32 chunkSize,
+        ParticleJobCounter &counter);
+
+    // returns once all jobs of the counter finished, running queued jobs meanwhile
+    void wait(ParticleJobCounter &counter);
+
+private:
+    struct WorkerQueue
+    {
+        std::mutex m_lock;
+        std::deque<ParticleJob> m_jobs;
+    };
+
+    void workerMain(PrimitiveTypes::UInt32 workerIndex);
+    bool popOrSteal(PrimitiveTypes::UInt32 queueIndex, ParticleJob &job);
+    void execute(const ParticleJob &job);
+    void stopWorkers();
+
+    std::vector<std::thread> m_workers;
+    std::vector<WorkerQueue *> m_queues;
+    std::atomic<PrimitiveTypes::UInt32> m_nextQueue;
+    std::atomic<PrimitiveTypes::Int32> m_queuedJobs;
+    std::mutex m_sleepLock;
+    std::condition_variable m_wakeUp;
+    bool m_quit;
+};
+
+}; // namespace Components
+}; // namespace PE
+
+#endif
@@ -0,0 +1,194 @@
+#include "ParticleMemoryPool.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace PE {
+namespace Components {
+
+ParticleMemoryPool *ParticleMemoryPool::Instance()
+{
+    // never destroyed: particle storage can be released from other static destructors
+    static ParticleMemoryPool *s_pInstance = new ParticleMemoryPool();
+    return s_pInstance;
+}
+
+ParticleMemoryPool::ParticleMemoryPool()
+{
+    PEASSERT(sizeof(BlockHeader) == Alignment, "ParticleMemoryPool::BlockHeader has to keep blocks aligned");
+    for (PrimitiveTypes::UInt32 i = 0; i < ClassCount; i++)
+        m_freeLists[i] = NULL;
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+ParticleMemoryPool::~ParticleMemoryPool()
+{
+    // blocks still in use above SmallBlockBytes belong to their owners from here on
+    trim();
+    for (size_t i = 0; i < m_slabs.size(); i++)
+        free(m_slabs[i]);
+}
+
+size_t ParticleMemoryPool::getClassBytes(PrimitiveTypes::UInt32 sizeClass)
+{
+    return (size_t)(4 + (sizeClass & 3)) << ((sizeClass >> 2) + 4);
+}
+
+PrimitiveTypes::UInt32 ParticleMemoryPool::getSizeClass(size_t bytes)
+{
+    if (bytes <= 64)
+        return 0;
+
+    // the two bits below the top bit pick the quarter within the power of two
+    size_t b = bytes - 1;
+    PrimitiveTypes::UInt32 msb = 0;
+    while ((b >> msb) > 1)
+        msb++;
+    PrimitiveTypes::UInt32 shift = msb - 2;
+    PrimitiveTypes::UInt32 quarter = (PrimitiveTypes::UInt32)(b >> shift) - 4;
+
+    PrimitiveTypes::UInt32 sizeClass = (shift - 4) * 4 + quarter + 1;
+    return sizeClass < ClassCount ? sizeClass : (PrimitiveTypes::UInt32)ClassCount;
+}
+
+ParticleMemoryPool::BlockHeader *ParticleMemoryPool::getHeader(void *p)
+{
+    return static_cast<BlockHeader *>(p) - 1;
+}
+
+ParticleMemoryPool::BlockHeader *ParticleMemoryPool::allocateFromHeap(PrimitiveTypes::UInt32 sizeClass, size_t bytes)
+{
+    void *pAllocation = malloc(sizeof(BlockHeader) + bytes + Alignment);
+    PEASSERT(pAllocation, "ParticleMemoryPool: out of memory");
+    if (!pAllocation)
+        return NULL;
+
+    uintptr_t aligned = ((uintptr_t)pAllocation + Alignment - 1) & ~(uintptr_t)(Alignment - 1);
+    BlockHeader *pHeader = reinterpret_cast<BlockHeader *>(aligned);
+    pHeader->m_bytes = bytes;
+    pHeader->m_pAllocation = pAllocation;
+    pHeader->m_pNextFree = NULL;
+    pHeader->m_sizeClass = sizeClass;
+
+    m_stats.m_bytesReserved += bytes;
+    m_stats.m_heapAllocations++;
+    return pHeader;
+}
+
+void ParticleMemoryPool::carveSlab(PrimitiveTypes::UInt32 sizeClass)
+{
+    void *pSlab = malloc(SlabBytes + Alignment);
+    PEASSERT(pSlab, "ParticleMemoryPool: out of memory");
+    if (!pSlab)
+        return;
+    m_slabs.push_back(pSlab);
+
+    const size_t bytes = getClassBytes(sizeClass);
+    const size_t stride = (sizeof(BlockHeader) + bytes + Alignment - 1) & ~(size_t)(Alignment - 1);
+    char *pBlock = reinterpret_cast<char *>(((uintptr_t)pSlab + Alignment - 1) & ~(uintptr_t)(Alignment - 1));
+
+    for (size_t offset = 0; offset + stride <= SlabBytes; offset += stride)
+    {
+        BlockHeader *pHeader = reinterpret_cast<BlockHeader *>(pBlock + offset);
+        pHeader->m_bytes = bytes;
+        pHeader->m_pAllocation = NULL; // part of the slab
+        pHeader->m_sizeClass = sizeClass;
+        pHeader->m_pNextFree = m_freeLists[sizeClass];
+        m_freeLists[sizeClass] = pHeader;
+    }
+
+    m_stats.m_bytesReserved += SlabBytes;
+    m_stats.m_heapAllocations++;
+}
+
+void *ParticleMemoryPool::allocate(size_t bytes)
+{
+    PrimitiveTypes::UInt32 sizeClass = getSizeClass(bytes);
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_stats.m_allocations++;
+
+    BlockHeader *pHeader;
+    if (sizeClass == ClassCount)
+    {
+        pHeader = allocateFromHeap(sizeClass, bytes);
+    }
+    else
+    {
+        if (!m_freeLists[sizeClass])
+        {
+            size_t classBytes = getClassBytes(sizeClass);
+            if (classBytes <= SmallBlockBytes)
+                carveSlab(sizeClass);
+            else
+                m_freeLists[sizeClass] = allocateFromHeap(sizeClass, classBytes);
+        }
+
+        pHeader = m_freeLists[sizeClass];
+        if (pHeader)
+            m_freeLists[sizeClass] = pHeader->m_pNextFree;
+    }
+
+    if (!pHeader)
+        return NULL;
+
+    m_stats.m_bytesInUse += pHeader->m_bytes;
+    if (m_stats.m_bytesInUse > m_stats.m_highWaterBytes)
+        m_stats.m_highWaterBytes = m_stats.m_bytesInUse;
+    return pHeader + 1;
+}
+
+void ParticleMemoryPool::release(void *p)
+{
+    if (!p)
+        return;
+
+    BlockHeader *pHeader = getHeader(p);
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_stats.m_bytesInUse -= pHeader->m_bytes;
+
+    if (pHeader->m_sizeClass == ClassCount)
+    {
+        m_stats.m_bytesReserved -= pHeader->m_bytes;
+        free(pHeader->m_pAllocation);
+        return;
+    }
+
+    pHeader->m_pNextFree = m_freeLists[pHeader->m_sizeClass];
+    m_freeLists[pHeader->m_sizeClass] = pHeader;
+}
+
+void ParticleMemoryPool::trim()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    for (PrimitiveTypes::UInt32 i = 0; i < ClassCount; i++)
+    {
+        if (getClassBytes(i) <= SmallBlockBytes)
+            continue;
+
+        while (m_freeLists[i])
+        {
+            BlockHeader *pHeader = m_freeLists[i];
+            m_freeLists[i] = pHeader->m_pNextFree;
+            m_stats.m_bytesReserved -= pHeader->m_bytes;
+            free(pHeader->m_pAllocation);
+        }
+    }
+}
+
+ParticleMemoryStats ParticleMemoryPool::getStats()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_stats;
+}
+
+void ParticleMemoryPool::resetHighWater()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_stats.m_highWaterBytes = m_stats.m_bytesInUse;
+}
+
+}; // namespace Components
+}; // namespace PE
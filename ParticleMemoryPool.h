@@ -0,0 +1,105 @@
+#ifndef _PE_PARTICLE_MEMORY_POOL_H_
+#define _PE_PARTICLE_MEMORY_POOL_H_
+
+#include "ParticleCoreTypes.h"
+
+#include <mutex>
+#include <stddef.h>
+#include <vector>
+
+namespace PE {
+namespace Components {
+
+struct ParticleMemoryStats
+{
+    PrimitiveTypes::UInt64 m_bytesInUse;      // size classes handed out and not released
+    PrimitiveTypes::UInt64 m_highWaterBytes;  // most m_bytesInUse seen since the last resetHighWater()
+    PrimitiveTypes::UInt64 m_bytesReserved;   // taken from the heap and still held (in use or free)
+    PrimitiveTypes::UInt64 m_allocations;     // allocate() calls
+    PrimitiveTypes::UInt64 m_heapAllocations; // allocate() calls that had to go to the heap
+};
+
+// Size-classed memory for particle storage (particle streams, depth sort arrays).
+// Requests are rounded up to one of four classes per power of two (at most 25% slack).
+// Released blocks stay on their class's free list, so an effect that dies and one that
+// spawns later with a similar size reuse the same memory and steady-state frames do not
+// touch the heap. Classes up to SmallBlockBytes are carved out of SlabBytes slabs; larger
+// blocks are one heap allocation each and trim() hands the free ones back.
+// Every block is Alignment-byte aligned. Allocation takes a lock: it belongs to emitter
+// creation and resizing, not to the per-particle loops.
+struct ParticleMemoryPool
+{
+    static ParticleMemoryPool *Instance();
+
+    ParticleMemoryPool();
+    ~ParticleMemoryPool();
+
+    void *allocate(size_t bytes);
+    void release(void *p);
+
+    // returns free blocks above SmallBlockBytes to the heap
+    void trim();
+
+    ParticleMemoryStats getStats();
+    void resetHighWater();
+
+    enum { Alignment = 64 };
+    enum { SlabBytes = 64 * 1024 };
+    enum { SmallBlockBytes = 8 * 1024 };
+    enum { ClassCount = 88 }; // largest class is 224 MB; beyond that goes straight to the heap
+
+    // bytes of a size class; class 0 is 64 bytes
+    static size_t getClassBytes(PrimitiveTypes::UInt32 sizeClass);
+    // smallest class that holds bytes, ClassCount if none does
+    static PrimitiveTypes::UInt32 getSizeClass(size_t bytes);
+
+private:
+    ParticleMemoryPool(const ParticleMemoryPool &);
+    ParticleMemoryPool &operator=(const ParticleMemoryPool &);
+
+    // sits right in front of every block, keeps the block aligned
+    struct BlockHeader
+    {
+        size_t m_bytes;                     // usable bytes
+        void *m_pAllocation;                // what the heap returned, for blocks that own one
+        BlockHeader *m_pNextFree;
+        PrimitiveTypes::UInt32 m_sizeClass; // ClassCount for blocks bigger than every class
+        char m_padding[Alignment - sizeof(size_t) - 2 * sizeof(void *) - sizeof(PrimitiveTypes::UInt32)];
+    };
+
+    static BlockHeader *getHeader(void *p);
+    BlockHeader *allocateFromHeap(PrimitiveTypes::UInt32 sizeClass, size_t bytes);
+    void carveSlab(PrimitiveTypes::UInt32 sizeClass);
+
+    std::mutex m_lock;
+    BlockHeader *m_freeLists[ClassCount];
+    std::vector<void *> m_slabs; // slab allocations, held until the pool goes away
+    ParticleMemoryStats m_stats;
+};
+
+// std allocator over ParticleMemoryPool, for containers owned by particle code
+template <typename T>
+struct ParticlePoolAllocator
+{
+    typedef T value_type;
+
+    ParticlePoolAllocator() {}
+    template <typename U>
+    ParticlePoolAllocator(const ParticlePoolAllocator<U> &) {}
+
+    T *allocate(size_t count) { return static_cast<T *>(ParticleMemoryPool::Instance()->allocate(count * sizeof(T))); }
+    void deallocate(T *p, size_t) { ParticleMemoryPool::Instance()->release(p); }
+
+    template <typename U>
+    bool operator==(const ParticlePoolAllocator<U> &) const { return true; }
+    template <typename U>
+    bool operator!=(const ParticlePoolAllocator<U> &) const { return false; }
+};
+
+typedef std::vector<PrimitiveTypes::UInt32, ParticlePoolAllocator<PrimitiveTypes::UInt32> > ParticleIndexArray;
+typedef std::vector<PrimitiveTypes::Float32, ParticlePoolAllocator<PrimitiveTypes::Float32> > ParticleFloatArray;
+
+}; // namespace Components
+}; // namespace PE
+
+#endif
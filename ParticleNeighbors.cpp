@@ -0,0 +1,153 @@
+#include "ParticleNeighbors.h"
+#include "ParticleSimCore.h"
+
+#include <float.h>
+
+namespace PE {
+namespace Components {
+
+ParticleNeighborGrid::ParticleNeighborGrid()
+    : m_radius(0.0f)
+    , m_cellCount(0)
+    , m_count(0)
+{
+    for (int k = 0; k < 3; k++)
+    {
+        m_min[k] = 0.0f;
+        m_invCellSize[k] = 0.0f;
+        m_cells[k] = 1;
+    }
+}
+
+void ParticleNeighborGrid::build(const ParticleBufferCPU &pb, PrimitiveTypes::Float32 radius)
+{
+    PEASSERT(radius > 0.0f, "ParticleNeighborGrid needs a positive search radius");
+    const PrimitiveTypes::UInt32 count = pb.m_size;
+    const PrimitiveTypes::Float32 *pos[3] = { pb.m_posX, pb.m_posY, pb.m_posZ };
+    m_radius = radius;
+    m_count = count;
+
+    // bounds of the cloud; NaN positions are left out here and land in the first cells
+    float minimum[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, maximum[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (int k = 0; k < 3; k++)
+    {
+        const PrimitiveTypes::Float32 *p = pos[k];
+        float lo = minimum[k], hi = maximum[k];
+        for (PrimitiveTypes::UInt32 i = 0; i < count; i++)
+        {
+            lo = p[i] < lo ? p[i] : lo;
+            hi = p[i] > hi ? p[i] : hi;
+        }
+        minimum[k] = lo;
+        maximum[k] = hi;
+    }
+
+    // radius wide cells, then halve the longest axis until the grid fits the cell limit;
+    // the last cell along an axis stretches to the end of the bounds
+    PrimitiveTypes::UInt32 cellLimit = MinCellLimit;
+    if (count * 2 > cellLimit)
+        cellLimit = count * 2;
+    float extent[3];
+    for (int k = 0; k < 3; k++)
+    {
+        extent[k] = maximum[k] - minimum[k];
+        if (!(extent[k] > 0.0f))
+        {
+            extent[k] = 0.0f;
+            minimum[k] = 0.0f;
+        }
+        float cells = extent[k] / radius;
+        cells = cells < (float)cellLimit ? cells : (float)cellLimit;
+        m_cells[k] = (PrimitiveTypes::UInt32)cells + 1;
+        m_min[k] = minimum[k];
+    }
+    for (;;)
+    {
+        PrimitiveTypes::UInt64 cellCount = (PrimitiveTypes::UInt64)m_cells[0] * m_cells[1] * m_cells[2];
+        if (cellCount <= cellLimit)
+            break;
+        int longest = m_cells[0] >= m_cells[1] ? 0 : 1;
+        longest = m_cells[longest] >= m_cells[2] ? longest : 2;
+        m_cells[longest] = (m_cells[longest] + 1) / 2;
+    }
+    for (int k = 0; k < 3; k++)
+    {
+        // cells are never narrower than the radius
+        float perCell = extent[k] > 0.0f ? (float)m_cells[k] / extent[k] : 0.0f;
+        m_invCellSize[k] = perCell < 1.0f / radius ? perCell : 1.0f / radius;
+    }
+    m_cellCount = m_cells[0] * m_cells[1] * m_cells[2];
+
+    if (m_cellOf.size() < count)
+    {
+        m_cellOf.resize(count);
+        m_particle.resize(count);
+        m_posX.resize(count + SlotPadding);
+        m_posY.resize(count + SlotPadding);
+        m_posZ.resize(count + SlotPadding);
+        m_velX.resize(count + SlotPadding);
+        m_velY.resize(count + SlotPadding);
+        m_velZ.resize(count + SlotPadding);
+    }
+
+    // count per cell, shifted up by one so the prefix sum leaves the cell starts
+    m_cellStart.assign(m_cellCount + 1, 0);
+    PrimitiveTypes::UInt32 *cellStart = &m_cellStart[0];
+    PrimitiveTypes::UInt32 *cellOf = count ? &m_cellOf[0] : NULL;
+    for (PrimitiveTypes::UInt32 i = 0; i < count; i++)
+    {
+        PrimitiveTypes::UInt32 cell = (getCell(2, pb.m_posZ[i]) * m_cells[1] + getCell(1, pb.m_posY[i])) * m_cells[0]
+            + getCell(0, pb.m_posX[i]);
+        cellOf[i] = cell;
+        cellStart[cell + 1]++;
+    }
+    for (PrimitiveTypes::UInt32 c = 0; c < m_cellCount; c++)
+        cellStart[c + 1] += cellStart[c];
+
+    // scatter in buffer order, so a cell keeps its particles in the order they were in;
+    // each cell's start advances to the next cell's start on the way
+    for (PrimitiveTypes::UInt32 i = 0; i < count; i++)
+    {
+        PrimitiveTypes::UInt32 slot = cellStart[cellOf[i]]++;
+        m_particle[slot] = i;
+        m_posX[slot] = pb.m_posX[i];
+        m_posY[slot] = pb.m_posY[i];
+        m_posZ[slot] = pb.m_posZ[i];
+        m_velX[slot] = pb.m_velX[i];
+        m_velY[slot] = pb.m_velY[i];
+        m_velZ[slot] = pb.m_velZ[i];
+    }
+    for (PrimitiveTypes::UInt32 c = m_cellCount; c > 0; c--)
+        cellStart[c] = cellStart[c - 1];
+    cellStart[0] = 0;
+}
+
+PrimitiveTypes::UInt32 ParticleNeighborGrid::getNeighborRows(PrimitiveTypes::UInt32 slot, PrimitiveTypes::UInt32 *pBegin,
+    PrimitiveTypes::UInt32 *pEnd, PrimitiveTypes::UInt32 &cellEnd) const
+{
+    const PrimitiveTypes::UInt32 cx = getCell(0, m_posX[slot]), cy = getCell(1, m_posY[slot]), cz = getCell(2, m_posZ[slot]);
+    const PrimitiveTypes::UInt32 x0 = cx > 0 ? cx - 1 : 0;
+    const PrimitiveTypes::UInt32 x1 = cx + 1 < m_cells[0] ? cx + 1 : cx;
+    const PrimitiveTypes::UInt32 y0 = cy > 0 ? cy - 1 : 0;
+    const PrimitiveTypes::UInt32 y1 = cy + 1 < m_cells[1] ? cy + 1 : cy;
+    const PrimitiveTypes::UInt32 z0 = cz > 0 ? cz - 1 : 0;
+    const PrimitiveTypes::UInt32 z1 = cz + 1 < m_cells[2] ? cz + 1 : cz;
+    cellEnd = m_cellStart[(cz * m_cells[1] + cy) * m_cells[0] + cx + 1];
+
+    PrimitiveTypes::UInt32 rows = 0;
+    for (PrimitiveTypes::UInt32 iz = z0; iz <= z1; iz++)
+    {
+        for (PrimitiveTypes::UInt32 iy = y0; iy <= y1; iy++)
+        {
+            // the row's cells sit next to each other in the sorted particles
+            const PrimitiveTypes::UInt32 row = (iz * m_cells[1] + iy) * m_cells[0];
+            pBegin[rows] = m_cellStart[row + x0];
+            pEnd[rows] = m_cellStart[row + x1 + 1];
+            rows++;
+        }
+    }
+    return rows;
+}
+
+}; // namespace Components
+}; // namespace PE
@@ -0,0 +1,95 @@
+#ifndef _PE_PARTICLE_NEIGHBORS_H_
+#define _PE_PARTICLE_NEIGHBORS_H_
+
+#include "ParticleCoreTypes.h"
+#include "ParticleMemoryPool.h"
+
+namespace PE {
+namespace Components {
+
+struct ParticleBufferCPU;
+
+// Uniform grid over an emitter's live particles for short range particle-particle work.
+// build() buckets the particles by a counting sort: one pass counts the particles per
+// cell, a prefix sum turns the counts into cell starts and a second pass scatters the
+// particles cell by cell, together with copies of their positions and velocities. The
+// grid covers the bounds of the particles with cells at least the search radius wide,
+// so the neighbors of a particle are in the 3x3x3 cells around it, and every row of
+// three cells along x is one contiguous range of the sorted particles. Nothing is
+// allocated per cell; the arrays only grow, so an emitter of steady size stops
+// allocating after its first steps.
+struct ParticleNeighborGrid
+{
+    // the grid holds at most this many cells or twice the particles, whichever is more;
+    // sparse clouds get wider cells instead of mostly empty ones
+    enum { MinCellLimit = 4096 };
+    enum { MaxNeighborRows = 9 };
+    // floats readable past m_count in the sorted copies, for vector loads over a row
+    enum { SlotPadding = 8 };
+
+    ParticleNeighborGrid();
+
+    // buckets the first pb.m_size particles for neighbor searches within radius
+    void build(const ParticleBufferCPU &pb, PrimitiveTypes::Float32 radius);
+
+    // the sorted slot ranges [pBegin[r], pEnd[r]) of the rows of three cells along x
+    // around the cell of slot, all particles that can be within m_radius of it (slot
+    // among them); returns the number of rows, up to MaxNeighborRows, some maybe empty.
+    // The slots before cellEnd are in the same cell and share the rows
+    PrimitiveTypes::UInt32 getNeighborRows(PrimitiveTypes::UInt32 slot, PrimitiveTypes::UInt32 *pBegin,
+        PrimitiveTypes::UInt32 *pEnd, PrimitiveTypes::UInt32 &cellEnd) const;
+
+    // calls visitor(other, dx, dy, dz, distanceSquared) for every particle closer than
+    // m_radius to the one in sorted slot, with d from that particle to the other; both
+    // are sorted slots (m_particle has their buffer indices). Reads the grid only, so
+    // any number of threads may search at once
+    template <typename Visitor>
+    void forEachNeighbor(PrimitiveTypes::UInt32 slot, Visitor &visitor) const;
+
+    // cell of a coordinate along axis, clamped to the grid, NaN to its first cell
+    PrimitiveTypes::UInt32 getCell(int axis, PrimitiveTypes::Float32 coordinate) const
+    {
+        float g = (coordinate - m_min[axis]) * m_invCellSize[axis];
+        g = g > 0.0f ? g : 0.0f;
+        float last = (float)(m_cells[axis] - 1);
+        return (PrimitiveTypes::UInt32)(g < last ? g : last);
+    }
+
+    PrimitiveTypes::Float32 m_radius;
+    PrimitiveTypes::Float32 m_min[3];
+    PrimitiveTypes::Float32 m_invCellSize[3];
+    PrimitiveTypes::UInt32 m_cells[3];   // along x, y and z, x varying fastest
+    PrimitiveTypes::UInt32 m_cellCount;
+    PrimitiveTypes::UInt32 m_count;      // particles bucketed by the last build()
+    ParticleIndexArray m_cellStart;      // m_cellCount + 1 sorted slots, cell c is [start[c], start[c + 1])
+    ParticleIndexArray m_cellOf;         // per buffer index, scratch of build()
+    ParticleIndexArray m_particle;       // per sorted slot, the buffer index
+    ParticleFloatArray m_posX, m_posY, m_posZ; // per sorted slot, SlotPadding more
+    ParticleFloatArray m_velX, m_velY, m_velZ; // per sorted slot as of build(), SlotPadding more
+};
+
+template <typename Visitor>
+void ParticleNeighborGrid::forEachNeighbor(PrimitiveTypes::UInt32 slot, Visitor &visitor) const
+{
+    PrimitiveTypes::UInt32 rowBegin[MaxNeighborRows], rowEnd[MaxNeighborRows], cellEnd;
+    const PrimitiveTypes::UInt32 rows = getNeighborRows(slot, rowBegin, rowEnd, cellEnd);
+    const PrimitiveTypes::Float32 *posX = &m_posX[0], *posY = &m_posY[0], *posZ = &m_posZ[0];
+    const float x = posX[slot], y = posY[slot], z = posZ[slot];
+    const float radiusSquared = m_radius * m_radius;
+
+    for (PrimitiveTypes::UInt32 r = 0; r < rows; r++)
+    {
+        for (PrimitiveTypes::UInt32 other = rowBegin[r]; other < rowEnd[r]; other++)
+        {
+            float dx = posX[other] - x, dy = posY[other] - y, dz = posZ[other] - z;
+            float distanceSquared = dx * dx + dy * dy + dz * dz;
+            if (distanceSquared < radiusSquared && other != slot)
+                visitor(other, dx, dy, dz, distanceSquared);
+        }
+    }
+}
+
+}; // namespace Components
+}; // namespace PE
+
+#endif
@@ -0,0 +1,144 @@
+#include "ParticleProfiler.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+namespace PE {
+namespace Components {
+
+PrimitiveTypes::UInt64 particleProfileNowNs()
+{
+    static const std::chrono::steady_clock::time_point s_origin = std::chrono::steady_clock::now();
+    return (PrimitiveTypes::UInt64)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - s_origin).count();
+}
+
+// small stable ids for trace rows instead of the opaque std::thread::id
+static PrimitiveTypes::UInt32 currentTraceThreadId()
+{
+    static std::atomic<PrimitiveTypes::UInt32> s_nextThreadId(0);
+    static thread_local PrimitiveTypes::UInt32 s_threadId = s_nextThreadId++;
+    return s_threadId;
+}
+
+// ParticleEmitterStats implementation
+ParticleEmitterStats::ParticleEmitterStats()
+    : m_emitterId(0)
+    , m_frames(0)
+{
+    memset(m_counters, 0, sizeof(m_counters));
+    memset(m_timesNs, 0, sizeof(m_timesNs));
+    memset(m_lastFrameCounters, 0, sizeof(m_lastFrameCounters));
+    memset(m_lastFrameTimesNs, 0, sizeof(m_lastFrameTimesNs));
+    memset(m_frameStartCounters, 0, sizeof(m_frameStartCounters));
+    memset(m_frameStartTimesNs, 0, sizeof(m_frameStartTimesNs));
+}
+
+void ParticleEmitterStats::endFrame()
+{
+    for (int i = 0; i < ParticleCounter_Count; i++)
+    {
+        m_lastFrameCounters[i] = m_counters[i] - m_frameStartCounters[i];
+        m_frameStartCounters[i] = m_counters[i];
+    }
+    for (int i = 0; i < ParticleTimer_Count; i++)
+    {
+        m_lastFrameTimesNs[i] = m_timesNs[i] - m_frameStartTimesNs[i];
+        m_frameStartTimesNs[i] = m_timesNs[i];
+    }
+    m_frames++;
+}
+
+const char *getParticleCounterName(ParticleCounter counter)
+{
+    switch (counter)
+    {
+    case ParticleCounter_Simulated: return "simulated";
+    case ParticleCounter_Spawned: return "spawned";
+    case ParticleCounter_Killed: return "killed";
+    case ParticleCounter_VerticesWritten: return "vertices_written";
+    case ParticleCounter_BytesUploaded: return "bytes_uploaded";
+    case ParticleCounter_CulledFrames: return "culled_frames";
+    default: return "unknown";
+    }
+}
+
+const char *getParticleTimerName(ParticleTimer timer)
+{
+    switch (timer)
+    {
+    case ParticleTimer_Update: return "update";
+    case ParticleTimer_Build: return "build";
+    case ParticleTimer_Upload: return "upload";
+    default: return "unknown";
+    }
+}
+
+// ParticleTraceRecorder implementation
+ParticleTraceRecorder *ParticleTraceRecorder::Instance()
+{
+    static ParticleTraceRecorder s_instance;
+    return &s_instance;
+}
+
+ParticleTraceRecorder::ParticleTraceRecorder()
+    : m_eventCount(0)
+    , m_capturing(false)
+{
+}
+
+void ParticleTraceRecorder::beginCapture(PrimitiveTypes::UInt32 maxEvents)
+{
+    m_capturing = false;
+    m_events.resize(maxEvents);
+    m_eventCount = 0;
+    m_capturing = true;
+}
+
+void ParticleTraceRecorder::endCapture()
+{
+    m_capturing = false;
+}
+
+void ParticleTraceRecorder::record(ParticleTimer timer, PrimitiveTypes::UInt32 emitterId,
+    PrimitiveTypes::UInt64 startNs, PrimitiveTypes::UInt64 durationNs)
+{
+    PrimitiveTypes::UInt32 index = m_eventCount++;
+    if (index >= m_events.size())
+        return;
+
+    Event &event = m_events[index];
+    event.m_startNs = startNs;
+    event.m_durationNs = durationNs;
+    event.m_emitterId = emitterId;
+    event.m_threadId = currentTraceThreadId();
+    event.m_timer = timer;
+}
+
+bool ParticleTraceRecorder::writeChromeTrace(const char *path)
+{
+    FILE *pFile = fopen(path, "w");
+    if (!pFile)
+        return false;
+
+    PrimitiveTypes::UInt32 count = m_eventCount.load();
+    if (count > m_events.size())
+        count = (PrimitiveTypes::UInt32)m_events.size();
+
+    // complete ("X") events, timestamps in microseconds
+    fprintf(pFile, "{\"traceEvents\":[\n");
+    for (PrimitiveTypes::UInt32 i = 0; i < count; i++)
+    {
+        const Event &event = m_events[i];
+        fprintf(pFile, "%s{\"name\":\"%s\",\"cat\":\"particles\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":0,\"tid\":%u,\"args\":{\"emitter\":%u}}\n",
+            i ? "," : "", getParticleTimerName(event.m_timer), event.m_startNs / 1000.0, event.m_durationNs / 1000.0,
+            event.m_threadId, event.m_emitterId);
+    }
+    fprintf(pFile, "]}\n");
+    fclose(pFile);
+    return true;
+}
+
+}; // namespace Components
+}; // namespace PE
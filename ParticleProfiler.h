@@ -0,0 +1,149 @@
+#ifndef _PE_PARTICLE_PROFILER_H_
+#define _PE_PARTICLE_PROFILER_H_
+
+#include "ParticleCoreTypes.h"
+
+#include <atomic>
+#include <vector>
+
+// PE_PARTICLE_PROFILE switches the particle instrumentation on. Off, the timers,
+// counters and PE_PARTICLE_LOG compile to nothing; ParticleEmitterStats stays in the
+// emitters and simply reads zero. Defaults to off in NDEBUG builds.
+#ifndef PE_PARTICLE_PROFILE
+#ifdef NDEBUG
+#define PE_PARTICLE_PROFILE 0
+#else
+#define PE_PARTICLE_PROFILE 1
+#endif
+#endif
+
+namespace PE {
+namespace Components {
+
+enum ParticleCounter
+{
+    ParticleCounter_Simulated,       // particles integrated, once per fixed step
+    ParticleCounter_Spawned,
+    ParticleCounter_Killed,
+    ParticleCounter_VerticesWritten,
+    ParticleCounter_BytesUploaded,   // bytes handed to the gpu mesh update
+    ParticleCounter_CulledFrames,    // frames the mesh build was skipped for
+    ParticleCounter_Count
+};
+
+enum ParticleTimer
+{
+    ParticleTimer_Update, // fixed substeps of a frame, on whichever thread ran them
+    ParticleTimer_Build,  // mesh streams written from the particles
+    ParticleTimer_Upload, // mesh load / update on the render context
+    ParticleTimer_Count
+};
+
+// Counters and timers of one emitter. Totals accumulate for the emitter's life;
+// endFrame() snapshots what happened since the previous call into m_lastFrame.
+// Update values are written by the thread running the emitter's step and read
+// after finishUpdate(), so no atomics are needed.
+struct ParticleEmitterStats
+{
+    ParticleEmitterStats();
+
+    void add(ParticleCounter counter, PrimitiveTypes::UInt32 amount) { m_counters[counter] += amount; }
+    void addTime(ParticleTimer timer, PrimitiveTypes::UInt64 ns) { m_timesNs[timer] += ns; }
+    void endFrame();
+
+    PrimitiveTypes::UInt32 m_emitterId;
+    PrimitiveTypes::UInt64 m_counters[ParticleCounter_Count];
+    PrimitiveTypes::UInt64 m_timesNs[ParticleTimer_Count];
+    PrimitiveTypes::UInt64 m_frames;
+
+    // deltas of the last finished frame
+    PrimitiveTypes::UInt64 m_lastFrameCounters[ParticleCounter_Count];
+    PrimitiveTypes::UInt64 m_lastFrameTimesNs[ParticleTimer_Count];
+
+private:
+    PrimitiveTypes::UInt64 m_frameStartCounters[ParticleCounter_Count];
+    PrimitiveTypes::UInt64 m_frameStartTimesNs[ParticleTimer_Count];
+};
+
+const char *getParticleCounterName(ParticleCounter counter);
+const char *getParticleTimerName(ParticleTimer timer);
+
+// Optional Chrome trace ("chrome://tracing" / Perfetto) of the scoped timers.
+// beginCapture() preallocates the event storage; recording is lock-free and drops
+// events once the storage is full.
+struct ParticleTraceRecorder
+{
+    static ParticleTraceRecorder *Instance();
+
+    ParticleTraceRecorder();
+
+    void beginCapture(PrimitiveTypes::UInt32 maxEvents);
+    void endCapture();
+    bool isCapturing() const { return m_capturing.load(std::memory_order_relaxed); }
+
+    void record(ParticleTimer timer, PrimitiveTypes::UInt32 emitterId, PrimitiveTypes::UInt64 startNs, PrimitiveTypes::UInt64 durationNs);
+
+    // writes the captured events as trace json; returns false if the file can't be opened
+    bool writeChromeTrace(const char *path);
+
+private:
+    struct Event
+    {
+        PrimitiveTypes::UInt64 m_startNs;
+        PrimitiveTypes::UInt64 m_durationNs;
+        PrimitiveTypes::UInt32 m_emitterId;
+        PrimitiveTypes::UInt32 m_threadId;
+        ParticleTimer m_timer;
+    };
+
+    std::vector<Event> m_events;
+    std::atomic<PrimitiveTypes::UInt32> m_eventCount;
+    std::atomic<bool> m_capturing;
+};
+
+// monotonic nanoseconds, shared origin for timers and trace events
+PrimitiveTypes::UInt64 particleProfileNowNs();
+
+// adds the lifetime of the scope to one timer of an emitter (and the trace, if capturing)
+struct ParticleScopedTimer
+{
+    ParticleScopedTimer(ParticleEmitterStats &stats, ParticleTimer timer)
+        : m_stats(stats), m_timer(timer), m_startNs(particleProfileNowNs())
+    {
+    }
+
+    ~ParticleScopedTimer()
+    {
+        PrimitiveTypes::UInt64 duration = particleProfileNowNs() - m_startNs;
+        m_stats.addTime(m_timer, duration);
+        ParticleTraceRecorder *pTrace = ParticleTraceRecorder::Instance();
+        if (pTrace->isCapturing())
+            pTrace->record(m_timer, m_stats.m_emitterId, m_startNs, duration);
+    }
+
+private:
+    ParticleEmitterStats &m_stats;
+    ParticleTimer m_timer;
+    PrimitiveTypes::UInt64 m_startNs;
+};
+
+}; // namespace Components
+}; // namespace PE
+
+#define PE_PARTICLE_CONCAT_INNER(a, b) a##b
+#define PE_PARTICLE_CONCAT(a, b) PE_PARTICLE_CONCAT_INNER(a, b)
+
+#if PE_PARTICLE_PROFILE
+#define PE_PARTICLE_SCOPED_TIMER(stats, timer) PE::Components::ParticleScopedTimer PE_PARTICLE_CONCAT(particleScopedTimer, __LINE__)((stats), (timer))
+#define PE_PARTICLE_COUNT(stats, counter, amount) (stats).add((counter), (amount))
+#define PE_PARTICLE_END_FRAME(stats) (stats).endFrame()
+// per-frame diagnostics; one-off messages keep using PEINFO
+#define PE_PARTICLE_LOG(...) PEINFO(__VA_ARGS__)
+#else
+#define PE_PARTICLE_SCOPED_TIMER(stats, timer) ((void)0)
+#define PE_PARTICLE_COUNT(stats, counter, amount) ((void)0)
+#define PE_PARTICLE_END_FRAME(stats) ((void)0)
+#define PE_PARTICLE_LOG(...) ((void)0)
+#endif
+
+#endif
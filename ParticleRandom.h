@@ -0,0 +1,128 @@
+#ifndef _PE_PARTICLE_RANDOM_H_
+#define _PE_PARTICLE_RANDOM_H_
+
+#include "ParticleCoreTypes.h"
+#include "ParticleSimd.h"
+
+namespace PE {
+namespace Components {
+
+// Per-emitter random number generator: eight interleaved xoshiro128+ streams stepped
+// together, so filling a batch is plain 32-bit lane arithmetic, run by the simd
+// uniform kernel (getParticleUniformKernel()). Single draws come out of a small cache
+// that is refilled in batches.
+// Same seed and stream give the same sequence on every platform, and emitters do
+// not share any state, so spawning is safe from any thread that owns the emitter.
+struct ParticleRandom
+{
+    enum { Lanes = ParticleRandomLanes, CacheSize = 64 };
+
+    ParticleRandom() { seed(0, 0); }
+
+    // stream separates emitters that share a template seed
+    void seed(PrimitiveTypes::UInt32 seedValue, PrimitiveTypes::UInt32 stream)
+    {
+        // splitmix32 expands the seed into a non-zero state for every lane
+        PrimitiveTypes::UInt32 x = seedValue ^ (stream * 0x9E3779B9u);
+        for (int w = 0; w < 4; w++)
+        {
+            for (int lane = 0; lane < Lanes; lane++)
+            {
+                x += 0x9E3779B9u;
+                PrimitiveTypes::UInt32 z = x;
+                z = (z ^ (z >> 16)) * 0x85EBCA6Bu;
+                z = (z ^ (z >> 13)) * 0xC2B2AE35u;
+                m_state[w][lane] = z ^ (z >> 16);
+            }
+        }
+        for (int lane = 0; lane < Lanes; lane++)
+        {
+            if ((m_state[0][lane] | m_state[1][lane] | m_state[2][lane] | m_state[3][lane]) == 0)
+                m_state[0][lane] = 1;
+        }
+        m_cacheIndex = CacheSize;
+    }
+
+    // count uniform floats in [0, 1); count does not need to be a multiple of Lanes
+    void fillUniform(PrimitiveTypes::Float32 *pOut, PrimitiveTypes::UInt32 count)
+    {
+        PrimitiveTypes::UInt32 i = count & ~(PrimitiveTypes::UInt32)(Lanes - 1);
+        if (i > 0)
+            getParticleUniformKernel()(&m_state[0][0], pOut, i);
+        if (i < count)
+        {
+            PrimitiveTypes::UInt32 bits[Lanes];
+            step(bits);
+            for (int lane = 0; i < count; lane++, i++)
+                pOut[i] = toUnitFloat(bits[lane]);
+        }
+    }
+
+    // count uniform floats in [lo, hi)
+    void fillRange(PrimitiveTypes::Float32 *pOut, PrimitiveTypes::UInt32 count, PrimitiveTypes::Float32 lo, PrimitiveTypes::Float32 hi)
+    {
+        fillUniform(pOut, count);
+        PrimitiveTypes::Float32 scale = hi - lo;
+        for (PrimitiveTypes::UInt32 i = 0; i < count; i++)
+            pOut[i] = lo + pOut[i] * scale;
+    }
+
+    // [0, 1)
+    PrimitiveTypes::Float32 nextFloat()
+    {
+        if (m_cacheIndex == CacheSize)
+        {
+            fillUniform(m_cache, CacheSize);
+            m_cacheIndex = 0;
+        }
+        return m_cache[m_cacheIndex++];
+    }
+
+    // [lo, hi)
+    PrimitiveTypes::Float32 nextRange(PrimitiveTypes::Float32 lo, PrimitiveTypes::Float32 hi)
+    {
+        return lo + nextFloat() * (hi - lo);
+    }
+
+private:
+    void step(PrimitiveTypes::UInt32 *pOut)
+    {
+        for (int lane = 0; lane < Lanes; lane++)
+        {
+            PrimitiveTypes::UInt32 s0 = m_state[0][lane];
+            PrimitiveTypes::UInt32 s1 = m_state[1][lane];
+            PrimitiveTypes::UInt32 s2 = m_state[2][lane];
+            PrimitiveTypes::UInt32 s3 = m_state[3][lane];
+
+            pOut[lane] = s0 + s3;
+
+            PrimitiveTypes::UInt32 t = s1 << 9;
+            s2 ^= s0;
+            s3 ^= s1;
+            s1 ^= s2;
+            s0 ^= s3;
+            s2 ^= t;
+            s3 = (s3 << 11) | (s3 >> 21);
+
+            m_state[0][lane] = s0;
+            m_state[1][lane] = s1;
+            m_state[2][lane] = s2;
+            m_state[3][lane] = s3;
+        }
+    }
+
+    // top 24 bits are the good ones for xoshiro128+ and fit a float mantissa exactly
+    static PrimitiveTypes::Float32 toUnitFloat(PrimitiveTypes::UInt32 bits)
+    {
+        return (PrimitiveTypes::Float32)(bits >> 8) * (1.0f / 16777216.0f);
+    }
+
+    PrimitiveTypes::UInt32 m_state[4][Lanes];
+    PrimitiveTypes::Float32 m_cache[CacheSize];
+    PrimitiveTypes::UInt32 m_cacheIndex;
+};
+
+}; // namespace Components
+}; // namespace PE
+
+#endif
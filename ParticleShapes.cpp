@@ -0,0 +1,291 @@
+#include "ParticleShapes.h"
+
+#include <math.h>
+#include <string.h>
+
+namespace PE {
+namespace Components {
+
+void ParticleShapeMesh::build(const PrimitiveTypes::Float32 *pPositions, PrimitiveTypes::UInt32 vertexCount,
+    const PrimitiveTypes::UInt32 *pIndices, PrimitiveTypes::UInt32 triangleCount)
+{
+    m_corners.clear();
+    m_normals.clear();
+    m_keep.clear();
+    m_alias.clear();
+    m_totalArea = 0.0f;
+
+    for (PrimitiveTypes::UInt32 t = 0; t < triangleCount; t++)
+    {
+        const PrimitiveTypes::UInt32 *pTriangle = pIndices + t * 3;
+        PEASSERT(pTriangle[0] < vertexCount && pTriangle[1] < vertexCount && pTriangle[2] < vertexCount,
+            "ParticleShapeMesh: triangle %u indexes past the %u vertices", t, vertexCount);
+        if (pTriangle[0] >= vertexCount || pTriangle[1] >= vertexCount || pTriangle[2] >= vertexCount)
+            continue;
+
+        const PrimitiveTypes::Float32 *a = pPositions + pTriangle[0] * 3;
+        const PrimitiveTypes::Float32 *b = pPositions + pTriangle[1] * 3;
+        const PrimitiveTypes::Float32 *c = pPositions + pTriangle[2] * 3;
+        float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+        float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+        float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+        float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (!(length > 0.0f))
+            continue;
+
+        m_corners.insert(m_corners.end(), a, a + 3);
+        m_corners.insert(m_corners.end(), e1, e1 + 3);
+        m_corners.insert(m_corners.end(), e2, e2 + 3);
+        for (int k = 0; k < 3; k++)
+            m_normals.push_back(n[k] / length);
+        m_keep.push_back(0.5f * length);
+        m_totalArea += 0.5f * length;
+    }
+
+    // Vose: scale the areas so the mean is 1, then let every slot below 1 borrow the
+    // rest from one above 1
+    PrimitiveTypes::UInt32 count = getTriangleCount();
+    m_alias.resize(count);
+    std::vector<PrimitiveTypes::UInt32> small, large;
+    for (PrimitiveTypes::UInt32 t = 0; t < count; t++)
+    {
+        m_keep[t] *= count / m_totalArea;
+        m_alias[t] = t;
+        (m_keep[t] < 1.0f ? small : large).push_back(t);
+    }
+    while (!small.empty() && !large.empty())
+    {
+        PrimitiveTypes::UInt32 lender = large.back();
+        PrimitiveTypes::UInt32 borrower = small.back();
+        small.pop_back();
+        m_alias[borrower] = lender;
+        m_keep[lender] -= 1.0f - m_keep[borrower];
+        if (m_keep[lender] < 1.0f)
+        {
+            large.pop_back();
+            small.push_back(lender);
+        }
+    }
+    // what is left is 1 up to rounding
+    for (size_t i = 0; i < small.size(); i++)
+        m_keep[small[i]] = 1.0f;
+    for (size_t i = 0; i < large.size(); i++)
+        m_keep[large[i]] = 1.0f;
+}
+
+// random, mostly horizontal, slightly down
+static void generateDriftDirections(ParticleRandom &random, PrimitiveTypes::Float32 *pX, PrimitiveTypes::Float32 *pY,
+    PrimitiveTypes::Float32 *pZ, PrimitiveTypes::UInt32 count)
+{
+    random.fillRange(pX, count, -1.0f, 1.0f);
+    random.fillRange(pY, count, -0.2f, -0.1f);
+    random.fillRange(pZ, count, -1.0f, 1.0f);
+    // |y| >= 0.1, never zero length
+    getParticleNormalizeKernel()(pX, pY, pZ, count);
+}
+
+// count angles uniform in [0, 2pi); sin goes to pSin and cos to pAngle
+static void generateCircle(ParticleRandom &random, PrimitiveTypes::Float32 *pAngle, PrimitiveTypes::Float32 *pSin,
+    PrimitiveTypes::UInt32 count)
+{
+    const float twoPi = 2.0f * PrimitiveTypes::Constants::c_Pi_F32;
+    random.fillUniform(pAngle, count);
+    for (PrimitiveTypes::UInt32 j = 0; j < count; j++)
+        pAngle[j] *= twoPi;
+    getParticleSinCosKernel()(pAngle, pSin, pAngle, count);
+}
+
+// The largest of n uniforms is distributed like the n-th root of one: the largest of
+// two spreads a radius evenly over a disc, of three over a ball, with no sqrt or cbrt.
+static inline float maxOf(float a, float b)
+{
+    return a > b ? a : b;
+}
+
+// one block of generateParticleShape(), small enough for its streams to stay in cache
+// across the passes
+static void generateParticleShapeBlock(const Particle &particle, const Vector3 &origin, ParticleRandom &random,
+    ParticleBufferCPU &pb, PrimitiveTypes::UInt32 begin, PrimitiveTypes::UInt32 count)
+{
+    PrimitiveTypes::Float32 *px = pb.m_posX + begin, *py = pb.m_posY + begin, *pz = pb.m_posZ + begin;
+    PrimitiveTypes::Float32 *vx = pb.m_velX + begin, *vy = pb.m_velY + begin, *vz = pb.m_velZ + begin;
+    // the prev streams are scratch until the positions are copied into them at the end
+    PrimitiveTypes::Float32 *qx = pb.m_prevX + begin, *qy = pb.m_prevY + begin, *qz = pb.m_prevZ + begin;
+
+    const float ox = origin.m_x, oy = origin.m_y, oz = origin.m_z;
+    const float radius = particle.m_spawnRadius;
+    const Vector3 &extents = particle.m_shapeExtents;
+
+    switch (particle.m_shape)
+    {
+    case Cone:
+    {
+        // uniform over the base disc; the heading leans out in proportion to the distance
+        // from the center, reaching m_coneAngle at the rim
+        float angle = particle.m_coneAngle;
+        angle = angle > 0.0f ? angle : 0.0f;
+        angle = angle < 1.5f ? angle : 1.5f;
+        const float spread = tanf(angle);
+
+        random.fillUniform(px, count);
+        random.fillUniform(py, count);
+        generateCircle(random, qx, qz, count);
+        for (PrimitiveTypes::UInt32 j = 0; j < count; j++)
+        {
+            float k = maxOf(px[j], py[j]);
+            float x = qx[j] * k, z = qz[j] * k;
+            px[j] = ox + x * radius;
+            py[j] = oy;
+            pz[j] = oz + z * radius;
+            vx[j] = x * spread;
+            vy[j] = 1.0f;
+            vz[j] = z * spread;
+        }
+        getParticleNormalizeKernel()(vx, vy, vz, count);
+        break;
+    }
+    case Sphere:
+    {
+        // heading uniform on the unit sphere: uniform height, uniform angle around it
+        random.fillUniform(px, count);
+        random.fillUniform(py, count);
+        random.fillUniform(pz, count);
+        random.fillUniform(vy, count);
+        generateCircle(random, qx, qz, count);
+        for (PrimitiveTypes::UInt32 j = 0; j < count; j++)
+        {
+            float y = 1.0f - 2.0f * vy[j];
+            vy[j] = y;
+            qy[j] = maxOf(1.0f - y * y, 0.0f);
+        }
+        getParticleSqrtKernel()(qy, count);
+        for (PrimitiveTypes::UInt32 j = 0; j < count; j++)
+        {
+            float x = qx[j] * qy[j], y = vy[j], z = qz[j] * qy[j];
+            float r = maxOf(maxOf(px[j], py[j]), pz[j]) * radius;
+            px[j] = ox + x * r;
+            py[j] = oy + y * r;
+            pz[j] = oz + z * r;
+            vx[j] = x;
+            vz[j] = z;
+        }
+        break;
+    }
+    case Box:
+    {
+        random.fillUniform(px, count);
+        random.fillUniform(py, count);
+        random.fillUniform(pz, count);
+        for (PrimitiveTypes::UInt32 j = 0; j < count; j++)
+        {
+            px[j] = ox + (2.0f * px[j] - 1.0f) * extents.m_x;
+            py[j] = oy + (2.0f * py[j] - 1.0f) * extents.m_y;
+            pz[j] = oz + (2.0f * pz[j] - 1.0f) * extents.m_z;
+        }
+        generateDriftDirections(random, vx, vy, vz, count);
+        break;
+    }
+    case Disc:
+    {
+        // the spawn of the original emitter: the radius itself is uniform, so particles
+        // gather toward the center rather than covering the disc evenly
+        const float height = particle.m_spawnHeight;
+        random.fillUniform(px, count);
+        random.fillUniform(py, count);
+        generateCircle(random, qx, qz, count);
+        for (PrimitiveTypes::UInt32 j = 0; j < count; j++)
+        {
+            float r = px[j] * radius;
+            px[j] = ox + qx[j] * r;
+            py[j] = oy + py[j] * height;
+            pz[j] = oz + qz[j] * r;
+        }
+        generateDriftDirections(random, vx, vy, vz, count);
+        break;
+    }
+    case MeshSurface:
+    {
+        const ParticleShapeMesh *pMesh = particle.m_pShapeMesh;
+        if (!pMesh || !(pMesh->m_totalArea > 0.0f))
+        {
+            for (PrimitiveTypes::UInt32 j = 0; j < count; j++)
+            {
+                px[j] = ox;
+                py[j] = oy;
+                pz[j] = oz;
+            }
+            generateDriftDirections(random, vx, vy, vz, count);
+            break;
+        }
+
+        const PrimitiveTypes::Float32 *pCorners = &pMesh->m_corners[0];
+        const PrimitiveTypes::Float32 *pNormals = &pMesh->m_normals[0];
+        const PrimitiveTypes::Float32 *pKeep = &pMesh->m_keep[0];
+        const PrimitiveTypes::UInt32 *pAlias = &pMesh->m_alias[0];
+        const PrimitiveTypes::UInt32 triangles = pMesh->getTriangleCount();
+        const float slots = (float)triangles;
+
+        random.fillUniform(px, count);
+        random.fillUniform(vx, count);
+        random.fillUniform(py, count);
+        random.fillUniform(qy, count);
+        random.fillUniform(pz, count);
+        for (PrimitiveTypes::UInt32 j = 0; j < count; j++)
+        {
+            PrimitiveTypes::UInt32 slot = (PrimitiveTypes::UInt32)(px[j] * slots);
+            slot = slot < triangles ? slot : triangles - 1;
+            PrimitiveTypes::UInt32 lo = vx[j] < pKeep[slot] ? slot : pAlias[slot];
+
+            // uniform over the triangle: a + e1 * s(1 - v) + e2 * sv, s distributed like sqrt(u)
+            float s = maxOf(py[j], qy[j]);
+            float wb = s * (1.0f - pz[j]), wc = s * pz[j];
+            const PrimitiveTypes::Float32 *c = pCorners + lo * 9;
+            px[j] = ox + c[0] + c[3] * wb + c[6] * wc;
+            py[j] = oy + c[1] + c[4] * wb + c[7] * wc;
+            pz[j] = oz + c[2] + c[5] * wb + c[8] * wc;
+
+            const PrimitiveTypes::Float32 *n = pNormals + lo * 3;
+            vx[j] = n[0];
+            vy[j] = n[1];
+            vz[j] = n[2];
+        }
+        break;
+    }
+    case Line:
+    {
+        random.fillUniform(px, count);
+        for (PrimitiveTypes::UInt32 j = 0; j < count; j++)
+        {
+            float t = 2.0f * px[j] - 1.0f;
+            px[j] = ox + t * extents.m_x;
+            py[j] = oy + t * extents.m_y;
+            pz[j] = oz + t * extents.m_z;
+        }
+        generateDriftDirections(random, vx, vy, vz, count);
+        break;
+    }
+    }
+
+    // nothing to interpolate from yet
+    memcpy(pb.m_prevX + begin, px, count * sizeof(PrimitiveTypes::Float32));
+    memcpy(pb.m_prevY + begin, py, count * sizeof(PrimitiveTypes::Float32));
+    memcpy(pb.m_prevZ + begin, pz, count * sizeof(PrimitiveTypes::Float32));
+}
+
+void generateParticleShape(const Particle &particle, const Vector3 &origin, ParticleRandom &random,
+    ParticleBufferCPU &pb, PrimitiveTypes::UInt32 begin, PrimitiveTypes::UInt32 count)
+{
+    PEASSERT(begin + count <= pb.m_capacity, "generateParticleShape past the buffer capacity");
+
+    // nine streams of a block fit in L1; whole streams of a big burst would not even
+    // stay in L2 between the passes
+    const PrimitiveTypes::UInt32 blockSize = 512;
+    for (PrimitiveTypes::UInt32 offset = 0; offset < count; offset += blockSize)
+    {
+        PrimitiveTypes::UInt32 blockCount = count - offset < blockSize ? count - offset : blockSize;
+        generateParticleShapeBlock(particle, origin, random, pb, begin + offset, blockCount);
+    }
+}
+
+}; // namespace Components
+}; // namespace PE
@@ -0,0 +1,55 @@
+#ifndef _PE_PARTICLE_SHAPES_H_
+#define _PE_PARTICLE_SHAPES_H_
+
+#include "ParticleSimCore.h"
+
+#include <vector>
+
+namespace PE {
+namespace Components {
+
+// Triangles a MeshSurface emitter spawns on, in emitter space. Triangles are picked
+// with probability proportional to their area, so the surface is covered evenly; the
+// pick is an alias table (Walker/Vose): a uniform slot, then that slot's triangle or
+// its alias, in constant time and without branches.
+struct ParticleShapeMesh
+{
+    ParticleShapeMesh() : m_totalArea(0.0f) {}
+
+    // copies positions (x,y,z per vertex) and triangles (three vertex indices each);
+    // degenerate triangles are dropped
+    void build(const PrimitiveTypes::Float32 *pPositions, PrimitiveTypes::UInt32 vertexCount,
+        const PrimitiveTypes::UInt32 *pIndices, PrimitiveTypes::UInt32 triangleCount);
+
+    PrimitiveTypes::UInt32 getTriangleCount() const { return (PrimitiveTypes::UInt32)m_keep.size(); }
+
+    std::vector<PrimitiveTypes::Float32> m_corners; // per triangle: a, b - a, c - a
+    std::vector<PrimitiveTypes::Float32> m_normals; // per triangle: unit face normal
+    std::vector<PrimitiveTypes::Float32> m_keep;    // per slot: chance of its own triangle over m_alias
+    std::vector<PrimitiveTypes::UInt32> m_alias;
+    PrimitiveTypes::Float32 m_totalArea;
+};
+
+// Writes the positions (m_pos and m_prev streams) and unit headings (m_vel streams) of
+// particles [begin, begin + count) for particle.m_shape around origin:
+//   Cone        - on a disc of m_spawnRadius, heading up (+y), tilted outward up to
+//                 m_coneAngle at the rim
+//   Sphere      - in a ball of m_spawnRadius, heading away from its center
+//   Box         - in a box of half size m_shapeExtents, heading the drift direction
+//   Disc        - on a disc of m_spawnRadius (uniform radius, denser at the center) and
+//                 up to m_spawnHeight above it, heading the drift direction; the
+//                 original emitter's spawn and the Particle default
+//   MeshSurface - on m_pShapeMesh, along the face normal; at origin without a mesh
+//   Line        - between origin - m_shapeExtents and origin + m_shapeExtents, heading
+//                 the drift direction
+// The drift direction is random, mostly horizontal and slightly down.
+// The random numbers for the whole batch are drawn straight into those nine streams
+// and each shape is a few flat loops over them, with sin/cos from
+// getParticleSinCosKernel(); there is no per-particle call.
+void generateParticleShape(const Particle &particle, const Vector3 &origin, ParticleRandom &random,
+    ParticleBufferCPU &pb, PrimitiveTypes::UInt32 begin, PrimitiveTypes::UInt32 count);
+
+}; // namespace Components
+}; // namespace PE
+
+#endif
@@ -0,0 +1,1108 @@
+#include "ParticleSimCore.h"
+#include "ParticleShapes.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace PE {
+namespace Components {
+
+// template speeds and swirl strengths are in 1/50 world units per second
+static const float s_moveScale = 0.02f;
+
+// ParticleSimClock implementation
+ParticleSimClock::ParticleSimClock()
+    : m_step(1.0f / 60.0f)
+    , m_baseStep(1.0f / 60.0f)
+    , m_maxSubsteps(4)
+    , m_accumulator(0.0f)
+    , m_alpha(1.0f)
+{
+}
+
+void ParticleSimClock::setRate(PrimitiveTypes::Float32 stepsPerSecond, PrimitiveTypes::UInt32 maxSubsteps)
+{
+    m_baseStep = 1.0f / (stepsPerSecond > 1.0f ? stepsPerSecond : 1.0f);
+    m_step = m_baseStep;
+    m_maxSubsteps = maxSubsteps > 0 ? maxSubsteps : 1;
+    m_accumulator = 0.0f;
+    m_alpha = 1.0f;
+}
+
+void ParticleSimClock::setStepDivisor(PrimitiveTypes::UInt32 divisor)
+{
+    // time already accumulated carries over, it just drains in longer steps
+    m_step = m_baseStep * (divisor > 1 ? divisor : 1);
+}
+
+PrimitiveTypes::UInt32 ParticleSimClock::advance(PrimitiveTypes::Float32 frameTime)
+{
+    m_accumulator += frameTime > 0.0f ? frameTime : 0.0f;
+
+    PrimitiveTypes::UInt32 substeps = (PrimitiveTypes::UInt32)(m_accumulator / m_step);
+    if (substeps > m_maxSubsteps)
+    {
+        // too far behind (hitch, breakpoint): drop the backlog instead of spiraling
+        substeps = m_maxSubsteps;
+        m_accumulator = m_step * m_maxSubsteps;
+    }
+    m_accumulator -= substeps * m_step;
+
+    m_alpha = m_accumulator / m_step;
+    if (m_alpha > 1.0f)
+        m_alpha = 1.0f;
+    return substeps;
+}
+
+// ParticleBufferCPU implementation
+ParticleBufferCPU::ParticleBufferCPU()
+    : m_posX(NULL), m_posY(NULL), m_posZ(NULL)
+    , m_velX(NULL), m_velY(NULL), m_velZ(NULL)
+    , m_age(NULL), m_duration(NULL)
+    , m_sizeX(NULL), m_sizeY(NULL)
+    , m_phase(NULL)
+    , m_prevX(NULL), m_prevY(NULL), m_prevZ(NULL)
+    , m_size(0), m_capacity(0)
+    , m_pBlock(NULL)
+{
+}
+
+ParticleBufferCPU::~ParticleBufferCPU()
+{
+    ParticleMemoryPool::Instance()->release(m_pBlock);
+}
+
+void ParticleBufferCPU::reset(PrimitiveTypes::UInt32 capacity)
+{
+    const PrimitiveTypes::UInt32 numStreams = 14;
+    PrimitiveTypes::UInt32 padded = (capacity + StreamPadding - 1) & ~(PrimitiveTypes::UInt32)(StreamPadding - 1);
+    if (padded == 0)
+        padded = StreamPadding;
+
+    if (padded != m_capacity)
+    {
+        // one block for all streams; a freed emitter's block is reused from the pool
+        ParticleMemoryPool::Instance()->release(m_pBlock);
+        m_pBlock = ParticleMemoryPool::Instance()->allocate(numStreams * padded * sizeof(PrimitiveTypes::Float32));
+
+        PrimitiveTypes::Float32 *pStream = (PrimitiveTypes::Float32 *)m_pBlock;
+
+        // padded is a multiple of 8 floats, so every stream stays 32-byte aligned
+        m_posX = pStream; pStream += padded;
+        m_posY = pStream; pStream += padded;
+        m_posZ = pStream; pStream += padded;
+        m_velX = pStream; pStream += padded;
+        m_velY = pStream; pStream += padded;
+        m_velZ = pStream; pStream += padded;
+        m_age = pStream; pStream += padded;
+        m_duration = pStream; pStream += padded;
+        m_sizeX = pStream; pStream += padded;
+        m_sizeY = pStream; pStream += padded;
+        m_phase = pStream; pStream += padded;
+        m_prevX = pStream; pStream += padded;
+        m_prevY = pStream; pStream += padded;
+        m_prevZ = pStream; pStream += padded;
+
+        memset(m_pBlock, 0, numStreams * padded * sizeof(PrimitiveTypes::Float32));
+        m_capacity = padded;
+    }
+
+    m_size = 0;
+}
+
+PrimitiveTypes::UInt32 ParticleBufferCPU::add()
+{
+    PEASSERT(m_size < m_capacity, "ParticleBufferCPU overflow");
+    PrimitiveTypes::UInt32 index = m_size++;
+
+    m_posX[index] = m_posY[index] = m_posZ[index] = 0.0f;
+    m_velX[index] = m_velY[index] = m_velZ[index] = 0.0f;
+    m_age[index] = 0.0f;
+    m_duration[index] = 1.0f;
+    m_sizeX[index] = m_sizeY[index] = 0.1f;
+    m_phase[index] = 0.0f;
+    m_prevX[index] = m_prevY[index] = m_prevZ[index] = 0.0f;
+    return index;
+}
+
+PrimitiveTypes::UInt32 ParticleBufferCPU::add(PrimitiveTypes::UInt32 count)
+{
+    PEASSERT(m_size + count <= m_capacity, "ParticleBufferCPU overflow");
+    PrimitiveTypes::UInt32 index = m_size;
+    m_size += count;
+    return index;
+}
+
+void ParticleBufferCPU::kill(PrimitiveTypes::UInt32 index)
+{
+    PEASSERT(index < m_size, "ParticleBufferCPU::kill out of range");
+    PrimitiveTypes::UInt32 last = --m_size;
+    if (index == last)
+        return;
+
+    m_posX[index] = m_posX[last];
+    m_posY[index] = m_posY[last];
+    m_posZ[index] = m_posZ[last];
+    m_velX[index] = m_velX[last];
+    m_velY[index] = m_velY[last];
+    m_velZ[index] = m_velZ[last];
+    m_age[index] = m_age[last];
+    m_duration[index] = m_duration[last];
+    m_sizeX[index] = m_sizeX[last];
+    m_sizeY[index] = m_sizeY[last];
+    m_phase[index] = m_phase[last];
+    m_prevX[index] = m_prevX[last];
+    m_prevY[index] = m_prevY[last];
+    m_prevZ[index] = m_prevZ[last];
+}
+
+// ParticleEmitterCore implementation
+ParticleEmitterCore::ParticleEmitterCore(const Particle &particle)
+    : m_particleTemplate(particle)
+{
+    m_updateMode = ParticleUpdateMode_Jobs;
+    m_updatePending = false;
+    m_pendingExpired = 0;
+    m_pastTime = 0.0f;
+    m_emitAccumulator = 0.0f;
+    m_spawnCount = 0;
+    m_stopped = false;
+    m_pendingSubsteps = 0;
+    m_collidePending = false;
+    m_lodLevel = ParticleLodLevel_Full;
+    m_spawnScale = 1.0f;
+    m_clock.setRate(m_particleTemplate.m_simRate, m_particleTemplate.m_maxSubsteps);
+    m_curves.bake(m_particleTemplate);
+    bindKernels(getKernelFeatures(true));
+
+    // emitters created in the same order replay the same particles
+    static PrimitiveTypes::UInt32 s_emitterCount = 0;
+    m_stats.m_emitterId = s_emitterCount;
+    m_random.seed(m_particleTemplate.m_seed, s_emitterCount++);
+}
+
+void ParticleEmitterCore::start(const Vector3 &origin)
+{
+    m_origin = origin;
+    m_affectors.compile(m_particleTemplate.m_affectors, origin);
+
+    const PrimitiveTypes::Int32 maxParticleSize = (PrimitiveTypes::Int32)(m_particleTemplate.m_duration * m_particleTemplate.m_rate);
+    m_buffer.reset(maxParticleSize);
+
+    int initialParticleCount = m_particleTemplate.m_rate;
+    if (initialParticleCount > maxParticleSize)
+        initialParticleCount = maxParticleSize;
+    PE_PARTICLE_COUNT(m_stats, ParticleCounter_Spawned, initialParticleCount);
+
+    // give random ages so the cloud looks already alive
+    spawnParticles(m_buffer, initialParticleCount, m_particleTemplate.m_duration);
+
+    m_pastTime = 0.0f;
+    m_emitAccumulator = 0.0f;
+    m_stopped = false;
+}
+
+void ParticleEmitterCore::restart(const Vector3 &origin)
+{
+    finishUpdate();
+    m_clock.m_accumulator = 0.0f;
+    m_clock.m_alpha = 0.0f;
+    start(origin);
+    updateBounds();
+}
+
+void ParticleEmitterCore::setTemplate(const Particle &particle)
+{
+    finishUpdate();
+
+    // keep what the mesh was created for
+    Particle updated = particle;
+    updated.m_renderMode = m_particleTemplate.m_renderMode;
+    updated.m_texture = m_particleTemplate.m_texture;
+    m_particleTemplate = updated;
+    m_curves.bake(m_particleTemplate);
+    // a generic binding stays generic
+    if (!(m_kernels.m_features & ParticleKernelFeature_Generic))
+        bindKernels(getKernelFeatures((m_kernels.m_features & ParticleKernelFeature_Color) != 0));
+
+    m_clock.setRate(m_particleTemplate.m_simRate, m_particleTemplate.m_maxSubsteps);
+    // the next setLod() applies its level to the new clock
+    m_lodLevel = ParticleLodLevel_Full;
+    m_spawnScale = 1.0f;
+    restart(m_origin);
+}
+
+static bool isParticleCurveFlat(const PrimitiveTypes::Float32 *pTable)
+{
+    for (int s = 1; s < ParticleCurveTables::TableSize; s++)
+    {
+        if (pTable[s] != pTable[0])
+            return false;
+    }
+    return true;
+}
+
+PrimitiveTypes::UInt32 ParticleEmitterCore::getKernelFeatures(PrimitiveTypes::Bool lifetimeColor) const
+{
+    PrimitiveTypes::UInt32 features = 0;
+    if (m_particleTemplate.m_swirlStrength != 0.0f)
+        features |= ParticleKernelFeature_Swirl;
+    if (!isParticleCurveFlat(m_curves.m_size))
+        features |= ParticleKernelFeature_SizeCurve;
+    if (!isParticleCurveFlat(m_curves.m_speed))
+        features |= ParticleKernelFeature_SpeedCurve;
+    if (m_particleTemplate.m_affectors.hasForces())
+        features |= ParticleKernelFeature_Affectors;
+    if (lifetimeColor)
+        features |= ParticleKernelFeature_Color;
+    if (m_particleTemplate.m_depthSort)
+        features |= ParticleKernelFeature_Sorted;
+    return features;
+}
+
+void ParticleEmitterCore::bindKernels(PrimitiveTypes::UInt32 features)
+{
+    static const ParticleSimdLevel s_level = detectParticleSimdLevel();
+    m_kernels.m_features = features;
+    m_kernels.m_integrate = getParticleIntegrateKernel(s_level, features);
+    m_kernels.m_collide = getParticleCollideKernel(s_level);
+    m_kernels.m_interact = getParticleInteractKernel(s_level);
+    m_kernels.m_writeQuads = getParticleQuadWriter(features);
+    m_kernels.m_writePackedQuads = getParticlePackedQuadWriter(features);
+    m_kernels.m_writePoints = getParticlePointWriter(features);
+}
+
+void ParticleEmitterCore::stop()
+{
+    finishUpdate();
+    m_buffer.m_size = 0;
+    m_clock.m_accumulator = 0.0f;
+    // a looping template would otherwise spawn again on the next update
+    m_stopped = true;
+    updateBounds();
+}
+
+void ParticleEmitterCore::spawnParticles(ParticleBufferCPU &pb, PrimitiveTypes::UInt32 count, PrimitiveTypes::Float32 maxAge)
+{
+    if (count == 0)
+        return;
+    PrimitiveTypes::UInt32 begin = pb.add(count);
+    PrimitiveTypes::UInt32 end = begin + count;
+
+    generateParticleShape(m_particleTemplate, m_origin, m_random, pb, begin, count);
+
+    if (maxAge > 0.0f)
+        m_random.fillRange(pb.m_age + begin, count, 0.0f, maxAge);
+    else
+        memset(pb.m_age + begin, 0, count * sizeof(PrimitiveTypes::Float32));
+
+    // shapes write unit headings; the velocity is in world units per second
+    const float speed = m_particleTemplate.m_speed * s_moveScale;
+    const float sizeX = m_particleTemplate.m_size.m_x * m_curves.m_size[0];
+    const float sizeY = m_particleTemplate.m_size.m_y * m_curves.m_size[0];
+    const float duration = m_particleTemplate.m_duration;
+    for (PrimitiveTypes::UInt32 j = begin; j < end; j++)
+    {
+        pb.m_velX[j] *= speed;
+        pb.m_velY[j] *= speed;
+        pb.m_velZ[j] *= speed;
+        pb.m_sizeX[j] = sizeX;
+        pb.m_sizeY[j] = sizeY;
+        pb.m_duration[j] = duration;
+    }
+
+    // every spawn gets its own swirl phase so particles don't move in lockstep;
+    // kept in [0, 2pi) since it no longer follows the slot index
+    const float twoPi = 2.0f * PrimitiveTypes::Constants::c_Pi_F32;
+    float phase = fmodf(m_spawnCount * 0.37f, twoPi);
+    for (PrimitiveTypes::UInt32 j = begin; j < end; j++)
+    {
+        pb.m_phase[j] = phase;
+        phase += 0.37f;
+        phase = phase < twoPi ? phase : phase - twoPi;
+    }
+    m_spawnCount += count;
+}
+
+
+void ParticleEmitterCore::updateParticleBuffer(PrimitiveTypes::Float32 time)
+{
+    beginUpdate(time);
+    finishUpdate();
+}
+
+void ParticleEmitterCore::beginUpdate(PrimitiveTypes::Float32 time)
+{
+    if (m_updatePending)
+        finishUpdate();
+
+    static int callCount = 0;
+    if (callCount % 60 == 0)
+    {
+        PE_PARTICLE_LOG("updateParticleBuffer called, time=%.4f, call#%d\n", time, callCount);
+    }
+    callCount++;
+
+    if (m_buffer.m_capacity == 0)
+    {
+        const PrimitiveTypes::Int32 maxParticleSize = m_particleTemplate.m_duration * m_particleTemplate.m_rate;
+        m_buffer.reset(maxParticleSize);
+    }
+
+    m_pastTime += time;
+
+    // a finished burst costs nothing
+    if (isFinished())
+        return;
+
+    m_pendingSubsteps = m_clock.advance(time);
+    if (m_pendingSubsteps == 0)
+        return;
+
+    // the whole emitter step is one job; large emitters fan their integration out into
+    // chunk jobs from inside it, so many small emitters and one huge one both spread
+    m_updatePending = true;
+    if (m_updateMode == ParticleUpdateMode_Jobs)
+    {
+        ParticleJob job;
+        job.m_pFunc = &ParticleEmitterCore::substepJob;
+        job.m_pData = this;
+        job.m_begin = 0;
+        job.m_end = m_pendingSubsteps;
+        job.m_pCounter = &m_pendingJobs;
+        ParticleJobPool::Instance()->submit(job);
+    }
+    else
+    {
+        substepJob(this, 0, m_pendingSubsteps);
+    }
+}
+
+void ParticleEmitterCore::finishUpdate()
+{
+    if (!m_updatePending)
+        return;
+
+    ParticleJobPool::Instance()->wait(m_pendingJobs);
+    m_updatePending = false;
+}
+
+bool ParticleEmitterCore::pollUpdate()
+{
+    if (m_updatePending && m_pendingJobs.m_pending.load(std::memory_order_acquire) == 0)
+        finishUpdate();
+    return !m_updatePending;
+}
+
+void ParticleEmitterCore::substepJob(void *pData, PrimitiveTypes::UInt32 begin, PrimitiveTypes::UInt32 end)
+{
+    ParticleEmitterCore *pSelf = (ParticleEmitterCore *)pData;
+    PE_PARTICLE_SCOPED_TIMER(pSelf->m_stats, ParticleTimer_Update);
+    for (PrimitiveTypes::UInt32 i = begin; i < end; i++)
+        pSelf->step(pSelf->m_clock.m_step);
+
+    // once per frame is enough for culling
+    pSelf->updateBounds();
+}
+
+void ParticleEmitterCore::step(PrimitiveTypes::Float32 time)
+{
+    ParticleBufferCPU &pb = m_buffer;
+
+    ParticleIntegrateParams &params = m_pendingParams;
+    params.m_dt = time;
+
+    // forces, applied by the kernels in the same pass
+    m_affectors.prepare(time);
+    params.m_pAffectors = m_affectors.m_active ? &m_affectors : NULL;
+
+    // swirl
+    params.m_swirlScale = m_particleTemplate.m_swirlStrength * time * s_moveScale;
+    params.m_swirlSpeed = m_particleTemplate.m_swirlSpeed;
+
+    // size and speed over lifetime, the size pulse is baked into the size curve
+    params.m_baseSizeX = m_particleTemplate.m_size.m_x;
+    params.m_baseSizeY = m_particleTemplate.m_size.m_y;
+    params.m_pSizeCurve = m_curves.m_size;
+    params.m_pSpeedCurve = m_curves.m_speed;
+
+    // collisions, tested right after the integration of each chunk
+    const ParticleColliderSet *pColliders = m_particleTemplate.m_pColliders;
+    m_collidePending = false;
+    if (pColliders)
+    {
+        const ParticleHeightfield *pHeightfield = pColliders->m_pHeightfield;
+        if (pHeightfield && (pHeightfield->m_columns < 2 || pHeightfield->m_rows < 2))
+            pHeightfield = NULL;
+        m_pendingCollide.m_pPlanes = pColliders->m_planes;
+        m_pendingCollide.m_planeCount = pColliders->m_planeCount;
+        m_pendingCollide.m_pHeightfield = pHeightfield;
+        m_pendingCollide.m_response = m_particleTemplate.m_collision;
+        m_pendingCollide.m_bounce = m_particleTemplate.m_bounce;
+        m_pendingCollide.m_friction = m_particleTemplate.m_friction;
+        m_collidePending = pColliders->m_planeCount > 0 || pHeightfield;
+    }
+
+    // particle-particle forces from where everyone is at the start of the step. jobs take
+    // runs of grid cells and each particle reads its neighbors from the grid's copies, so
+    // this does not depend on the workers either
+    if (m_affectors.m_interactionRadius > 0.0f && pb.m_size > 1)
+    {
+        m_pendingInteract.m_dt = time;
+        m_pendingInteract.m_radius = m_affectors.m_interactionRadius;
+        m_pendingInteract.m_separation = m_affectors.m_separation;
+        m_pendingInteract.m_cohesion = m_affectors.m_cohesion;
+        m_pendingInteract.m_alignment = m_affectors.m_alignment;
+        m_neighbors.build(pb, m_affectors.m_interactionRadius);
+        if (m_updateMode == ParticleUpdateMode_Jobs && pb.m_size > InteractChunkSize)
+        {
+            ParticleJobCounter chunks;
+            ParticleJobPool::Instance()->submitRange(&ParticleEmitterCore::interactChunk, this,
+                0, pb.m_size, InteractChunkSize, chunks);
+            ParticleJobPool::Instance()->wait(chunks);
+        }
+        else
+        {
+            interactChunk(this, 0, pb.m_size);
+        }
+    }
+
+    // update current particles. chunks write disjoint ranges and only the expired count
+    // is shared, so the result does not depend on how the chunks land on workers
+    m_pendingExpired = 0;
+    if (m_updateMode == ParticleUpdateMode_Jobs && pb.m_size > UpdateChunkSize)
+    {
+        ParticleJobCounter chunks;
+        ParticleJobPool::Instance()->submitRange(&ParticleEmitterCore::integrateChunk, this,
+            0, pb.m_size, UpdateChunkSize, chunks);
+        ParticleJobPool::Instance()->wait(chunks);
+    }
+    else
+    {
+        integrateChunk(this, 0, pb.m_size);
+    }
+
+    // drop the ones that ran out of life by swapping the last live particle into their
+    // slot; this and the spawning below stay serial so the slot order and the
+    // emitter's random sequence do not depend on the workers
+    PrimitiveTypes::UInt32 expired = m_pendingExpired;
+    PE_PARTICLE_COUNT(m_stats, ParticleCounter_Simulated, pb.m_size);
+    PE_PARTICLE_COUNT(m_stats, ParticleCounter_Killed, expired);
+    for (PrimitiveTypes::UInt32 j = 0; expired > 0 && j < pb.m_size;)
+    {
+        if (pb.m_age[j] >= pb.m_duration[j])
+        {
+            pb.kill(j);
+            expired--;
+        }
+        else
+        {
+            j++;
+        }
+    }
+
+    // looping emitters keep emitting at m_rate into the freed capacity
+    if (m_particleTemplate.m_looping)
+    {
+        m_emitAccumulator += time * m_particleTemplate.m_rate * m_spawnScale;
+        int partCount = (int)m_emitAccumulator;
+        m_emitAccumulator -= partCount;
+
+        int freeSlots = (int)(m_particleTemplate.m_duration * m_particleTemplate.m_rate) - (int)pb.m_size;
+        if (partCount > freeSlots)
+            partCount = freeSlots > 0 ? freeSlots : 0;
+
+        spawnParticles(pb, partCount, 0.0f);
+        PE_PARTICLE_COUNT(m_stats, ParticleCounter_Spawned, partCount);
+    }
+}
+
+void ParticleEmitterCore::integrateChunk(void *pData, PrimitiveTypes::UInt32 begin, PrimitiveTypes::UInt32 end)
+{
+    ParticleEmitterCore *pSelf = (ParticleEmitterCore *)pData;
+    ParticleBufferCPU &pb = pSelf->m_buffer;
+
+    PrimitiveTypes::UInt32 expired = pSelf->m_kernels.m_integrate(pb, begin, end, pSelf->m_pendingParams);
+    // while the chunk is still in cache; Kill hands its victims to the expired tail
+    if (pSelf->m_collidePending)
+        expired += pSelf->m_kernels.m_collide(pb, begin, end, pSelf->m_pendingCollide);
+    pSelf->m_pendingExpired += expired;
+}
+
+void ParticleEmitterCore::interactChunk(void *pData, PrimitiveTypes::UInt32 begin, PrimitiveTypes::UInt32 end)
+{
+    ParticleEmitterCore *pSelf = (ParticleEmitterCore *)pData;
+    pSelf->m_kernels.m_interact(pSelf->m_buffer, pSelf->m_neighbors, begin, end, pSelf->m_pendingInteract);
+}
+
+void ParticleEmitterCore::updateBounds()
+{
+    const ParticleBufferCPU &pb = m_buffer;
+    if (pb.m_size == 0)
+    {
+        m_bounds.m_valid = false;
+        return;
+    }
+
+    float minX = pb.m_posX[0], minY = pb.m_posY[0], minZ = pb.m_posZ[0];
+    float maxX = minX, maxY = minY, maxZ = minZ;
+    for (PrimitiveTypes::UInt32 i = 1; i < pb.m_size; i++)
+    {
+        minX = pb.m_posX[i] < minX ? pb.m_posX[i] : minX;
+        minY = pb.m_posY[i] < minY ? pb.m_posY[i] : minY;
+        minZ = pb.m_posZ[i] < minZ ? pb.m_posZ[i] : minZ;
+        maxX = pb.m_posX[i] > maxX ? pb.m_posX[i] : maxX;
+        maxY = pb.m_posY[i] > maxY ? pb.m_posY[i] : maxY;
+        maxZ = pb.m_posZ[i] > maxZ ? pb.m_posZ[i] : maxZ;
+    }
+
+    // quads reach half their (slightly pulsing) size past the centers in any direction
+    float pad = (m_particleTemplate.m_size.m_x > m_particleTemplate.m_size.m_y
+        ? m_particleTemplate.m_size.m_x : m_particleTemplate.m_size.m_y) * m_curves.m_maxSize * 0.75f;
+
+    m_bounds.m_min = Vector3(minX - pad, minY - pad, minZ - pad);
+    m_bounds.m_max = Vector3(maxX + pad, maxY + pad, maxZ + pad);
+    m_bounds.m_valid = true;
+}
+
+void ParticleEmitterCore::setLod(ParticleLodLevel level, const ParticleLodPolicy &policy)
+{
+    if (level == m_lodLevel)
+        return;
+
+    m_lodLevel = level;
+    switch (level)
+    {
+    case ParticleLodLevel_Reduced:
+        m_spawnScale = policy.m_reducedSpawnScale;
+        m_clock.setStepDivisor(policy.m_reducedTickDivisor);
+        break;
+    case ParticleLodLevel_Culled:
+        m_spawnScale = policy.m_culledSpawnScale;
+        m_clock.setStepDivisor(policy.m_culledTickDivisor);
+        break;
+    default:
+        m_spawnScale = 1.0f;
+        m_clock.setStepDivisor(1);
+        break;
+    }
+}
+
+bool ParticleEmitterCore::isFinished()
+{
+    if (m_stopped)
+        return true;
+    if (m_particleTemplate.m_looping || m_buffer.m_capacity == 0)
+        return false;
+    return m_buffer.m_size == 0;
+}
+
+bool ParticleCameraSnapshot::isSphereVisible(const Vector3 &center, PrimitiveTypes::Float32 radius) const
+{
+    if (m_tanHalfFovY <= 0.0f)
+        return true;
+
+    // sphere center in camera space
+    Vector3 d = center - m_position;
+    float x = d.m_x * m_right.m_x + d.m_y * m_right.m_y + d.m_z * m_right.m_z;
+    float y = d.m_x * m_up.m_x + d.m_y * m_up.m_y + d.m_z * m_up.m_z;
+    float z = d.m_x * m_front.m_x + d.m_y * m_front.m_y + d.m_z * m_front.m_z;
+
+    if (z + radius < m_near || z - radius > m_far)
+        return false;
+
+    // side planes through the eye: |y| <= z * tan is inside, the distance to the plane
+    // is (|y| - z * tan) / sqrt(1 + tan^2)
+    float tanY = m_tanHalfFovY;
+    float tanX = m_tanHalfFovY * m_aspect;
+    if (fabsf(y) - z * tanY > radius * sqrtf(1.0f + tanY * tanY))
+        return false;
+    if (fabsf(x) - z * tanX > radius * sqrtf(1.0f + tanX * tanX))
+        return false;
+    return true;
+}
+
+ParticleLodLevel selectParticleLod(const ParticleLodPolicy &policy, const ParticleBounds &bounds,
+    const ParticleCameraSnapshot *pViews, PrimitiveTypes::UInt32 viewCount)
+{
+    if (!policy.m_enabled)
+        return ParticleLodLevel_Full;
+    if (!bounds.m_valid)
+        return ParticleLodLevel_Culled;
+
+    Vector3 center = bounds.getCenter();
+    float radius = bounds.getRadius();
+
+    ParticleLodLevel best = ParticleLodLevel_Culled;
+    for (PrimitiveTypes::UInt32 v = 0; v < viewCount && best != ParticleLodLevel_Full; v++)
+    {
+        if (!pViews[v].isSphereVisible(center, radius))
+            continue;
+
+        float distance = (center - pViews[v].m_position).length() - radius;
+        best = distance > policy.m_reducedDistance ? ParticleLodLevel_Reduced : ParticleLodLevel_Full;
+    }
+    return best;
+}
+
+// ParticleDepthSorter implementation
+ParticleDepthSorter::ParticleDepthSorter()
+    : m_count(0)
+    , m_refineSkip(0)
+    , m_refineBackoff(1)
+    , m_radixSorts(0)
+    , m_incrementalSorts(0)
+{
+}
+
+// float bits mapped so unsigned order is descending depth (farthest first)
+static inline PrimitiveTypes::UInt32 particleDepthKey(float depth)
+{
+    PrimitiveTypes::UInt32 bits;
+    memcpy(&bits, &depth, sizeof(bits));
+    bits ^= (bits & 0x80000000u) ? 0xFFFFFFFFu : 0x80000000u; // ascending depth
+    return ~bits;
+}
+
+const PrimitiveTypes::UInt32 *ParticleDepthSorter::sort(const ParticleBufferCPU &pb, PrimitiveTypes::UInt32 count,
+    const ParticleCameraSnapshot &view)
+{
+    if (count == 0)
+    {
+        m_count = 0;
+        return NULL;
+    }
+
+    if (m_order.size() < count)
+    {
+        // grow to the buffer's capacity once, not per frame
+        PrimitiveTypes::UInt32 capacity = pb.m_capacity > count ? pb.m_capacity : count;
+        m_order.resize(capacity);
+        m_keys.resize(capacity);
+        m_orderKeys.resize(capacity);
+        m_scratchOrder.resize(capacity);
+        m_scratchKeys.resize(capacity);
+    }
+
+    const float fx = view.m_front.m_x, fy = view.m_front.m_y, fz = view.m_front.m_z;
+    for (PrimitiveTypes::UInt32 i = 0; i < count; i++)
+        m_keys[i] = particleDepthKey(pb.m_posX[i] * fx + pb.m_posY[i] * fy + pb.m_posZ[i] * fz);
+
+    if (m_count == 0 || m_refineSkip > 0)
+    {
+        // nothing to start from, or reusing the order did not pay off recently
+        if (m_refineSkip > 0)
+            m_refineSkip--;
+        m_count = count;
+        radixSort(count);
+        m_radixSorts++;
+        return &m_order[0];
+    }
+
+    // last frame's order, minus slots that are gone, plus the slots spawned since;
+    // kill() moves particles between slots, so this is only a guess for the fix-up
+    PrimitiveTypes::UInt32 kept = 0;
+    for (PrimitiveTypes::UInt32 k = 0; k < m_count; k++)
+    {
+        if (m_order[k] < count)
+            m_order[kept++] = m_order[k];
+    }
+    for (PrimitiveTypes::UInt32 i = m_count; i < count; i++)
+        m_order[kept++] = i;
+    m_count = count;
+
+    PrimitiveTypes::Bool cheap = false;
+    if (refineOrder(count, cheap))
+        m_incrementalSorts++;
+    else
+    {
+        radixSort(count);
+        m_radixSorts++;
+    }
+
+    // particles that keep reordering (dense swirling clouds) make the refine cost more
+    // than the radix sort; back off for a growing number of frames before trying again
+    if (cheap)
+        m_refineBackoff = 1;
+    else
+    {
+        m_refineSkip = m_refineBackoff;
+        if (m_refineBackoff < MaxRefineBackoff)
+            m_refineBackoff *= 2;
+    }
+    return &m_order[0];
+}
+
+// LSD radix sort of (key, index) pairs, 4 passes of 8 bits; ping-pongs between the
+// given arrays and returns the one holding the sorted indices (keys next to it in *pSortedKeys)
+static PrimitiveTypes::UInt32 *radixSortPairs(PrimitiveTypes::UInt32 *keys, PrimitiveTypes::UInt32 *order,
+    PrimitiveTypes::UInt32 *tmpKeys, PrimitiveTypes::UInt32 *tmpOrder, PrimitiveTypes::UInt32 count,
+    PrimitiveTypes::UInt32 **pSortedKeys)
+{
+    PrimitiveTypes::UInt32 histograms[4][256];
+    memset(histograms, 0, sizeof(histograms));
+    for (PrimitiveTypes::UInt32 i = 0; i < count; i++)
+    {
+        PrimitiveTypes::UInt32 key = keys[i];
+        histograms[0][key & 0xFF]++;
+        histograms[1][(key >> 8) & 0xFF]++;
+        histograms[2][(key >> 16) & 0xFF]++;
+        histograms[3][key >> 24]++;
+    }
+
+    for (int pass = 0; pass < 4; pass++)
+    {
+        PrimitiveTypes::UInt32 shift = pass * 8;
+        PrimitiveTypes::UInt32 *histogram = histograms[pass];
+
+        // all keys share this digit: the pass would not move anything
+        if (histogram[(keys[0] >> shift) & 0xFF] == count)
+            continue;
+
+        PrimitiveTypes::UInt32 offset = 0;
+        for (int d = 0; d < 256; d++)
+        {
+            PrimitiveTypes::UInt32 n = histogram[d];
+            histogram[d] = offset;
+            offset += n;
+        }
+
+        for (PrimitiveTypes::UInt32 i = 0; i < count; i++)
+        {
+            PrimitiveTypes::UInt32 key = keys[i];
+            PrimitiveTypes::UInt32 slot = histogram[(key >> shift) & 0xFF]++;
+            tmpKeys[slot] = key;
+            tmpOrder[slot] = order[i];
+        }
+
+        PrimitiveTypes::UInt32 *t = keys; keys = tmpKeys; tmpKeys = t;
+        t = order; order = tmpOrder; tmpOrder = t;
+    }
+
+    *pSortedKeys = keys;
+    return order;
+}
+
+bool ParticleDepthSorter::refineOrder(PrimitiveTypes::UInt32 count, PrimitiveTypes::Bool &cheap)
+{
+    // insertion sort of the previous order where no particle may move further than
+    // MaxShift places; particles that would (respawned, or swapped into another slot)
+    // are set aside. Keys travel next to the indices so the scan reads memory in order
+    const PrimitiveTypes::UInt32 MaxShift = 16;
+    PrimitiveTypes::UInt32 *order = &m_order[0];
+    PrimitiveTypes::UInt32 *orderKeys = &m_orderKeys[0];
+    PrimitiveTypes::UInt32 *outliers = &m_scratchOrder[0];
+    PrimitiveTypes::UInt32 *outlierKeys = &m_scratchKeys[0];
+    PrimitiveTypes::UInt32 maxOutliers = count / 8;
+    PrimitiveTypes::UInt32 kept = 0;
+    PrimitiveTypes::UInt32 outlierCount = 0;
+    PrimitiveTypes::UInt32 shifts = 0;
+    cheap = false;
+
+    for (PrimitiveTypes::UInt32 k = 0; k < count; k++)
+    {
+        PrimitiveTypes::UInt32 index = order[k];
+        PrimitiveTypes::UInt32 key = m_keys[index];
+        PrimitiveTypes::UInt32 j = kept;
+        while (j > 0 && orderKeys[j - 1] > key && kept - j < MaxShift)
+            j--;
+        shifts += kept - j;
+
+        if (j > 0 && orderKeys[j - 1] > key)
+        {
+            // too many changed: one full sort is cheaper than sorting and merging them
+            if (outlierCount == maxOutliers)
+                return false;
+            outliers[outlierCount] = index;
+            outlierKeys[outlierCount] = key;
+            outlierCount++;
+            continue;
+        }
+
+        // kept <= k, so this never overwrites entries not read yet
+        for (PrimitiveTypes::UInt32 m = kept; m > j; m--)
+        {
+            order[m] = order[m - 1];
+            orderKeys[m] = orderKeys[m - 1];
+        }
+        order[j] = index;
+        orderKeys[j] = key;
+        kept++;
+    }
+
+    // rough cost against the ~8 touches per particle of a full radix sort
+    cheap = shifts + outlierCount * 8 < count * 2;
+    if (outlierCount == 0)
+        return true;
+
+    // the outliers are at most an eighth of the particles, so the scratch arrays
+    // have room behind them for the radix ping-pong
+    PrimitiveTypes::UInt32 *sortedKeys;
+    PrimitiveTypes::UInt32 *sorted = radixSortPairs(outlierKeys, outliers,
+        outlierKeys + outlierCount, outliers + outlierCount, outlierCount, &sortedKeys);
+
+    // merge from the back into the free tail of m_order
+    PrimitiveTypes::Int32 a = (PrimitiveTypes::Int32)kept - 1;
+    PrimitiveTypes::Int32 b = (PrimitiveTypes::Int32)outlierCount - 1;
+    PrimitiveTypes::Int32 dst = (PrimitiveTypes::Int32)count - 1;
+    while (b >= 0)
+    {
+        if (a >= 0 && orderKeys[a] > sortedKeys[b])
+        {
+            orderKeys[dst] = orderKeys[a];
+            order[dst--] = order[a--];
+        }
+        else
+        {
+            orderKeys[dst] = sortedKeys[b];
+            order[dst--] = sorted[b--];
+        }
+    }
+    return true;
+}
+
+void ParticleDepthSorter::radixSort(PrimitiveTypes::UInt32 count)
+{
+    // starts from slot order; clobbers m_keys as the second key buffer
+    memcpy(&m_scratchKeys[0], &m_keys[0], count * sizeof(PrimitiveTypes::UInt32));
+    for (PrimitiveTypes::UInt32 i = 0; i < count; i++)
+        m_scratchOrder[i] = i;
+
+    PrimitiveTypes::UInt32 *sortedKeys;
+    PrimitiveTypes::UInt32 *sorted = radixSortPairs(&m_scratchKeys[0], &m_scratchOrder[0],
+        &m_keys[0], &m_order[0], count, &sortedKeys);
+    if (sorted != &m_order[0])
+        memcpy(&m_order[0], sorted, count * sizeof(PrimitiveTypes::UInt32));
+}
+
+template <PrimitiveTypes::UInt32 Features>
+static void writeParticleQuadsT(const ParticleBufferCPU &pb, PrimitiveTypes::UInt32 count, const PrimitiveTypes::UInt32 *pOrder,
+    const ParticleCameraSnapshot &view, PrimitiveTypes::Float32 alpha, const ParticleCurveTables &curves,
+    PrimitiveTypes::Float32 *pPositions, PrimitiveTypes::Float32 *pColors)
+{
+    const bool color = particleKernelDoes<Features>(ParticleKernelFeature_Color, pColors != NULL);
+    const bool sorted = particleKernelDoes<Features>(ParticleKernelFeature_Sorted, pOrder != NULL);
+
+    // let particles face the camera
+    const Vector3 right = view.m_right;
+    const Vector3 up = view.m_up;
+
+    for (PrimitiveTypes::UInt32 q = 0; q < count; q++)
+    {
+        PrimitiveTypes::UInt32 i = sorted ? pOrder[q] : q;
+
+        // render between the last two simulated states
+        float cx = pb.m_prevX[i] + (pb.m_posX[i] - pb.m_prevX[i]) * alpha;
+        float cy = pb.m_prevY[i] + (pb.m_posY[i] - pb.m_prevY[i]) * alpha;
+        float cz = pb.m_prevZ[i] + (pb.m_posZ[i] - pb.m_prevZ[i]) * alpha;
+        float hx = pb.m_sizeX[i] / 2.f;
+        float hy = pb.m_sizeY[i] / 2.f;
+
+        // corner offsets along the camera basis
+        float rx = right.m_x * hx, ry = right.m_y * hx, rz = right.m_z * hx;
+        float ux = up.m_x * hy, uy = up.m_y * hy, uz = up.m_z * hy;
+
+        PrimitiveTypes::Float32 *v = pPositions + q * 12;
+        v[0] = cx - rx + ux; v[1] = cy - ry + uy; v[2] = cz - rz + uz;   // top left
+        v[3] = cx + rx + ux; v[4] = cy + ry + uy; v[5] = cz + rz + uz;   // top right
+        v[6] = cx + rx - ux; v[7] = cy + ry - uy; v[8] = cz + rz - uz;   // bottom right
+        v[9] = cx - rx - ux; v[10] = cy - ry - uy; v[11] = cz - rz - uz; // bottom left
+
+        if (color)
+        {
+            PrimitiveTypes::Int32 sample;
+            float fraction;
+            locateParticleCurveSample(pb.m_age[i] / pb.m_duration[i], sample, fraction);
+
+            float r = sampleParticleCurve(curves.m_red, sample, fraction);
+            float g = sampleParticleCurve(curves.m_green, sample, fraction);
+            float b = sampleParticleCurve(curves.m_blue, sample, fraction);
+
+            PrimitiveTypes::Float32 *c = pColors + q * 12;
+            c[0] = r; c[1] = g; c[2] = b;
+            c[3] = r; c[4] = g; c[5] = b;
+            c[6] = r; c[7] = g; c[8] = b;
+            c[9] = r; c[10] = g; c[11] = b;
+        }
+    }
+}
+
+void writeParticleQuads(const ParticleBufferCPU &pb, PrimitiveTypes::UInt32 count, const PrimitiveTypes::UInt32 *pOrder,
+    const ParticleCameraSnapshot &view, PrimitiveTypes::Float32 alpha, const ParticleCurveTables &curves,
+    PrimitiveTypes::Float32 *pPositions, PrimitiveTypes::Float32 *pColors)
+{
+    writeParticleQuadsT<ParticleKernelFeature_Generic>(pb, count, pOrder, view, alpha, curves, pPositions, pColors);
+}
+
+static inline PrimitiveTypes::UInt32 packParticleChannel(float value)
+{
+    if (value < 0.0f) value = 0.0f;
+    if (value > 1.0f) value = 1.0f;
+    return (PrimitiveTypes::UInt32)(value * 255.0f + 0.5f);
+}
+
+template <PrimitiveTypes::UInt32 Features>
+static void writeParticlePackedQuadsT(const ParticleBufferCPU &pb, PrimitiveTypes::UInt32 count, const PrimitiveTypes::UInt32 *pOrder,
+    const ParticleCameraSnapshot &view, PrimitiveTypes::Float32 alpha, const ParticleCurveTables &curves, PrimitiveTypes::Bool lifetimeColor,
+    const Vector3 &origin, ParticlePackedVertex *pVertices)
+{
+    const bool color = particleKernelDoes<Features>(ParticleKernelFeature_Color, lifetimeColor);
+    const bool sorted = particleKernelDoes<Features>(ParticleKernelFeature_Sorted, pOrder != NULL);
+
+    const Vector3 right = view.m_right;
+    const Vector3 up = view.m_up;
+    const float k = (float)ParticlePackedStepsPerUnit;
+    const ParticleQuantizeKernel quantize = getParticleQuantizeKernel();
+
+    // without lifetime color every vertex gets the same packed color
+    const PrimitiveTypes::UInt32 baseColor = packParticleChannel(curves.m_baseColor.m_x)
+        | (packParticleChannel(curves.m_baseColor.m_y) << 8)
+        | (packParticleChannel(curves.m_baseColor.m_z) << 16)
+        | (255u << 24);
+
+    // corners go out in blocks: float steps first, then one quantize call per block
+    enum { BlockQuads = 64 };
+    PrimitiveTypes::Float32 steps[BlockQuads * 12];
+    PrimitiveTypes::Int16 coords[BlockQuads * 12];
+    PrimitiveTypes::UInt32 colors[BlockQuads];
+
+    for (PrimitiveTypes::UInt32 first = 0; first < count; first += BlockQuads)
+    {
+        PrimitiveTypes::UInt32 blockCount = count - first < (PrimitiveTypes::UInt32)BlockQuads ? count - first : (PrimitiveTypes::UInt32)BlockQuads;
+
+        for (PrimitiveTypes::UInt32 b = 0; b < blockCount; b++)
+        {
+            PrimitiveTypes::UInt32 i = sorted ? pOrder[first + b] : first + b;
+
+            // relative to the origin, in steps
+            float cx = (pb.m_prevX[i] + (pb.m_posX[i] - pb.m_prevX[i]) * alpha - origin.m_x) * k;
+            float cy = (pb.m_prevY[i] + (pb.m_posY[i] - pb.m_prevY[i]) * alpha - origin.m_y) * k;
+            float cz = (pb.m_prevZ[i] + (pb.m_posZ[i] - pb.m_prevZ[i]) * alpha - origin.m_z) * k;
+            float hx = pb.m_sizeX[i] * (0.5f * k);
+            float hy = pb.m_sizeY[i] * (0.5f * k);
+
+            float rx = right.m_x * hx, ry = right.m_y * hx, rz = right.m_z * hx;
+            float ux = up.m_x * hy, uy = up.m_y * hy, uz = up.m_z * hy;
+
+            float *v = steps + b * 12;
+            v[0] = cx - rx + ux; v[1] = cy - ry + uy; v[2] = cz - rz + uz;   // top left
+            v[3] = cx + rx + ux; v[4] = cy + ry + uy; v[5] = cz + rz + uz;   // top right
+            v[6] = cx + rx - ux; v[7] = cy + ry - uy; v[8] = cz + rz - uz;   // bottom right
+            v[9] = cx - rx - ux; v[10] = cy - ry - uy; v[11] = cz - rz - uz; // bottom left
+
+            if (color)
+            {
+                PrimitiveTypes::Int32 sample;
+                float fraction;
+                locateParticleCurveSample(pb.m_age[i] / pb.m_duration[i], sample, fraction);
+                colors[b] = packParticleChannel(sampleParticleCurve(curves.m_red, sample, fraction))
+                    | (packParticleChannel(sampleParticleCurve(curves.m_green, sample, fraction)) << 8)
+                    | (packParticleChannel(sampleParticleCurve(curves.m_blue, sample, fraction)) << 16)
+                    | (255u << 24);
+            }
+            else
+            {
+                colors[b] = baseColor;
+            }
+        }
+
+        quantize(steps, coords, blockCount * 12);
+
+        // whole 32-bit words, so no partial stores into the vertex
+        for (PrimitiveTypes::UInt32 b = 0; b < blockCount; b++)
+        {
+            const PrimitiveTypes::Int16 *c = coords + b * 12;
+            PrimitiveTypes::UInt32 *w = reinterpret_cast<PrimitiveTypes::UInt32 *>(pVertices + (first + b) * 4);
+            for (int corner = 0; corner < 4; corner++)
+            {
+                w[corner * 3 + 0] = (PrimitiveTypes::UInt16)c[corner * 3 + 0] | ((PrimitiveTypes::UInt32)(PrimitiveTypes::UInt16)c[corner * 3 + 1] << 16);
+                w[corner * 3 + 1] = (PrimitiveTypes::UInt16)c[corner * 3 + 2] | ((PrimitiveTypes::UInt32)corner << 16);
+                w[corner * 3 + 2] = colors[b];
+            }
+        }
+    }
+}
+
+void writeParticlePackedQuads(const ParticleBufferCPU &pb, PrimitiveTypes::UInt32 count, const PrimitiveTypes::UInt32 *pOrder,
+    const ParticleCameraSnapshot &view, PrimitiveTypes::Float32 alpha, const ParticleCurveTables &curves, PrimitiveTypes::Bool lifetimeColor,
+    const Vector3 &origin, ParticlePackedVertex *pVertices)
+{
+    writeParticlePackedQuadsT<ParticleKernelFeature_Generic>(pb, count, pOrder, view, alpha, curves, lifetimeColor, origin, pVertices);
+}
+
+template <PrimitiveTypes::UInt32 Features>
+static void writeParticlePointsT(const ParticleBufferCPU &pb, PrimitiveTypes::UInt32 count, const PrimitiveTypes::UInt32 *pOrder,
+    PrimitiveTypes::Float32 alpha, const ParticleCurveTables &curves, PrimitiveTypes::Bool lifetimeColor,
+    PrimitiveTypes::Float32 *pPositions, PrimitiveTypes::Float32 *pColors, PrimitiveTypes::Float32 *pSizes)
+{
+    const bool color = particleKernelDoes<Features>(ParticleKernelFeature_Color, lifetimeColor);
+    const bool sorted = particleKernelDoes<Features>(ParticleKernelFeature_Sorted, pOrder != NULL);
+
+    for (PrimitiveTypes::UInt32 q = 0; q < count; q++)
+    {
+        PrimitiveTypes::UInt32 i = sorted ? pOrder[q] : q;
+
+        pPositions[q * 3 + 0] = pb.m_prevX[i] + (pb.m_posX[i] - pb.m_prevX[i]) * alpha;
+        pPositions[q * 3 + 1] = pb.m_prevY[i] + (pb.m_posY[i] - pb.m_prevY[i]) * alpha;
+        pPositions[q * 3 + 2] = pb.m_prevZ[i] + (pb.m_posZ[i] - pb.m_prevZ[i]) * alpha;
+
+        pSizes[q * 2 + 0] = pb.m_sizeX[i];
+        pSizes[q * 2 + 1] = pb.m_sizeY[i];
+
+        if (color)
+        {
+            PrimitiveTypes::Int32 sample;
+            float fraction;
+            locateParticleCurveSample(pb.m_age[i] / pb.m_duration[i], sample, fraction);
+            pColors[q * 3 + 0] = sampleParticleCurve(curves.m_red, sample, fraction);
+            pColors[q * 3 + 1] = sampleParticleCurve(curves.m_green, sample, fraction);
+            pColors[q * 3 + 2] = sampleParticleCurve(curves.m_blue, sample, fraction);
+        }
+        else
+        {
+            pColors[q * 3 + 0] = curves.m_baseColor.m_x;
+            pColors[q * 3 + 1] = curves.m_baseColor.m_y;
+            pColors[q * 3 + 2] = curves.m_baseColor.m_z;
+        }
+    }
+}
+
+void writeParticlePoints(const ParticleBufferCPU &pb, PrimitiveTypes::UInt32 count, const PrimitiveTypes::UInt32 *pOrder,
+    PrimitiveTypes::Float32 alpha, const ParticleCurveTables &curves, PrimitiveTypes::Bool lifetimeColor,
+    PrimitiveTypes::Float32 *pPositions, PrimitiveTypes::Float32 *pColors, PrimitiveTypes::Float32 *pSizes)
+{
+    writeParticlePointsT<ParticleKernelFeature_Generic>(pb, count, pOrder, alpha, curves, lifetimeColor, pPositions, pColors, pSizes);
+}
+
+// the four combinations of the build features, indexed by (features & ParticleBuildFeatures) >> 4
+#define PE_PARTICLE_BUILD_VARIANTS(writer) \
+    { &writer<0>, &writer<ParticleKernelFeature_Color>, &writer<ParticleKernelFeature_Sorted>, \
+      &writer<ParticleKernelFeature_Color | ParticleKernelFeature_Sorted> }
+
+static PrimitiveTypes::UInt32 particleBuildVariant(PrimitiveTypes::UInt32 features)
+{
+    return (features & ParticleBuildFeatures) / ParticleKernelFeature_Color;
+}
+
+ParticleQuadWriter getParticleQuadWriter(PrimitiveTypes::UInt32 features)
+{
+    static const ParticleQuadWriter s_writers[] = PE_PARTICLE_BUILD_VARIANTS(writeParticleQuadsT);
+    return (features & ParticleKernelFeature_Generic) ? writeParticleQuads : s_writers[particleBuildVariant(features)];
+}
+
+ParticlePackedQuadWriter getParticlePackedQuadWriter(PrimitiveTypes::UInt32 features)
+{
+    static const ParticlePackedQuadWriter s_writers[] = PE_PARTICLE_BUILD_VARIANTS(writeParticlePackedQuadsT);
+    return (features & ParticleKernelFeature_Generic) ? writeParticlePackedQuads : s_writers[particleBuildVariant(features)];
+}
+
+ParticlePointWriter getParticlePointWriter(PrimitiveTypes::UInt32 features)
+{
+    static const ParticlePointWriter s_writers[] = PE_PARTICLE_BUILD_VARIANTS(writeParticlePointsT);
+    return (features & ParticleKernelFeature_Generic) ? writeParticlePoints : s_writers[particleBuildVariant(features)];
+}
+
+}; // namespace Components
+}; // namespace PE
@@ -0,0 +1,471 @@
+#ifndef _PE_PARTICLE_SIM_CORE_H_
+#define _PE_PARTICLE_SIM_CORE_H_
+
+// Particle simulation core: emitter templates, particle storage, spawning, the fixed
+// step update and the vertex writers. Nothing in here touches handles, scene nodes,
+// meshes or the render context, so it also builds headless (see ParticleCoreTypes.h).
+
+#include "ParticleCoreTypes.h"
+#include "ParticleSimd.h"
+#include "ParticleJobs.h"
+#include "ParticleRandom.h"
+#include "ParticleCurves.h"
+#include "ParticleAffectors.h"
+#include "ParticleCollision.h"
+#include "ParticleNeighbors.h"
+#include "ParticleProfiler.h"
+#include "ParticleMemoryPool.h"
+
+#include <vector>
+
+struct Matrix4x4;
+
+namespace PE {
+
+struct Vector2
+{
+    float m_x, m_y;
+    Vector2() : m_x(0.0f), m_y(0.0f) {}
+    Vector2(float x, float y) : m_x(x), m_y(y) {}
+};
+
+namespace Components {
+
+struct ParticleShapeMesh;
+
+// where new particles start and which way they head; see generateParticleShape()
+enum Shape { Cone, Sphere, Box, Disc, MeshSurface, Line };
+
+enum ParticleRenderMode
+{
+    ParticleRenderMode_CPUExpanded, // four camera-facing vertices per particle built on the cpu
+    ParticleRenderMode_Instanced,   // one point record per particle, expanded by ParticleBillboard_Tech
+    ParticleRenderMode_Packed,      // cpu-expanded quads as 12-byte ParticlePackedVertex, drawn by ParticlePacked_Tech
+};
+
+// Quantized quad corner. The position is relative to the emitter's packed origin in
+// steps of 1 / ParticlePackedStepsPerUnit, so it reaches +-64 units (further is
+// clamped) with 2 mm precision; the origin comes from the world transform of the
+// mesh instance. Texture coordinates follow from m_corner (0 top left, clockwise) and
+// there is no normal. Read as SHORT4 (x, y, z, corner) + UBYTE4N rgba.
+struct ParticlePackedVertex
+{
+    PrimitiveTypes::Int16 m_x;
+    PrimitiveTypes::Int16 m_y;
+    PrimitiveTypes::Int16 m_z;
+    PrimitiveTypes::UInt16 m_corner;
+    PrimitiveTypes::UInt32 m_color; // r in the lowest byte
+};
+
+enum { ParticlePackedStepsPerUnit = 512 };
+
+// Camera basis captured once per frame and consumed when the mesh is built, so
+// particles themselves carry no orientation. The projection part is only used for
+// culling; a snapshot without one (m_tanHalfFovY == 0) sees everything.
+struct ParticleCameraSnapshot
+{
+    Vector3 m_position;
+    Vector3 m_right;
+    Vector3 m_up;
+    Vector3 m_front;
+    PrimitiveTypes::Float32 m_tanHalfFovY;
+    PrimitiveTypes::Float32 m_aspect; // width / height
+    PrimitiveTypes::Float32 m_near;
+    PrimitiveTypes::Float32 m_far;
+
+    ParticleCameraSnapshot()
+        : m_right(1.0f, 0.0f, 0.0f), m_up(0.0f, 1.0f, 0.0f), m_front(0.0f, 0.0f, 1.0f)
+        , m_tanHalfFovY(0.0f), m_aspect(1.0f)
+        , m_near(0.0f), m_far(PrimitiveTypes::Constants::c_MaxFloat32)
+    {}
+
+    // engine side only, implemented next to ParticleSystem
+    void capture(const Matrix4x4 &cameraWorldTransform);
+    void capture(const Matrix4x4 &cameraWorldTransform, PrimitiveTypes::Float32 fovY, PrimitiveTypes::Float32 aspect,
+        PrimitiveTypes::Float32 nearDist, PrimitiveTypes::Float32 farDist);
+
+    // conservative: false only if the sphere is entirely outside the view frustum
+    bool isSphereVisible(const Vector3 &center, PrimitiveTypes::Float32 radius) const;
+};
+
+// world space box around an emitter's live particles, quads included
+struct ParticleBounds
+{
+    Vector3 m_min;
+    Vector3 m_max;
+    PrimitiveTypes::Bool m_valid; // false while the emitter has no particles
+
+    ParticleBounds() : m_valid(false) {}
+
+    Vector3 getCenter() const { return (m_min + m_max) * 0.5f; }
+    PrimitiveTypes::Float32 getRadius() const { return (m_max - m_min).length() * 0.5f; }
+};
+
+enum ParticleLodLevel
+{
+    ParticleLodLevel_Full,
+    ParticleLodLevel_Reduced, // visible but beyond ParticleLodPolicy::m_reducedDistance
+    ParticleLodLevel_Culled,  // outside every view this frame, or empty
+};
+
+// How emitters scale down with distance and visibility. Tick divisors stretch the
+// fixed step (fewer, longer steps); spawn scales thin out looping emission.
+struct ParticleLodPolicy
+{
+    PrimitiveTypes::Bool m_enabled;
+    PrimitiveTypes::Float32 m_reducedDistance; // from the camera to the bounds
+    PrimitiveTypes::Float32 m_reducedSpawnScale;
+    PrimitiveTypes::UInt32 m_reducedTickDivisor;
+    PrimitiveTypes::Float32 m_culledSpawnScale;
+    PrimitiveTypes::UInt32 m_culledTickDivisor;
+    PrimitiveTypes::Bool m_skipBuildWhenCulled; // keep the last mesh instead of rebuilding it
+
+    ParticleLodPolicy()
+        : m_enabled(true)
+        , m_reducedDistance(40.0f)
+        , m_reducedSpawnScale(0.5f)
+        , m_reducedTickDivisor(2)
+        , m_culledSpawnScale(0.25f)
+        , m_culledTickDivisor(4)
+        , m_skipBuildWhenCulled(true)
+    {
+    }
+};
+
+// level for an emitter seen from viewCount views: the best level of any view
+ParticleLodLevel selectParticleLod(const ParticleLodPolicy &policy, const ParticleBounds &bounds,
+    const ParticleCameraSnapshot *pViews, PrimitiveTypes::UInt32 viewCount);
+
+// Structure-of-arrays particle storage. Every field lives in its own contiguous
+// stream so the update and mesh-build loops only pull the floats they touch.
+// Streams share one ParticleMemoryPool block, are 32-byte aligned and the capacity is
+// padded to a multiple of ParticleBufferCPU::StreamPadding so vector loops may run
+// past m_size.
+struct ParticleBufferCPU
+{
+    enum { StreamAlignment = 32, StreamPadding = 8 };
+
+    ParticleBufferCPU();
+    ~ParticleBufferCPU();
+
+    // drops all particles and (re)allocates the streams for the given capacity
+    void reset(PrimitiveTypes::UInt32 capacity);
+
+    // appends a zeroed particle and returns its index
+    PrimitiveTypes::UInt32 add();
+    // appends count particles without clearing them and returns the first index; the
+    // caller writes every stream
+    PrimitiveTypes::UInt32 add(PrimitiveTypes::UInt32 count);
+
+    // removes a particle by moving the last live one into its slot, so [0, m_size)
+    // always holds exactly the live particles
+    void kill(PrimitiveTypes::UInt32 index);
+
+    PrimitiveTypes::Float32 *m_posX, *m_posY, *m_posZ;
+    PrimitiveTypes::Float32 *m_velX, *m_velY, *m_velZ;
+    PrimitiveTypes::Float32 *m_age;
+    PrimitiveTypes::Float32 *m_duration;
+    PrimitiveTypes::Float32 *m_sizeX, *m_sizeY;
+    PrimitiveTypes::Float32 *m_phase; // swirl phase offset, fixed at spawn
+    PrimitiveTypes::Float32 *m_prevX, *m_prevY, *m_prevZ; // position before the last sim step
+
+    PrimitiveTypes::UInt32 m_size;
+    PrimitiveTypes::UInt32 m_capacity;
+
+private:
+    ParticleBufferCPU(const ParticleBufferCPU &);
+    ParticleBufferCPU &operator=(const ParticleBufferCPU &);
+
+    void *m_pBlock;
+};
+
+struct Particle
+{
+    PrimitiveTypes::Int16 m_rate;
+    PrimitiveTypes::Float32 m_speed;         // initial velocity along the spawn heading, 1/50 units per second
+    PrimitiveTypes::Float32 m_duration;
+    PrimitiveTypes::Bool m_looping;
+    Vector2 m_size;
+    Shape m_shape;                           // Disc unless set: the spawn from before shapes existed
+    const char* m_texture;
+    Vector3 color;
+    PrimitiveTypes::UInt32 m_seed; // seeds the emitter's ParticleRandom
+    ParticleRenderMode m_renderMode;
+    PrimitiveTypes::Float32 m_simRate;       // fixed simulation steps per second
+    PrimitiveTypes::UInt32 m_maxSubsteps;    // steps per frame before the backlog is dropped
+    PrimitiveTypes::Bool m_depthSort;        // draw back to front, for alpha-blended textures
+    PrimitiveTypes::Float32 m_spawnRadius;   // Cone, Sphere and Disc radius
+    PrimitiveTypes::Float32 m_spawnHeight;   // Disc: new particles start up to this far above it
+    PrimitiveTypes::Float32 m_coneAngle;     // Cone: heading off +y at the rim, radians
+    Vector3 m_shapeExtents;                  // Box: half size; Line: half of the segment
+    const ParticleShapeMesh *m_pShapeMesh;   // MeshSurface: not owned, outlives the emitters
+    PrimitiveTypes::Float32 m_swirlStrength; // horizontal swirl added to the drift
+    PrimitiveTypes::Float32 m_swirlSpeed;
+    PrimitiveTypes::Float32 m_pulseAmount;   // size breathing, relative to m_size
+    PrimitiveTypes::Float32 m_pulseFrequency;
+    // over-lifetime curves, baked into each emitter's ParticleCurveTables
+    ParticleCurve m_sizeOverLife;            // scales m_size
+    ParticleGradient m_colorOverLife;        // scales color
+    ParticleCurve m_alphaOverLife;           // fades color; ramps in over the first 20%, out over the last 30%
+    ParticleCurve m_speedOverLife;           // scales the drift
+    ParticleAffectorStack m_affectors;       // forces on the velocity, none by default
+    const ParticleColliderSet *m_pColliders; // what the particles collide with: not owned, NULL for nothing
+    ParticleCollisionResponse m_collision;
+    PrimitiveTypes::Float32 m_bounce;        // Bounce: share of the speed into the surface kept
+    PrimitiveTypes::Float32 m_friction;      // Bounce: share of the speed along the surface lost per contact
+    
+    Particle()
+        : m_rate(80)                         
+        , m_speed(0.05f)                     
+        , m_duration(8.0f)                   
+        , m_looping(true)
+        , m_size(0.02f, 0.02f)              
+        , m_shape(Disc)
+        , m_texture("")                     
+        , color(0.9f, 0.95f, 0.8f)          
+        , m_seed(0x2545F491)
+        , m_renderMode(ParticleRenderMode_CPUExpanded)
+        , m_simRate(60.0f)
+        , m_maxSubsteps(4)
+        , m_depthSort(false)
+        , m_spawnRadius(0.5f)
+        , m_spawnHeight(0.5f)
+        , m_coneAngle(0.44f)
+        , m_shapeExtents(0.5f, 0.5f, 0.5f)
+        , m_pShapeMesh(NULL)
+        , m_swirlStrength(0.1f)
+        , m_swirlSpeed(1.0f)
+        , m_pulseAmount(0.05f)
+        , m_pulseFrequency(2.0f)
+        , m_pColliders(NULL)
+        , m_collision(ParticleCollision_Bounce)
+        , m_bounce(0.5f)
+        , m_friction(0.2f)
+    {
+        // particle goes from dark to bright, stays bright, then fades out
+        m_alphaOverLife.addKey(0.0f, 0.0f);
+        m_alphaOverLife.addKey(0.2f, 1.0f);
+        m_alphaOverLife.addKey(0.7f, 1.0f);
+        m_alphaOverLife.addKey(1.0f, 0.0f);
+    }
+
+
+};
+
+// Fixed-timestep scheduler. Frame time goes into an accumulator that is drained in
+// m_step sized substeps, at most m_maxSubsteps per frame. m_alpha is how far the
+// frame is between the last two simulated states, for render interpolation.
+struct ParticleSimClock
+{
+    ParticleSimClock();
+
+    void setRate(PrimitiveTypes::Float32 stepsPerSecond, PrimitiveTypes::UInt32 maxSubsteps);
+
+    // runs every divisor-th step of the base rate, each divisor times as long
+    void setStepDivisor(PrimitiveTypes::UInt32 divisor);
+
+    // adds frame time and returns the number of substeps to run
+    PrimitiveTypes::UInt32 advance(PrimitiveTypes::Float32 frameTime);
+
+    PrimitiveTypes::Float32 m_step;
+    PrimitiveTypes::Float32 m_baseStep;
+    PrimitiveTypes::UInt32 m_maxSubsteps;
+    PrimitiveTypes::Float32 m_accumulator;
+    PrimitiveTypes::Float32 m_alpha;
+};
+
+enum ParticleUpdateMode
+{
+    ParticleUpdateMode_Serial, // integrate on the thread that dispatches Event_UPDATE
+    ParticleUpdateMode_Jobs,   // integrate in chunks on the ParticleJobPool
+};
+
+// Vertex writers of one emitter, see writeParticleQuads() and friends below
+typedef void (*ParticleQuadWriter)(const ParticleBufferCPU &pb, PrimitiveTypes::UInt32 count, const PrimitiveTypes::UInt32 *pOrder,
+    const ParticleCameraSnapshot &view, PrimitiveTypes::Float32 alpha, const ParticleCurveTables &curves,
+    PrimitiveTypes::Float32 *pPositions, PrimitiveTypes::Float32 *pColors);
+typedef void (*ParticlePackedQuadWriter)(const ParticleBufferCPU &pb, PrimitiveTypes::UInt32 count, const PrimitiveTypes::UInt32 *pOrder,
+    const ParticleCameraSnapshot &view, PrimitiveTypes::Float32 alpha, const ParticleCurveTables &curves, PrimitiveTypes::Bool lifetimeColor,
+    const Vector3 &origin, ParticlePackedVertex *pVertices);
+typedef void (*ParticlePointWriter)(const ParticleBufferCPU &pb, PrimitiveTypes::UInt32 count, const PrimitiveTypes::UInt32 *pOrder,
+    PrimitiveTypes::Float32 alpha, const ParticleCurveTables &curves, PrimitiveTypes::Bool lifetimeColor,
+    PrimitiveTypes::Float32 *pPositions, PrimitiveTypes::Float32 *pColors, PrimitiveTypes::Float32 *pSizes);
+
+// The kernels an emitter's features call for, bound by ParticleEmitterCore::bindKernels()
+// so the per-particle loops do not test the features again
+struct ParticleEmitterKernels
+{
+    PrimitiveTypes::UInt32 m_features; // ParticleKernelFeature bits
+    ParticleIntegrateKernel m_integrate;
+    ParticleCollideKernel m_collide;
+    ParticleInteractKernel m_interact;
+    ParticleQuadWriter m_writeQuads;
+    ParticlePackedQuadWriter m_writePackedQuads;
+    ParticlePointWriter m_writePoints;
+};
+
+// One emitter's simulation: owns the particle streams, spawns, integrates on the fixed
+// clock and kills. ParticleSystemCPU adapts it to the engine; headless code drives it
+// with start() and beginUpdate()/finishUpdate() directly.
+struct ParticleEmitterCore
+{
+    // particles per integration job; a multiple of the widest simd kernel
+    enum { UpdateChunkSize = 4096 };
+    // particles per interaction job, fewer since each one visits all its neighbors
+    enum { InteractChunkSize = 1024 };
+
+    explicit ParticleEmitterCore(const Particle &particle);
+    virtual ~ParticleEmitterCore() {}
+
+    // sizes the buffer for the template, compiles its affectors for origin and spawns
+    // the initial particles around it
+    void start(const Vector3 &origin);
+
+    // waits for a pending update and starts over at origin with a fresh clock; keeps the
+    // buffer (no reallocation at the same capacity), the random stream and the stats
+    void restart(const Vector3 &origin);
+    // drops every particle and stays idle, looping or not, until start() or restart()
+    void stop();
+    // switches to another template (a hot-reloaded one, say) and restarts at m_origin.
+    // the render mode and texture stay what the mesh was loaded with
+    void setTemplate(const Particle &particle);
+
+    // appends count particles from the template's shape with ages spread over [0, maxAge)
+    void spawnParticles(ParticleBufferCPU &pb, PrimitiveTypes::UInt32 count, PrimitiveTypes::Float32 maxAge);
+    void updateParticleBuffer(PrimitiveTypes::Float32 time);
+
+    // a non-looping emitter is finished once its burst has died out, any emitter once stopped
+    bool isFinished();
+
+    // split update: beginUpdate() feeds frame time to the clock and starts the due
+    // fixed substeps (as a job in job mode), finishUpdate() waits for them
+    void beginUpdate(PrimitiveTypes::Float32 time);
+    void finishUpdate();
+    // finishUpdate() if the update has already run, without waiting; true once none is pending
+    bool pollUpdate();
+
+    // one fixed step: interact (for templates with an interaction affector), integrate
+    // and collide, then the serial kill/spawn tail
+    void step(PrimitiveTypes::Float32 time);
+
+    // recomputes m_bounds from the live particles
+    void updateBounds();
+
+    // applies a lod level from the next update on; call between finishUpdate() and beginUpdate()
+    void setLod(ParticleLodLevel level, const ParticleLodPolicy &policy);
+    // the ParticleKernelFeature mask of this template; lifetimeColor as for the writers
+    PrimitiveTypes::UInt32 getKernelFeatures(PrimitiveTypes::Bool lifetimeColor) const;
+    // picks the update and mesh build kernels for features, once: the constructor binds
+    // getKernelFeatures(true), setTemplate() rebinds for the new template
+    void bindKernels(PrimitiveTypes::UInt32 features);
+
+    static void substepJob(void *pData, PrimitiveTypes::UInt32 begin, PrimitiveTypes::UInt32 end);
+    static void integrateChunk(void *pData, PrimitiveTypes::UInt32 begin, PrimitiveTypes::UInt32 end);
+    static void interactChunk(void *pData, PrimitiveTypes::UInt32 begin, PrimitiveTypes::UInt32 end);
+
+    ParticleBufferCPU m_buffer;
+    Vector3 m_origin;
+    Particle m_particleTemplate; // only setTemplate() changes it
+    ParticleCurveTables m_curves; // baked from m_particleTemplate
+    ParticleAffectorProgram m_affectors; // m_particleTemplate.m_affectors, compiled by start()
+    ParticleEmitterKernels m_kernels;
+    ParticleNeighborGrid m_neighbors; // rebuilt every step while the template has interactions, empty otherwise
+    PrimitiveTypes::Float32 m_pastTime;
+    PrimitiveTypes::Float32 m_emitAccumulator; // fractional particles owed by the looping rate
+    PrimitiveTypes::UInt32 m_spawnCount;
+    PrimitiveTypes::Bool m_stopped; // stop() was called; beginUpdate() neither steps nor spawns
+    ParticleSimClock m_clock;
+    ParticleUpdateMode m_updateMode;
+    PrimitiveTypes::Bool m_updatePending;
+    PrimitiveTypes::UInt32 m_pendingSubsteps;
+    ParticleRandom m_random;
+    ParticleIntegrateParams m_pendingParams;
+    ParticleCollideParams m_pendingCollide;
+    PrimitiveTypes::Bool m_collidePending; // the step has colliders to test
+    ParticleInteractParams m_pendingInteract;
+    ParticleJobCounter m_pendingJobs;
+    std::atomic<PrimitiveTypes::UInt32> m_pendingExpired;
+    ParticleEmitterStats m_stats;
+    ParticleBounds m_bounds;
+    ParticleLodLevel m_lodLevel;
+    PrimitiveTypes::Float32 m_spawnScale; // looping emission multiplier set by the lod
+};
+
+// Back-to-front order of an emitter's particles for alpha blending. Sorts a compact
+// index array; the particle streams never move. Every frame starts from the previous
+// order: a bounded insertion sort fixes the small depth changes of one frame, the few
+// particles that moved far (spawned, or swapped into another slot by kill()) are radix
+// sorted on their own and merged in. When too much changed (camera cut, first frame)
+// a 4-pass 8-bit radix sort on the depth keys orders everything in O(n). Emitters whose
+// order churns every frame stop trying the reuse for a while (see m_refineBackoff).
+struct ParticleDepthSorter
+{
+    ParticleDepthSorter();
+
+    // orders the first count particles by depth along view.m_front, farthest first;
+    // the returned array holds count particle indices (NULL when count is 0) and stays
+    // valid until the next sort
+    const PrimitiveTypes::UInt32 *sort(const ParticleBufferCPU &pb, PrimitiveTypes::UInt32 count,
+        const ParticleCameraSnapshot &view);
+
+    // drops the previous order, the next sort is a full radix sort
+    void invalidate() { m_count = 0; m_refineSkip = 0; m_refineBackoff = 1; }
+
+    enum { MaxRefineBackoff = 32 }; // frames
+
+    ParticleIndexArray m_order;
+    ParticleIndexArray m_keys;      // per particle index, clobbered by the radix sort
+    ParticleIndexArray m_orderKeys; // keys of m_order while refining it
+    ParticleIndexArray m_scratchOrder;
+    ParticleIndexArray m_scratchKeys;
+    PrimitiveTypes::UInt32 m_count; // particles in m_order
+    PrimitiveTypes::UInt32 m_refineSkip;    // frames left that go straight to the radix sort
+    PrimitiveTypes::UInt32 m_refineBackoff; // next skip length, doubles while the reuse does not pay
+
+    PrimitiveTypes::UInt32 m_radixSorts;       // full sorts
+    PrimitiveTypes::UInt32 m_incrementalSorts; // sorts that reused the previous order
+
+private:
+    void radixSort(PrimitiveTypes::UInt32 count);
+    // false when too much changed to finish; cheap tells whether it beat a radix sort
+    bool refineOrder(PrimitiveTypes::UInt32 count, PrimitiveTypes::Bool &cheap);
+};
+
+// Vertex writers shared by the engine mesh and headless consumers. Both write the first
+// count particles, interpolated by alpha between the last two simulated states; colors
+// are sampled from the emitter's baked curves at age / duration.
+
+// count particles in buffer order, or in the order of pOrder (e.g. ParticleDepthSorter)
+// when not NULL.
+
+// four camera-facing corners (x,y,z) per particle, top left first and clockwise;
+// pColors (rgb per vertex, from the color curves) is skipped when NULL
+void writeParticleQuads(const ParticleBufferCPU &pb, PrimitiveTypes::UInt32 count, const PrimitiveTypes::UInt32 *pOrder,
+    const ParticleCameraSnapshot &view, PrimitiveTypes::Float32 alpha, const ParticleCurveTables &curves,
+    PrimitiveTypes::Float32 *pPositions, PrimitiveTypes::Float32 *pColors);
+
+// four ParticlePackedVertex per particle, same corners as writeParticleQuads; the
+// color follows the curves when lifetimeColor is set and is curves.m_baseColor otherwise
+void writeParticlePackedQuads(const ParticleBufferCPU &pb, PrimitiveTypes::UInt32 count, const PrimitiveTypes::UInt32 *pOrder,
+    const ParticleCameraSnapshot &view, PrimitiveTypes::Float32 alpha, const ParticleCurveTables &curves, PrimitiveTypes::Bool lifetimeColor,
+    const Vector3 &origin, ParticlePackedVertex *pVertices);
+
+// one record per particle: center (x,y,z), rgb and size (x,y); lifetimeColor as in
+// writeParticlePackedQuads
+void writeParticlePoints(const ParticleBufferCPU &pb, PrimitiveTypes::UInt32 count, const PrimitiveTypes::UInt32 *pOrder,
+    PrimitiveTypes::Float32 alpha, const ParticleCurveTables &curves, PrimitiveTypes::Bool lifetimeColor,
+    PrimitiveTypes::Float32 *pPositions, PrimitiveTypes::Float32 *pColors, PrimitiveTypes::Float32 *pSizes);
+
+// The writers above decide color and order per particle. These return versions
+// specialized for the ParticleBuildFeatures bits of features, with those tests compiled
+// out: with Color the color comes from the curves (pColors must not be NULL for quads),
+// without it from m_baseColor (quads write none); with Sorted pOrder must not be NULL,
+// without it pOrder is ignored. ParticleKernelFeature_Generic returns the writers above.
+ParticleQuadWriter getParticleQuadWriter(PrimitiveTypes::UInt32 features);
+ParticlePackedQuadWriter getParticlePackedQuadWriter(PrimitiveTypes::UInt32 features);
+ParticlePointWriter getParticlePointWriter(PrimitiveTypes::UInt32 features);
+
+}; // namespace Components
+}; // namespace PE
+
+#endif
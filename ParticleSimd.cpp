@@ -0,0 +1,1587 @@
+#include "ParticleSimd.h"
+#include "ParticleSimCore.h"
+#include "ParticleCurves.h"
+#include "ParticleAffectors.h"
+#include "ParticleCollision.h"
+#include "ParticleNeighbors.h"
+
+#include <math.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PE_PARTICLE_SIMD_X86 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#else
+#define PE_PARTICLE_SIMD_X86 0
+#endif
+
+#if PE_PARTICLE_SIMD_X86 && defined(__GNUC__)
+#define PE_PARTICLE_TARGET_SSE2 __attribute__((target("sse2")))
+#define PE_PARTICLE_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define PE_PARTICLE_TARGET_SSE2
+#define PE_PARTICLE_TARGET_AVX2
+#endif
+
+#if defined(_MSC_VER)
+#define PE_PARTICLE_ALIGN16 __declspec(align(16))
+#else
+#define PE_PARTICLE_ALIGN16 __attribute__((aligned(16)))
+#endif
+
+namespace PE {
+namespace Components {
+
+// velocity change of one particle over dt from a compiled affector stack
+static inline void applyParticleAffectorsScalar(const ParticleAffectorProgram &program, float dt,
+    float px, float py, float pz, float &vx, float &vy, float &vz)
+{
+    float ax = program.m_acceleration[0];
+    float ay = program.m_acceleration[1];
+    float az = program.m_acceleration[2];
+    for (PrimitiveTypes::UInt32 i = 0; i < program.m_opCount; i++)
+    {
+        const ParticleAffectorOp &op = program.m_ops[i];
+        switch (op.m_type)
+        {
+        case ParticleAffector_Attractor:
+        {
+            // strength * d / (|d|^2 + r^2)^1.5
+            float dx = op.m_center[0] - px, dy = op.m_center[1] - py, dz = op.m_center[2] - pz;
+            float q = dx * dx + dy * dy + dz * dz + op.m_radiusSquared;
+            float s = op.m_strength / (q * sqrtf(q));
+            ax += dx * s;
+            ay += dy * s;
+            az += dz * s;
+            break;
+        }
+        case ParticleAffector_Vortex:
+        {
+            // strength * r * (axis x d) / (|axis x d|^2 + r^2); |axis x d| is the distance to the axis
+            float dx = px - op.m_center[0], dy = py - op.m_center[1], dz = pz - op.m_center[2];
+            float cx = op.m_axis[1] * dz - op.m_axis[2] * dy;
+            float cy = op.m_axis[2] * dx - op.m_axis[0] * dz;
+            float cz = op.m_axis[0] * dy - op.m_axis[1] * dx;
+            float s = op.m_strength / (cx * cx + cy * cy + cz * cz + op.m_radiusSquared);
+            ax += cx * s;
+            ay += cy * s;
+            az += cz * s;
+            break;
+        }
+        case ParticleAffector_Turbulence:
+        {
+            // ABC flow: divergence free and its own curl, from three sin/cos pairs
+            float x = px * op.m_radiusSquared + op.m_center[0];
+            float y = py * op.m_radiusSquared + op.m_center[1];
+            float z = pz * op.m_radiusSquared + op.m_center[2];
+            ax += (sinf(z) + cosf(y)) * op.m_strength;
+            ay += (sinf(x) + cosf(z)) * op.m_strength;
+            az += (sinf(y) + cosf(x)) * op.m_strength;
+            break;
+        }
+        }
+    }
+
+    // accelerate, then relax toward the wind
+    vx = program.m_wind[0] + (vx + ax * dt - program.m_wind[0]) * program.m_dragKeep;
+    vy = program.m_wind[1] + (vy + ay * dt - program.m_wind[1]) * program.m_dragKeep;
+    vz = program.m_wind[2] + (vz + az * dt - program.m_wind[2]) * program.m_dragKeep;
+}
+
+template <PrimitiveTypes::UInt32 Features>
+static PrimitiveTypes::UInt32 integrateParticlesScalarT(ParticleBufferCPU &pb,
+    PrimitiveTypes::UInt32 begin, PrimitiveTypes::UInt32 end, const ParticleIntegrateParams &params)
+{
+    const bool swirl = particleKernelDoes<Features>(ParticleKernelFeature_Swirl, true);
+    const bool sizeCurve = particleKernelDoes<Features>(ParticleKernelFeature_SizeCurve, true);
+    const bool speedCurve = particleKernelDoes<Features>(ParticleKernelFeature_SpeedCurve, true);
+    const bool affectors = particleKernelDoes<Features>(ParticleKernelFeature_Affectors, params.m_pAffectors != NULL);
+    // a flat speed curve is its first sample everywhere
+    const float flatDrift = params.m_dt * params.m_pSpeedCurve[0];
+
+    PrimitiveTypes::UInt32 expired = 0;
+    for (PrimitiveTypes::UInt32 j = begin; j < end; j++)
+    {
+        float age = pb.m_age[j] + params.m_dt;
+        pb.m_age[j] = age;
+
+        // previous state for render interpolation
+        pb.m_prevX[j] = pb.m_posX[j];
+        pb.m_prevY[j] = pb.m_posY[j];
+        pb.m_prevZ[j] = pb.m_posZ[j];
+
+        if (age >= pb.m_duration[j])
+        {
+            expired++;
+            continue;
+        }
+
+        PrimitiveTypes::Int32 sample = 0;
+        float fraction = 0.0f;
+        if (sizeCurve || speedCurve)
+            locateParticleCurveSample(age / pb.m_duration[j], sample, fraction);
+        float vx = pb.m_velX[j], vy = pb.m_velY[j], vz = pb.m_velZ[j];
+        if (affectors)
+        {
+            applyParticleAffectorsScalar(*params.m_pAffectors, params.m_dt, pb.m_posX[j], pb.m_posY[j], pb.m_posZ[j], vx, vy, vz);
+            pb.m_velX[j] = vx;
+            pb.m_velY[j] = vy;
+            pb.m_velZ[j] = vz;
+        }
+
+        float drift = speedCurve ? params.m_dt * sampleParticleCurve(params.m_pSpeedCurve, sample, fraction) : flatDrift;
+        float dx = vx * drift;
+        float dz = vz * drift;
+        if (swirl)
+        {
+            float phase = params.m_swirlSpeed * age + pb.m_phase[j];
+            dx += cosf(phase) * params.m_swirlScale;
+            dz += sinf(phase) * params.m_swirlScale;
+        }
+
+        pb.m_posX[j] += dx;
+        pb.m_posY[j] += vy * drift;
+        pb.m_posZ[j] += dz;
+
+        // otherwise the spawn size holds for life
+        if (sizeCurve)
+        {
+            float size = sampleParticleCurve(params.m_pSizeCurve, sample, fraction);
+            pb.m_sizeX[j] = params.m_baseSizeX * size;
+            pb.m_sizeY[j] = params.m_baseSizeY * size;
+        }
+    }
+    return expired;
+}
+
+PrimitiveTypes::UInt32 integrateParticlesScalar(ParticleBufferCPU &pb,
+    PrimitiveTypes::UInt32 begin, PrimitiveTypes::UInt32 end, const ParticleIntegrateParams &params)
+{
+    return integrateParticlesScalarT<ParticleKernelFeature_Generic>(pb, begin, end, params);
+}
+
+// Bounce and Stick as one formula: the velocity is split along the surface normal n,
+// the tangential part is scaled by tangentKeep and the normal part vn becomes
+// vn * normalKeep - approach * min(vn, 0)
+struct ParticleContactResponse
+{
+    explicit ParticleContactResponse(const ParticleCollideParams &params)
+    {
+        bool stick = params.m_response == ParticleCollision_Stick;
+        m_tangentKeep = stick ? 0.0f : 1.0f - params.m_friction;
+        m_normalKeep = stick ? 0.0f : 1.0f;
+        m_approach = stick ? 0.0f : 1.0f + params.m_bounce;
+    }
+
+    float m_tangentKeep;
+    float m_normalKeep;
+    float m_approach;
+};
+
+static inline void respondToParticleContact(const ParticleContactResponse &response, float nx, float ny, float nz,
+    float &vx, float &vy, float &vz)
+{
+    float vn = nx * vx + ny * vy + nz * vz;
+    float normal = vn * response.m_normalKeep - response.m_approach * (vn < 0.0f ? vn : 0.0f);
+    vx = (vx - nx * vn) * response.m_tangentKeep + nx * normal;
+    vy = (vy - ny * vn) * response.m_tangentKeep + ny * normal;
+    vz = (vz - nz * vn) * response.m_tangentKeep + nz * normal;
+}
+
+PrimitiveTypes::UInt32 collideParticlesScalar(ParticleBufferCPU &pb,
+    PrimitiveTypes::UInt32 begin, PrimitiveTypes::UInt32 end, const ParticleCollideParams &params)
+{
+    const ParticleContactResponse response(params);
+    const bool kill = params.m_response == ParticleCollision_Kill;
+
+    PrimitiveTypes::UInt32 killed = 0;
+    for (PrimitiveTypes::UInt32 j = begin; j < end; j++)
+    {
+        float px = pb.m_posX[j], py = pb.m_posY[j], pz = pb.m_posZ[j];
+        float vx = pb.m_velX[j], vy = pb.m_velY[j], vz = pb.m_velZ[j];
+        bool hit = false;
+
+        for (PrimitiveTypes::UInt32 k = 0; k < params.m_planeCount; k++)
+        {
+            const ParticleCollisionPlane &plane = params.m_pPlanes[k];
+            float nx = plane.m_normal[0], ny = plane.m_normal[1], nz = plane.m_normal[2];
+            float d = nx * px + ny * py + nz * pz - plane.m_offset;
+            if (d >= 0.0f)
+                continue;
+            hit = true;
+            if (kill)
+                continue;
+            px -= nx * d;
+            py -= ny * d;
+            pz -= nz * d;
+            respondToParticleContact(response, nx, ny, nz, vx, vy, vz);
+        }
+
+        if (params.m_pHeightfield)
+        {
+            float height, slopeX, slopeZ;
+            sampleParticleHeightfield(*params.m_pHeightfield, px, pz, height, slopeX, slopeZ);
+            float d = py - height;
+            if (d < 0.0f)
+            {
+                hit = true;
+                if (!kill)
+                {
+                    py -= d;
+                    float scale = 1.0f / sqrtf(1.0f + slopeX * slopeX + slopeZ * slopeZ);
+                    respondToParticleContact(response, -slopeX * scale, scale, -slopeZ * scale, vx, vy, vz);
+                }
+            }
+        }
+
+        if (kill)
+        {
+            // expired particles were counted by the integrate kernel
+            if (hit && pb.m_age[j] < pb.m_duration[j])
+            {
+                pb.m_age[j] = pb.m_duration[j];
+                killed++;
+            }
+            continue;
+        }
+        pb.m_posX[j] = px;
+        pb.m_posY[j] = py;
+        pb.m_posZ[j] = pz;
+        pb.m_velX[j] = vx;
+        pb.m_velY[j] = vy;
+        pb.m_velZ[j] = vz;
+    }
+    return killed;
+}
+
+// sums the interaction forces on one particle over its neighbors
+struct ParticleInteractionSum
+{
+    const ParticleNeighborGrid *m_pGrid;
+    float m_invRadius, m_separation, m_cohesion, m_alignment;
+    float m_velX, m_velY, m_velZ;
+    float m_accelX, m_accelY, m_accelZ;
+
+    void operator()(PrimitiveTypes::UInt32 other, float dx, float dy, float dz, float distanceSquared)
+    {
+        // a pair on the same spot has no direction to push along
+        if (distanceSquared <= 0.0f)
+            return;
+        float distance = sqrtf(distanceSquared);
+        float q = 1.0f - distance * m_invRadius;
+        // along the direction to the other particle: cohesion pulls, separation pushes
+        float pull = (m_cohesion * q - m_separation * q * q) / distance;
+        float match = m_alignment * q;
+        m_accelX += pull * dx + match * (m_pGrid->m_velX[other] - m_velX);
+        m_accelY += pull * dy + match * (m_pGrid->m_velY[other] - m_velY);
+        m_accelZ += pull * dz + match * (m_pGrid->m_velZ[other] - m_velZ);
+    }
+};
+
+void interactParticlesScalar(ParticleBufferCPU &pb, const ParticleNeighborGrid &grid,
+    PrimitiveTypes::UInt32 begin, PrimitiveTypes::UInt32 end, const ParticleInteractParams &params)
+{
+    ParticleInteractionSum sum;
+    sum.m_pGrid = &grid;
+    sum.m_invRadius = 1.0f / params.m_radius;
+    sum.m_separation = params.m_separation;
+    sum.m_cohesion = params.m_cohesion;
+    sum.m_alignment = params.m_alignment;
+
+    for (PrimitiveTypes::UInt32 slot = begin; slot < end; slot++)
+    {
+        sum.m_velX = grid.m_velX[slot];
+        sum.m_velY = grid.m_velY[slot];
+        sum.m_velZ = grid.m_velZ[slot];
+        sum.m_accelX = sum.m_accelY = sum.m_accelZ = 0.0f;
+        grid.forEachNeighbor(slot, sum);
+
+        PrimitiveTypes::UInt32 i = grid.m_particle[slot];
+        pb.m_velX[i] = sum.m_velX + sum.m_accelX * params.m_dt;
+        pb.m_velY[i] = sum.m_velY + sum.m_accelY * params.m_dt;
+        pb.m_velZ[i] = sum.m_velZ + sum.m_accelZ * params.m_dt;
+    }
+}
+
+void quantizeParticleValuesScalar(const PrimitiveTypes::Float32 *pValues, PrimitiveTypes::Int16 *pOut,
+    PrimitiveTypes::UInt32 count)
+{
+    for (PrimitiveTypes::UInt32 j = 0; j < count; j++)
+    {
+        float v = pValues[j];
+        v = v < 32767.0f ? v : 32767.0f;
+        v = v > -32767.0f ? v : -32767.0f;
+        pOut[j] = (PrimitiveTypes::Int16)lrintf(v);
+    }
+}
+
+void sinCosParticleValuesScalar(const PrimitiveTypes::Float32 *pAngles, PrimitiveTypes::Float32 *pSin,
+    PrimitiveTypes::Float32 *pCos, PrimitiveTypes::UInt32 count)
+{
+    for (PrimitiveTypes::UInt32 j = 0; j < count; j++)
+    {
+        float angle = pAngles[j];
+        pSin[j] = sinf(angle);
+        pCos[j] = cosf(angle);
+    }
+}
+
+void sqrtParticleValuesScalar(PrimitiveTypes::Float32 *pValues, PrimitiveTypes::UInt32 count)
+{
+    for (PrimitiveTypes::UInt32 j = 0; j < count; j++)
+        pValues[j] = sqrtf(pValues[j]);
+}
+
+void normalizeParticleVectorsScalar(PrimitiveTypes::Float32 *pX, PrimitiveTypes::Float32 *pY,
+    PrimitiveTypes::Float32 *pZ, PrimitiveTypes::UInt32 count)
+{
+    for (PrimitiveTypes::UInt32 j = 0; j < count; j++)
+    {
+        float inv = 1.0f / sqrtf(pX[j] * pX[j] + pY[j] * pY[j] + pZ[j] * pZ[j]);
+        pX[j] *= inv;
+        pY[j] *= inv;
+        pZ[j] *= inv;
+    }
+}
+
+void fillParticleUniformScalar(PrimitiveTypes::UInt32 *pState, PrimitiveTypes::Float32 *pOut,
+    PrimitiveTypes::UInt32 count)
+{
+    const int lanes = ParticleRandomLanes;
+    PrimitiveTypes::UInt32 *s0 = pState, *s1 = pState + lanes, *s2 = pState + 2 * lanes, *s3 = pState + 3 * lanes;
+    for (PrimitiveTypes::UInt32 i = 0; i < count; i += lanes)
+    {
+        for (int lane = 0; lane < lanes; lane++)
+        {
+            PrimitiveTypes::UInt32 result = s0[lane] + s3[lane];
+            PrimitiveTypes::UInt32 t = s1[lane] << 9;
+            s2[lane] ^= s0[lane];
+            s3[lane] ^= s1[lane];
+            s1[lane] ^= s2[lane];
+            s0[lane] ^= s3[lane];
+            s2[lane] ^= t;
+            s3[lane] = (s3[lane] << 11) | (s3[lane] >> 21);
+
+            // top 24 bits, exact in a float
+            pOut[i + lane] = (PrimitiveTypes::Float32)(PrimitiveTypes::Int32)(result >> 8) * (1.0f / 16777216.0f);
+        }
+    }
+}
+
+#if PE_PARTICLE_SIMD_X86
+
+// sin/cos approximation shared by the vector kernels: reduce by pi/2 (three-part
+// Cody-Waite), evaluate minimax polynomials on [-pi/4, pi/4], then fix up by quadrant
+#define PE_PARTICLE_PIO2_1 1.5703125f
+#define PE_PARTICLE_PIO2_2 4.837512969970703125e-4f
+#define PE_PARTICLE_PIO2_3 7.54978995489188216e-8f
+#define PE_PARTICLE_2OPI 0.636619772367581343f
+#define PE_PARTICLE_SIN_1 -1.6666654611e-1f
+#define PE_PARTICLE_SIN_2 8.3321608736e-3f
+#define PE_PARTICLE_SIN_3 -1.9515295891e-4f
+#define PE_PARTICLE_COS_1 4.166664568298827e-2f
+#define PE_PARTICLE_COS_2 -1.388731625493765e-3f
+#define PE_PARTICLE_COS_3 2.443315711809948e-5f
+
+PE_PARTICLE_TARGET_SSE2
+static inline void sincos4(__m128 x, __m128 &outSin, __m128 &outCos)
+{
+    __m128i q = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(PE_PARTICLE_2OPI)));
+    __m128 qf = _mm_cvtepi32_ps(q);
+
+    __m128 r = _mm_sub_ps(x, _mm_mul_ps(qf, _mm_set1_ps(PE_PARTICLE_PIO2_1)));
+    r = _mm_sub_ps(r, _mm_mul_ps(qf, _mm_set1_ps(PE_PARTICLE_PIO2_2)));
+    r = _mm_sub_ps(r, _mm_mul_ps(qf, _mm_set1_ps(PE_PARTICLE_PIO2_3)));
+    __m128 r2 = _mm_mul_ps(r, r);
+
+    __m128 s = _mm_add_ps(_mm_mul_ps(r2, _mm_set1_ps(PE_PARTICLE_SIN_3)), _mm_set1_ps(PE_PARTICLE_SIN_2));
+    s = _mm_add_ps(_mm_mul_ps(s, r2), _mm_set1_ps(PE_PARTICLE_SIN_1));
+    s = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(s, r2), r), r);
+
+    __m128 c = _mm_add_ps(_mm_mul_ps(r2, _mm_set1_ps(PE_PARTICLE_COS_3)), _mm_set1_ps(PE_PARTICLE_COS_2));
+    c = _mm_add_ps(_mm_mul_ps(c, r2), _mm_set1_ps(PE_PARTICLE_COS_1));
+    c = _mm_mul_ps(_mm_mul_ps(c, r2), r2);
+    c = _mm_add_ps(_mm_sub_ps(c, _mm_mul_ps(r2, _mm_set1_ps(0.5f))), _mm_set1_ps(1.0f));
+
+    // odd quadrants swap sin and cos
+    __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, _mm_set1_epi32(1)), _mm_set1_epi32(1)));
+    __m128 sinv = _mm_or_ps(_mm_and_ps(swap, c), _mm_andnot_ps(swap, s));
+    __m128 cosv = _mm_or_ps(_mm_and_ps(swap, s), _mm_andnot_ps(swap, c));
+
+    // sin is negative in quadrants 2,3; cos in quadrants 1,2
+    __m128 sinSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(q, _mm_set1_epi32(2)), 30));
+    __m128 cosSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(q, _mm_set1_epi32(1)), _mm_set1_epi32(2)), 30));
+    outSin = _mm_xor_ps(sinv, sinSign);
+    outCos = _mm_xor_ps(cosv, cosSign);
+}
+
+// same clamping and rounding as locateParticleCurveSample(); the sample index stays a
+// float here, SSE2 has no 32-bit integer min
+PE_PARTICLE_TARGET_SSE2
+static inline void locateCurveSamples4(__m128 t, __m128 &sample, __m128 &fraction)
+{
+    const __m128 samples = _mm_set1_ps((float)ParticleCurveSamples);
+    __m128 x = _mm_min_ps(_mm_max_ps(_mm_mul_ps(t, samples), _mm_setzero_ps()), samples);
+    sample = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(x)), _mm_set1_ps((float)(ParticleCurveSamples - 1)));
+    fraction = _mm_sub_ps(x, sample);
+}
+
+PE_PARTICLE_TARGET_SSE2
+static inline __m128 sampleCurve4(const PrimitiveTypes::Float32 *pTable, __m128 sample, __m128 fraction)
+{
+    // no gather before AVX2: four scalar loads per table
+    PE_PARTICLE_ALIGN16 PrimitiveTypes::Int32 index[4];
+    _mm_store_si128(reinterpret_cast<__m128i *>(index), _mm_cvttps_epi32(sample));
+    __m128 a = _mm_setr_ps(pTable[index[0]], pTable[index[1]], pTable[index[2]], pTable[index[3]]);
+    __m128 b = _mm_setr_ps(pTable[index[0] + 1], pTable[index[1] + 1], pTable[index[2] + 1], pTable[index[3] + 1]);
+    return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), fraction));
+}
+
+// applyParticleAffectorsScalar() on four particles
+PE_PARTICLE_TARGET_SSE2
+static inline void applyAffectors4(const ParticleAffectorProgram &program, __m128 dt,
+    __m128 px, __m128 py, __m128 pz, __m128 &vx, __m128 &vy, __m128 &vz)
+{
+    __m128 ax = _mm_set1_ps(program.m_acceleration[0]);
+    __m128 ay = _mm_set1_ps(program.m_acceleration[1]);
+    __m128 az = _mm_set1_ps(program.m_acceleration[2]);
+    for (PrimitiveTypes::UInt32 i = 0; i < program.m_opCount; i++)
+    {
+        const ParticleAffectorOp &op = program.m_ops[i];
+        switch (op.m_type)
+        {
+        case ParticleAffector_Attractor:
+        {
+            __m128 dx = _mm_sub_ps(_mm_set1_ps(op.m_center[0]), px);
+            __m128 dy = _mm_sub_ps(_mm_set1_ps(op.m_center[1]), py);
+            __m128 dz = _mm_sub_ps(_mm_set1_ps(op.m_center[2]), pz);
+            __m128 q = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)),
+                _mm_add_ps(_mm_mul_ps(dz, dz), _mm_set1_ps(op.m_radiusSquared)));
+            __m128 s = _mm_div_ps(_mm_set1_ps(op.m_strength), _mm_mul_ps(q, _mm_sqrt_ps(q)));
+            ax = _mm_add_ps(ax, _mm_mul_ps(dx, s));
+            ay = _mm_add_ps(ay, _mm_mul_ps(dy, s));
+            az = _mm_add_ps(az, _mm_mul_ps(dz, s));
+            break;
+        }
+        case ParticleAffector_Vortex:
+        {
+            __m128 dx = _mm_sub_ps(px, _mm_set1_ps(op.m_center[0]));
+            __m128 dy = _mm_sub_ps(py, _mm_set1_ps(op.m_center[1]));
+            __m128 dz = _mm_sub_ps(pz, _mm_set1_ps(op.m_center[2]));
+            __m128 axisX = _mm_set1_ps(op.m_axis[0]), axisY = _mm_set1_ps(op.m_axis[1]), axisZ = _mm_set1_ps(op.m_axis[2]);
+            __m128 cx = _mm_sub_ps(_mm_mul_ps(axisY, dz), _mm_mul_ps(axisZ, dy));
+            __m128 cy = _mm_sub_ps(_mm_mul_ps(axisZ, dx), _mm_mul_ps(axisX, dz));
+            __m128 cz = _mm_sub_ps(_mm_mul_ps(axisX, dy), _mm_mul_ps(axisY, dx));
+            __m128 q = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, cx), _mm_mul_ps(cy, cy)),
+                _mm_add_ps(_mm_mul_ps(cz, cz), _mm_set1_ps(op.m_radiusSquared)));
+            __m128 s = _mm_div_ps(_mm_set1_ps(op.m_strength), q);
+            ax = _mm_add_ps(ax, _mm_mul_ps(cx, s));
+            ay = _mm_add_ps(ay, _mm_mul_ps(cy, s));
+            az = _mm_add_ps(az, _mm_mul_ps(cz, s));
+            break;
+        }
+        case ParticleAffector_Turbulence:
+        {
+            __m128 frequency = _mm_set1_ps(op.m_radiusSquared);
+            __m128 sinX, cosX, sinY, cosY, sinZ, cosZ;
+            sincos4(_mm_add_ps(_mm_mul_ps(px, frequency), _mm_set1_ps(op.m_center[0])), sinX, cosX);
+            sincos4(_mm_add_ps(_mm_mul_ps(py, frequency), _mm_set1_ps(op.m_center[1])), sinY, cosY);
+            sincos4(_mm_add_ps(_mm_mul_ps(pz, frequency), _mm_set1_ps(op.m_center[2])), sinZ, cosZ);
+            __m128 strength = _mm_set1_ps(op.m_strength);
+            ax = _mm_add_ps(ax, _mm_mul_ps(_mm_add_ps(sinZ, cosY), strength));
+            ay = _mm_add_ps(ay, _mm_mul_ps(_mm_add_ps(sinX, cosZ), strength));
+            az = _mm_add_ps(az, _mm_mul_ps(_mm_add_ps(sinY, cosX), strength));
+            break;
+        }
+        }
+    }
+
+    __m128 keep = _mm_set1_ps(program.m_dragKeep);
+    __m128 windX = _mm_set1_ps(program.m_wind[0]), windY = _mm_set1_ps(program.m_wind[1]), windZ = _mm_set1_ps(program.m_wind[2]);
+    vx = _mm_add_ps(windX, _mm_mul_ps(_mm_sub_ps(_mm_add_ps(vx, _mm_mul_ps(ax, dt)), windX), keep));
+    vy = _mm_add_ps(windY, _mm_mul_ps(_mm_sub_ps(_mm_add_ps(vy, _mm_mul_ps(ay, dt)), windY), keep));
+    vz = _mm_add_ps(windZ, _mm_mul_ps(_mm_sub_ps(_mm_add_ps(vz, _mm_mul_ps(az, dt)), windZ), keep));
+}
+
+template <PrimitiveTypes::UInt32 Features>
+PE_PARTICLE_TARGET_SSE2
+static PrimitiveTypes::UInt32 integrateParticlesSSE2(ParticleBufferCPU &pb,
+    PrimitiveTypes::UInt32 begin, PrimitiveTypes::UInt32 end, const ParticleIntegrateParams &params)
+{
+    const bool swirl = particleKernelDoes<Features>(ParticleKernelFeature_Swirl, true);
+    const bool sizeCurve = particleKernelDoes<Features>(ParticleKernelFeature_SizeCurve, true);
+    const bool speedCurve = particleKernelDoes<Features>(ParticleKernelFeature_SpeedCurve, true);
+    const bool affectors = particleKernelDoes<Features>(ParticleKernelFeature_Affectors, params.m_pAffectors != NULL);
+
+    const __m128 dt = _mm_set1_ps(params.m_dt);
+    const __m128 flatDrift = _mm_set1_ps(params.m_dt * params.m_pSpeedCurve[0]);
+    const __m128 swirlScale = _mm_set1_ps(params.m_swirlScale);
+    const __m128 swirlSpeed = _mm_set1_ps(params.m_swirlSpeed);
+    const __m128 baseSizeX = _mm_set1_ps(params.m_baseSizeX);
+    const __m128 baseSizeY = _mm_set1_ps(params.m_baseSizeY);
+
+    PrimitiveTypes::UInt32 expired = 0;
+    PrimitiveTypes::UInt32 j = begin;
+    for (; j + 4 <= end; j += 4)
+    {
+        __m128 age = _mm_add_ps(_mm_loadu_ps(pb.m_age + j), dt);
+        _mm_storeu_ps(pb.m_age + j, age);
+
+        // previous state for render interpolation
+        __m128 px = _mm_loadu_ps(pb.m_posX + j);
+        __m128 py = _mm_loadu_ps(pb.m_posY + j);
+        __m128 pz = _mm_loadu_ps(pb.m_posZ + j);
+        _mm_storeu_ps(pb.m_prevX + j, px);
+        _mm_storeu_ps(pb.m_prevY + j, py);
+        _mm_storeu_ps(pb.m_prevZ + j, pz);
+
+        __m128 alive = _mm_cmplt_ps(age, _mm_loadu_ps(pb.m_duration + j));
+        int aliveBits = _mm_movemask_ps(alive);
+        expired += 4 - ((aliveBits & 1) + ((aliveBits >> 1) & 1) + ((aliveBits >> 2) & 1) + ((aliveBits >> 3) & 1));
+        if (aliveBits == 0)
+            continue;
+
+        __m128 sample = _mm_setzero_ps(), fraction = _mm_setzero_ps();
+        if (sizeCurve || speedCurve)
+            locateCurveSamples4(_mm_div_ps(age, _mm_loadu_ps(pb.m_duration + j)), sample, fraction);
+        __m128 drift = speedCurve ? _mm_mul_ps(dt, sampleCurve4(params.m_pSpeedCurve, sample, fraction)) : flatDrift;
+
+        // dead lanes keep their old values
+        __m128 vx = _mm_loadu_ps(pb.m_velX + j);
+        __m128 vy = _mm_loadu_ps(pb.m_velY + j);
+        __m128 vz = _mm_loadu_ps(pb.m_velZ + j);
+        if (affectors)
+        {
+            __m128 nx = vx, ny = vy, nz = vz;
+            applyAffectors4(*params.m_pAffectors, dt, px, py, pz, nx, ny, nz);
+            vx = _mm_or_ps(_mm_and_ps(alive, nx), _mm_andnot_ps(alive, vx));
+            vy = _mm_or_ps(_mm_and_ps(alive, ny), _mm_andnot_ps(alive, vy));
+            vz = _mm_or_ps(_mm_and_ps(alive, nz), _mm_andnot_ps(alive, vz));
+            _mm_storeu_ps(pb.m_velX + j, vx);
+            _mm_storeu_ps(pb.m_velY + j, vy);
+            _mm_storeu_ps(pb.m_velZ + j, vz);
+        }
+
+        __m128 dx = _mm_mul_ps(vx, drift);
+        __m128 dy = _mm_mul_ps(vy, drift);
+        __m128 dz = _mm_mul_ps(vz, drift);
+        if (swirl)
+        {
+            __m128 phase = _mm_add_ps(_mm_mul_ps(swirlSpeed, age), _mm_loadu_ps(pb.m_phase + j));
+            __m128 swirlSin, swirlCos;
+            sincos4(phase, swirlSin, swirlCos);
+            dx = _mm_add_ps(dx, _mm_mul_ps(swirlCos, swirlScale));
+            dz = _mm_add_ps(dz, _mm_mul_ps(swirlSin, swirlScale));
+        }
+        _mm_storeu_ps(pb.m_posX + j, _mm_add_ps(px, _mm_and_ps(alive, dx)));
+        _mm_storeu_ps(pb.m_posY + j, _mm_add_ps(py, _mm_and_ps(alive, dy)));
+        _mm_storeu_ps(pb.m_posZ + j, _mm_add_ps(pz, _mm_and_ps(alive, dz)));
+
+        if (sizeCurve)
+        {
+            __m128 size = sampleCurve4(params.m_pSizeCurve, sample, fraction);
+            __m128 sx = _mm_loadu_ps(pb.m_sizeX + j);
+            __m128 sy = _mm_loadu_ps(pb.m_sizeY + j);
+            _mm_storeu_ps(pb.m_sizeX + j, _mm_or_ps(_mm_and_ps(alive, _mm_mul_ps(baseSizeX, size)), _mm_andnot_ps(alive, sx)));
+            _mm_storeu_ps(pb.m_sizeY + j, _mm_or_ps(_mm_and_ps(alive, _mm_mul_ps(baseSizeY, size)), _mm_andnot_ps(alive, sy)));
+        }
+    }
+
+    if (j < end)
+        expired += integrateParticlesScalarT<Features>(pb, j, end, params);
+    return expired;
+}
+
+// respondToParticleContact() on the lanes of contact
+PE_PARTICLE_TARGET_SSE2
+static inline void respondToContact4(const ParticleContactResponse &response, __m128 contact,
+    __m128 nx, __m128 ny, __m128 nz, __m128 &vx, __m128 &vy, __m128 &vz)
+{
+    const __m128 tangentKeep = _mm_set1_ps(response.m_tangentKeep);
+    __m128 vn = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, vx), _mm_mul_ps(ny, vy)), _mm_mul_ps(nz, vz));
+    __m128 normal = _mm_sub_ps(_mm_mul_ps(vn, _mm_set1_ps(response.m_normalKeep)),
+        _mm_mul_ps(_mm_set1_ps(response.m_approach), _mm_min_ps(vn, _mm_setzero_ps())));
+    __m128 rx = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(vx, _mm_mul_ps(nx, vn)), tangentKeep), _mm_mul_ps(nx, normal));
+    __m128 ry = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(vy, _mm_mul_ps(ny, vn)), tangentKeep), _mm_mul_ps(ny, normal));
+    __m128 rz = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(vz, _mm_mul_ps(nz, vn)), tangentKeep), _mm_mul_ps(nz, normal));
+    vx = _mm_or_ps(_mm_and_ps(contact, rx), _mm_andnot_ps(contact, vx));
+    vy = _mm_or_ps(_mm_and_ps(contact, ry), _mm_andnot_ps(contact, vy));
+    vz = _mm_or_ps(_mm_and_ps(contact, rz), _mm_andnot_ps(contact, vz));
+}
+
+// sampleParticleHeightfield() on four positions; no gather before AVX2, so four loads
+// per corner
+PE_PARTICLE_TARGET_SSE2
+static inline void sampleHeightfield4(const ParticleHeightfield &field, __m128 x, __m128 z,
+    __m128 &height, __m128 &slopeX, __m128 &slopeZ)
+{
+    const __m128 invCell = _mm_set1_ps(field.m_invCellSize);
+    const __m128 maxX = _mm_set1_ps((float)(field.m_columns - 1));
+    const __m128 maxZ = _mm_set1_ps((float)(field.m_rows - 1));
+    const __m128 one = _mm_set1_ps(1.0f);
+    // max() takes the second operand for NaN, like the scalar compare
+    __m128 gx = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(x, _mm_set1_ps(field.m_originX)), invCell), _mm_setzero_ps());
+    __m128 gz = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(z, _mm_set1_ps(field.m_originZ)), invCell), _mm_setzero_ps());
+    gx = _mm_min_ps(gx, maxX);
+    gz = _mm_min_ps(gz, maxZ);
+    __m128 cellX = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(gx)), _mm_sub_ps(maxX, one));
+    __m128 cellZ = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(gz)), _mm_sub_ps(maxZ, one));
+    __m128 fx = _mm_sub_ps(gx, cellX), fz = _mm_sub_ps(gz, cellZ);
+
+    PE_PARTICLE_ALIGN16 PrimitiveTypes::Int32 index[4];
+    _mm_store_si128(reinterpret_cast<__m128i *>(index),
+        _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(cellZ, _mm_set1_ps((float)field.m_columns)), cellX)));
+    const PrimitiveTypes::Float32 *h = &field.m_heights[0];
+    const PrimitiveTypes::Int32 row = (PrimitiveTypes::Int32)field.m_columns;
+    __m128 h00 = _mm_setr_ps(h[index[0]], h[index[1]], h[index[2]], h[index[3]]);
+    __m128 h10 = _mm_setr_ps(h[index[0] + 1], h[index[1] + 1], h[index[2] + 1], h[index[3] + 1]);
+    __m128 h01 = _mm_setr_ps(h[index[0] + row], h[index[1] + row], h[index[2] + row], h[index[3] + row]);
+    __m128 h11 = _mm_setr_ps(h[index[0] + row + 1], h[index[1] + row + 1], h[index[2] + row + 1], h[index[3] + row + 1]);
+
+    __m128 dx0 = _mm_sub_ps(h10, h00), dx1 = _mm_sub_ps(h11, h01);
+    __m128 h0 = _mm_add_ps(h00, _mm_mul_ps(dx0, fx));
+    __m128 h1 = _mm_add_ps(h01, _mm_mul_ps(dx1, fx));
+    height = _mm_add_ps(h0, _mm_mul_ps(_mm_sub_ps(h1, h0), fz));
+    slopeX = _mm_mul_ps(_mm_add_ps(dx0, _mm_mul_ps(_mm_sub_ps(dx1, dx0), fz)), invCell);
+    slopeZ = _mm_mul_ps(_mm_sub_ps(h1, h0), invCell);
+}
+
+PE_PARTICLE_TARGET_SSE2
+static PrimitiveTypes::UInt32 collideParticlesSSE2(ParticleBufferCPU &pb,
+    PrimitiveTypes::UInt32 begin, PrimitiveTypes::UInt32 end, const ParticleCollideParams &params)
+{
+    const ParticleContactResponse response(params);
+    const bool kill = params.m_response == ParticleCollision_Kill;
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    PrimitiveTypes::UInt32 killed = 0;
+    PrimitiveTypes::UInt32 j = begin;
+    for (; j + 4 <= end; j += 4)
+    {
+        __m128 px = _mm_loadu_ps(pb.m_posX + j);
+        __m128 py = _mm_loadu_ps(pb.m_posY + j);
+        __m128 pz = _mm_loadu_ps(pb.m_posZ + j);
+        __m128 vx = _mm_loadu_ps(pb.m_velX + j);
+        __m128 vy = _mm_loadu_ps(pb.m_velY + j);
+        __m128 vz = _mm_loadu_ps(pb.m_velZ + j);
+        __m128 hit = zero;
+
+        for (PrimitiveTypes::UInt32 k = 0; k < params.m_planeCount; k++)
+        {
+            const ParticleCollisionPlane &plane = params.m_pPlanes[k];
+            __m128 nx = _mm_set1_ps(plane.m_normal[0]);
+            __m128 ny = _mm_set1_ps(plane.m_normal[1]);
+            __m128 nz = _mm_set1_ps(plane.m_normal[2]);
+            __m128 d = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, px), _mm_mul_ps(ny, py)), _mm_mul_ps(nz, pz)),
+                _mm_set1_ps(plane.m_offset));
+            __m128 contact = _mm_cmplt_ps(d, zero);
+            hit = _mm_or_ps(hit, contact);
+            if (kill)
+                continue;
+            // lanes in front have d clamped to 0 and stay put
+            d = _mm_min_ps(d, zero);
+            px = _mm_sub_ps(px, _mm_mul_ps(nx, d));
+            py = _mm_sub_ps(py, _mm_mul_ps(ny, d));
+            pz = _mm_sub_ps(pz, _mm_mul_ps(nz, d));
+            respondToContact4(response, contact, nx, ny, nz, vx, vy, vz);
+        }
+
+        if (params.m_pHeightfield)
+        {
+            __m128 height, slopeX, slopeZ;
+            sampleHeightfield4(*params.m_pHeightfield, px, pz, height, slopeX, slopeZ);
+            __m128 d = _mm_sub_ps(py, height);
+            __m128 contact = _mm_cmplt_ps(d, zero);
+            hit = _mm_or_ps(hit, contact);
+            if (!kill && _mm_movemask_ps(contact))
+            {
+                py = _mm_sub_ps(py, _mm_min_ps(d, zero));
+                __m128 scale = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(one,
+                    _mm_add_ps(_mm_mul_ps(slopeX, slopeX), _mm_mul_ps(slopeZ, slopeZ)))));
+                __m128 nx = _mm_sub_ps(zero, _mm_mul_ps(slopeX, scale));
+                __m128 nz = _mm_sub_ps(zero, _mm_mul_ps(slopeZ, scale));
+                respondToContact4(response, contact, nx, scale, nz, vx, vy, vz);
+            }
+        }
+
+        if (kill)
+        {
+            __m128 age = _mm_loadu_ps(pb.m_age + j);
+            __m128 duration = _mm_loadu_ps(pb.m_duration + j);
+            __m128 dies = _mm_and_ps(hit, _mm_cmplt_ps(age, duration));
+            int dieBits = _mm_movemask_ps(dies);
+            if (dieBits)
+            {
+                _mm_storeu_ps(pb.m_age + j, _mm_or_ps(_mm_and_ps(dies, duration), _mm_andnot_ps(dies, age)));
+                killed += (dieBits & 1) + ((dieBits >> 1) & 1) + ((dieBits >> 2) & 1) + ((dieBits >> 3) & 1);
+            }
+            continue;
+        }
+        _mm_storeu_ps(pb.m_posX + j, px);
+        _mm_storeu_ps(pb.m_posY + j, py);
+        _mm_storeu_ps(pb.m_posZ + j, pz);
+        _mm_storeu_ps(pb.m_velX + j, vx);
+        _mm_storeu_ps(pb.m_velY + j, vy);
+        _mm_storeu_ps(pb.m_velZ + j, vz);
+    }
+
+    if (j < end)
+        killed += collideParticlesScalar(pb, j, end, params);
+    return killed;
+}
+
+PE_PARTICLE_TARGET_SSE2
+static inline float horizontalSum4(__m128 v)
+{
+    v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+    return _mm_cvtss_f32(v);
+}
+
+PE_PARTICLE_TARGET_SSE2
+static void interactParticlesSSE2(ParticleBufferCPU &pb, const ParticleNeighborGrid &grid,
+    PrimitiveTypes::UInt32 begin, PrimitiveTypes::UInt32 end, const ParticleInteractParams &params)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 radiusSquared = _mm_set1_ps(params.m_radius * params.m_radius);
+    const __m128 invRadius = _mm_set1_ps(1.0f / params.m_radius);
+    const __m128 separation = _mm_set1_ps(params.m_separation);
+    const __m128 cohesion = _mm_set1_ps(params.m_cohesion);
+    const __m128 alignment = _mm_set1_ps(params.m_alignment);
+    const __m128i lanes = _mm_setr_epi32(0, 1, 2, 3);
+    const PrimitiveTypes::Float32 *posX = &grid.m_posX[0], *posY = &grid.m_posY[0], *posZ = &grid.m_posZ[0];
+    const PrimitiveTypes::Float32 *velX = &grid.m_velX[0], *velY = &grid.m_velY[0], *velZ = &grid.m_velZ[0];
+
+    // particles of one cell share their rows; the slots are sorted by cell
+    PrimitiveTypes::UInt32 rowBegin[ParticleNeighborGrid::MaxNeighborRows], rowEnd[ParticleNeighborGrid::MaxNeighborRows];
+    PrimitiveTypes::UInt32 rows = 0, cellEnd = begin;
+    for (PrimitiveTypes::UInt32 slot = begin; slot < end; slot++)
+    {
+        if (slot >= cellEnd)
+            rows = grid.getNeighborRows(slot, rowBegin, rowEnd, cellEnd);
+
+        const __m128 x = _mm_set1_ps(posX[slot]), y = _mm_set1_ps(posY[slot]), z = _mm_set1_ps(posZ[slot]);
+        const __m128 vx = _mm_set1_ps(velX[slot]), vy = _mm_set1_ps(velY[slot]), vz = _mm_set1_ps(velZ[slot]);
+        __m128 ax = zero, ay = zero, az = zero;
+
+        for (PrimitiveTypes::UInt32 r = 0; r < rows; r++)
+        {
+            const __m128i rowLimit = _mm_set1_epi32((int)rowEnd[r]);
+            // the sorted copies are padded, loads past the row read other particles or
+            // padding and are masked out
+            for (PrimitiveTypes::UInt32 other = rowBegin[r]; other < rowEnd[r]; other += 4)
+            {
+                __m128 inRow = _mm_castsi128_ps(_mm_cmplt_epi32(_mm_add_epi32(_mm_set1_epi32((int)other), lanes), rowLimit));
+                __m128 dx = _mm_sub_ps(_mm_loadu_ps(posX + other), x);
+                __m128 dy = _mm_sub_ps(_mm_loadu_ps(posY + other), y);
+                __m128 dz = _mm_sub_ps(_mm_loadu_ps(posZ + other), z);
+                __m128 distanceSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+                // the particle itself and any on the same spot fail the > 0
+                __m128 inside = _mm_and_ps(inRow, _mm_and_ps(_mm_cmplt_ps(distanceSquared, radiusSquared),
+                    _mm_cmpgt_ps(distanceSquared, zero)));
+
+                __m128 distance = _mm_sqrt_ps(distanceSquared);
+                __m128 q = _mm_sub_ps(one, _mm_mul_ps(distance, invRadius));
+                __m128 pull = _mm_div_ps(_mm_sub_ps(_mm_mul_ps(cohesion, q), _mm_mul_ps(separation, _mm_mul_ps(q, q))), distance);
+                __m128 match = _mm_mul_ps(alignment, q);
+                ax = _mm_add_ps(ax, _mm_and_ps(inside, _mm_add_ps(_mm_mul_ps(pull, dx),
+                    _mm_mul_ps(match, _mm_sub_ps(_mm_loadu_ps(velX + other), vx)))));
+                ay = _mm_add_ps(ay, _mm_and_ps(inside, _mm_add_ps(_mm_mul_ps(pull, dy),
+                    _mm_mul_ps(match, _mm_sub_ps(_mm_loadu_ps(velY + other), vy)))));
+                az = _mm_add_ps(az, _mm_and_ps(inside, _mm_add_ps(_mm_mul_ps(pull, dz),
+                    _mm_mul_ps(match, _mm_sub_ps(_mm_loadu_ps(velZ + other), vz)))));
+            }
+        }
+
+        PrimitiveTypes::UInt32 i = grid.m_particle[slot];
+        pb.m_velX[i] = velX[slot] + horizontalSum4(ax) * params.m_dt;
+        pb.m_velY[i] = velY[slot] + horizontalSum4(ay) * params.m_dt;
+        pb.m_velZ[i] = velZ[slot] + horizontalSum4(az) * params.m_dt;
+    }
+}
+
+PE_PARTICLE_TARGET_AVX2
+static inline void sincos8(__m256 x, __m256 &outSin, __m256 &outCos)
+{
+    __m256i q = _mm256_cvtps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(PE_PARTICLE_2OPI)));
+    __m256 qf = _mm256_cvtepi32_ps(q);
+
+    __m256 r = _mm256_sub_ps(x, _mm256_mul_ps(qf, _mm256_set1_ps(PE_PARTICLE_PIO2_1)));
+    r = _mm256_sub_ps(r, _mm256_mul_ps(qf, _mm256_set1_ps(PE_PARTICLE_PIO2_2)));
+    r = _mm256_sub_ps(r, _mm256_mul_ps(qf, _mm256_set1_ps(PE_PARTICLE_PIO2_3)));
+    __m256 r2 = _mm256_mul_ps(r, r);
+
+    __m256 s = _mm256_add_ps(_mm256_mul_ps(r2, _mm256_set1_ps(PE_PARTICLE_SIN_3)), _mm256_set1_ps(PE_PARTICLE_SIN_2));
+    s = _mm256_add_ps(_mm256_mul_ps(s, r2), _mm256_set1_ps(PE_PARTICLE_SIN_1));
+    s = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(s, r2), r), r);
+
+    __m256 c = _mm256_add_ps(_mm256_mul_ps(r2, _mm256_set1_ps(PE_PARTICLE_COS_3)), _mm256_set1_ps(PE_PARTICLE_COS_2));
+    c = _mm256_add_ps(_mm256_mul_ps(c, r2), _mm256_set1_ps(PE_PARTICLE_COS_1));
+    c = _mm256_mul_ps(_mm256_mul_ps(c, r2), r2);
+    c = _mm256_add_ps(_mm256_sub_ps(c, _mm256_mul_ps(r2, _mm256_set1_ps(0.5f))), _mm256_set1_ps(1.0f));
+
+    __m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(q, _mm256_set1_epi32(1)), _mm256_set1_epi32(1)));
+    __m256 sinv = _mm256_blendv_ps(s, c, swap);
+    __m256 cosv = _mm256_blendv_ps(c, s, swap);
+
+    __m256 sinSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(q, _mm256_set1_epi32(2)), 30));
+    __m256 cosSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(q, _mm256_set1_epi32(1)), _mm256_set1_epi32(2)), 30));
+    outSin = _mm256_xor_ps(sinv, sinSign);
+    outCos = _mm256_xor_ps(cosv, cosSign);
+}
+
+PE_PARTICLE_TARGET_AVX2
+static inline void locateCurveSamples8(__m256 t, __m256i &sample, __m256 &fraction)
+{
+    const __m256 samples = _mm256_set1_ps((float)ParticleCurveSamples);
+    __m256 x = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(t, samples), _mm256_setzero_ps()), samples);
+    sample = _mm256_min_epi32(_mm256_cvttps_epi32(x), _mm256_set1_epi32(ParticleCurveSamples - 1));
+    fraction = _mm256_sub_ps(x, _mm256_cvtepi32_ps(sample));
+}
+
+PE_PARTICLE_TARGET_AVX2
+static inline __m256 sampleCurve8(const PrimitiveTypes::Float32 *pTable, __m256i sample, __m256 fraction)
+{
+    __m256 a = _mm256_i32gather_ps(pTable, sample, 4);
+    __m256 b = _mm256_i32gather_ps(pTable + 1, sample, 4);
+    return _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), fraction));
+}
+
+// applyParticleAffectorsScalar() on eight particles
+PE_PARTICLE_TARGET_AVX2
+static inline void applyAffectors8(const ParticleAffectorProgram &program, __m256 dt,
+    __m256 px, __m256 py, __m256 pz, __m256 &vx, __m256 &vy, __m256 &vz)
+{
+    __m256 ax = _mm256_set1_ps(program.m_acceleration[0]);
+    __m256 ay = _mm256_set1_ps(program.m_acceleration[1]);
+    __m256 az = _mm256_set1_ps(program.m_acceleration[2]);
+    for (PrimitiveTypes::UInt32 i = 0; i < program.m_opCount; i++)
+    {
+        const ParticleAffectorOp &op = program.m_ops[i];
+        switch (op.m_type)
+        {
+        case ParticleAffector_Attractor:
+        {
+            __m256 dx = _mm256_sub_ps(_mm256_set1_ps(op.m_center[0]), px);
+            __m256 dy = _mm256_sub_ps(_mm256_set1_ps(op.m_center[1]), py);
+            __m256 dz = _mm256_sub_ps(_mm256_set1_ps(op.m_center[2]), pz);
+            __m256 q = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)),
+                _mm256_add_ps(_mm256_mul_ps(dz, dz), _mm256_set1_ps(op.m_radiusSquared)));
+            __m256 s = _mm256_div_ps(_mm256_set1_ps(op.m_strength), _mm256_mul_ps(q, _mm256_sqrt_ps(q)));
+            ax = _mm256_add_ps(ax, _mm256_mul_ps(dx, s));
+            ay = _mm256_add_ps(ay, _mm256_mul_ps(dy, s));
+            az = _mm256_add_ps(az, _mm256_mul_ps(dz, s));
+            break;
+        }
+        case ParticleAffector_Vortex:
+        {
+            __m256 dx = _mm256_sub_ps(px, _mm256_set1_ps(op.m_center[0]));
+            __m256 dy = _mm256_sub_ps(py, _mm256_set1_ps(op.m_center[1]));
+            __m256 dz = _mm256_sub_ps(pz, _mm256_set1_ps(op.m_center[2]));
+            __m256 axisX = _mm256_set1_ps(op.m_axis[0]), axisY = _mm256_set1_ps(op.m_axis[1]), axisZ = _mm256_set1_ps(op.m_axis[2]);
+            __m256 cx = _mm256_sub_ps(_mm256_mul_ps(axisY, dz), _mm256_mul_ps(axisZ, dy));
+            __m256 cy = _mm256_sub_ps(_mm256_mul_ps(axisZ, dx), _mm256_mul_ps(axisX, dz));
+            __m256 cz = _mm256_sub_ps(_mm256_mul_ps(axisX, dy), _mm256_mul_ps(axisY, dx));
+            __m256 q = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(cx, cx), _mm256_mul_ps(cy, cy)),
+                _mm256_add_ps(_mm256_mul_ps(cz, cz), _mm256_set1_ps(op.m_radiusSquared)));
+            __m256 s = _mm256_div_ps(_mm256_set1_ps(op.m_strength), q);
+            ax = _mm256_add_ps(ax, _mm256_mul_ps(cx, s));
+            ay = _mm256_add_ps(ay, _mm256_mul_ps(cy, s));
+            az = _mm256_add_ps(az, _mm256_mul_ps(cz, s));
+            break;
+        }
+        case ParticleAffector_Turbulence:
+        {
+            __m256 frequency = _mm256_set1_ps(op.m_radiusSquared);
+            __m256 sinX, cosX, sinY, cosY, sinZ, cosZ;
+            sincos8(_mm256_add_ps(_mm256_mul_ps(px, frequency), _mm256_set1_ps(op.m_center[0])), sinX, cosX);
+            sincos8(_mm256_add_ps(_mm256_mul_ps(py, frequency), _mm256_set1_ps(op.m_center[1])), sinY, cosY);
+            sincos8(_mm256_add_ps(_mm256_mul_ps(pz, frequency), _mm256_set1_ps(op.m_center[2])), sinZ, cosZ);
+            __m256 strength = _mm256_set1_ps(op.m_strength);
+            ax = _mm256_add_ps(ax, _mm256_mul_ps(_mm256_add_ps(sinZ, cosY), strength));
+            ay = _mm256_add_ps(ay, _mm256_mul_ps(_mm256_add_ps(sinX, cosZ), strength));
+            az = _mm256_add_ps(az, _mm256_mul_ps(_mm256_add_ps(sinY, cosX), strength));
+            break;
+        }
+        }
+    }
+
+    __m256 keep = _mm256_set1_ps(program.m_dragKeep);
+    __m256 windX = _mm256_set1_ps(program.m_wind[0]), windY = _mm256_set1_ps(program.m_wind[1]), windZ = _mm256_set1_ps(program.m_wind[2]);
+    vx = _mm256_add_ps(windX, _mm256_mul_ps(_mm256_sub_ps(_mm256_add_ps(vx, _mm256_mul_ps(ax, dt)), windX), keep));
+    vy = _mm256_add_ps(windY, _mm256_mul_ps(_mm256_sub_ps(_mm256_add_ps(vy, _mm256_mul_ps(ay, dt)), windY), keep));
+    vz = _mm256_add_ps(windZ, _mm256_mul_ps(_mm256_sub_ps(_mm256_add_ps(vz, _mm256_mul_ps(az, dt)), windZ), keep));
+}
+
+template <PrimitiveTypes::UInt32 Features>
+PE_PARTICLE_TARGET_AVX2
+static PrimitiveTypes::UInt32 integrateParticlesAVX2(ParticleBufferCPU &pb,
+    PrimitiveTypes::UInt32 begin, PrimitiveTypes::UInt32 end, const ParticleIntegrateParams &params)
+{
+    const bool swirl = particleKernelDoes<Features>(ParticleKernelFeature_Swirl, true);
+    const bool sizeCurve = particleKernelDoes<Features>(ParticleKernelFeature_SizeCurve, true);
+    const bool speedCurve = particleKernelDoes<Features>(ParticleKernelFeature_SpeedCurve, true);
+    const bool affectors = particleKernelDoes<Features>(ParticleKernelFeature_Affectors, params.m_pAffectors != NULL);
+
+    const __m256 dt = _mm256_set1_ps(params.m_dt);
+    const __m256 flatDrift = _mm256_set1_ps(params.m_dt * params.m_pSpeedCurve[0]);
+    const __m256 swirlScale = _mm256_set1_ps(params.m_swirlScale);
+    const __m256 swirlSpeed = _mm256_set1_ps(params.m_swirlSpeed);
+    const __m256 baseSizeX = _mm256_set1_ps(params.m_baseSizeX);
+    const __m256 baseSizeY = _mm256_set1_ps(params.m_baseSizeY);
+
+    PrimitiveTypes::UInt32 expired = 0;
+    PrimitiveTypes::UInt32 j = begin;
+    for (; j + 8 <= end; j += 8)
+    {
+        __m256 age = _mm256_add_ps(_mm256_loadu_ps(pb.m_age + j), dt);
+        _mm256_storeu_ps(pb.m_age + j, age);
+
+        __m256 px = _mm256_loadu_ps(pb.m_posX + j);
+        __m256 py = _mm256_loadu_ps(pb.m_posY + j);
+        __m256 pz = _mm256_loadu_ps(pb.m_posZ + j);
+        _mm256_storeu_ps(pb.m_prevX + j, px);
+        _mm256_storeu_ps(pb.m_prevY + j, py);
+        _mm256_storeu_ps(pb.m_prevZ + j, pz);
+
+        __m256 alive = _mm256_cmp_ps(age, _mm256_loadu_ps(pb.m_duration + j), _CMP_LT_OQ);
+        int aliveBits = _mm256_movemask_ps(alive);
+        int aliveCount = 0;
+        for (int bits = aliveBits; bits; bits &= bits - 1)
+            aliveCount++;
+        expired += 8 - aliveCount;
+        if (aliveBits == 0)
+            continue;
+
+        __m256i sample = _mm256_setzero_si256();
+        __m256 fraction = _mm256_setzero_ps();
+        if (sizeCurve || speedCurve)
+            locateCurveSamples8(_mm256_div_ps(age, _mm256_loadu_ps(pb.m_duration + j)), sample, fraction);
+        __m256 drift = speedCurve ? _mm256_mul_ps(dt, sampleCurve8(params.m_pSpeedCurve, sample, fraction)) : flatDrift;
+
+        __m256 vx = _mm256_loadu_ps(pb.m_velX + j);
+        __m256 vy = _mm256_loadu_ps(pb.m_velY + j);
+        __m256 vz = _mm256_loadu_ps(pb.m_velZ + j);
+        if (affectors)
+        {
+            __m256 nx = vx, ny = vy, nz = vz;
+            applyAffectors8(*params.m_pAffectors, dt, px, py, pz, nx, ny, nz);
+            vx = _mm256_blendv_ps(vx, nx, alive);
+            vy = _mm256_blendv_ps(vy, ny, alive);
+            vz = _mm256_blendv_ps(vz, nz, alive);
+            _mm256_storeu_ps(pb.m_velX + j, vx);
+            _mm256_storeu_ps(pb.m_velY + j, vy);
+            _mm256_storeu_ps(pb.m_velZ + j, vz);
+        }
+
+        __m256 dx = _mm256_mul_ps(vx, drift);
+        __m256 dy = _mm256_mul_ps(vy, drift);
+        __m256 dz = _mm256_mul_ps(vz, drift);
+        if (swirl)
+        {
+            __m256 phase = _mm256_add_ps(_mm256_mul_ps(swirlSpeed, age), _mm256_loadu_ps(pb.m_phase + j));
+            __m256 swirlSin, swirlCos;
+            sincos8(phase, swirlSin, swirlCos);
+            dx = _mm256_add_ps(dx, _mm256_mul_ps(swirlCos, swirlScale));
+            dz = _mm256_add_ps(dz, _mm256_mul_ps(swirlSin, swirlScale));
+        }
+        _mm256_storeu_ps(pb.m_posX + j, _mm256_add_ps(px, _mm256_and_ps(alive, dx)));
+        _mm256_storeu_ps(pb.m_posY + j, _mm256_add_ps(py, _mm256_and_ps(alive, dy)));
+        _mm256_storeu_ps(pb.m_posZ + j, _mm256_add_ps(pz, _mm256_and_ps(alive, dz)));
+
+        if (sizeCurve)
+        {
+            __m256 size = sampleCurve8(params.m_pSizeCurve, sample, fraction);
+            __m256 sx = _mm256_loadu_ps(pb.m_sizeX + j);
+            __m256 sy = _mm256_loadu_ps(pb.m_sizeY + j);
+            _mm256_storeu_ps(pb.m_sizeX + j, _mm256_blendv_ps(sx, _mm256_mul_ps(baseSizeX, size), alive));
+            _mm256_storeu_ps(pb.m_sizeY + j, _mm256_blendv_ps(sy, _mm256_mul_ps(baseSizeY, size), alive));
+        }
+    }
+
+    if (j < end)
+        expired += integrateParticlesSSE2<Features>(pb, j, end, params);
+    return expired;
+}
+
+PE_PARTICLE_TARGET_AVX2
+static inline void respondToContact8(const ParticleContactResponse &response, __m256 contact,
+    __m256 nx, __m256 ny, __m256 nz, __m256 &vx, __m256 &vy, __m256 &vz)
+{
+    const __m256 tangentKeep = _mm256_set1_ps(response.m_tangentKeep);
+    __m256 vn = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, vx), _mm256_mul_ps(ny, vy)), _mm256_mul_ps(nz, vz));
+    __m256 normal = _mm256_sub_ps(_mm256_mul_ps(vn, _mm256_set1_ps(response.m_normalKeep)),
+        _mm256_mul_ps(_mm256_set1_ps(response.m_approach), _mm256_min_ps(vn, _mm256_setzero_ps())));
+    __m256 rx = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(vx, _mm256_mul_ps(nx, vn)), tangentKeep), _mm256_mul_ps(nx, normal));
+    __m256 ry = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(vy, _mm256_mul_ps(ny, vn)), tangentKeep), _mm256_mul_ps(ny, normal));
+    __m256 rz = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(vz, _mm256_mul_ps(nz, vn)), tangentKeep), _mm256_mul_ps(nz, normal));
+    vx = _mm256_blendv_ps(vx, rx, contact);
+    vy = _mm256_blendv_ps(vy, ry, contact);
+    vz = _mm256_blendv_ps(vz, rz, contact);
+}
+
+PE_PARTICLE_TARGET_AVX2
+static inline void sampleHeightfield8(const ParticleHeightfield &field, __m256 x, __m256 z,
+    __m256 &height, __m256 &slopeX, __m256 &slopeZ)
+{
+    const __m256 invCell = _mm256_set1_ps(field.m_invCellSize);
+    const __m256 maxX = _mm256_set1_ps((float)(field.m_columns - 1));
+    const __m256 maxZ = _mm256_set1_ps((float)(field.m_rows - 1));
+    const __m256 one = _mm256_set1_ps(1.0f);
+    __m256 gx = _mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(x, _mm256_set1_ps(field.m_originX)), invCell), _mm256_setzero_ps());
+    __m256 gz = _mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(z, _mm256_set1_ps(field.m_originZ)), invCell), _mm256_setzero_ps());
+    gx = _mm256_min_ps(gx, maxX);
+    gz = _mm256_min_ps(gz, maxZ);
+    __m256 cellX = _mm256_min_ps(_mm256_cvtepi32_ps(_mm256_cvttps_epi32(gx)), _mm256_sub_ps(maxX, one));
+    __m256 cellZ = _mm256_min_ps(_mm256_cvtepi32_ps(_mm256_cvttps_epi32(gz)), _mm256_sub_ps(maxZ, one));
+    __m256 fx = _mm256_sub_ps(gx, cellX), fz = _mm256_sub_ps(gz, cellZ);
+
+    __m256i index = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(cellZ, _mm256_set1_ps((float)field.m_columns)), cellX));
+    const PrimitiveTypes::Float32 *h = &field.m_heights[0];
+    const PrimitiveTypes::Float32 *hNext = h + field.m_columns;
+    __m256 h00 = _mm256_i32gather_ps(h, index, 4);
+    __m256 h10 = _mm256_i32gather_ps(h + 1, index, 4);
+    __m256 h01 = _mm256_i32gather_ps(hNext, index, 4);
+    __m256 h11 = _mm256_i32gather_ps(hNext + 1, index, 4);
+
+    __m256 dx0 = _mm256_sub_ps(h10, h00), dx1 = _mm256_sub_ps(h11, h01);
+    __m256 h0 = _mm256_add_ps(h00, _mm256_mul_ps(dx0, fx));
+    __m256 h1 = _mm256_add_ps(h01, _mm256_mul_ps(dx1, fx));
+    height = _mm256_add_ps(h0, _mm256_mul_ps(_mm256_sub_ps(h1, h0), fz));
+    slopeX = _mm256_mul_ps(_mm256_add_ps(dx0, _mm256_mul_ps(_mm256_sub_ps(dx1, dx0), fz)), invCell);
+    slopeZ = _mm256_mul_ps(_mm256_sub_ps(h1, h0), invCell);
+}
+
+PE_PARTICLE_TARGET_AVX2
+static PrimitiveTypes::UInt32 collideParticlesAVX2(ParticleBufferCPU &pb,
+    PrimitiveTypes::UInt32 begin, PrimitiveTypes::UInt32 end, const ParticleCollideParams &params)
+{
+    const ParticleContactResponse response(params);
+    const bool kill = params.m_response == ParticleCollision_Kill;
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+
+    PrimitiveTypes::UInt32 killed = 0;
+    PrimitiveTypes::UInt32 j = begin;
+    for (; j + 8 <= end; j += 8)
+    {
+        __m256 px = _mm256_loadu_ps(pb.m_posX + j);
+        __m256 py = _mm256_loadu_ps(pb.m_posY + j);
+        __m256 pz = _mm256_loadu_ps(pb.m_posZ + j);
+        __m256 vx = _mm256_loadu_ps(pb.m_velX + j);
+        __m256 vy = _mm256_loadu_ps(pb.m_velY + j);
+        __m256 vz = _mm256_loadu_ps(pb.m_velZ + j);
+        __m256 hit = zero;
+
+        for (PrimitiveTypes::UInt32 k = 0; k < params.m_planeCount; k++)
+        {
+            const ParticleCollisionPlane &plane = params.m_pPlanes[k];
+            __m256 nx = _mm256_set1_ps(plane.m_normal[0]);
+            __m256 ny = _mm256_set1_ps(plane.m_normal[1]);
+            __m256 nz = _mm256_set1_ps(plane.m_normal[2]);
+            __m256 d = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, px), _mm256_mul_ps(ny, py)),
+                _mm256_mul_ps(nz, pz)), _mm256_set1_ps(plane.m_offset));
+            __m256 contact = _mm256_cmp_ps(d, zero, _CMP_LT_OQ);
+            hit = _mm256_or_ps(hit, contact);
+            if (kill)
+                continue;
+            d = _mm256_min_ps(d, zero);
+            px = _mm256_sub_ps(px, _mm256_mul_ps(nx, d));
+            py = _mm256_sub_ps(py, _mm256_mul_ps(ny, d));
+            pz = _mm256_sub_ps(pz, _mm256_mul_ps(nz, d));
+            respondToContact8(response, contact, nx, ny, nz, vx, vy, vz);
+        }
+
+        if (params.m_pHeightfield)
+        {
+            __m256 height, slopeX, slopeZ;
+            sampleHeightfield8(*params.m_pHeightfield, px, pz, height, slopeX, slopeZ);
+            __m256 d = _mm256_sub_ps(py, height);
+            __m256 contact = _mm256_cmp_ps(d, zero, _CMP_LT_OQ);
+            hit = _mm256_or_ps(hit, contact);
+            if (!kill && _mm256_movemask_ps(contact))
+            {
+                py = _mm256_sub_ps(py, _mm256_min_ps(d, zero));
+                __m256 scale = _mm256_div_ps(one, _mm256_sqrt_ps(_mm256_add_ps(one,
+                    _mm256_add_ps(_mm256_mul_ps(slopeX, slopeX), _mm256_mul_ps(slopeZ, slopeZ)))));
+                __m256 nx = _mm256_sub_ps(zero, _mm256_mul_ps(slopeX, scale));
+                __m256 nz = _mm256_sub_ps(zero, _mm256_mul_ps(slopeZ, scale));
+                respondToContact8(response, contact, nx, scale, nz, vx, vy, vz);
+            }
+        }
+
+        if (kill)
+        {
+            __m256 age = _mm256_loadu_ps(pb.m_age + j);
+            __m256 duration = _mm256_loadu_ps(pb.m_duration + j);
+            __m256 dies = _mm256_and_ps(hit, _mm256_cmp_ps(age, duration, _CMP_LT_OQ));
+            int dieBits = _mm256_movemask_ps(dies);
+            if (dieBits)
+            {
+                _mm256_storeu_ps(pb.m_age + j, _mm256_blendv_ps(age, duration, dies));
+                for (; dieBits; dieBits &= dieBits - 1)
+                    killed++;
+            }
+            continue;
+        }
+        _mm256_storeu_ps(pb.m_posX + j, px);
+        _mm256_storeu_ps(pb.m_posY + j, py);
+        _mm256_storeu_ps(pb.m_posZ + j, pz);
+        _mm256_storeu_ps(pb.m_velX + j, vx);
+        _mm256_storeu_ps(pb.m_velY + j, vy);
+        _mm256_storeu_ps(pb.m_velZ + j, vz);
+    }
+
+    if (j < end)
+        killed += collideParticlesSSE2(pb, j, end, params);
+    return killed;
+}
+
+PE_PARTICLE_TARGET_AVX2
+static void interactParticlesAVX2(ParticleBufferCPU &pb, const ParticleNeighborGrid &grid,
+    PrimitiveTypes::UInt32 begin, PrimitiveTypes::UInt32 end, const ParticleInteractParams &params)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 radiusSquared = _mm256_set1_ps(params.m_radius * params.m_radius);
+    const __m256 invRadius = _mm256_set1_ps(1.0f / params.m_radius);
+    const __m256 separation = _mm256_set1_ps(params.m_separation);
+    const __m256 cohesion = _mm256_set1_ps(params.m_cohesion);
+    const __m256 alignment = _mm256_set1_ps(params.m_alignment);
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const PrimitiveTypes::Float32 *posX = &grid.m_posX[0], *posY = &grid.m_posY[0], *posZ = &grid.m_posZ[0];
+    const PrimitiveTypes::Float32 *velX = &grid.m_velX[0], *velY = &grid.m_velY[0], *velZ = &grid.m_velZ[0];
+
+    // particles of one cell share their rows; the slots are sorted by cell
+    PrimitiveTypes::UInt32 rowBegin[ParticleNeighborGrid::MaxNeighborRows], rowEnd[ParticleNeighborGrid::MaxNeighborRows];
+    PrimitiveTypes::UInt32 rows = 0, cellEnd = begin;
+    for (PrimitiveTypes::UInt32 slot = begin; slot < end; slot++)
+    {
+        if (slot >= cellEnd)
+            rows = grid.getNeighborRows(slot, rowBegin, rowEnd, cellEnd);
+
+        const __m256 x = _mm256_set1_ps(posX[slot]), y = _mm256_set1_ps(posY[slot]), z = _mm256_set1_ps(posZ[slot]);
+        const __m256 vx = _mm256_set1_ps(velX[slot]), vy = _mm256_set1_ps(velY[slot]), vz = _mm256_set1_ps(velZ[slot]);
+        __m256 ax = zero, ay = zero, az = zero;
+
+        for (PrimitiveTypes::UInt32 r = 0; r < rows; r++)
+        {
+            const __m256i rowLimit = _mm256_set1_epi32((int)rowEnd[r]);
+            for (PrimitiveTypes::UInt32 other = rowBegin[r]; other < rowEnd[r]; other += 8)
+            {
+                __m256 inRow = _mm256_castsi256_ps(_mm256_cmpgt_epi32(rowLimit, _mm256_add_epi32(_mm256_set1_epi32((int)other), lanes)));
+                __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(posX + other), x);
+                __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(posY + other), y);
+                __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(posZ + other), z);
+                __m256 distanceSquared = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)),
+                    _mm256_mul_ps(dz, dz));
+                __m256 inside = _mm256_and_ps(inRow, _mm256_and_ps(_mm256_cmp_ps(distanceSquared, radiusSquared, _CMP_LT_OQ),
+                    _mm256_cmp_ps(distanceSquared, zero, _CMP_GT_OQ)));
+
+                __m256 distance = _mm256_sqrt_ps(distanceSquared);
+                __m256 q = _mm256_sub_ps(one, _mm256_mul_ps(distance, invRadius));
+                __m256 pull = _mm256_div_ps(_mm256_sub_ps(_mm256_mul_ps(cohesion, q), _mm256_mul_ps(separation, _mm256_mul_ps(q, q))),
+                    distance);
+                __m256 match = _mm256_mul_ps(alignment, q);
+                ax = _mm256_add_ps(ax, _mm256_and_ps(inside, _mm256_add_ps(_mm256_mul_ps(pull, dx),
+                    _mm256_mul_ps(match, _mm256_sub_ps(_mm256_loadu_ps(velX + other), vx)))));
+                ay = _mm256_add_ps(ay, _mm256_and_ps(inside, _mm256_add_ps(_mm256_mul_ps(pull, dy),
+                    _mm256_mul_ps(match, _mm256_sub_ps(_mm256_loadu_ps(velY + other), vy)))));
+                az = _mm256_add_ps(az, _mm256_and_ps(inside, _mm256_add_ps(_mm256_mul_ps(pull, dz),
+                    _mm256_mul_ps(match, _mm256_sub_ps(_mm256_loadu_ps(velZ + other), vz)))));
+            }
+        }
+
+        PrimitiveTypes::UInt32 i = grid.m_particle[slot];
+        pb.m_velX[i] = velX[slot] + horizontalSum4(_mm_add_ps(_mm256_castps256_ps128(ax), _mm256_extractf128_ps(ax, 1))) * params.m_dt;
+        pb.m_velY[i] = velY[slot] + horizontalSum4(_mm_add_ps(_mm256_castps256_ps128(ay), _mm256_extractf128_ps(ay, 1))) * params.m_dt;
+        pb.m_velZ[i] = velZ[slot] + horizontalSum4(_mm_add_ps(_mm256_castps256_ps128(az), _mm256_extractf128_ps(az, 1))) * params.m_dt;
+    }
+}
+
+PE_PARTICLE_TARGET_SSE2
+static void quantizeParticleValuesSSE2(const PrimitiveTypes::Float32 *pValues, PrimitiveTypes::Int16 *pOut,
+    PrimitiveTypes::UInt32 count)
+{
+    // the clamp keeps cvtps from returning its out-of-range value; packs only narrows
+    const __m128 hi = _mm_set1_ps(32767.0f);
+    const __m128 lo = _mm_set1_ps(-32767.0f);
+
+    PrimitiveTypes::UInt32 j = 0;
+    for (; j + 8 <= count; j += 8)
+    {
+        __m128 a = _mm_max_ps(_mm_min_ps(_mm_loadu_ps(pValues + j), hi), lo);
+        __m128 b = _mm_max_ps(_mm_min_ps(_mm_loadu_ps(pValues + j + 4), hi), lo);
+        _mm_storeu_si128((__m128i *)(pOut + j), _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b)));
+    }
+
+    if (j < count)
+        quantizeParticleValuesScalar(pValues + j, pOut + j, count - j);
+}
+
+PE_PARTICLE_TARGET_SSE2
+static void sinCosParticleValuesSSE2(const PrimitiveTypes::Float32 *pAngles, PrimitiveTypes::Float32 *pSin,
+    PrimitiveTypes::Float32 *pCos, PrimitiveTypes::UInt32 count)
+{
+    PrimitiveTypes::UInt32 j = 0;
+    for (; j + 4 <= count; j += 4)
+    {
+        __m128 s, c;
+        sincos4(_mm_loadu_ps(pAngles + j), s, c);
+        _mm_storeu_ps(pSin + j, s);
+        _mm_storeu_ps(pCos + j, c);
+    }
+
+    if (j < count)
+        sinCosParticleValuesScalar(pAngles + j, pSin + j, pCos + j, count - j);
+}
+
+PE_PARTICLE_TARGET_AVX2
+static void sinCosParticleValuesAVX2(const PrimitiveTypes::Float32 *pAngles, PrimitiveTypes::Float32 *pSin,
+    PrimitiveTypes::Float32 *pCos, PrimitiveTypes::UInt32 count)
+{
+    PrimitiveTypes::UInt32 j = 0;
+    for (; j + 8 <= count; j += 8)
+    {
+        __m256 s, c;
+        sincos8(_mm256_loadu_ps(pAngles + j), s, c);
+        _mm256_storeu_ps(pSin + j, s);
+        _mm256_storeu_ps(pCos + j, c);
+    }
+
+    if (j < count)
+        sinCosParticleValuesSSE2(pAngles + j, pSin + j, pCos + j, count - j);
+}
+
+PE_PARTICLE_TARGET_SSE2
+static void sqrtParticleValuesSSE2(PrimitiveTypes::Float32 *pValues, PrimitiveTypes::UInt32 count)
+{
+    PrimitiveTypes::UInt32 j = 0;
+    for (; j + 4 <= count; j += 4)
+        _mm_storeu_ps(pValues + j, _mm_sqrt_ps(_mm_loadu_ps(pValues + j)));
+
+    if (j < count)
+        sqrtParticleValuesScalar(pValues + j, count - j);
+}
+
+PE_PARTICLE_TARGET_AVX2
+static void sqrtParticleValuesAVX2(PrimitiveTypes::Float32 *pValues, PrimitiveTypes::UInt32 count)
+{
+    PrimitiveTypes::UInt32 j = 0;
+    for (; j + 8 <= count; j += 8)
+        _mm256_storeu_ps(pValues + j, _mm256_sqrt_ps(_mm256_loadu_ps(pValues + j)));
+
+    if (j < count)
+        sqrtParticleValuesSSE2(pValues + j, count - j);
+}
+
+PE_PARTICLE_TARGET_SSE2
+static void normalizeParticleVectorsSSE2(PrimitiveTypes::Float32 *pX, PrimitiveTypes::Float32 *pY,
+    PrimitiveTypes::Float32 *pZ, PrimitiveTypes::UInt32 count)
+{
+    const __m128 one = _mm_set1_ps(1.0f);
+    PrimitiveTypes::UInt32 j = 0;
+    for (; j + 4 <= count; j += 4)
+    {
+        __m128 x = _mm_loadu_ps(pX + j), y = _mm_loadu_ps(pY + j), z = _mm_loadu_ps(pZ + j);
+        __m128 lengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+        __m128 inv = _mm_div_ps(one, _mm_sqrt_ps(lengthSq));
+        _mm_storeu_ps(pX + j, _mm_mul_ps(x, inv));
+        _mm_storeu_ps(pY + j, _mm_mul_ps(y, inv));
+        _mm_storeu_ps(pZ + j, _mm_mul_ps(z, inv));
+    }
+
+    if (j < count)
+        normalizeParticleVectorsScalar(pX + j, pY + j, pZ + j, count - j);
+}
+
+PE_PARTICLE_TARGET_AVX2
+static void normalizeParticleVectorsAVX2(PrimitiveTypes::Float32 *pX, PrimitiveTypes::Float32 *pY,
+    PrimitiveTypes::Float32 *pZ, PrimitiveTypes::UInt32 count)
+{
+    const __m256 one = _mm256_set1_ps(1.0f);
+    PrimitiveTypes::UInt32 j = 0;
+    for (; j + 8 <= count; j += 8)
+    {
+        __m256 x = _mm256_loadu_ps(pX + j), y = _mm256_loadu_ps(pY + j), z = _mm256_loadu_ps(pZ + j);
+        __m256 lengthSq = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)), _mm256_mul_ps(z, z));
+        __m256 inv = _mm256_div_ps(one, _mm256_sqrt_ps(lengthSq));
+        _mm256_storeu_ps(pX + j, _mm256_mul_ps(x, inv));
+        _mm256_storeu_ps(pY + j, _mm256_mul_ps(y, inv));
+        _mm256_storeu_ps(pZ + j, _mm256_mul_ps(z, inv));
+    }
+
+    if (j < count)
+        normalizeParticleVectorsSSE2(pX + j, pY + j, pZ + j, count - j);
+}
+
+// the eight lanes as two independent halves, which also hides some of the latency
+PE_PARTICLE_TARGET_SSE2
+static void fillParticleUniformSSE2(PrimitiveTypes::UInt32 *pState, PrimitiveTypes::Float32 *pOut,
+    PrimitiveTypes::UInt32 count)
+{
+    __m128i *pWords = reinterpret_cast<__m128i *>(pState);
+    const __m128 scale = _mm_set1_ps(1.0f / 16777216.0f);
+    for (int half = 0; half < 2; half++)
+    {
+        __m128i s0 = _mm_loadu_si128(pWords + half), s1 = _mm_loadu_si128(pWords + 2 + half);
+        __m128i s2 = _mm_loadu_si128(pWords + 4 + half), s3 = _mm_loadu_si128(pWords + 6 + half);
+        for (PrimitiveTypes::UInt32 i = half * 4; i < count; i += ParticleRandomLanes)
+        {
+            __m128i result = _mm_add_epi32(s0, s3);
+            __m128i t = _mm_slli_epi32(s1, 9);
+            s2 = _mm_xor_si128(s2, s0);
+            s3 = _mm_xor_si128(s3, s1);
+            s1 = _mm_xor_si128(s1, s2);
+            s0 = _mm_xor_si128(s0, s3);
+            s2 = _mm_xor_si128(s2, t);
+            s3 = _mm_or_si128(_mm_slli_epi32(s3, 11), _mm_srli_epi32(s3, 21));
+            _mm_storeu_ps(pOut + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(result, 8)), scale));
+        }
+        _mm_storeu_si128(pWords + half, s0);
+        _mm_storeu_si128(pWords + 2 + half, s1);
+        _mm_storeu_si128(pWords + 4 + half, s2);
+        _mm_storeu_si128(pWords + 6 + half, s3);
+    }
+}
+
+PE_PARTICLE_TARGET_AVX2
+static void fillParticleUniformAVX2(PrimitiveTypes::UInt32 *pState, PrimitiveTypes::Float32 *pOut,
+    PrimitiveTypes::UInt32 count)
+{
+    __m256i *pWords = reinterpret_cast<__m256i *>(pState);
+    __m256i s0 = _mm256_loadu_si256(pWords), s1 = _mm256_loadu_si256(pWords + 1);
+    __m256i s2 = _mm256_loadu_si256(pWords + 2), s3 = _mm256_loadu_si256(pWords + 3);
+    const __m256 scale = _mm256_set1_ps(1.0f / 16777216.0f);
+    for (PrimitiveTypes::UInt32 i = 0; i < count; i += ParticleRandomLanes)
+    {
+        __m256i result = _mm256_add_epi32(s0, s3);
+        __m256i t = _mm256_slli_epi32(s1, 9);
+        s2 = _mm256_xor_si256(s2, s0);
+        s3 = _mm256_xor_si256(s3, s1);
+        s1 = _mm256_xor_si256(s1, s2);
+        s0 = _mm256_xor_si256(s0, s3);
+        s2 = _mm256_xor_si256(s2, t);
+        s3 = _mm256_or_si256(_mm256_slli_epi32(s3, 11), _mm256_srli_epi32(s3, 21));
+        _mm256_storeu_ps(pOut + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(result, 8)), scale));
+    }
+    _mm256_storeu_si256(pWords, s0);
+    _mm256_storeu_si256(pWords + 1, s1);
+    _mm256_storeu_si256(pWords + 2, s2);
+    _mm256_storeu_si256(pWords + 3, s3);
+}
+
+#endif // PE_PARTICLE_SIMD_X86
+
+ParticleSimdLevel detectParticleSimdLevel()
+{
+#if PE_PARTICLE_SIMD_X86
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+
+    __cpuid(info, 1);
+    bool sse2 = (info[3] & (1 << 26)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!sse2)
+        return ParticleSimdLevel_Scalar;
+
+    // the os has to save ymm registers on context switch
+    if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6)
+    {
+        __cpuidex(info, 7, 0);
+        if (info[1] & (1 << 5))
+            return ParticleSimdLevel_AVX2;
+    }
+    return ParticleSimdLevel_SSE2;
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return ParticleSimdLevel_AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return ParticleSimdLevel_SSE2;
+    return ParticleSimdLevel_Scalar;
+#endif
+#else
+    return ParticleSimdLevel_Scalar;
+#endif
+}
+
+// every combination of the integrate features, indexed by the feature bits
+#define PE_PARTICLE_INTEGRATE_VARIANTS(kernel) \
+    { &kernel<0>, &kernel<1>, &kernel<2>, &kernel<3>, &kernel<4>, &kernel<5>, &kernel<6>, &kernel<7>, \
+      &kernel<8>, &kernel<9>, &kernel<10>, &kernel<11>, &kernel<12>, &kernel<13>, &kernel<14>, &kernel<15> }
+
+ParticleIntegrateKernel getParticleIntegrateKernel(ParticleSimdLevel level)
+{
+#if PE_PARTICLE_SIMD_X86
+    if (level == ParticleSimdLevel_AVX2)
+        return integrateParticlesAVX2<ParticleKernelFeature_Generic>;
+    if (level == ParticleSimdLevel_SSE2)
+        return integrateParticlesSSE2<ParticleKernelFeature_Generic>;
+#endif
+    return integrateParticlesScalar;
+}
+
+ParticleIntegrateKernel getParticleIntegrateKernel(ParticleSimdLevel level, PrimitiveTypes::UInt32 features)
+{
+    if (features & ParticleKernelFeature_Generic)
+        return getParticleIntegrateKernel(level);
+
+    static const ParticleIntegrateKernel s_scalar[] = PE_PARTICLE_INTEGRATE_VARIANTS(integrateParticlesScalarT);
+    features &= ParticleIntegrateFeatures;
+#if PE_PARTICLE_SIMD_X86
+    static const ParticleIntegrateKernel s_sse2[] = PE_PARTICLE_INTEGRATE_VARIANTS(integrateParticlesSSE2);
+    static const ParticleIntegrateKernel s_avx2[] = PE_PARTICLE_INTEGRATE_VARIANTS(integrateParticlesAVX2);
+    if (level == ParticleSimdLevel_AVX2)
+        return s_avx2[features];
+    if (level == ParticleSimdLevel_SSE2)
+        return s_sse2[features];
+#endif
+    return s_scalar[features];
+}
+
+ParticleIntegrateKernel getParticleIntegrateKernel()
+{
+    static ParticleIntegrateKernel s_kernel = NULL;
+    if (!s_kernel)
+    {
+        ParticleSimdLevel level = detectParticleSimdLevel();
+        PEINFO("Particle integration kernel: %s\n", getParticleSimdLevelName(level));
+        s_kernel = getParticleIntegrateKernel(level);
+    }
+    return s_kernel;
+}
+
+ParticleCollideKernel getParticleCollideKernel(ParticleSimdLevel level)
+{
+#if PE_PARTICLE_SIMD_X86
+    if (level == ParticleSimdLevel_AVX2)
+        return collideParticlesAVX2;
+    if (level == ParticleSimdLevel_SSE2)
+        return collideParticlesSSE2;
+#endif
+    return collideParticlesScalar;
+}
+
+ParticleCollideKernel getParticleCollideKernel()
+{
+    static ParticleCollideKernel s_kernel = NULL;
+    if (!s_kernel)
+        s_kernel = getParticleCollideKernel(detectParticleSimdLevel());
+    return s_kernel;
+}
+
+ParticleInteractKernel getParticleInteractKernel(ParticleSimdLevel level)
+{
+#if PE_PARTICLE_SIMD_X86
+    if (level == ParticleSimdLevel_AVX2)
+        return interactParticlesAVX2;
+    if (level == ParticleSimdLevel_SSE2)
+        return interactParticlesSSE2;
+#endif
+    return interactParticlesScalar;
+}
+
+ParticleInteractKernel getParticleInteractKernel()
+{
+    static ParticleInteractKernel s_kernel = NULL;
+    if (!s_kernel)
+        s_kernel = getParticleInteractKernel(detectParticleSimdLevel());
+    return s_kernel;
+}
+
+ParticleQuantizeKernel getParticleQuantizeKernel()
+{
+#if PE_PARTICLE_SIMD_X86
+    static ParticleQuantizeKernel s_kernel = detectParticleSimdLevel() >= ParticleSimdLevel_SSE2
+        ? quantizeParticleValuesSSE2 : quantizeParticleValuesScalar;
+    return s_kernel;
+#else
+    return quantizeParticleValuesScalar;
+#endif
+}
+
+ParticleSinCosKernel getParticleSinCosKernel()
+{
+#if PE_PARTICLE_SIMD_X86
+    static ParticleSinCosKernel s_kernel = NULL;
+    if (!s_kernel)
+    {
+        ParticleSimdLevel level = detectParticleSimdLevel();
+        s_kernel = level == ParticleSimdLevel_AVX2 ? sinCosParticleValuesAVX2
+            : level == ParticleSimdLevel_SSE2 ? sinCosParticleValuesSSE2 : sinCosParticleValuesScalar;
+    }
+    return s_kernel;
+#else
+    return sinCosParticleValuesScalar;
+#endif
+}
+
+ParticleSqrtKernel getParticleSqrtKernel()
+{
+#if PE_PARTICLE_SIMD_X86
+    static ParticleSqrtKernel s_kernel = NULL;
+    if (!s_kernel)
+    {
+        ParticleSimdLevel level = detectParticleSimdLevel();
+        s_kernel = level == ParticleSimdLevel_AVX2 ? sqrtParticleValuesAVX2
+            : level == ParticleSimdLevel_SSE2 ? sqrtParticleValuesSSE2 : sqrtParticleValuesScalar;
+    }
+    return s_kernel;
+#else
+    return sqrtParticleValuesScalar;
+#endif
+}
+
+ParticleNormalizeKernel getParticleNormalizeKernel()
+{
+#if PE_PARTICLE_SIMD_X86
+    static ParticleNormalizeKernel s_kernel = NULL;
+    if (!s_kernel)
+    {
+        ParticleSimdLevel level = detectParticleSimdLevel();
+        s_kernel = level == ParticleSimdLevel_AVX2 ? normalizeParticleVectorsAVX2
+            : level == ParticleSimdLevel_SSE2 ? normalizeParticleVectorsSSE2 : normalizeParticleVectorsScalar;
+    }
+    return s_kernel;
+#else
+    return normalizeParticleVectorsScalar;
+#endif
+}
+
+ParticleUniformKernel getParticleUniformKernel()
+{
+#if PE_PARTICLE_SIMD_X86
+    static ParticleUniformKernel s_kernel = NULL;
+    if (!s_kernel)
+    {
+        ParticleSimdLevel level = detectParticleSimdLevel();
+        s_kernel = level == ParticleSimdLevel_AVX2 ? fillParticleUniformAVX2
+            : level == ParticleSimdLevel_SSE2 ? fillParticleUniformSSE2 : fillParticleUniformScalar;
+    }
+    return s_kernel;
+#else
+    return fillParticleUniformScalar;
+#endif
+}
+
+const char *getParticleSimdLevelName(ParticleSimdLevel level)
+{
+    switch (level)
+    {
+    case ParticleSimdLevel_AVX2: return "AVX2";
+    case ParticleSimdLevel_SSE2: return "SSE2";
+    default: return "Scalar";
+    }
+}
+
+}; // namespace Components
+}; // namespace PE
@@ -0,0 +1,219 @@
+#ifndef _PE_PARTICLE_SIMD_H_
+#define _PE_PARTICLE_SIMD_H_
+
+#include "ParticleCoreTypes.h"
+
+namespace PE {
+namespace Components {
+
+struct ParticleBufferCPU;
+struct ParticleAffectorProgram;
+struct ParticleCollisionPlane;
+struct ParticleHeightfield;
+struct ParticleNeighborGrid;
+
+enum ParticleSimdLevel
+{
+    ParticleSimdLevel_Scalar,
+    ParticleSimdLevel_SSE2,
+    ParticleSimdLevel_AVX2,
+};
+
+// What an emitter's particles need from the update and mesh build kernels. An emitter
+// binds the kernels for its mask once (ParticleEmitterCore::bindKernels()); each mask
+// gets its own instantiation with the branches for the features it lacks compiled out.
+enum ParticleKernelFeature
+{
+    ParticleKernelFeature_Swirl      = 1 << 0, // m_swirlStrength != 0
+    ParticleKernelFeature_SizeCurve  = 1 << 1, // size varies over the lifetime, pulse included
+    ParticleKernelFeature_SpeedCurve = 1 << 2, // speed varies over the lifetime
+    ParticleKernelFeature_Affectors  = 1 << 3, // the template has affectors
+    ParticleKernelFeature_Color      = 1 << 4, // vertices carry a per-particle color
+    ParticleKernelFeature_Sorted     = 1 << 5, // particles are written in a given order
+    // decides all of the above per call from the arguments; what the plain kernels do
+    ParticleKernelFeature_Generic    = 1 << 6,
+};
+
+enum
+{
+    ParticleIntegrateFeatures = ParticleKernelFeature_Swirl | ParticleKernelFeature_SizeCurve |
+        ParticleKernelFeature_SpeedCurve | ParticleKernelFeature_Affectors,
+    ParticleBuildFeatures = ParticleKernelFeature_Color | ParticleKernelFeature_Sorted,
+};
+
+// whether a kernel instantiated for Features does feature; generic kernels go by the
+// runtime value instead. Features is a constant, so this folds away.
+template <PrimitiveTypes::UInt32 Features>
+inline bool particleKernelDoes(PrimitiveTypes::UInt32 feature, bool generic)
+{
+    return (Features & ParticleKernelFeature_Generic) ? generic : (Features & feature) != 0;
+}
+
+// per-step constants of the integration kernel
+struct ParticleIntegrateParams
+{
+    PrimitiveTypes::Float32 m_dt;
+    PrimitiveTypes::Float32 m_swirlScale;  // swirlStrength * dt * moveScale
+    PrimitiveTypes::Float32 m_swirlSpeed;
+    PrimitiveTypes::Float32 m_baseSizeX;
+    PrimitiveTypes::Float32 m_baseSizeY;
+    const PrimitiveTypes::Float32 *m_pSizeCurve;  // ParticleCurveTables::m_size
+    const PrimitiveTypes::Float32 *m_pSpeedCurve; // ParticleCurveTables::m_speed, scales the drift
+    const ParticleAffectorProgram *m_pAffectors;  // NULL when the template has no affectors
+};
+
+// Ages particles [begin, end) by m_dt, saves the current position into the m_prev
+// streams and moves every particle that is still alive: the affectors change its
+// velocity first (semi-implicit Euler), then it drifts along the velocity scaled by
+// the speed curve, plus a horizontal swirl offset by the particle's m_phase; size
+// comes from the size curve. Both curves are sampled at
+// age / duration with one lerp per lane. Particles whose age reached
+// their duration are aged but not moved; the number of those is returned so the caller
+// can skip the respawn scan when nothing expired.
+//
+// The vector kernels use a polynomial sin/cos (max abs error ~2e-7 on [-pi, pi]) in
+// place of sinf/cosf. Against the scalar kernel, positions and velocities match within
+// 1e-6 * max(1, |value|) per step and sizes within 1e-6 relative; ages and the expired
+// count are bit-identical. ParticleSimdTest.cpp checks these bounds and those of the
+// collide and interact kernels below.
+//
+// The specialized kernels of getParticleIntegrateKernel(level, features) write exactly
+// what the generic one does, provided the mask is true to the params: without Swirl
+// m_swirlScale is 0, without SizeCurve the size table is flat and the sizes already
+// hold m_baseSize * table[0] (as spawning leaves them), without SpeedCurve the speed
+// table is flat, and Affectors is set exactly when m_pAffectors is.
+typedef PrimitiveTypes::UInt32 (*ParticleIntegrateKernel)(ParticleBufferCPU &pb,
+    PrimitiveTypes::UInt32 begin, PrimitiveTypes::UInt32 end, const ParticleIntegrateParams &params);
+
+PrimitiveTypes::UInt32 integrateParticlesScalar(ParticleBufferCPU &pb,
+    PrimitiveTypes::UInt32 begin, PrimitiveTypes::UInt32 end, const ParticleIntegrateParams &params);
+
+// per-step constants of the collision kernel
+struct ParticleCollideParams
+{
+    const ParticleCollisionPlane *m_pPlanes;
+    PrimitiveTypes::UInt32 m_planeCount;
+    const ParticleHeightfield *m_pHeightfield; // NULL for none
+    PrimitiveTypes::UInt32 m_response;         // ParticleCollisionResponse
+    PrimitiveTypes::Float32 m_bounce;          // Bounce: share of the normal speed kept
+    PrimitiveTypes::Float32 m_friction;        // Bounce: share of the tangential speed lost
+};
+
+// Tests particles [begin, end) against the planes, in order, and then the heightfield.
+// A particle on the wrong side of one is pushed back onto it (along the plane normal,
+// straight up out of the heightfield) and, at Bounce, its velocity toward the surface
+// is reflected and scaled by m_bounce while the velocity along it loses m_friction; at
+// Stick its velocity is zeroed. At Kill nothing moves: a live particle that hits
+// anything gets age = duration and the number of those is returned (0 for the other
+// responses), so it goes with the expired particles of the step.
+// One flat pass over the position and velocity streams with no per-particle queries;
+// the vector kernels load the four heightfield samples per lane (gathers on AVX2).
+// Against the scalar kernel, positions and velocities match within 1e-5 * max(1, |value|);
+// the kill count is the same unless a particle sits within that of a surface.
+typedef PrimitiveTypes::UInt32 (*ParticleCollideKernel)(ParticleBufferCPU &pb,
+    PrimitiveTypes::UInt32 begin, PrimitiveTypes::UInt32 end, const ParticleCollideParams &params);
+
+PrimitiveTypes::UInt32 collideParticlesScalar(ParticleBufferCPU &pb,
+    PrimitiveTypes::UInt32 begin, PrimitiveTypes::UInt32 end, const ParticleCollideParams &params);
+
+// per-step constants of the interaction kernel, the merged interactions of a
+// ParticleAffectorProgram
+struct ParticleInteractParams
+{
+    PrimitiveTypes::Float32 m_dt;
+    PrimitiveTypes::Float32 m_radius;
+    PrimitiveTypes::Float32 m_separation;
+    PrimitiveTypes::Float32 m_cohesion;
+    PrimitiveTypes::Float32 m_alignment;
+};
+
+// Adds dt worth of the interaction forces (ParticleAffectorStack::addInteraction()) to
+// the velocities of the particles in sorted slots [begin, end) of grid, which was built
+// from pb this step. The neighbors come from the grid's copies of the positions and
+// velocities and a particle writes its own velocity only, so disjoint slot ranges can run
+// at the same time with the same result. The vector kernels test 4 or 8 particles of a
+// grid row at once and mask out the ones beyond the radius instead of branching on them.
+// Against the scalar kernel, velocities match within 1e-5 * max(1, |value|).
+typedef void (*ParticleInteractKernel)(ParticleBufferCPU &pb, const ParticleNeighborGrid &grid,
+    PrimitiveTypes::UInt32 begin, PrimitiveTypes::UInt32 end, const ParticleInteractParams &params);
+
+void interactParticlesScalar(ParticleBufferCPU &pb, const ParticleNeighborGrid &grid,
+    PrimitiveTypes::UInt32 begin, PrimitiveTypes::UInt32 end, const ParticleInteractParams &params);
+
+// Rounds count values to the nearest integer (ties to even) and saturates them to
+// [-32767, 32767]. Used to quantize packed vertex coordinates in bulk.
+typedef void (*ParticleQuantizeKernel)(const PrimitiveTypes::Float32 *pValues, PrimitiveTypes::Int16 *pOut,
+    PrimitiveTypes::UInt32 count);
+
+void quantizeParticleValuesScalar(const PrimitiveTypes::Float32 *pValues, PrimitiveTypes::Int16 *pOut,
+    PrimitiveTypes::UInt32 count);
+
+// sin and cos of count angles. The vector versions use the polynomial of the integrate
+// kernels; pSin or pCos may be pAngles. Used to place spawned particles around circles
+// in bulk.
+typedef void (*ParticleSinCosKernel)(const PrimitiveTypes::Float32 *pAngles, PrimitiveTypes::Float32 *pSin,
+    PrimitiveTypes::Float32 *pCos, PrimitiveTypes::UInt32 count);
+
+void sinCosParticleValuesScalar(const PrimitiveTypes::Float32 *pAngles, PrimitiveTypes::Float32 *pSin,
+    PrimitiveTypes::Float32 *pCos, PrimitiveTypes::UInt32 count);
+
+// square roots of count non-negative values, in place
+typedef void (*ParticleSqrtKernel)(PrimitiveTypes::Float32 *pValues, PrimitiveTypes::UInt32 count);
+
+void sqrtParticleValuesScalar(PrimitiveTypes::Float32 *pValues, PrimitiveTypes::UInt32 count);
+
+// scales count vectors, one stream per axis, to unit length in place; none may be zero
+typedef void (*ParticleNormalizeKernel)(PrimitiveTypes::Float32 *pX, PrimitiveTypes::Float32 *pY,
+    PrimitiveTypes::Float32 *pZ, PrimitiveTypes::UInt32 count);
+
+void normalizeParticleVectorsScalar(PrimitiveTypes::Float32 *pX, PrimitiveTypes::Float32 *pY,
+    PrimitiveTypes::Float32 *pZ, PrimitiveTypes::UInt32 count);
+
+enum { ParticleRandomLanes = 8 };
+
+// Bulk half of ParticleRandom: steps the xoshiro128+ state (four words of
+// ParticleRandomLanes lanes each, word-major) count / ParticleRandomLanes times and
+// writes one float in [0, 1) per lane and step. count is a multiple of
+// ParticleRandomLanes. Integer math only, so every level writes the same floats.
+typedef void (*ParticleUniformKernel)(PrimitiveTypes::UInt32 *pState, PrimitiveTypes::Float32 *pOut,
+    PrimitiveTypes::UInt32 count);
+
+void fillParticleUniformScalar(PrimitiveTypes::UInt32 *pState, PrimitiveTypes::Float32 *pOut,
+    PrimitiveTypes::UInt32 count);
+
+// best level supported by this cpu and os
+ParticleSimdLevel detectParticleSimdLevel();
+
+// kernel for a given level; falls back to the next lower level when not compiled in
+ParticleIntegrateKernel getParticleIntegrateKernel(ParticleSimdLevel level);
+
+// kernel for a given level specialized for the ParticleIntegrateFeatures bits of
+// features; the generic kernel when ParticleKernelFeature_Generic is set
+ParticleIntegrateKernel getParticleIntegrateKernel(ParticleSimdLevel level, PrimitiveTypes::UInt32 features);
+
+// kernel for the detected level, resolved once
+ParticleIntegrateKernel getParticleIntegrateKernel();
+
+// collision kernel for a given level, and for the detected level resolved once
+ParticleCollideKernel getParticleCollideKernel(ParticleSimdLevel level);
+ParticleCollideKernel getParticleCollideKernel();
+
+// interaction kernel for a given level, and for the detected level resolved once
+ParticleInteractKernel getParticleInteractKernel(ParticleSimdLevel level);
+ParticleInteractKernel getParticleInteractKernel();
+
+// quantize kernel for the detected level, resolved once
+ParticleQuantizeKernel getParticleQuantizeKernel();
+
+// sin/cos, sqrt, normalize and uniform kernels for the detected level, resolved once
+ParticleSinCosKernel getParticleSinCosKernel();
+ParticleSqrtKernel getParticleSqrtKernel();
+ParticleNormalizeKernel getParticleNormalizeKernel();
+ParticleUniformKernel getParticleUniformKernel();
+
+const char *getParticleSimdLevelName(ParticleSimdLevel level);
+
+}; // namespace Components
+}; // namespace PE
+
+#endif
@@ -0,0 +1,440 @@
+// Headless check of the simd kernels against the scalar ones, within the tolerances
+// ParticleSimd.h documents. Every level this cpu runs (scalar included) is fed the same
+// seeded buffer and compared to the scalar generic kernel:
+//   integrate: the generic and the specialized kernels of a few templates; positions,
+//     prev positions, velocities and sizes within 1e-6 * max(1, |value|), ages and the
+//     expired count bit-identical
+//   collide: planes, a heightfield and both with each response; positions and
+//     velocities within 1e-5 * max(1, |value|), the kill count the same but for
+//     particles within that of a surface (which are left out of the comparison), and
+//     no live particle left under a surface
+//   interact: separation only and a flock; velocities within 1e-5 * max(1, |value|)
+// Only built with PE_PARTICLE_HEADLESS, e.g.
+//   g++ -std=c++11 -O2 -pthread -DPE_PARTICLE_HEADLESS ParticleSimdTest.cpp ParticleSimCore.cpp ParticleSimd.cpp ParticleJobs.cpp ParticleProfiler.cpp ParticleMemoryPool.cpp ParticleCurves.cpp ParticleShapes.cpp ParticleAffectors.cpp ParticleCollision.cpp ParticleNeighbors.cpp -o particle_simd_test
+//   ./particle_simd_test
+// Prints one line per case and exits nonzero when any of them fails.
+
+#ifdef PE_PARTICLE_HEADLESS
+
+#include "ParticleSimCore.h"
+#include "ParticleCollision.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+namespace PE {
+namespace Components {
+
+namespace {
+
+typedef PrimitiveTypes::Float32 *ParticleBufferCPU::*ParticleStream;
+
+const ParticleStream s_streams[] =
+{
+    &ParticleBufferCPU::m_posX, &ParticleBufferCPU::m_posY, &ParticleBufferCPU::m_posZ,
+    &ParticleBufferCPU::m_velX, &ParticleBufferCPU::m_velY, &ParticleBufferCPU::m_velZ,
+    &ParticleBufferCPU::m_age, &ParticleBufferCPU::m_duration,
+    &ParticleBufferCPU::m_sizeX, &ParticleBufferCPU::m_sizeY, &ParticleBufferCPU::m_phase,
+    &ParticleBufferCPU::m_prevX, &ParticleBufferCPU::m_prevY, &ParticleBufferCPU::m_prevZ,
+};
+const char *s_streamNames[] =
+{
+    "pos_x", "pos_y", "pos_z", "vel_x", "vel_y", "vel_z", "age", "duration",
+    "size_x", "size_y", "phase", "prev_x", "prev_y", "prev_z",
+};
+enum { StreamCount = sizeof(s_streams) / sizeof(s_streams[0]) };
+enum { AgeStream = 6 };
+
+const ParticleSimdLevel s_levels[] = { ParticleSimdLevel_Scalar, ParticleSimdLevel_SSE2, ParticleSimdLevel_AVX2 };
+
+PrimitiveTypes::UInt32 s_failures = 0;
+
+void copyBuffer(const ParticleBufferCPU &source, ParticleBufferCPU &target)
+{
+    target.reset(source.m_capacity);
+    target.add(source.m_size);
+    for (int s = 0; s < StreamCount; s++)
+        memcpy(target.*s_streams[s], source.*s_streams[s], source.m_size * sizeof(PrimitiveTypes::Float32));
+}
+
+bool withinTolerance(float value, float expected, float tolerance)
+{
+    if (value != value || expected != expected)
+        return value != value && expected != expected;
+    float magnitude = fabsf(expected) > 1.0f ? fabsf(expected) : 1.0f;
+    return fabsf(value - expected) <= tolerance * magnitude;
+}
+
+// compares every stream of the live particles not in skip; ages bit for bit, the rest
+// within tolerance. Prints the first mismatch
+bool compareBuffers(const ParticleBufferCPU &result, const ParticleBufferCPU &expected, float tolerance,
+    const std::vector<bool> *pSkip, float &maxError)
+{
+    if (result.m_size != expected.m_size)
+    {
+        printf("  size %u, expected %u\n", result.m_size, expected.m_size);
+        return false;
+    }
+    for (int s = 0; s < StreamCount; s++)
+    {
+        const PrimitiveTypes::Float32 *a = result.*s_streams[s], *b = expected.*s_streams[s];
+        for (PrimitiveTypes::UInt32 i = 0; i < expected.m_size; i++)
+        {
+            if (pSkip && (*pSkip)[i])
+                continue;
+            bool same = s == AgeStream ? memcmp(&a[i], &b[i], sizeof(float)) == 0 : withinTolerance(a[i], b[i], tolerance);
+            if (!same)
+            {
+                printf("  %s[%u] = %.9g, expected %.9g\n", s_streamNames[s], i, a[i], b[i]);
+                return false;
+            }
+            float magnitude = fabsf(b[i]) > 1.0f ? fabsf(b[i]) : 1.0f;
+            float error = fabsf(a[i] - b[i]) / magnitude;
+            maxError = error > maxError ? error : maxError;
+        }
+    }
+    return true;
+}
+
+void reportCase(const char *name, bool passed, float maxError, const char *extra)
+{
+    printf("%s %s max_error=%.3g%s\n", passed ? "ok  " : "FAIL", name, maxError, extra);
+    s_failures += passed ? 0 : 1;
+}
+
+Particle makeTestTemplate(int kind)
+{
+    Particle p;
+    p.m_rate = 8000;
+    p.m_duration = 1.0f;
+    p.m_looping = true;
+    if (kind == 1)
+    {
+        // hit_spark: curves and gravity, no swirl or pulse
+        p.m_swirlStrength = 0.0f;
+        p.m_pulseAmount = 0.0f;
+        p.m_sizeOverLife.addKey(0.0f, 1.0f);
+        p.m_sizeOverLife.addKey(1.0f, 0.3f);
+        p.m_speedOverLife.addKey(0.0f, 1.0f);
+        p.m_speedOverLife.addKey(0.5f, 0.4f);
+        p.m_speedOverLife.addKey(1.0f, 0.1f);
+        p.m_affectors.addGravity(Vector3(0.0f, -1.5f, 0.0f));
+    }
+    else if (kind == 2)
+    {
+        // all five forces on top of the default swirl and pulse
+        p.m_affectors.addGravity(Vector3(0.0f, -0.5f, 0.0f));
+        p.m_affectors.addDrag(0.5f, Vector3(0.1f, 0.0f, 0.0f));
+        p.m_affectors.addAttractor(Vector3(0.0f, 1.0f, 0.0f), 0.2f, 0.25f);
+        p.m_affectors.addVortex(Vector3(0.0f, 0.0f, 0.0f), Vector3(0.0f, 1.0f, 0.0f), 0.5f, 0.5f);
+        p.m_affectors.addTurbulence(0.3f, 0.5f, 0.2f);
+    }
+    else if (kind == 3)
+    {
+        // no feature at all
+        p.m_swirlStrength = 0.0f;
+        p.m_pulseAmount = 0.0f;
+    }
+    return p;
+}
+
+// integrate: every few steps of a running emitter, one more step by each kernel from
+// the same state, against the scalar generic kernel
+void testIntegrate()
+{
+    const char *templateNames[] = { "default", "spark", "affectors", "plain" };
+    const PrimitiveTypes::Float32 dt = 1.0f / 30.0f;
+    for (int kind = 0; kind < 4; kind++)
+    {
+        ParticleEmitterCore emitter(makeTestTemplate(kind));
+        emitter.m_random.seed(1234, kind);
+        emitter.m_updateMode = ParticleUpdateMode_Serial;
+        emitter.start(Vector3(0.5f, 0.0f, -0.25f));
+        const PrimitiveTypes::UInt32 specialized = emitter.getKernelFeatures(false) & ParticleIntegrateFeatures;
+
+        bool passed[2][3] = { { true, true, true }, { true, true, true } };
+        float maxError[2][3] = {};
+        PrimitiveTypes::UInt32 expiredTotal = 0;
+        for (int check = 0; check < 24; check++)
+        {
+            // moves the emitter on and leaves the params of a step of dt behind
+            emitter.step(dt);
+            const ParticleIntegrateParams params = emitter.m_pendingParams;
+
+            ParticleBufferCPU expected;
+            copyBuffer(emitter.m_buffer, expected);
+            const PrimitiveTypes::UInt32 expectedExpired =
+                integrateParticlesScalar(expected, 0, expected.m_size, params);
+            expiredTotal += expectedExpired;
+
+            for (int mask = 0; mask < 2; mask++)
+            {
+                for (size_t l = 0; l < sizeof(s_levels) / sizeof(s_levels[0]); l++)
+                {
+                    if (s_levels[l] > detectParticleSimdLevel() || !passed[mask][l])
+                        continue;
+                    ParticleIntegrateKernel kernel = getParticleIntegrateKernel(s_levels[l],
+                        mask ? specialized : (PrimitiveTypes::UInt32)ParticleKernelFeature_Generic);
+                    ParticleBufferCPU result;
+                    copyBuffer(emitter.m_buffer, result);
+                    PrimitiveTypes::UInt32 expired = kernel(result, 0, result.m_size, params);
+                    if (expired != expectedExpired)
+                    {
+                        printf("  expired %u, expected %u\n", expired, expectedExpired);
+                        passed[mask][l] = false;
+                        continue;
+                    }
+                    passed[mask][l] = compareBuffers(result, expected, 1e-6f, NULL, maxError[mask][l]);
+                }
+            }
+        }
+
+        for (int mask = 0; mask < 2; mask++)
+        {
+            for (size_t l = 0; l < sizeof(s_levels) / sizeof(s_levels[0]); l++)
+            {
+                char name[128], extra[64];
+                sprintf(name, "integrate/template:%s/level:%s/specialized:%d", templateNames[kind],
+                    getParticleSimdLevelName(s_levels[l]), mask);
+                if (s_levels[l] > detectParticleSimdLevel())
+                {
+                    printf("skip %s, not supported here\n", name);
+                    continue;
+                }
+                sprintf(extra, " expired=%u features=0x%x", expiredTotal, mask ? specialized : 0u);
+                reportCase(name, passed[mask][l], maxError[mask][l], extra);
+            }
+        }
+    }
+}
+
+// distance of a point to the nearest collider surface, along the normal for planes and
+// vertically for the heightfield
+float surfaceDistance(const ParticleColliderSet &colliders, float x, float y, float z)
+{
+    float nearest = 1e30f;
+    for (PrimitiveTypes::UInt32 k = 0; k < colliders.m_planeCount; k++)
+    {
+        const ParticleCollisionPlane &plane = colliders.m_planes[k];
+        float d = fabsf(plane.m_normal[0] * x + plane.m_normal[1] * y + plane.m_normal[2] * z - plane.m_offset);
+        nearest = d < nearest ? d : nearest;
+    }
+    if (colliders.m_pHeightfield)
+    {
+        float d = fabsf(y - colliders.m_pHeightfield->sample(x, z));
+        nearest = d < nearest ? d : nearest;
+    }
+    return nearest;
+}
+
+// live particles (age under duration) more than a hair under one of the colliders
+PrimitiveTypes::UInt32 countBelowSurface(const ParticleBufferCPU &pb, const ParticleColliderSet &colliders)
+{
+    const float tolerance = 1e-3f;
+    PrimitiveTypes::UInt32 below = 0;
+    for (PrimitiveTypes::UInt32 i = 0; i < pb.m_size; i++)
+    {
+        if (!(pb.m_age[i] < pb.m_duration[i]))
+            continue;
+        bool under = false;
+        for (PrimitiveTypes::UInt32 k = 0; k < colliders.m_planeCount; k++)
+        {
+            const ParticleCollisionPlane &plane = colliders.m_planes[k];
+            under |= plane.m_normal[0] * pb.m_posX[i] + plane.m_normal[1] * pb.m_posY[i]
+                + plane.m_normal[2] * pb.m_posZ[i] < plane.m_offset - tolerance;
+        }
+        if (colliders.m_pHeightfield)
+            under |= pb.m_posY[i] < colliders.m_pHeightfield->sample(pb.m_posX[i], pb.m_posZ[i]) - tolerance;
+        below += under ? 1 : 0;
+    }
+    return below;
+}
+
+// collide: a box of particles with random velocities around the surfaces, some of
+// them underneath
+void testCollide()
+{
+    const PrimitiveTypes::UInt32 count = 20000;
+    ParticleBufferCPU source;
+    source.reset(count);
+    source.add(count);
+    ParticleRandom random;
+    random.seed(99, 0);
+    random.fillRange(source.m_posX, count, -1.5f, 1.5f);
+    random.fillRange(source.m_posY, count, -1.2f, 0.2f);
+    random.fillRange(source.m_posZ, count, -1.5f, 1.5f);
+    random.fillRange(source.m_velX, count, -1.0f, 1.0f);
+    random.fillRange(source.m_velY, count, -2.0f, 1.0f);
+    random.fillRange(source.m_velZ, count, -1.0f, 1.0f);
+    random.fillRange(source.m_age, count, 0.0f, 1.2f);
+    random.fillRange(source.m_duration, count, 0.5f, 1.0f);
+    random.fillRange(source.m_sizeX, count, 0.01f, 0.05f);
+    random.fillRange(source.m_sizeY, count, 0.01f, 0.05f);
+    random.fillRange(source.m_phase, count, 0.0f, 6.28f);
+    memcpy(source.m_prevX, source.m_posX, count * sizeof(PrimitiveTypes::Float32));
+    memcpy(source.m_prevY, source.m_posY, count * sizeof(PrimitiveTypes::Float32));
+    memcpy(source.m_prevZ, source.m_posZ, count * sizeof(PrimitiveTypes::Float32));
+
+    // a ground plane and a tilted wall; hills; all of them
+    const PrimitiveTypes::UInt32 columns = 40, rows = 40;
+    std::vector<PrimitiveTypes::Float32> heights(columns * rows);
+    for (PrimitiveTypes::UInt32 z = 0; z < rows; z++)
+    {
+        for (PrimitiveTypes::UInt32 x = 0; x < columns; x++)
+            heights[z * columns + x] = -0.6f + 0.2f * sinf(x * 0.7f) * cosf(z * 0.9f);
+    }
+    ParticleHeightfield heightfield;
+    heightfield.build(-2.0f, -2.0f, 0.1f, columns, rows, &heights[0]);
+
+    ParticleColliderSet colliderSets[3];
+    colliderSets[0].addPlane(Vector3(0.0f, 1.0f, 0.0f), Vector3(0.0f, -0.5f, 0.0f));
+    colliderSets[0].addPlane(Vector3(-0.6f, 0.8f, 0.0f), Vector3(1.0f, -0.5f, 0.0f));
+    colliderSets[1].m_pHeightfield = &heightfield;
+    colliderSets[2] = colliderSets[0];
+    colliderSets[2].m_pHeightfield = &heightfield;
+    const char *colliderNames[] = { "planes", "heightfield", "both" };
+    const char *responseNames[] = { "bounce", "stick", "kill" };
+
+    for (int c = 0; c < 3; c++)
+    {
+        const ParticleColliderSet &colliders = colliderSets[c];
+
+        // particles the kernels may disagree on, whether they touch or not
+        std::vector<bool> nearSurface(count);
+        PrimitiveTypes::UInt32 nearCount = 0;
+        for (PrimitiveTypes::UInt32 i = 0; i < count; i++)
+        {
+            float x = source.m_posX[i], y = source.m_posY[i], z = source.m_posZ[i];
+            float magnitude = fabsf(x) > fabsf(y) ? fabsf(x) : fabsf(y);
+            magnitude = fabsf(z) > magnitude ? fabsf(z) : magnitude;
+            magnitude = magnitude > 1.0f ? magnitude : 1.0f;
+            nearSurface[i] = surfaceDistance(colliders, x, y, z) <= 1e-5f * magnitude;
+            nearCount += nearSurface[i] ? 1 : 0;
+        }
+
+        for (int response = ParticleCollision_Bounce; response <= ParticleCollision_Kill; response++)
+        {
+            ParticleCollideParams params;
+            params.m_pPlanes = colliders.m_planes;
+            params.m_planeCount = colliders.m_planeCount;
+            params.m_pHeightfield = colliders.m_pHeightfield;
+            params.m_response = response;
+            params.m_bounce = 0.5f;
+            params.m_friction = 0.2f;
+
+            ParticleBufferCPU expected;
+            copyBuffer(source, expected);
+            const PrimitiveTypes::UInt32 expectedKilled = collideParticlesScalar(expected, 0, count, params);
+
+            for (size_t l = 0; l < sizeof(s_levels) / sizeof(s_levels[0]); l++)
+            {
+                char name[128], extra[64];
+                sprintf(name, "collide/colliders:%s/response:%s/level:%s", colliderNames[c], responseNames[response],
+                    getParticleSimdLevelName(s_levels[l]));
+                if (s_levels[l] > detectParticleSimdLevel())
+                {
+                    printf("skip %s, not supported here\n", name);
+                    continue;
+                }
+                ParticleBufferCPU result;
+                copyBuffer(source, result);
+                const PrimitiveTypes::UInt32 killed = getParticleCollideKernel(s_levels[l])(result, 0, count, params);
+
+                float maxError = 0.0f;
+                PrimitiveTypes::UInt32 killDifference = killed > expectedKilled ? killed - expectedKilled : expectedKilled - killed;
+                bool passed = killDifference <= nearCount;
+                if (!passed)
+                    printf("  killed %u, expected %u with %u near a surface\n", killed, expectedKilled, nearCount);
+                passed = passed && compareBuffers(result, expected, 1e-5f, &nearSurface, maxError);
+
+                // every response leaves no live particle under a surface: pushed out of
+                // it, or dead at Kill
+                const PrimitiveTypes::UInt32 below = countBelowSurface(result, colliders);
+                if (below > 0)
+                {
+                    printf("  %u live particles below a surface\n", below);
+                    passed = false;
+                }
+                sprintf(extra, " killed=%u near_surface=%u below_surface=%u", killed, nearCount, below);
+                reportCase(name, passed, maxError, extra);
+            }
+        }
+    }
+}
+
+struct ParticleTestNeighborCount
+{
+    PrimitiveTypes::UInt32 m_count;
+    void operator()(PrimitiveTypes::UInt32, float, float, float, float) { m_count++; }
+};
+
+// interact: a running emitter with the interaction, each kernel over all slots of the
+// grid built from the same buffer
+void testInteract()
+{
+    const char *interactionNames[] = { "separation", "flock" };
+    for (int flock = 0; flock < 2; flock++)
+    {
+        Particle p = makeTestTemplate(3);
+        p.m_affectors.addInteraction(0.08f, 2.0f, flock ? 0.5f : 0.0f, flock ? 1.0f : 0.0f);
+        ParticleEmitterCore emitter(p);
+        emitter.m_random.seed(4321, flock);
+        emitter.m_updateMode = ParticleUpdateMode_Serial;
+        emitter.start(Vector3(0.0f, 0.0f, 0.0f));
+        for (int s = 0; s < 10; s++)
+            emitter.step(1.0f / 30.0f);
+        const ParticleInteractParams params = emitter.m_pendingInteract;
+
+        ParticleNeighborGrid grid;
+        grid.build(emitter.m_buffer, params.m_radius);
+        ParticleTestNeighborCount neighbors = {};
+        for (PrimitiveTypes::UInt32 slot = 0; slot < grid.m_count; slot++)
+            grid.forEachNeighbor(slot, neighbors);
+
+        ParticleBufferCPU expected;
+        copyBuffer(emitter.m_buffer, expected);
+        interactParticlesScalar(expected, grid, 0, grid.m_count, params);
+
+        for (size_t l = 0; l < sizeof(s_levels) / sizeof(s_levels[0]); l++)
+        {
+            char name[128], extra[64];
+            sprintf(name, "interact/interaction:%s/level:%s", interactionNames[flock], getParticleSimdLevelName(s_levels[l]));
+            if (s_levels[l] > detectParticleSimdLevel())
+            {
+                printf("skip %s, not supported here\n", name);
+                continue;
+            }
+            ParticleBufferCPU result;
+            copyBuffer(emitter.m_buffer, result);
+            getParticleInteractKernel(s_levels[l])(result, grid, 0, grid.m_count, params);
+
+            float maxError = 0.0f;
+            bool passed = neighbors.m_count > 0 && compareBuffers(result, expected, 1e-5f, NULL, maxError);
+            sprintf(extra, " neighbors_per_particle=%.2f", grid.m_count ? (double)neighbors.m_count / grid.m_count : 0.0);
+            reportCase(name, passed, maxError, extra);
+        }
+    }
+}
+
+}; // namespace
+
+}; // namespace Components
+}; // namespace PE
+
+int main()
+{
+    printf("simd level: %s\n", PE::Components::getParticleSimdLevelName(PE::Components::detectParticleSimdLevel()));
+    PE::Components::testIntegrate();
+    PE::Components::testCollide();
+    PE::Components::testInteract();
+    if (PE::Components::s_failures > 0)
+    {
+        printf("%u case(s) failed\n", PE::Components::s_failures);
+        return 1;
+    }
+    return 0;
+}
+
+#endif // PE_PARTICLE_HEADLESS
@@ -1,4 +1,5 @@
 #include "ParticleSystem.h"
+#include "ParticleTemplates.h"
 #include "PrimeEngine/Scene/MeshInstance.h"
 #include "PrimeEngine/Scene/SceneNode.h"
 #include "PrimeEngine/Lua/LuaEnvironment.h"                    
@@ -20,6 +21,11 @@ namespace PE {
 namespace Components {
 
 PE_IMPLEMENT_CLASS1(ParticleSystem, Mesh);
+PE_IMPLEMENT_CLASS1(ParticleTemplateWatcher, Component);
+
+const char *ParticleSystem::ParticleBillboardTechName = "ParticleBillboard_Tech";
+const char *ParticleSystem::ParticlePackedTechName = "ParticlePacked_Tech";
+const PrimitiveTypes::Float32 ParticleSystem::CameraFovY = 0.33f * PrimitiveTypes::Constants::c_Pi_F32;
 
 ParticleSystem::ParticleSystem(PE::GameContext &context, PE::MemoryArena arena, Handle hMyself)
     :Mesh(context, arena, hMyself)
@@ -29,8 +35,60 @@ ParticleSystem::ParticleSystem(PE::GameContext &context, PE::MemoryArena arena,
     m_arena = arena;
     m_pContext = &context;
     m_loaded = false;
+    m_builtEmpty = false;
     m_hasTexture = false;
     m_hasColor = false;
+    m_renderMode = ParticleRenderMode_CPUExpanded;
+    m_cameraViewCount = 1;
+    m_cameraViewsSet = false;
+    m_meshCapacity = 0;
+    m_templateName[0] = '\0';
+    m_templateGeneration = 0;
+}
+
+void ParticleCameraSnapshot::capture(const Matrix4x4 &cameraWorldTransform)
+{
+    m_position = cameraWorldTransform.getPos();
+    m_right = cameraWorldTransform.getU();
+    m_up = cameraWorldTransform.getV();
+    m_front = cameraWorldTransform.getN();
+}
+
+void ParticleCameraSnapshot::capture(const Matrix4x4 &cameraWorldTransform, PrimitiveTypes::Float32 fovY,
+    PrimitiveTypes::Float32 aspect, PrimitiveTypes::Float32 nearDist, PrimitiveTypes::Float32 farDist)
+{
+    capture(cameraWorldTransform);
+    m_tanHalfFovY = tanf(fovY * 0.5f);
+    m_aspect = aspect;
+    m_near = nearDist;
+    m_far = farDist;
+}
+
+void ParticleSystem::setLodPolicy(const ParticleLodPolicy &policy)
+{
+    m_lodPolicy = policy;
+}
+
+void ParticleSystem::setCameraViews(const ParticleCameraSnapshot *pViews, PrimitiveTypes::UInt32 count)
+{
+    PEASSERT(count > 0 && count <= MaxCameraViews, "ParticleSystem supports up to %d camera views", MaxCameraViews);
+    if (count > MaxCameraViews)
+        count = MaxCameraViews;
+
+    for (PrimitiveTypes::UInt32 i = 0; i < count; i++)
+        m_cameraViews[i] = pViews[i];
+    m_cameraViewCount = count;
+    m_cameraViewsSet = true;
+}
+
+ParticleEmitterStats &ParticleSystem::getStats()
+{
+    return m_hParticleSystemCPU.getObject<ParticleSystemCPU>()->m_stats;
+}
+
+void ParticleSystem::setUpdateWorkerCount(PrimitiveTypes::UInt32 count)
+{
+    ParticleJobPool::Instance()->setWorkerCount(count);
 }
 
 void ParticleSystem::addDefaultComponents()
@@ -45,7 +103,7 @@ void ParticleSystem::addDefaultComponents()
 
 // ParticleSystemCPU implementation
 ParticleSystemCPU::ParticleSystemCPU(PE::GameContext &context, PE::MemoryArena arena, Particle particle)
-    : m_particleTemplate(particle)
+    : ParticleEmitterCore(particle)
 {
     m_arena = arena;
     m_pContext = &context;
@@ -67,14 +125,65 @@ void ParticleSystem::createParticleSystem(Particle pTemplate)
 
     Vector3 pos = particleBase.getPos();
 
+    m_renderMode = pTemplate.m_renderMode;
+    m_packedOrigin = pos;
     m_hasTexture = strlen(pTemplate.m_texture) > 0;
     m_hasColor = pTemplate.color.m_x != 0 && pTemplate.color.m_y != 0 && pTemplate.color.m_z != 0;
     m_hasColor = true;
+    // color and the template's features are fixed from here on; setTemplate() rebinds
+    psysCPU.bindKernels(psysCPU.getKernelFeatures(m_hasColor));
 
     psysCPU.create(particleBase);
     PEINFO("=== createParticleSystem SUCCESS ===\n");
 }
 
+void ParticleSystem::restartParticleSystem(const Vector3 &pos)
+{
+    ParticleSystemCPU* psysCPU = m_hParticleSystemCPU.getObject<ParticleSystemCPU>();
+    PEASSERT(psysCPU, "restartParticleSystem() needs createParticleSystem() first");
+
+    m_offset.setPos(pos);
+    m_packedOrigin = pos;
+    // the old order belongs to particles that are gone
+    m_depthSorter.invalidate();
+
+    psysCPU->m_base.setPos(pos);
+    psysCPU->restart(pos);
+}
+
+void ParticleSystem::setTemplateName(const char *name)
+{
+    strncpy(m_templateName, name, MaxTemplateName - 1);
+    m_templateName[MaxTemplateName - 1] = '\0';
+    m_templateGeneration = ParticleTemplateLibrary::Instance()->m_generation;
+}
+
+bool ParticleSystem::reloadTemplate()
+{
+#if PE_PARTICLE_HOT_RELOAD
+    ParticleTemplateLibrary *pTemplates = ParticleTemplateLibrary::Instance();
+    ParticleSystemCPU *psysCPU = m_hParticleSystemCPU.getObject<ParticleSystemCPU>();
+    if (!psysCPU || m_templateName[0] == '\0' || m_templateGeneration == pTemplates->m_generation)
+        return false;
+    m_templateGeneration = pTemplates->m_generation;
+
+    // found into a copy of the running template, so the pointers the game set stay
+    Particle particle = psysCPU->m_particleTemplate;
+    if (!pTemplates->find(m_templateName, particle))
+        return false;
+    particle.m_pShapeMesh = psysCPU->m_particleTemplate.m_pShapeMesh;
+    particle.m_pColliders = psysCPU->m_particleTemplate.m_pColliders;
+
+    psysCPU->setTemplate(particle);
+    m_depthSorter.invalidate();
+    m_builtEmpty = false;
+    PEINFO("ParticleSystem: %s reloaded\n", m_templateName);
+    return true;
+#else
+    return false;
+#endif
+}
+
 void ParticleSystemCPU::create(const Matrix4x4& base)
 {
     m_base = Matrix4x4(base);
@@ -83,223 +192,233 @@ void ParticleSystemCPU::create(const Matrix4x4& base)
 
 void ParticleSystemCPU::createParticleBuffer()
 {
-    m_hParticleBufferCPU = Handle("PARTICLE_BUFFER_CPU", sizeof(ParticleBufferCPU<ParticleCPU>));
-    ParticleBufferCPU<ParticleCPU>* ppbcpu = new(m_hParticleBufferCPU) ParticleBufferCPU<ParticleCPU>(*m_pContext, m_arena);
-
-    const PrimitiveTypes::Int32 maxParticleSize = (PrimitiveTypes::Int32)(m_particleTemplate.m_duration * m_particleTemplate.m_rate);
-    ppbcpu->m_values.reset(maxParticleSize);
-
-    int initialParticleCount = m_particleTemplate.m_rate;
-
-    float spawnRadius = 0.5f;
-
-    for (int i = 0; i < initialParticleCount; ++i)
-    {
-        ParticleCPU newParticle;
-
-        Vector3 basePos = m_base.getPos();
-
-        // randomly
-        float r = (rand() / (float)RAND_MAX); // [0,1)
-        float theta = (rand() / (float)RAND_MAX) * 2.0f * PrimitiveTypes::Constants::c_Pi_F32;
-        float yOffset = ((rand() / (float)RAND_MAX) * 0.5f); // 0 ~ 0.5
-
-        basePos.m_x += cosf(theta) * spawnRadius * r;
-        basePos.m_z += sinf(theta) * spawnRadius * r;
-        basePos.m_y += yOffset;
-
-        newParticle.m_base = m_base;
-        newParticle.m_base.setPos(basePos);
-
-        newParticle.m_size = m_particleTemplate.m_size;
-        newParticle.m_duration = m_particleTemplate.m_duration;
-
-        // give random ages
-        newParticle.m_age = (rand() / (float)RAND_MAX) * m_particleTemplate.m_duration;
-
-        newParticle.velocity = generateVelocity();
-
-        ppbcpu->m_values.add(newParticle);
-    }
+    start(m_base.getPos());
 
     m_hMaterialSetCPU = Handle("MATERIAL_SET_CPU", sizeof(MaterialSetCPU));
     MaterialSetCPU* pmscpu = new(m_hMaterialSetCPU) MaterialSetCPU(*m_pContext, m_arena);
     pmscpu->createSetWithOneTexturedMaterial(m_particleTemplate.m_texture, "Default");
-
-    m_pastTime = 0.0f;
 }
 
+PrimitiveTypes::UInt32 ParticleSystem::getMaxMeshCapacity(ParticleRenderMode renderMode)
+{
+    if (renderMode == ParticleRenderMode_Instanced)
+        return MaxInstancedPoints;
+    return MaxExpandedQuads;
+}
 
-void ParticleSystemCPU::updateParticleBuffer(PrimitiveTypes::Float32 time)
+void ParticleSystem::prepareMeshBuffers(MeshCPU &mcpu, PrimitiveTypes::UInt32 capacity)
 {
-    static int callCount = 0;
-    if (callCount % 60 == 0)
-    {
-        PEINFO("updateParticleBuffer called, time=%.4f, call#%d\n", time, callCount);
-    }
-    callCount++;
+    if (capacity > getMaxMeshCapacity(m_renderMode))
+        capacity = getMaxMeshCapacity(m_renderMode);
 
-    ParticleBufferCPU<ParticleCPU>* ppbcpu;
-    if (!m_hParticleBufferCPU.isValid())
-    {
-        m_hParticleBufferCPU = Handle("PARTICLE_BUFFER_CPU", sizeof(ParticleBufferCPU<ParticleCPU>));
-        ppbcpu = new(m_hParticleBufferCPU) ParticleBufferCPU<ParticleCPU>(*m_pContext, m_arena);
-        const PrimitiveTypes::Int32 maxParticleSize = m_particleTemplate.m_duration * m_particleTemplate.m_rate;
-        ppbcpu->m_values.reset(maxParticleSize);
-    }
-    else
-    {
-        ppbcpu = m_hParticleBufferCPU.getObject<ParticleBufferCPU<ParticleCPU>>();
-    }
+    m_uploadStats.m_staticBytes = 0;
+    if (capacity <= m_meshCapacity)
+        return;
 
-    m_pastTime += time;
-    int totalParticles = m_pastTime * m_particleTemplate.m_rate;
+    // sized for the whole emitter once; only the live prefix is rewritten every frame and
+    // everything that does not depend on the particles is written here and kept
+    PositionBufferCPU* pvB = mcpu.m_hPositionBufferCPU.getObject<PositionBufferCPU>();
+    IndexBufferCPU* pIB = mcpu.m_hIndexBufferCPU.getObject<IndexBufferCPU>();
 
+    PrimitiveTypes::UInt32 staticBytes = 0;
 
-    // update current particles
-    for (int j = 0; j < ppbcpu->m_values.m_size; j++)
+    if (m_renderMode == ParticleRenderMode_Instanced)
     {
-        ppbcpu->m_values[j].m_age += time;
-
-        if (ppbcpu->m_values[j].m_age >= ppbcpu->m_values[j].m_duration)
-        {
-            ParticleCPU newParticle;
+        ColorBufferCPU* pCB = mcpu.m_hColorBufferCPU.getObject<ColorBufferCPU>();
+        TexCoordBufferCPU* pTCB = mcpu.m_hTexCoordBufferCPU.getObject<TexCoordBufferCPU>();
 
-            Vector3 basePos = m_base.getPos();
-            float spawnRadius = 0.5f;
+        pvB->m_values.reset(capacity * 3);
+        pCB->m_values.reset(capacity * 3);
+        pTCB->m_values.reset(capacity * 2);
+        pIB->m_values.reset(capacity);
 
-            float r = (rand() / (float)RAND_MAX);
-            float theta = (rand() / (float)RAND_MAX) * 2.0f * PrimitiveTypes::Constants::c_Pi_F32;
-            float yOffset = ((rand() / (float)RAND_MAX) * 0.5f);
+        pIB->m_primitiveTopology = PEPrimitveTopology_POINTS;
+        for (PrimitiveTypes::UInt32 i = 0; i < capacity; i++)
+            pIB->m_values.add(i);
 
-            basePos.m_x += cosf(theta) * spawnRadius * r;
-            basePos.m_z += sinf(theta) * spawnRadius * r;
-            basePos.m_y += yOffset;
-
-            newParticle.m_base = m_base;
-            newParticle.m_base.setPos(basePos);
-
-            newParticle.m_size = m_particleTemplate.m_size;
-            newParticle.m_age = 0.0f;
-            newParticle.m_duration = m_particleTemplate.m_duration;
-            newParticle.velocity = generateVelocity();
+        staticBytes += capacity * sizeof(pIB->m_values[0]);
+    }
+    else
+    {
+        // a ParticlePackedVertex takes the place of one (x,y,z)
+        pvB->m_values.reset(capacity * 4 * 3); // 4 verts * (x,y,z)
+        pIB->m_values.reset(capacity * 6); // 2 tris
 
-            ppbcpu->m_values[j] = newParticle;
+        for (PrimitiveTypes::UInt32 i = 0; i < capacity; i++)
+        {
+            pIB->m_values.add(i * 4 + 0, i * 4 + 1, i * 4 + 2);
+            pIB->m_values.add(i * 4 + 2, i * 4 + 3, i * 4 + 0);
         }
+        staticBytes += capacity * 6 * sizeof(pIB->m_values[0]);
 
-
-        else
+        // packed vertices carry color and corner themselves
+        const bool packed = m_renderMode == ParticleRenderMode_Packed;
+        if (m_hasColor && !packed)
         {
-            ParticleCPU& p = ppbcpu->m_values[j];
-
-            float t = p.m_age / p.m_duration;
-            if (t < 0.0f) t = 0.0f;
-            if (t > 1.0f) t = 1.0f;
+            ColorBufferCPU* pCB = mcpu.m_hColorBufferCPU.getObject<ColorBufferCPU>();
+            pCB->m_values.reset(capacity * 4 * 3);
+        }
 
-            Vector3 curPos = p.m_base.getPos();
+        if (m_hasTexture && !packed)
+        {
+            TexCoordBufferCPU* pTCB = mcpu.m_hTexCoordBufferCPU.getObject<TexCoordBufferCPU>();
+            NormalBufferCPU* pNB = mcpu.m_hNormalBufferCPU.getObject<NormalBufferCPU>();
 
-            const float moveScale = 0.02f;
+            pTCB->m_values.reset(capacity * 4 * 2);
+            pNB->m_values.reset(capacity * 4 * 3);
 
-            // follow velocity drifting down
-            Vector3 drift = p.velocity * (m_particleTemplate.m_speed * time * moveScale);
+            for (PrimitiveTypes::UInt32 i = 0; i < capacity; i++)
+            {
+                pTCB->m_values.add(0, 0); // top left
+                pTCB->m_values.add(1, 0); // top right
+                pTCB->m_values.add(1, 1);
+                pTCB->m_values.add(0, 1);
+
+                pNB->m_values.add(0, 0, 0);
+                pNB->m_values.add(0, 0, 0);
+                pNB->m_values.add(0, 0, 0);
+                pNB->m_values.add(0, 0, 0);
+            }
+            staticBytes += capacity * 4 * (2 + 3) * sizeof(PrimitiveTypes::Float32);
+        }
+    }
 
-            // swirl
-            float swirlStrength = 0.1f;   
-            float swirlSpeed = 1.0f;   
-            float phase = swirlSpeed * p.m_age + j * 0.37f;
+    m_meshCapacity = capacity;
+    m_uploadStats.m_staticBytes = staticBytes;
+}
 
-            Vector3 swirl(cosf(phase), 0.0f, sinf(phase));
-            swirl *= swirlStrength * time * moveScale;
+void ParticleSystem::setLiveRange(MeshCPU &mcpu, PrimitiveTypes::UInt32 particleCount)
+{
+    PositionBufferCPU* pvB = mcpu.m_hPositionBufferCPU.getObject<PositionBufferCPU>();
+    IndexBufferCPU* pIB = mcpu.m_hIndexBufferCPU.getObject<IndexBufferCPU>();
 
-            curPos += drift + swirl;
-            p.m_base.setPos(curPos);
+    const bool instanced = m_renderMode == ParticleRenderMode_Instanced;
+    const bool packed = m_renderMode == ParticleRenderMode_Packed;
+    const PrimitiveTypes::UInt32 vertsPerParticle = instanced ? 1 : 4;
+    const PrimitiveTypes::UInt32 indicesPerParticle = instanced ? 1 : 6;
 
-            // 3) pulse slightly
-            float baseSizeX = m_particleTemplate.m_size.m_x;
-            float baseSizeY = m_particleTemplate.m_size.m_y;
-            float sizePulse = 0.05f * sinf(p.m_age * 2.0f);  
+    // the static index prefix already describes exactly the live particles
+    pIB->m_values.m_size = particleCount * indicesPerParticle;
+    pIB->m_indexRanges[0].m_start = 0;
+    pIB->m_indexRanges[0].m_end = particleCount * indicesPerParticle - 1;
+    pIB->m_indexRanges[0].m_minVertIndex = 0;
+    pIB->m_indexRanges[0].m_maxVertIndex = particleCount * vertsPerParticle - 1;
 
-            p.m_size = Vector2(
-                baseSizeX * (1.0f + sizePulse),
-                baseSizeY * (1.0f + sizePulse)
-            );
-        }
+    pIB->m_minVertexIndex = pIB->m_indexRanges[0].m_minVertIndex;
+    pIB->m_maxVertexIndex = pIB->m_indexRanges[0].m_maxVertIndex;
 
+    pvB->m_values.m_size = particleCount * vertsPerParticle * 3;
+    PrimitiveTypes::UInt32 submitted = pvB->m_values.m_size * sizeof(PrimitiveTypes::Float32)
+        + pIB->m_values.m_size * sizeof(pIB->m_values[0]);
 
+    if (instanced || (m_hasColor && !packed))
+    {
+        ColorBufferCPU* pCB = mcpu.m_hColorBufferCPU.getObject<ColorBufferCPU>();
+        pCB->m_values.m_size = particleCount * vertsPerParticle * 3;
+        submitted += pCB->m_values.m_size * sizeof(PrimitiveTypes::Float32);
     }
-
-    // add new particles
-    if (m_particleTemplate.m_looping && totalParticles > ppbcpu->m_values.m_size)
+    if (instanced || (m_hasTexture && !packed))
     {
-        int maxSize = m_particleTemplate.m_duration * m_particleTemplate.m_rate;
-        if (ppbcpu->m_values.m_size < maxSize)
-        {
-            PrimitiveTypes::Int16 partCount = totalParticles - ppbcpu->m_values.m_size;
-            if (partCount + ppbcpu->m_values.m_size > maxSize)
-                partCount = maxSize - ppbcpu->m_values.m_size;
-
-            for (int i = 0; i < partCount; ++i)
-            {
-                ParticleCPU newParticle;
+        TexCoordBufferCPU* pTCB = mcpu.m_hTexCoordBufferCPU.getObject<TexCoordBufferCPU>();
+        pTCB->m_values.m_size = particleCount * vertsPerParticle * 2;
+        submitted += pTCB->m_values.m_size * sizeof(PrimitiveTypes::Float32);
+    }
+    if (!instanced && !packed && m_hasTexture)
+    {
+        NormalBufferCPU* pNB = mcpu.m_hNormalBufferCPU.getObject<NormalBufferCPU>();
+        pNB->m_values.m_size = particleCount * 4 * 3;
+        submitted += pNB->m_values.m_size * sizeof(PrimitiveTypes::Float32);
+    }
 
-                // —— random position —— //
-                Vector3 basePos = m_base.getPos();
-                float spawnRadius = 0.5f;  // same as create
+    m_uploadStats.m_submittedBytes = submitted;
+    m_uploadStats.m_fullRebuildBytes = getFullRebuildBytes(particleCount);
+}
 
-                float r = (rand() / (float)RAND_MAX); // [0,1)
-                float theta = (rand() / (float)RAND_MAX) * 2.0f * PrimitiveTypes::Constants::c_Pi_F32;
-                float yOffset = ((rand() / (float)RAND_MAX) * 0.5f);   
+void ParticleSystem::writeParticleRange(MeshCPU &mcpu, ParticleSystemCPU &psysCPU, const ParticleCameraSnapshot &view,
+    const PrimitiveTypes::UInt32 *pOrder, PrimitiveTypes::UInt32 first, PrimitiveTypes::UInt32 count)
+{
+    ParticleBufferCPU* ppb = &psysCPU.m_buffer;
+    PrimitiveTypes::Float32 *pPos = mcpu.m_hPositionBufferCPU.getObject<PositionBufferCPU>()->m_values.getFirstPtr();
 
-                basePos.m_x += cosf(theta) * spawnRadius * r;
-                basePos.m_z += sinf(theta) * spawnRadius * r;
-                basePos.m_y += yOffset;
+    if (m_renderMode == ParticleRenderMode_Instanced)
+    {
+        // one point per particle: center in the position stream, rgb in the color stream and
+        // the quad size in the texcoord stream. ParticleBillboard_Tech expands every point
+        // into a camera-facing quad using the view basis, so nothing here depends on the camera
+        PrimitiveTypes::Float32 *pColor = mcpu.m_hColorBufferCPU.getObject<ColorBufferCPU>()->m_values.getFirstPtr();
+        PrimitiveTypes::Float32 *pSize = mcpu.m_hTexCoordBufferCPU.getObject<TexCoordBufferCPU>()->m_values.getFirstPtr();
+
+        psysCPU.m_kernels.m_writePoints(*ppb, count, pOrder, psysCPU.m_clock.m_alpha, psysCPU.m_curves, m_hasColor,
+            pPos + first * 3, pColor + first * 3, pSize + first * 2);
+    }
+    else if (m_renderMode == ParticleRenderMode_Packed)
+    {
+        psysCPU.m_kernels.m_writePackedQuads(*ppb, count, pOrder, view, psysCPU.m_clock.m_alpha, psysCPU.m_curves, m_hasColor,
+            m_packedOrigin, reinterpret_cast<ParticlePackedVertex *>(pPos) + first * 4);
+    }
+    else
+    {
+        // positions and colors are the only per-frame data; written in place
+        PrimitiveTypes::Float32 *pColor = m_hasColor ? mcpu.m_hColorBufferCPU.getObject<ColorBufferCPU>()->m_values.getFirstPtr() : NULL;
 
-                newParticle.m_base = m_base;
-                newParticle.m_base.setPos(basePos);
+        psysCPU.m_kernels.m_writeQuads(*ppb, count, pOrder, view, psysCPU.m_clock.m_alpha, psysCPU.m_curves,
+            pPos + first * 12, pColor ? pColor + first * 12 : NULL);
+    }
+}
 
-                newParticle.m_size = m_particleTemplate.m_size;
-                newParticle.m_age = 0.0f;
-                newParticle.m_duration = m_particleTemplate.m_duration;
-                newParticle.velocity = generateVelocity();
+PrimitiveTypes::UInt32 ParticleSystem::getDynamicBytes(PrimitiveTypes::UInt32 particleCount) const
+{
+    if (m_renderMode == ParticleRenderMode_Instanced)
+        return particleCount * (3 + 3 + 2) * sizeof(PrimitiveTypes::Float32);
+    if (m_renderMode == ParticleRenderMode_Packed)
+        return particleCount * 4 * sizeof(ParticlePackedVertex);
+    return particleCount * 4 * 3 * sizeof(PrimitiveTypes::Float32) * (m_hasColor ? 2 : 1);
+}
 
-                ppbcpu->m_values.add(newParticle);
-            }
+PrimitiveTypes::UInt32 ParticleSystem::getFullRebuildBytes(PrimitiveTypes::UInt32 particleCount) const
+{
+    // positions, colors, uvs and normals reset and added for 4 verts, and 2 tris of indices
+    PrimitiveTypes::UInt32 floatsPerParticle = 4 * 3 + (m_hasColor ? 4 * 3 : 0) + (m_hasTexture ? 4 * (2 + 3) : 0);
+    return particleCount * (floatsPerParticle * sizeof(PrimitiveTypes::Float32) + 6 * sizeof(PrimitiveTypes::UInt16));
+}
 
+void ParticleSystem::buildExpandedQuads(MeshCPU &mcpu, ParticleSystemCPU &psysCPU, const ParticleCameraSnapshot &view,
+    const PrimitiveTypes::UInt32 *pOrder)
+{
+    ParticleBufferCPU* ppb = &psysCPU.m_buffer;
+    PrimitiveTypes::UInt32 particleCount = ppb->m_size;
 
-        }
-    }
+    prepareMeshBuffers(mcpu, ppb->m_capacity);
+    if (particleCount > m_meshCapacity)
+        particleCount = m_meshCapacity; // past this the 16-bit indices would wrap
+    setLiveRange(mcpu, particleCount);
 
-    // let particle face the camera
-    for (int i = 0; i < ppbcpu->m_values.m_size; i++)
-    {
-        Components::CameraSceneNode* pCam = Components::CameraManager::Instance()->getActiveCamera()->getCamSceneNode();
-        Vector3 cameraFront = pCam->m_worldTransform.getN();
-        Vector3 cameraRight = pCam->m_worldTransform.getU();
-        Vector3 cameraUp = pCam->m_worldTransform.getV();
+    writeParticleRange(mcpu, psysCPU, view, pOrder, 0, particleCount);
 
-        ppbcpu->m_values[i].m_base.setN(cameraFront);
-        ppbcpu->m_values[i].m_base.setU(cameraRight);
-        ppbcpu->m_values[i].m_base.setV(cameraUp);
-    }
+    m_uploadStats.m_dynamicBytes = getDynamicBytes(particleCount);
 }
-Vector3 ParticleSystemCPU::generateVelocity()
+
+void ParticleSystem::buildInstances(MeshCPU &mcpu, ParticleSystemCPU &psysCPU, const PrimitiveTypes::UInt32 *pOrder)
 {
-    // random horizontal component [-1, 1]
-    float rx = (rand() / (float)RAND_MAX) * 2.0f - 1.0f;
-    float rz = (rand() / (float)RAND_MAX) * 2.0f - 1.0f;
+    ParticleBufferCPU* ppb = &psysCPU.m_buffer;
+    PrimitiveTypes::UInt32 particleCount = ppb->m_size;
 
-    // main direction：down
-    float vy = -0.1f - ((rand() / (float)RAND_MAX) * 0.1f); // [-0.1, -0.2]
+    prepareMeshBuffers(mcpu, ppb->m_capacity);
+    if (particleCount > m_meshCapacity)
+        particleCount = m_meshCapacity; // past this the 16-bit indices would wrap
+    setLiveRange(mcpu, particleCount);
 
-    Vector3 dir(rx, vy, rz);
-    dir.normalize();  
+    writeParticleRange(mcpu, psysCPU, m_cameraViews[0], pOrder, 0, particleCount);
 
-    return dir;
+    m_uploadStats.m_dynamicBytes = getDynamicBytes(particleCount);
 }
 
-
-
 void ParticleSystem::loadParticle_needsRC(int& threadOwnershipMask)
+{
+    loadParticleForView_needsRC(threadOwnershipMask, 0);
+}
+
+void ParticleSystem::loadParticleForView_needsRC(int& threadOwnershipMask, PrimitiveTypes::UInt32 viewIndex)
 {
     static bool firstCall = true;
     if (firstCall)
@@ -307,185 +426,120 @@ void ParticleSystem::loadParticle_needsRC(int& threadOwnershipMask)
         firstCall = false;
     }
 
-    MeshCPU* mcpu;
-    if (!m_meshCPU.isValid())
-    {
-        m_meshCPU = Handle("MeshCPU SpriteMesh", sizeof(MeshCPU));
-        mcpu = new (m_meshCPU) MeshCPU(*m_pContext, m_arena);
-    }
-    else
-    {
-        mcpu = m_meshCPU.getObject<MeshCPU>();
-    }
-
-    if (!m_loaded)
-    {
-        mcpu->createEmptyMesh();
-        // mcpu.createBillboardMeshWithColorTexture("cobble2_color.dds", "Default", 32, 32, SamplerState_NoMips_NoMinTex);
-    }
-
-    mcpu->m_manualBufferManagement = true;
+    MeshCPU* mcpu = getMeshCPU();
     ParticleSystemCPU* psysCPU = m_hParticleSystemCPU.getObject<ParticleSystemCPU>();
 
-    ParticleBufferCPU<ParticleCPU>* ppb = psysCPU->m_hParticleBufferCPU.getObject<ParticleBufferCPU<ParticleCPU>>();
-    PrimitiveTypes::Int16 particleCount = ppb->m_values.m_size;
+    ParticleBufferCPU* ppb = &psysCPU->m_buffer;
+    PrimitiveTypes::Int32 particleCount = ppb->m_size;
+    m_builtEmpty = particleCount == 0;
 
     // print particle count
     if (firstCall)
     {
-        PEINFO("=== loadParticle_needsRC first call ===\n");
-        PEINFO("Particle count: %d\n", particleCount);
+        PE_PARTICLE_LOG("=== loadParticle_needsRC first call ===\n");
+        PE_PARTICLE_LOG("Particle count: %d\n", particleCount);
         firstCall = false;
     }
 
     static int lastCount = -1;
+    static int lastUploadCount = -1;
     if (particleCount != lastCount)
     {
-        PEINFO("Particle count changed: %d -> %d\n", lastCount, particleCount);
+        PE_PARTICLE_LOG("Particle count changed: %d -> %d\n", lastCount, particleCount);
         lastCount = particleCount;
     }
 
-    PositionBufferCPU* pvB = mcpu->m_hPositionBufferCPU.getObject<PositionBufferCPU>();
-    IndexBufferCPU* pIB = mcpu->m_hIndexBufferCPU.getObject<IndexBufferCPU>();
+    resolveRenderMode();
 
-    ColorBufferCPU* pCB;
-    TexCoordBufferCPU* pTCB;
-    NormalBufferCPU* pNB;
-    MaterialSetCPU* msCPU;
-
-    pvB->m_values.reset(particleCount * 4 * 3); // 4 verts * (x,y,z)
-    pIB->m_values.reset(particleCount * 6); // 2 tris
+    {
+        PE_PARTICLE_SCOPED_TIMER(psysCPU->m_stats, ParticleTimer_Build);
+        const ParticleCameraSnapshot &view = m_cameraViews[viewIndex < m_cameraViewCount ? viewIndex : 0];
 
-    pIB->m_indexRanges[0].m_start = 0;
-    pIB->m_indexRanges[0].m_end = particleCount * 6 - 1;
-    pIB->m_indexRanges[0].m_minVertIndex = 0;
-    pIB->m_indexRanges[0].m_maxVertIndex = particleCount * 4 - 1;
+        // back to front for blending; both paths draw in the order the particles are written
+        const PrimitiveTypes::UInt32 *pOrder = psysCPU->m_particleTemplate.m_depthSort
+            ? m_depthSorter.sort(*ppb, ppb->m_size, view) : NULL;
 
-    pIB->m_minVertexIndex = pIB->m_indexRanges[0].m_minVertIndex;
-    pIB->m_maxVertexIndex = pIB->m_indexRanges[0].m_maxVertIndex;
+        if (m_renderMode == ParticleRenderMode_Instanced)
+            buildInstances(*mcpu, *psysCPU, pOrder);
+        else
+            buildExpandedQuads(*mcpu, *psysCPU, view, pOrder);
+    }
+    PE_PARTICLE_COUNT(psysCPU->m_stats, ParticleCounter_VerticesWritten,
+        mcpu->m_hPositionBufferCPU.getObject<PositionBufferCPU>()->m_values.m_size / 3);
+    PE_PARTICLE_COUNT(psysCPU->m_stats, ParticleCounter_BytesUploaded, m_uploadStats.m_submittedBytes);
 
-    if (m_hasTexture)
+    if (particleCount != lastUploadCount)
     {
-        pTCB = mcpu->m_hTexCoordBufferCPU.getObject<TexCoordBufferCPU>();
-        pTCB->m_values.reset(particleCount * 4 * 2);
-
-        pNB = mcpu->m_hNormalBufferCPU.getObject<NormalBufferCPU>();
-        pNB->m_values.reset(particleCount * 4 * 3);
+        PE_PARTICLE_LOG("Particle upload: %u bytes written (%u dynamic, %u static) against %u with a full rebuild, %u submitted\n",
+            m_uploadStats.m_dynamicBytes + m_uploadStats.m_staticBytes, m_uploadStats.m_dynamicBytes,
+            m_uploadStats.m_staticBytes, m_uploadStats.m_fullRebuildBytes, m_uploadStats.m_submittedBytes);
+        lastUploadCount = particleCount;
     }
 
-    if (m_hasColor)
+    PE_PARTICLE_SCOPED_TIMER(psysCPU->m_stats, ParticleTimer_Upload);
+    uploadMeshCPU_needsRC(*mcpu, threadOwnershipMask, psysCPU->m_hMaterialSetCPU);
+}
+
+MeshCPU *ParticleSystem::getMeshCPU()
+{
+    MeshCPU* mcpu;
+    if (!m_meshCPU.isValid())
     {
-        pCB = mcpu->m_hColorBufferCPU.getObject<ColorBufferCPU>();
-        pCB->m_values.reset(particleCount * 4 * 3);
+        m_meshCPU = Handle("MeshCPU SpriteMesh", sizeof(MeshCPU));
+        mcpu = new (m_meshCPU) MeshCPU(*m_pContext, m_arena);
     }
-
-    for (int i = 0; i < particleCount; i++)
+    else
     {
-        Matrix4x4 topLeftTransform = ppb->m_values[i].m_base;
-        Matrix4x4 topRightTransform = ppb->m_values[i].m_base;
-        Matrix4x4 bottomLeftTransform = ppb->m_values[i].m_base;
-        Matrix4x4 bottomRightTransform = ppb->m_values[i].m_base;
-        Vector2 curSize = ppb->m_values[i].m_size;
-
-        topLeftTransform.moveLeft(curSize.m_x / 2.f);
-        topLeftTransform.moveUp(curSize.m_y / 2.f);
-
-        topRightTransform.moveRight(curSize.m_x / 2.f);
-        topRightTransform.moveUp(curSize.m_y / 2.f);
-
-        bottomLeftTransform.moveLeft(curSize.m_x / 2.f);
-        bottomLeftTransform.moveDown(curSize.m_y / 2.f);
-
-        bottomRightTransform.moveRight(curSize.m_x / 2.f);
-        bottomRightTransform.moveDown(curSize.m_y / 2.f);
-
-        pvB->m_values.add(topLeftTransform.getPos().m_x, topLeftTransform.getPos().m_y, topLeftTransform.getPos().m_z); // top lef
-        pvB->m_values.add(topRightTransform.getPos().m_x, topRightTransform.getPos().m_y, topRightTransform.getPos().m_z); // top right
-        pvB->m_values.add(bottomRightTransform.getPos().m_x, bottomRightTransform.getPos().m_y, bottomRightTransform.getPos().m_z);
-        pvB->m_values.add(bottomLeftTransform.getPos().m_x, bottomLeftTransform.getPos().m_y, bottomLeftTransform.getPos().m_z);
-
-        pIB->m_values.add(i * 4 + 0, i * 4 + 1, i * 4 + 2);
-        pIB->m_values.add(i * 4 + 2, i * 4 + 3, i * 4 + 0);
-
-        if (m_hasColor)
-        {
-            ParticleCPU& p = ppb->m_values[i];
-
-            float t = p.m_age / p.m_duration;
-            if (t < 0.0f) t = 0.0f;
-            if (t > 1.0f) t = 1.0f;
-
-            // particle goes from dark to bright
-            float brightness;
-            if (t < 0.2f)
-            {
-                brightness = t / 0.2f;           // 0 → 1
-            }
-            else if (t > 0.7f)
-            {
-                brightness = (1.0f - t) / 0.3f;  // 1 → 0
-            }
-            else
-            {
-                brightness = 1.0f;
-            }
-            if (brightness < 0.0f) brightness = 0.0f;
-
-            Vector3 baseColor = psysCPU->m_particleTemplate.color; // (0.9,0.95,0.8)
-
-            float r = baseColor.m_x * brightness;
-            float g = baseColor.m_y * brightness;
-            float b = baseColor.m_z * brightness;
-
-            pCB->m_values.add(r, g, b);
-            pCB->m_values.add(r, g, b);
-            pCB->m_values.add(r, g, b);
-            pCB->m_values.add(r, g, b);
-        }
-
+        mcpu = m_meshCPU.getObject<MeshCPU>();
+    }
 
+    if (!m_loaded)
+    {
+        mcpu->createEmptyMesh();
+        // mcpu.createBillboardMeshWithColorTexture("cobble2_color.dds", "Default", 32, 32, SamplerState_NoMips_NoMinTex);
+    }
 
+    mcpu->m_manualBufferManagement = true;
+    return mcpu;
+}
 
-        if (m_hasTexture)
-        {
-            pTCB->m_values.add(0, 0); // top left
-            pTCB->m_values.add(1, 0); // top right
-            pTCB->m_values.add(1, 1);
-            pTCB->m_values.add(0, 1);
-
-            pNB->m_values.add(0, 0, 0);
-            pNB->m_values.add(0, 0, 0);
-            pNB->m_values.add(0, 0, 0);
-            pNB->m_values.add(0, 0, 0);
-        }
-    }
+void ParticleSystem::resolveRenderMode()
+{
+    if (m_loaded || m_renderMode == ParticleRenderMode_CPUExpanded)
+        return;
 
-    if (m_hasColor)
+    const char *techName = getTechniqueName();
+    if (!EffectManager::Instance()->getEffectHandle(techName).isValid())
     {
-        ColorBufferCPU* pCBCheck = mcpu->m_hColorBufferCPU.getObject<ColorBufferCPU>();
-
-        PEINFO("ColorBuffer floats: %d\n", pCBCheck->m_values.m_size);
-        if (pCBCheck->m_values.m_size >= 3)
-        {
-            PEINFO("First color in buffer: (%.2f, %.2f, %.2f)\n",
-                pCBCheck->m_values[0],
-                pCBCheck->m_values[1],
-                pCBCheck->m_values[2]);
-        }
+        PEINFO("%s not available, particles fall back to cpu-expanded quads\n", techName);
+        m_renderMode = ParticleRenderMode_CPUExpanded;
     }
+}
+
+const char *ParticleSystem::getTechniqueName() const
+{
+    if (m_renderMode == ParticleRenderMode_Instanced)
+        return ParticleBillboardTechName;
+    if (m_renderMode == ParticleRenderMode_Packed)
+        return ParticlePackedTechName;
+    return "ColoredMinimalMesh_Tech";
+}
 
+void ParticleSystem::uploadMeshCPU_needsRC(MeshCPU &mcpu, int &threadOwnershipMask, Handle hMaterialSetCPU)
+{
     if (!m_loaded)
     {
         // first time creating gpu mesh
+        MaterialSetCPU* msCPU;
         if (m_hasTexture)
         {
-            msCPU = mcpu->m_hMaterialSetCPU.getObject<MaterialSetCPU>();
-            memcpy(msCPU, psysCPU->m_hMaterialSetCPU.getObject<MaterialSetCPU>(), sizeof(msCPU));
+            msCPU = mcpu.m_hMaterialSetCPU.getObject<MaterialSetCPU>();
+            memcpy(msCPU, hMaterialSetCPU.getObject<MaterialSetCPU>(), sizeof(msCPU));
         }
-        loadFromMeshCPU_needsRC(*mcpu, threadOwnershipMask);
+        loadFromMeshCPU_needsRC(mcpu, threadOwnershipMask);
 
-        const char* techName = "ColoredMinimalMesh_Tech";
-        if (techName && m_hasColor)
+        const char* techName = getTechniqueName();
+        if (techName && (m_hasColor || m_renderMode != ParticleRenderMode_CPUExpanded))
         {
             Handle hEffect = EffectManager::Instance()->getEffectHandle(techName);
 
@@ -499,7 +553,7 @@ void ParticleSystem::loadParticle_needsRC(int& threadOwnershipMask)
     }
     else
     {
-        updateGeoFromMeshCPU_needsRC(*mcpu, threadOwnershipMask);
+        updateGeoFromMeshCPU_needsRC(mcpu, threadOwnershipMask);
     }
 }
 
@@ -508,30 +562,94 @@ void ParticleSystem::do_UPDATE(Events::Event* pEvt)
     static int count = 0;
     count++;
 
+    // batched emitters are updated by their batch
+    if (m_hBatch.isValid())
+        return;
+
     Events::Event_UPDATE* updateEvt = (Events::Event_UPDATE*)(pEvt);
     float dt = updateEvt->m_frameTime / 1000.0f;
 
+    reloadTemplate();
+
     ParticleSystemCPU* psysCPU = m_hParticleSystemCPU.getObject<ParticleSystemCPU>();
-    psysCPU->updateParticleBuffer(dt);
+    psysCPU->beginUpdate(dt);
 }
 
-void ParticleSystem::do_GATHER_DRAWCALLS(PE::Events::Event* pEvt)
+// ParticleTemplateWatcher implementation
+ParticleTemplateWatcher::ParticleTemplateWatcher(PE::GameContext &context, PE::MemoryArena arena, Handle hMyself)
+    : Component(context, arena, hMyself)
 {
-    static int count = 0;
-    if (count == 0) PEINFO("do_GATHER_DRAWCALLS called\n");
-    count++;
+}
+
+void ParticleTemplateWatcher::addDefaultComponents()
+{
+    Component::addDefaultComponents();
+    PE_REGISTER_EVENT_HANDLER(Events::Event_UPDATE, ParticleTemplateWatcher::do_UPDATE);
+}
+
+void ParticleTemplateWatcher::do_UPDATE(Events::Event *)
+{
+    // one stat of the source per frame; the emitters compare generations on their own update
+    ParticleTemplateLibrary::Instance()->reloadIfChanged();
+}
+
+void ParticleSystem::captureCameraViews()
+{
+    // one camera query per emitter per frame; the snapshot is shared by all particles
+    if (!m_cameraViewsSet)
+    {
+        Components::CameraSceneNode* pCam = Components::CameraManager::Instance()->getActiveCamera()->getCamSceneNode();
+        float aspect = (float)m_pContext->getGPUScreen()->getWidth() / (float)m_pContext->getGPUScreen()->getHeight();
+        m_cameraViews[0].capture(pCam->m_worldTransform, CameraFovY, aspect, pCam->m_near, pCam->m_far);
+        m_cameraViewCount = 1;
+    }
+    m_cameraViewsSet = false;
+}
+
+bool ParticleSystem::prepareFrame()
+{
+    // collect the update started in do_UPDATE; the simulation only advances there
+    ParticleSystemCPU* psysCPU = m_hParticleSystemCPU.getObject<ParticleSystemCPU>();
+    if (psysCPU)
+    {
+        psysCPU->finishUpdate();
 
-    // update
+        // the empty mesh of a finished burst was already uploaded
+        if (m_loaded && m_builtEmpty && psysCPU->isFinished())
+            return false;
+    }
+
+    captureCameraViews();
+
+    // visibility and distance of this frame drive the next update; off-screen emitters
+    // keep their last mesh, which the gpu clips anyway. a batch simply leaves them out
+    if (psysCPU)
     {
-        const float dt = 1.0f / 60.0f;
+        ParticleLodLevel lod = selectParticleLod(m_lodPolicy, psysCPU->m_bounds, m_cameraViews, m_cameraViewCount);
+        psysCPU->setLod(lod, m_lodPolicy);
 
-        ParticleSystemCPU* psysCPU = m_hParticleSystemCPU.getObject<ParticleSystemCPU>();
-        if (psysCPU)
+        if (lod == ParticleLodLevel_Culled && m_lodPolicy.m_skipBuildWhenCulled && (m_loaded || m_hBatch.isValid()))
         {
-            psysCPU->updateParticleBuffer(dt);
+            PE_PARTICLE_COUNT(psysCPU->m_stats, ParticleCounter_CulledFrames, 1);
+            PE_PARTICLE_END_FRAME(psysCPU->m_stats);
+            return false;
         }
     }
+    return true;
+}
 
+void ParticleSystem::do_GATHER_DRAWCALLS(PE::Events::Event* pEvt)
+{
+    static int count = 0;
+    if (count == 0) PE_PARTICLE_LOG("do_GATHER_DRAWCALLS called\n");
+    count++;
+
+    // batched emitters are drawn by their batch
+    if (m_hBatch.isValid())
+        return;
+
+    if (!prepareFrame())
+        return;
 
     Events::Event_GATHER_DRAWCALLS* gatherEvt = (Events::Event_GATHER_DRAWCALLS*)(pEvt);
 
@@ -542,6 +660,8 @@ void ParticleSystem::do_GATHER_DRAWCALLS(PE::Events::Event* pEvt)
 
     //  release RenderContext
     m_pContext->getGPUScreen()->ReleaseRenderContextOwnership(gatherEvt->m_threadOwnershipMask);
+
+    PE_PARTICLE_END_FRAME(getStats());
 }
 
 } // namespace Components
@@ -8,83 +8,37 @@
 #include "PrimeEngine/Math/Vector3.h"
 #include "PrimeEngine/Math/Matrix4x4.h"
 
-namespace PE {
-
-struct Vector2
-{
-    float m_x, m_y;
-    Vector2() : m_x(0.0f), m_y(0.0f) {}
-    Vector2(float x, float y) : m_x(x), m_y(y) {}
-};
+#include "ParticleSimCore.h"
 
+namespace PE {
 namespace Components {
 
-enum Shape { Cone, Sphere };
-
-struct ParticleCPU
-{
-    Matrix4x4 m_base;
-    Vector2 m_size;
-    float m_age;
-    float m_duration;
-    Vector3 velocity;
-    
-    ParticleCPU()
-        : m_base(), m_size(0.1f, 0.1f), m_age(0.0f), m_duration(1.0f), velocity() {}
-};
-
-template<typename T>
-struct ParticleBufferCPU : public PEAllocatableAndDefragmentable
-{
-    Array<T> m_values;
-    ParticleBufferCPU(PE::GameContext &context, PE::MemoryArena arena)
-        : m_values(context, arena) {}
-};
-
-struct Particle
-{
-    PrimitiveTypes::Int16 m_rate;
-    PrimitiveTypes::Float32 m_speed;
-    PrimitiveTypes::Float32 m_duration;
-    PrimitiveTypes::Bool m_looping;
-    Vector2 m_size;
-    Shape m_shape;
-    const char* m_texture;
-    Vector3 color;
-    
-    Particle()
-        : m_rate(80)                         
-        , m_speed(0.05f)                     
-        , m_duration(8.0f)                   
-        , m_looping(true)
-        , m_size(0.02f, 0.02f)              
-        , m_shape(Sphere)                   
-        , m_texture("")                     
-        , color(0.9f, 0.95f, 0.8f)          
-    {
-    }
-
-
-};
-
-struct ParticleSystemCPU : public PE::PEAllocatableAndDefragmentable
+// Engine side of an emitter: the simulation lives in ParticleEmitterCore, this adds
+// the world placement and the material set the mesh is loaded with.
+struct ParticleSystemCPU : public ParticleEmitterCore, public PE::PEAllocatableAndDefragmentable
 {
     ParticleSystemCPU(PE::GameContext &context, PE::MemoryArena arena, Particle particle);
     
     virtual void create(const Matrix4x4& base);
     virtual void createParticleBuffer();
-    Vector3 generateVelocity();
-    void updateParticleBuffer(PrimitiveTypes::Float32 time);
     
-    Handle m_hParticleBufferCPU;
     Handle m_hMaterialSetCPU;
     Matrix4x4 m_base;
-    const Particle m_particleTemplate;
-    PrimitiveTypes::Float32 m_pastTime;
     PE::MemoryArena m_arena;
     PE::GameContext *m_pContext;
 };
 
+// bytes moved by the last mesh rebuild of an emitter
+struct ParticleUploadStats
+{
+    PrimitiveTypes::UInt32 m_dynamicBytes; // rewritten in place: positions, colors, sizes
+    PrimitiveTypes::UInt32 m_staticBytes; // indices, uvs, normals; only when the capacity grows
+    PrimitiveTypes::UInt32 m_submittedBytes; // live range of all streams handed to updateGeoFromMeshCPU_needsRC
+    PrimitiveTypes::UInt32 m_fullRebuildBytes; // what the old reset-and-refill build wrote for the same count, see getFullRebuildBytes()
+
+    ParticleUploadStats() : m_dynamicBytes(0), m_staticBytes(0), m_submittedBytes(0), m_fullRebuildBytes(0) {}
+};
+
 struct ParticleSystem : public Mesh
 {
     PE_DECLARE_CLASS(ParticleSystem);
@@ -94,9 +48,81 @@ struct ParticleSystem : public Mesh
     virtual ~ParticleSystem() {}
 
     virtual void addDefaultComponents();
+
+    // worker threads used by emitters in ParticleUpdateMode_Jobs; 0 runs the jobs inline
+    static void setUpdateWorkerCount(PrimitiveTypes::UInt32 count);
+
     void createParticleSystem(Particle pTemplate);
+    // starts the template over at pos, keeping the cpu and gpu mesh buffers; the caller
+    // moves the SceneNode of a packed emitter to pos
+    void restartParticleSystem(const Vector3 &pos);
+    // the library template this emitter was made from; with PE_PARTICLE_HOT_RELOAD the
+    // emitter takes that template again whenever the library reloads
+    void setTemplateName(const char *name);
+    // hands the emitter its named template again if the library changed since the last
+    // call, keeping the game-owned shape mesh and colliders; true when it was replaced
+    bool reloadTemplate();
+
+    // counters and timers of this emitter; stays zero unless PE_PARTICLE_PROFILE is on
+    virtual ParticleEmitterStats &getStats();
     virtual void loadParticle_needsRC(int &threadOwnershipMask);
 
+    // rebuilds and uploads the geometry facing one of the views set for this frame.
+    // only cpu-expanded emitters depend on the view; call once per viewport before it draws
+    void loadParticleForView_needsRC(int &threadOwnershipMask, PrimitiveTypes::UInt32 viewIndex);
+
+    // views for this frame (split screen, reflections, ...). without a call the active
+    // camera is captured into view 0 at gather time
+    void setCameraViews(const ParticleCameraSnapshot *pViews, PrimitiveTypes::UInt32 count);
+
+    // most particles one mesh of the mode can draw before its 16-bit indices wrap
+    static PrimitiveTypes::UInt32 getMaxMeshCapacity(ParticleRenderMode renderMode);
+    // sizes the cpu mesh streams to the emitter capacity and writes the data that never
+    // changes (quad indices, uvs, normals) once; no-op while the capacity fits
+    void prepareMeshBuffers(MeshCPU &mcpu, PrimitiveTypes::UInt32 capacity);
+    // trims every stream and the index range to the first particleCount particles
+    void setLiveRange(MeshCPU &mcpu, PrimitiveTypes::UInt32 particleCount);
+
+    // writes count particles of an emitter into the streams from particle slot first on,
+    // in the layout of m_renderMode; pOrder as in the builders below
+    void writeParticleRange(MeshCPU &mcpu, ParticleSystemCPU &psysCPU, const ParticleCameraSnapshot &view,
+        const PrimitiveTypes::UInt32 *pOrder, PrimitiveTypes::UInt32 first, PrimitiveTypes::UInt32 count);
+    // per-frame bytes written for particleCount particles
+    PrimitiveTypes::UInt32 getDynamicBytes(PrimitiveTypes::UInt32 particleCount) const;
+    // bytes the old reset-and-refill build wrote for particleCount particles: every
+    // expanded quad stream plus 6 indices per particle, whatever the render mode
+    PrimitiveTypes::UInt32 getFullRebuildBytes(PrimitiveTypes::UInt32 particleCount) const;
+
+    // pOrder: particle indices to write in (back to front when depth sorted), NULL for buffer order
+    void buildExpandedQuads(MeshCPU &mcpu, ParticleSystemCPU &psysCPU, const ParticleCameraSnapshot &view,
+        const PrimitiveTypes::UInt32 *pOrder);
+    void buildInstances(MeshCPU &mcpu, ParticleSystemCPU &psysCPU, const PrimitiveTypes::UInt32 *pOrder);
+
+    // the cpu mesh, created on first use
+    MeshCPU *getMeshCPU();
+    // falls back to cpu-expanded quads before the first load if the mode's technique is missing
+    void resolveRenderMode();
+    const char *getTechniqueName() const;
+    // first call loads the gpu mesh and sets the technique, later calls update the geometry
+    void uploadMeshCPU_needsRC(MeshCPU &mcpu, int &threadOwnershipMask, Handle hMaterialSetCPU);
+
+    // active camera into view 0, unless views were set for this frame
+    void captureCameraViews();
+    // finishes the update and picks the lod for this frame's views; false when there is
+    // nothing new to draw (finished burst, culled)
+    bool prepareFrame();
+
+    // distance and visibility based scaling of this emitter, see ParticleLodPolicy
+    void setLodPolicy(const ParticleLodPolicy &policy);
+
+    static const char *ParticleBillboardTechName;
+    static const char *ParticlePackedTechName;
+    static const PrimitiveTypes::Float32 CameraFovY; // vertical fov of CameraSceneNode's projection
+    enum { MaxCameraViews = 4 };
+    enum { MaxExpandedQuads = 16384 }; // 4 verts each must stay addressable by 16-bit indices
+    enum { MaxInstancedPoints = 65536 }; // one 16-bit index per point
+    enum { MaxTemplateName = 64 };
+
     PE_DECLARE_IMPLEMENT_EVENT_HANDLER_WRAPPER(do_GATHER_DRAWCALLS);
     virtual void do_GATHER_DRAWCALLS(Events::Event *pEvt);
 
@@ -107,12 +133,44 @@ struct ParticleSystem : public Mesh
     Handle m_meshCPU;
     Matrix4x4 m_offset;
     PrimitiveTypes::Bool m_loaded;
+    PrimitiveTypes::Bool m_builtEmpty; // last rebuild had no live particles
     PrimitiveTypes::Bool m_hasTexture;
     PrimitiveTypes::Bool m_hasColor;
+    ParticleRenderMode m_renderMode; // falls back to cpu-expanded if the mode's technique is missing
+    // packed vertices are relative to this point; the MeshInstance drawing a packed emitter
+    // sits under a SceneNode placed here (ParticleBatcher does that for its batches)
+    Vector3 m_packedOrigin;
+    ParticleCameraSnapshot m_cameraViews[MaxCameraViews];
+    PrimitiveTypes::UInt32 m_cameraViewCount;
+    PrimitiveTypes::Bool m_cameraViewsSet; // views were provided for the current frame
+    PrimitiveTypes::UInt32 m_meshCapacity; // particles the cpu mesh streams are sized for
+    ParticleUploadStats m_uploadStats;
+    ParticleLodPolicy m_lodPolicy;
+    ParticleDepthSorter m_depthSorter; // used when Particle::m_depthSort is set
+    Handle m_hBatch; // ParticleBatch that updates and draws this emitter, if any
+    char m_templateName[MaxTemplateName]; // empty unless setTemplateName() was called
+    PrimitiveTypes::UInt32 m_templateGeneration; // library generation the template was taken from
     PE::MemoryArena m_arena;
     PE::GameContext *m_pContext;
 };
 
+// Polls the watched template source once per frame in dev builds (PE_PARTICLE_HOT_RELOAD);
+// emitters named with setTemplateName() take the reloaded templates on their next update.
+// The game creates one and adds it where it receives Event_UPDATE.
+struct ParticleTemplateWatcher : public Component
+{
+    PE_DECLARE_CLASS(ParticleTemplateWatcher);
+
+    ParticleTemplateWatcher(PE::GameContext &context, PE::MemoryArena arena, Handle hMyself);
+
+    virtual ~ParticleTemplateWatcher() {}
+
+    virtual void addDefaultComponents();
+
+    PE_DECLARE_IMPLEMENT_EVENT_HANDLER_WRAPPER(do_UPDATE);
+    virtual void do_UPDATE(Events::Event *pEvt);
+};
+
 }; // namespace Components
 }; // namespace PE
 
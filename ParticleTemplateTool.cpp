@@ -0,0 +1,81 @@
+// Author-time compiler for particle templates: turns the text format described in
+// ParticleTemplates.h into the file ParticleTemplateLibrary::open() maps.
+// Only built with PE_PARTICLE_HEADLESS, e.g.
+//   g++ -std=c++11 -O2 -pthread -DPE_PARTICLE_HEADLESS ParticleTemplateTool.cpp ParticleTemplates.cpp ParticleSimCore.cpp ParticleSimd.cpp ParticleJobs.cpp ParticleProfiler.cpp ParticleMemoryPool.cpp ParticleCurves.cpp ParticleShapes.cpp ParticleAffectors.cpp ParticleCollision.cpp ParticleNeighbors.cpp -o particle_templates
+//   ./particle_templates ParticleTemplates.txt ParticleTemplates.ptpl
+//   ./particle_templates --list ParticleTemplates.ptpl
+
+#ifdef PE_PARTICLE_HEADLESS
+
+#include "ParticleTemplates.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static int compileTemplateFile(const char *sourcePath, const char *outputPath)
+{
+    FILE *pSource = fopen(sourcePath, "rb");
+    if (!pSource)
+    {
+        fprintf(stderr, "cannot read %s\n", sourcePath);
+        return 1;
+    }
+    std::string text;
+    char chunk[4096];
+    size_t read;
+    while ((read = fread(chunk, 1, sizeof(chunk), pSource)) > 0)
+        text.append(chunk, read);
+    fclose(pSource);
+
+    std::vector<char> blob;
+    std::string error;
+    if (!PE::Components::compileParticleTemplates(text.data(), text.size(), blob, error))
+    {
+        fprintf(stderr, "%s: %s\n", sourcePath, error.c_str());
+        return 1;
+    }
+
+    FILE *pOutput = fopen(outputPath, "wb");
+    if (!pOutput || fwrite(&blob[0], 1, blob.size(), pOutput) != blob.size())
+    {
+        fprintf(stderr, "cannot write %s\n", outputPath);
+        if (pOutput)
+            fclose(pOutput);
+        return 1;
+    }
+    fclose(pOutput);
+
+    const PE::Components::ParticleTemplateFileHeader *pHeader =
+        reinterpret_cast<const PE::Components::ParticleTemplateFileHeader *>(&blob[0]);
+    printf("%s: %u templates, %u bytes\n", outputPath, pHeader->m_count, pHeader->m_fileBytes);
+    return 0;
+}
+
+static int listTemplateFile(const char *path)
+{
+    PE::Components::ParticleTemplateLibrary library;
+    if (!library.open(path))
+        return 1;
+
+    for (PrimitiveTypes::UInt32 i = 0; i < library.getCount(); i++)
+    {
+        PE::Components::Particle particle;
+        library.find(library.getName(i), particle);
+        printf("%s: rate %d duration %g looping %d texture '%s' render_mode %d\n", library.getName(i),
+            particle.m_rate, particle.m_duration, particle.m_looping ? 1 : 0, particle.m_texture, (int)particle.m_renderMode);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc == 3 && strcmp(argv[1], "--list") == 0)
+        return listTemplateFile(argv[2]);
+    if (argc == 3)
+        return compileTemplateFile(argv[1], argv[2]);
+
+    fprintf(stderr, "usage: %s source.txt output.ptpl\n       %s --list file.ptpl\n", argv[0], argv[0]);
+    return 1;
+}
+
+#endif // PE_PARTICLE_HEADLESS
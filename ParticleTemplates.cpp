@@ -0,0 +1,774 @@
+#include "ParticleTemplates.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace PE {
+namespace Components {
+
+PrimitiveTypes::UInt32 hashParticleTemplateName(const char *name)
+{
+    PrimitiveTypes::UInt32 hash = 2166136261u;
+    for (const char *c = name; *c; c++)
+    {
+        hash ^= (PrimitiveTypes::UInt8)*c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+namespace {
+
+enum TemplateValueType
+{
+    TemplateValue_Int,
+    TemplateValue_UInt,
+    TemplateValue_Bool,
+    TemplateValue_Float,
+    TemplateValue_Float2,
+    TemplateValue_Float3,
+    TemplateValue_Shape,
+    TemplateValue_RenderMode,
+    TemplateValue_Collision,
+    TemplateValue_String,
+    TemplateValue_Curve,
+    TemplateValue_Gradient,
+    TemplateValue_Affector, // appends to m_affectors, the key names the kind
+};
+
+struct TemplateKey
+{
+    const char *m_name;
+    TemplateValueType m_type;
+    size_t m_offset; // into ParticleTemplateRecord
+};
+
+const TemplateKey s_templateKeys[] =
+{
+    { "rate", TemplateValue_Int, offsetof(ParticleTemplateRecord, m_rate) },
+    { "speed", TemplateValue_Float, offsetof(ParticleTemplateRecord, m_speed) },
+    { "duration", TemplateValue_Float, offsetof(ParticleTemplateRecord, m_duration) },
+    { "looping", TemplateValue_Bool, offsetof(ParticleTemplateRecord, m_looping) },
+    { "size", TemplateValue_Float2, offsetof(ParticleTemplateRecord, m_size) },
+    { "shape", TemplateValue_Shape, offsetof(ParticleTemplateRecord, m_shape) },
+    { "texture", TemplateValue_String, offsetof(ParticleTemplateRecord, m_textureOffset) },
+    { "color", TemplateValue_Float3, offsetof(ParticleTemplateRecord, m_color) },
+    { "seed", TemplateValue_UInt, offsetof(ParticleTemplateRecord, m_seed) },
+    { "render_mode", TemplateValue_RenderMode, offsetof(ParticleTemplateRecord, m_renderMode) },
+    { "sim_rate", TemplateValue_Float, offsetof(ParticleTemplateRecord, m_simRate) },
+    { "max_substeps", TemplateValue_UInt, offsetof(ParticleTemplateRecord, m_maxSubsteps) },
+    { "depth_sort", TemplateValue_Bool, offsetof(ParticleTemplateRecord, m_depthSort) },
+    { "spawn_radius", TemplateValue_Float, offsetof(ParticleTemplateRecord, m_spawnRadius) },
+    { "spawn_height", TemplateValue_Float, offsetof(ParticleTemplateRecord, m_spawnHeight) },
+    { "cone_angle", TemplateValue_Float, offsetof(ParticleTemplateRecord, m_coneAngle) },
+    { "shape_extents", TemplateValue_Float3, offsetof(ParticleTemplateRecord, m_shapeExtents) },
+    { "swirl_strength", TemplateValue_Float, offsetof(ParticleTemplateRecord, m_swirlStrength) },
+    { "swirl_speed", TemplateValue_Float, offsetof(ParticleTemplateRecord, m_swirlSpeed) },
+    { "pulse_amount", TemplateValue_Float, offsetof(ParticleTemplateRecord, m_pulseAmount) },
+    { "pulse_frequency", TemplateValue_Float, offsetof(ParticleTemplateRecord, m_pulseFrequency) },
+    { "collision", TemplateValue_Collision, offsetof(ParticleTemplateRecord, m_collision) },
+    { "bounce", TemplateValue_Float, offsetof(ParticleTemplateRecord, m_bounce) },
+    { "friction", TemplateValue_Float, offsetof(ParticleTemplateRecord, m_friction) },
+    { "size_over_life", TemplateValue_Curve, offsetof(ParticleTemplateRecord, m_sizeOverLife) },
+    { "color_over_life", TemplateValue_Gradient, offsetof(ParticleTemplateRecord, m_colorOverLife) },
+    { "alpha_over_life", TemplateValue_Curve, offsetof(ParticleTemplateRecord, m_alphaOverLife) },
+    { "speed_over_life", TemplateValue_Curve, offsetof(ParticleTemplateRecord, m_speedOverLife) },
+    { "gravity", TemplateValue_Affector, offsetof(ParticleTemplateRecord, m_affectors) },
+    { "drag", TemplateValue_Affector, offsetof(ParticleTemplateRecord, m_affectors) },
+    { "attractor", TemplateValue_Affector, offsetof(ParticleTemplateRecord, m_affectors) },
+    { "vortex", TemplateValue_Affector, offsetof(ParticleTemplateRecord, m_affectors) },
+    { "turbulence", TemplateValue_Affector, offsetof(ParticleTemplateRecord, m_affectors) },
+    { "interaction", TemplateValue_Affector, offsetof(ParticleTemplateRecord, m_affectors) },
+};
+
+// string table under construction; equal strings are stored once
+struct TemplateStrings
+{
+    std::vector<char> m_bytes;
+
+    PrimitiveTypes::UInt32 add(const std::string &value)
+    {
+        for (size_t offset = 0; offset < m_bytes.size(); offset += strlen(&m_bytes[offset]) + 1)
+        {
+            if (value == &m_bytes[offset])
+                return (PrimitiveTypes::UInt32)offset;
+        }
+        PrimitiveTypes::UInt32 offset = (PrimitiveTypes::UInt32)m_bytes.size();
+        m_bytes.insert(m_bytes.end(), value.begin(), value.end());
+        m_bytes.push_back('\0');
+        return offset;
+    }
+};
+
+void initTemplateRecord(ParticleTemplateRecord &record)
+{
+    const Particle defaults;
+    // zero the unused curve keys too, so the same text always compiles to the same bytes
+    memset(static_cast<void *>(&record), 0, sizeof(record));
+    record.m_rate = defaults.m_rate;
+    record.m_speed = defaults.m_speed;
+    record.m_duration = defaults.m_duration;
+    record.m_looping = defaults.m_looping;
+    record.m_size[0] = defaults.m_size.m_x;
+    record.m_size[1] = defaults.m_size.m_y;
+    record.m_shape = defaults.m_shape;
+    record.m_color[0] = defaults.color.m_x;
+    record.m_color[1] = defaults.color.m_y;
+    record.m_color[2] = defaults.color.m_z;
+    record.m_seed = defaults.m_seed;
+    record.m_renderMode = defaults.m_renderMode;
+    record.m_simRate = defaults.m_simRate;
+    record.m_maxSubsteps = defaults.m_maxSubsteps;
+    record.m_depthSort = defaults.m_depthSort;
+    record.m_spawnRadius = defaults.m_spawnRadius;
+    record.m_spawnHeight = defaults.m_spawnHeight;
+    record.m_coneAngle = defaults.m_coneAngle;
+    record.m_shapeExtents[0] = defaults.m_shapeExtents.m_x;
+    record.m_shapeExtents[1] = defaults.m_shapeExtents.m_y;
+    record.m_shapeExtents[2] = defaults.m_shapeExtents.m_z;
+    record.m_swirlStrength = defaults.m_swirlStrength;
+    record.m_swirlSpeed = defaults.m_swirlSpeed;
+    record.m_pulseAmount = defaults.m_pulseAmount;
+    record.m_pulseFrequency = defaults.m_pulseFrequency;
+    record.m_collision = defaults.m_collision;
+    record.m_bounce = defaults.m_bounce;
+    record.m_friction = defaults.m_friction;
+    record.m_sizeOverLife = defaults.m_sizeOverLife;
+    record.m_colorOverLife = defaults.m_colorOverLife;
+    record.m_alphaOverLife = defaults.m_alphaOverLife;
+    record.m_speedOverLife = defaults.m_speedOverLife;
+    record.m_affectors = defaults.m_affectors;
+}
+
+std::string trimTemplateText(const std::string &text)
+{
+    size_t begin = text.find_first_not_of(" \t\r");
+    if (begin == std::string::npos)
+        return std::string();
+    size_t end = text.find_last_not_of(" \t\r");
+    return text.substr(begin, end - begin + 1);
+}
+
+// reads count floats separated by spaces; false on anything else
+bool parseTemplateFloats(const std::string &value, PrimitiveTypes::Float32 *pOut, int count)
+{
+    const char *c = value.c_str();
+    for (int i = 0; i < count; i++)
+    {
+        char *pEnd;
+        pOut[i] = strtof(c, &pEnd);
+        if (pEnd == c)
+            return false;
+        c = pEnd;
+    }
+    while (*c == ' ' || *c == '\t')
+        c++;
+    return *c == '\0';
+}
+
+// keys of width floats each (time first) for a curve or gradient; "none" gives no keys
+bool parseTemplateKeys(const std::string &value, int width, int maxKeys, PrimitiveTypes::Float32 *pKeys,
+    PrimitiveTypes::UInt32 &keyCount)
+{
+    keyCount = 0;
+    if (value == "none")
+        return true;
+
+    const char *c = value.c_str();
+    float lastTime = 0.0f;
+    for (;;)
+    {
+        while (*c == ' ' || *c == '\t')
+            c++;
+        if (*c == '\0')
+            break;
+        if ((int)keyCount == maxKeys)
+            return false;
+
+        for (int i = 0; i < width; i++)
+        {
+            char *pEnd;
+            pKeys[keyCount * width + i] = strtof(c, &pEnd);
+            if (pEnd == c)
+                return false;
+            c = pEnd;
+        }
+
+        float t = pKeys[keyCount * width];
+        if (t < lastTime || t > 1.0f)
+            return false;
+        lastTime = t;
+        keyCount++;
+    }
+    return keyCount > 0;
+}
+
+// one affector line, appended to the stack; see compileParticleTemplates() for the values
+bool parseTemplateAffector(const char *kind, const std::string &value, ParticleAffectorStack &stack)
+{
+    if (stack.m_count >= ParticleAffectorStack::MaxAffectors)
+        return false;
+
+    PrimitiveTypes::Float32 v[8];
+    if (strcmp(kind, "gravity") == 0)
+    {
+        if (!parseTemplateFloats(value, v, 3))
+            return false;
+        stack.addGravity(Vector3(v[0], v[1], v[2]));
+    }
+    else if (strcmp(kind, "drag") == 0)
+    {
+        // still air unless a wind follows the rate
+        if (parseTemplateFloats(value, v, 1))
+            v[1] = v[2] = v[3] = 0.0f;
+        else if (!parseTemplateFloats(value, v, 4))
+            return false;
+        if (v[0] < 0.0f)
+            return false;
+        stack.addDrag(v[0], Vector3(v[1], v[2], v[3]));
+    }
+    else if (strcmp(kind, "attractor") == 0)
+    {
+        if (!parseTemplateFloats(value, v, 5))
+            return false;
+        stack.addAttractor(Vector3(v[0], v[1], v[2]), v[3], v[4]);
+    }
+    else if (strcmp(kind, "vortex") == 0)
+    {
+        if (!parseTemplateFloats(value, v, 8))
+            return false;
+        stack.addVortex(Vector3(v[0], v[1], v[2]), Vector3(v[3], v[4], v[5]), v[6], v[7]);
+    }
+    else if (strcmp(kind, "turbulence") == 0)
+    {
+        if (!parseTemplateFloats(value, v, 3) || v[1] <= 0.0f)
+            return false;
+        stack.addTurbulence(v[0], v[1], v[2]);
+    }
+    else if (strcmp(kind, "interaction") == 0)
+    {
+        // pure separation unless cohesion and alignment follow
+        if (parseTemplateFloats(value, v, 2))
+            v[2] = v[3] = 0.0f;
+        else if (!parseTemplateFloats(value, v, 4))
+            return false;
+        if (v[0] <= 0.0f)
+            return false;
+        stack.addInteraction(v[0], v[1], v[2], v[3]);
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+bool parseTemplateValue(const TemplateKey &key, const std::string &value, ParticleTemplateRecord &record,
+    TemplateStrings &strings)
+{
+    char *pField = reinterpret_cast<char *>(&record) + key.m_offset;
+    switch (key.m_type)
+    {
+    case TemplateValue_Int:
+    case TemplateValue_UInt:
+    {
+        char *pEnd;
+        long long number = strtoll(value.c_str(), &pEnd, 0);
+        if (*pEnd != '\0' || pEnd == value.c_str())
+            return false;
+        if (key.m_type == TemplateValue_Int)
+        {
+            // m_rate ends up in Particle's 16-bit field
+            if (number < 0 || number > 32767)
+                return false;
+            *reinterpret_cast<PrimitiveTypes::Int32 *>(pField) = (PrimitiveTypes::Int32)number;
+        }
+        else
+        {
+            if (number < 0 || number > 0xffffffffll)
+                return false;
+            *reinterpret_cast<PrimitiveTypes::UInt32 *>(pField) = (PrimitiveTypes::UInt32)number;
+        }
+        return true;
+    }
+    case TemplateValue_Bool:
+        if (value != "true" && value != "false")
+            return false;
+        *reinterpret_cast<PrimitiveTypes::UInt32 *>(pField) = value == "true";
+        return true;
+    case TemplateValue_Float:
+        return parseTemplateFloats(value, reinterpret_cast<PrimitiveTypes::Float32 *>(pField), 1);
+    case TemplateValue_Float2:
+        return parseTemplateFloats(value, reinterpret_cast<PrimitiveTypes::Float32 *>(pField), 2);
+    case TemplateValue_Float3:
+        return parseTemplateFloats(value, reinterpret_cast<PrimitiveTypes::Float32 *>(pField), 3);
+    case TemplateValue_Shape:
+    {
+        PrimitiveTypes::UInt32 &shape = *reinterpret_cast<PrimitiveTypes::UInt32 *>(pField);
+        if (value == "cone") shape = Cone;
+        else if (value == "sphere") shape = Sphere;
+        else if (value == "box") shape = Box;
+        else if (value == "disc") shape = Disc;
+        else if (value == "mesh_surface") shape = MeshSurface;
+        else if (value == "line") shape = Line;
+        else return false;
+        return true;
+    }
+    case TemplateValue_RenderMode:
+    {
+        PrimitiveTypes::UInt32 &mode = *reinterpret_cast<PrimitiveTypes::UInt32 *>(pField);
+        if (value == "cpu_expanded") mode = ParticleRenderMode_CPUExpanded;
+        else if (value == "instanced") mode = ParticleRenderMode_Instanced;
+        else if (value == "packed") mode = ParticleRenderMode_Packed;
+        else return false;
+        return true;
+    }
+    case TemplateValue_Collision:
+    {
+        PrimitiveTypes::UInt32 &response = *reinterpret_cast<PrimitiveTypes::UInt32 *>(pField);
+        if (value == "bounce") response = ParticleCollision_Bounce;
+        else if (value == "stick") response = ParticleCollision_Stick;
+        else if (value == "kill") response = ParticleCollision_Kill;
+        else return false;
+        return true;
+    }
+    case TemplateValue_String:
+        *reinterpret_cast<PrimitiveTypes::UInt32 *>(pField) = strings.add(value);
+        return true;
+    case TemplateValue_Curve:
+    {
+        ParticleCurve &curve = *reinterpret_cast<ParticleCurve *>(pField);
+        PrimitiveTypes::Float32 keys[ParticleCurve::MaxKeys * 2];
+        PrimitiveTypes::UInt32 keyCount;
+        if (!parseTemplateKeys(value, 2, ParticleCurve::MaxKeys, keys, keyCount))
+            return false;
+        curve.clear();
+        for (PrimitiveTypes::UInt32 k = 0; k < keyCount; k++)
+            curve.addKey(keys[k * 2], keys[k * 2 + 1]);
+        return true;
+    }
+    case TemplateValue_Gradient:
+    {
+        ParticleGradient &gradient = *reinterpret_cast<ParticleGradient *>(pField);
+        PrimitiveTypes::Float32 keys[ParticleGradient::MaxKeys * 4];
+        PrimitiveTypes::UInt32 keyCount;
+        if (!parseTemplateKeys(value, 4, ParticleGradient::MaxKeys, keys, keyCount))
+            return false;
+        gradient.clear();
+        for (PrimitiveTypes::UInt32 k = 0; k < keyCount; k++)
+            gradient.addKey(keys[k * 4], Vector3(keys[k * 4 + 1], keys[k * 4 + 2], keys[k * 4 + 3]));
+        return true;
+    }
+    case TemplateValue_Affector:
+        return parseTemplateAffector(key.m_name, value, *reinterpret_cast<ParticleAffectorStack *>(pField));
+    }
+    return false;
+}
+
+bool compareTemplateRecords(const ParticleTemplateRecord &a, const ParticleTemplateRecord &b)
+{
+    return a.m_nameHash < b.m_nameHash;
+}
+
+}; // namespace
+
+bool compileParticleTemplates(const char *text, size_t length, std::vector<char> &blob, std::string &error)
+{
+    std::vector<ParticleTemplateRecord> records;
+    TemplateStrings strings;
+    // offset 0 is the empty string, the texture of templates without one
+    strings.add(std::string());
+
+    char message[256];
+    size_t lineStart = 0;
+    for (PrimitiveTypes::UInt32 lineNumber = 1; lineStart < length; lineNumber++)
+    {
+        size_t lineEnd = lineStart;
+        while (lineEnd < length && text[lineEnd] != '\n')
+            lineEnd++;
+        std::string line(text + lineStart, lineEnd - lineStart);
+        lineStart = lineEnd + 1;
+
+        size_t comment = line.find('#');
+        if (comment != std::string::npos)
+            line.erase(comment);
+        line = trimTemplateText(line);
+        if (line.empty())
+            continue;
+
+        if (line[0] == '[')
+        {
+            std::string name = line[line.size() - 1] == ']' ? trimTemplateText(line.substr(1, line.size() - 2)) : std::string();
+            if (name.empty())
+            {
+                snprintf(message, sizeof(message), "line %u: expected [template name]", lineNumber);
+                error = message;
+                return false;
+            }
+
+            ParticleTemplateRecord record;
+            initTemplateRecord(record);
+            record.m_nameHash = hashParticleTemplateName(name.c_str());
+            for (size_t i = 0; i < records.size(); i++)
+            {
+                if (records[i].m_nameHash == record.m_nameHash)
+                {
+                    snprintf(message, sizeof(message), "line %u: template '%s' clashes with '%s'", lineNumber,
+                        name.c_str(), &strings.m_bytes[records[i].m_nameOffset]);
+                    error = message;
+                    return false;
+                }
+            }
+            record.m_nameOffset = strings.add(name);
+            records.push_back(record);
+            continue;
+        }
+
+        size_t equals = line.find('=');
+        if (equals == std::string::npos)
+        {
+            snprintf(message, sizeof(message), "line %u: expected key = value", lineNumber);
+            error = message;
+            return false;
+        }
+        if (records.empty())
+        {
+            snprintf(message, sizeof(message), "line %u: value outside of a [template]", lineNumber);
+            error = message;
+            return false;
+        }
+
+        std::string key = trimTemplateText(line.substr(0, equals));
+        std::string value = trimTemplateText(line.substr(equals + 1));
+
+        const TemplateKey *pKey = NULL;
+        for (size_t i = 0; i < sizeof(s_templateKeys) / sizeof(s_templateKeys[0]); i++)
+        {
+            if (key == s_templateKeys[i].m_name)
+                pKey = &s_templateKeys[i];
+        }
+        if (!pKey)
+        {
+            snprintf(message, sizeof(message), "line %u: unknown key '%s'", lineNumber, key.c_str());
+            error = message;
+            return false;
+        }
+        if (!parseTemplateValue(*pKey, value, records.back(), strings))
+        {
+            snprintf(message, sizeof(message), "line %u: bad value '%s' for %s", lineNumber, value.c_str(), key.c_str());
+            error = message;
+            return false;
+        }
+    }
+
+    std::sort(records.begin(), records.end(), compareTemplateRecords);
+
+    ParticleTemplateFileHeader header;
+    header.m_magic = ParticleTemplateMagic;
+    header.m_version = ParticleTemplateVersion;
+    header.m_count = (PrimitiveTypes::UInt32)records.size();
+    header.m_recordOffset = sizeof(ParticleTemplateFileHeader);
+    header.m_stringOffset = header.m_recordOffset + header.m_count * sizeof(ParticleTemplateRecord);
+    header.m_fileBytes = header.m_stringOffset + (PrimitiveTypes::UInt32)strings.m_bytes.size();
+
+    blob.resize(header.m_fileBytes);
+    memcpy(&blob[0], &header, sizeof(header));
+    if (!records.empty())
+        memcpy(&blob[header.m_recordOffset], &records[0], records.size() * sizeof(ParticleTemplateRecord));
+    memcpy(&blob[header.m_stringOffset], &strings.m_bytes[0], strings.m_bytes.size());
+    return true;
+}
+
+ParticleTemplateLibrary *ParticleTemplateLibrary::Instance()
+{
+    static ParticleTemplateLibrary s_instance;
+    return &s_instance;
+}
+
+ParticleTemplateLibrary::ParticleTemplateLibrary()
+    : m_generation(0)
+    , m_pHeader(NULL)
+    , m_pRecords(NULL)
+    , m_pStrings(NULL)
+    , m_stringBytes(0)
+    , m_pMapping(NULL)
+    , m_mappingBytes(0)
+#if defined(_WIN32)
+    , m_hFile(NULL)
+    , m_hMapping(NULL)
+#endif
+    , m_sourceTime(0)
+    , m_sourceBytes(0)
+{
+}
+
+ParticleTemplateLibrary::~ParticleTemplateLibrary()
+{
+    close();
+}
+
+bool ParticleTemplateLibrary::use(const char *pData, size_t bytes)
+{
+    // the header is all that is checked up front; records are checked when found
+    const ParticleTemplateFileHeader *pHeader = reinterpret_cast<const ParticleTemplateFileHeader *>(pData);
+    if (bytes < sizeof(ParticleTemplateFileHeader)
+        || pHeader->m_magic != ParticleTemplateMagic
+        || pHeader->m_version != ParticleTemplateVersion
+        || pHeader->m_fileBytes != bytes
+        || pHeader->m_recordOffset != sizeof(ParticleTemplateFileHeader)
+        || pHeader->m_stringOffset != pHeader->m_recordOffset + (PrimitiveTypes::UInt64)pHeader->m_count * sizeof(ParticleTemplateRecord)
+        || pHeader->m_stringOffset >= bytes
+        || pData[bytes - 1] != '\0')
+    {
+        PEINFO("ParticleTemplateLibrary: not a compiled template file (version %d)\n", ParticleTemplateVersion);
+        return false;
+    }
+
+    m_pHeader = pHeader;
+    m_pRecords = reinterpret_cast<const ParticleTemplateRecord *>(pData + pHeader->m_recordOffset);
+    m_pStrings = pData + pHeader->m_stringOffset;
+    m_stringBytes = (PrimitiveTypes::UInt32)(bytes - pHeader->m_stringOffset);
+    m_generation++;
+    return true;
+}
+
+bool ParticleTemplateLibrary::open(const char *path)
+{
+    close();
+
+#if defined(_WIN32)
+    HANDLE hFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        PEINFO("ParticleTemplateLibrary: cannot open %s\n", path);
+        return false;
+    }
+    LARGE_INTEGER size;
+    HANDLE hMapping = GetFileSizeEx(hFile, &size) && size.QuadPart > 0
+        ? CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+    void *pView = hMapping ? MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (!pView)
+    {
+        if (hMapping)
+            CloseHandle(hMapping);
+        CloseHandle(hFile);
+        PEINFO("ParticleTemplateLibrary: cannot map %s\n", path);
+        return false;
+    }
+    m_hFile = hFile;
+    m_hMapping = hMapping;
+    m_pMapping = pView;
+    m_mappingBytes = (size_t)size.QuadPart;
+#else
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        PEINFO("ParticleTemplateLibrary: cannot open %s\n", path);
+        return false;
+    }
+    struct stat info;
+    void *pView = fstat(fd, &info) == 0 && info.st_size > 0
+        ? mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    // the mapping holds its own reference to the file
+    ::close(fd);
+    if (pView == MAP_FAILED)
+    {
+        PEINFO("ParticleTemplateLibrary: cannot map %s\n", path);
+        return false;
+    }
+    m_pMapping = pView;
+    m_mappingBytes = (size_t)info.st_size;
+#endif
+
+    if (!use(static_cast<const char *>(m_pMapping), m_mappingBytes))
+    {
+        unmap();
+        return false;
+    }
+    return true;
+}
+
+bool ParticleTemplateLibrary::openMemory(const void *pData, size_t bytes)
+{
+    close();
+    return use(static_cast<const char *>(pData), bytes);
+}
+
+void ParticleTemplateLibrary::unmap()
+{
+    if (!m_pMapping)
+        return;
+
+#if defined(_WIN32)
+    UnmapViewOfFile(m_pMapping);
+    CloseHandle(m_hMapping);
+    CloseHandle(m_hFile);
+    m_hMapping = NULL;
+    m_hFile = NULL;
+#else
+    munmap(m_pMapping, m_mappingBytes);
+#endif
+    m_pMapping = NULL;
+    m_mappingBytes = 0;
+}
+
+void ParticleTemplateLibrary::close()
+{
+    unmap();
+    m_compiled.clear();
+    m_pHeader = NULL;
+    m_pRecords = NULL;
+    m_pStrings = NULL;
+    m_stringBytes = 0;
+}
+
+bool ParticleTemplateLibrary::find(const char *name, Particle &particle) const
+{
+    if (!m_pHeader)
+        return false;
+
+    PrimitiveTypes::UInt32 hash = hashParticleTemplateName(name);
+    PrimitiveTypes::UInt32 low = 0, high = m_pHeader->m_count;
+    while (low < high)
+    {
+        PrimitiveTypes::UInt32 mid = (low + high) / 2;
+        if (m_pRecords[mid].m_nameHash < hash)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    if (low == m_pHeader->m_count || m_pRecords[low].m_nameHash != hash)
+        return false;
+
+    const ParticleTemplateRecord &record = m_pRecords[low];
+    if (record.m_nameOffset >= m_stringBytes || record.m_textureOffset >= m_stringBytes
+        || strcmp(m_pStrings + record.m_nameOffset, name) != 0)
+        return false;
+
+    particle.m_rate = (PrimitiveTypes::Int16)record.m_rate;
+    particle.m_speed = record.m_speed;
+    particle.m_duration = record.m_duration;
+    particle.m_looping = record.m_looping != 0;
+    particle.m_size = Vector2(record.m_size[0], record.m_size[1]);
+    particle.m_shape = record.m_shape <= Line ? (Shape)record.m_shape : Disc;
+    particle.m_texture = m_pStrings + record.m_textureOffset;
+    particle.color = Vector3(record.m_color[0], record.m_color[1], record.m_color[2]);
+    particle.m_seed = record.m_seed;
+    particle.m_renderMode = record.m_renderMode <= ParticleRenderMode_Packed
+        ? (ParticleRenderMode)record.m_renderMode : ParticleRenderMode_CPUExpanded;
+    particle.m_simRate = record.m_simRate;
+    particle.m_maxSubsteps = record.m_maxSubsteps;
+    particle.m_depthSort = record.m_depthSort != 0;
+    particle.m_spawnRadius = record.m_spawnRadius;
+    particle.m_spawnHeight = record.m_spawnHeight;
+    particle.m_coneAngle = record.m_coneAngle;
+    particle.m_shapeExtents = Vector3(record.m_shapeExtents[0], record.m_shapeExtents[1], record.m_shapeExtents[2]);
+    particle.m_swirlStrength = record.m_swirlStrength;
+    particle.m_swirlSpeed = record.m_swirlSpeed;
+    particle.m_pulseAmount = record.m_pulseAmount;
+    particle.m_pulseFrequency = record.m_pulseFrequency;
+    particle.m_collision = record.m_collision <= ParticleCollision_Kill
+        ? (ParticleCollisionResponse)record.m_collision : ParticleCollision_Bounce;
+    particle.m_bounce = record.m_bounce;
+    particle.m_friction = record.m_friction;
+    particle.m_sizeOverLife = record.m_sizeOverLife;
+    particle.m_colorOverLife = record.m_colorOverLife;
+    particle.m_alphaOverLife = record.m_alphaOverLife;
+    particle.m_speedOverLife = record.m_speedOverLife;
+    // key counts come from the file
+    if (particle.m_sizeOverLife.m_keyCount > ParticleCurve::MaxKeys) particle.m_sizeOverLife.clear();
+    if (particle.m_colorOverLife.m_keyCount > ParticleGradient::MaxKeys) particle.m_colorOverLife.clear();
+    if (particle.m_alphaOverLife.m_keyCount > ParticleCurve::MaxKeys) particle.m_alphaOverLife.clear();
+    if (particle.m_speedOverLife.m_keyCount > ParticleCurve::MaxKeys) particle.m_speedOverLife.clear();
+    particle.m_affectors = record.m_affectors;
+    if (particle.m_affectors.m_count > ParticleAffectorStack::MaxAffectors) particle.m_affectors.clear();
+    return true;
+}
+
+PrimitiveTypes::UInt32 ParticleTemplateLibrary::getCount() const
+{
+    return m_pHeader ? m_pHeader->m_count : 0;
+}
+
+const char *ParticleTemplateLibrary::getName(PrimitiveTypes::UInt32 index) const
+{
+    if (index >= getCount() || m_pRecords[index].m_nameOffset >= m_stringBytes)
+        return NULL;
+    return m_pStrings + m_pRecords[index].m_nameOffset;
+}
+
+// modification time and size; the size catches saves within the same second
+static bool getParticleSourceStamp(const char *path, PrimitiveTypes::Int64 &time, PrimitiveTypes::Int64 &bytes)
+{
+    struct stat info;
+    if (stat(path, &info) != 0)
+        return false;
+    time = (PrimitiveTypes::Int64)info.st_mtime;
+    bytes = (PrimitiveTypes::Int64)info.st_size;
+    return true;
+}
+
+void ParticleTemplateLibrary::watchSource(const char *sourcePath)
+{
+    m_sourcePath = sourcePath;
+    m_sourceTime = 0;
+    m_sourceBytes = 0;
+    getParticleSourceStamp(sourcePath, m_sourceTime, m_sourceBytes);
+}
+
+bool ParticleTemplateLibrary::reloadIfChanged()
+{
+#if PE_PARTICLE_HOT_RELOAD
+    if (m_sourcePath.empty())
+        return false;
+
+    PrimitiveTypes::Int64 sourceTime, sourceBytes;
+    if (!getParticleSourceStamp(m_sourcePath.c_str(), sourceTime, sourceBytes)
+        || (sourceTime == m_sourceTime && sourceBytes == m_sourceBytes))
+        return false;
+    m_sourceTime = sourceTime;
+    m_sourceBytes = sourceBytes;
+
+    FILE *pFile = fopen(m_sourcePath.c_str(), "rb");
+    if (!pFile)
+        return false;
+    std::string text;
+    char chunk[4096];
+    size_t read;
+    while ((read = fread(chunk, 1, sizeof(chunk), pFile)) > 0)
+        text.append(chunk, read);
+    fclose(pFile);
+
+    std::vector<char> blob;
+    std::string error;
+    if (!compileParticleTemplates(text.data(), text.size(), blob, error))
+    {
+        PEINFO("ParticleTemplateLibrary: %s: %s\n", m_sourcePath.c_str(), error.c_str());
+        return false;
+    }
+
+    m_compiled.push_back(std::vector<char>());
+    m_compiled.back().swap(blob);
+    const std::vector<char> &compiled = m_compiled.back();
+    if (!use(&compiled[0], compiled.size()))
+        return false;
+    PEINFO("ParticleTemplateLibrary: reloaded %u templates from %s\n", getCount(), m_sourcePath.c_str());
+    return true;
+#else
+    return false;
+#endif
+}
+
+}; // namespace Components
+}; // namespace PE
@@ -0,0 +1,170 @@
+#ifndef _PE_PARTICLE_TEMPLATES_H_
+#define _PE_PARTICLE_TEMPLATES_H_
+
+#include "ParticleSimCore.h"
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+// PE_PARTICLE_HOT_RELOAD lets a ParticleTemplateLibrary watch the text source it was
+// compiled from and rebuild itself when the file changes. Defaults to off in NDEBUG builds.
+#ifndef PE_PARTICLE_HOT_RELOAD
+#ifdef NDEBUG
+#define PE_PARTICLE_HOT_RELOAD 0
+#else
+#define PE_PARTICLE_HOT_RELOAD 1
+#endif
+#endif
+
+namespace PE {
+namespace Components {
+
+enum { ParticleTemplateMagic = 0x4c505450 }; // "PTPL"
+enum { ParticleTemplateVersion = 5 };
+
+// Compiled template file: this header, m_count records sorted by m_nameHash, then the
+// zero-terminated names and texture paths. All fields are 32-bit little endian and
+// offsets count from the start of the file, so the file is used as mapped.
+struct ParticleTemplateFileHeader
+{
+    PrimitiveTypes::UInt32 m_magic;
+    PrimitiveTypes::UInt32 m_version;
+    PrimitiveTypes::UInt32 m_count;
+    PrimitiveTypes::UInt32 m_recordOffset;
+    PrimitiveTypes::UInt32 m_stringOffset;
+    PrimitiveTypes::UInt32 m_fileBytes;
+};
+
+// one Particle as stored in the file; see Particle for the meaning of the fields
+struct ParticleTemplateRecord
+{
+    PrimitiveTypes::UInt32 m_nameHash;
+    PrimitiveTypes::UInt32 m_nameOffset;    // from m_stringOffset
+    PrimitiveTypes::UInt32 m_textureOffset; // from m_stringOffset
+    PrimitiveTypes::Int32 m_rate;
+    PrimitiveTypes::Float32 m_speed;
+    PrimitiveTypes::Float32 m_duration;
+    PrimitiveTypes::UInt32 m_looping;
+    PrimitiveTypes::Float32 m_size[2];
+    PrimitiveTypes::UInt32 m_shape;
+    PrimitiveTypes::Float32 m_color[3];
+    PrimitiveTypes::UInt32 m_seed;
+    PrimitiveTypes::UInt32 m_renderMode;
+    PrimitiveTypes::Float32 m_simRate;
+    PrimitiveTypes::UInt32 m_maxSubsteps;
+    PrimitiveTypes::UInt32 m_depthSort;
+    PrimitiveTypes::Float32 m_spawnRadius;
+    PrimitiveTypes::Float32 m_spawnHeight;
+    PrimitiveTypes::Float32 m_coneAngle;
+    PrimitiveTypes::Float32 m_shapeExtents[3];
+    PrimitiveTypes::Float32 m_swirlStrength;
+    PrimitiveTypes::Float32 m_swirlSpeed;
+    PrimitiveTypes::Float32 m_pulseAmount;
+    PrimitiveTypes::Float32 m_pulseFrequency;
+    PrimitiveTypes::UInt32 m_collision;
+    PrimitiveTypes::Float32 m_bounce;
+    PrimitiveTypes::Float32 m_friction;
+    ParticleCurve m_sizeOverLife;
+    ParticleGradient m_colorOverLife;
+    ParticleCurve m_alphaOverLife;
+    ParticleCurve m_speedOverLife;
+    ParticleAffectorStack m_affectors;
+};
+
+// FNV-1a of a template name, the key records are sorted and found by
+PrimitiveTypes::UInt32 hashParticleTemplateName(const char *name);
+
+// Author-time text format, one template per section:
+//
+//   # hit sparks
+//   [spark]
+//   rate = 60
+//   looping = false
+//   size = 0.02 0.02
+//   color = 1 0.8 0.3
+//   alpha_over_life = 0 1  0.6 1  1 0
+//   render_mode = packed
+//
+// Keys are the Particle fields without the m_ prefix in lower case with underscores
+// (rate, speed, duration, looping, size, shape, texture, color, seed, render_mode,
+// sim_rate, max_substeps, depth_sort, spawn_radius, spawn_height, cone_angle,
+// shape_extents, swirl_strength, swirl_speed, pulse_amount, pulse_frequency, collision,
+// bounce, friction, size_over_life, color_over_life, alpha_over_life, speed_over_life);
+// anything left out keeps the Particle default. shape is cone, sphere, box, disc,
+// mesh_surface or line (the mesh itself is not in the file), render_mode cpu_expanded,
+// instanced or packed, collision bounce, stick or kill (the colliders are not in the
+// file either), booleans true or false. Curves list their keys as "t value t value ...", color_over_life as
+// "t r g b t r g b ...", with t rising from 0 to 1; "none" clears a curve.
+// Affectors (see ParticleAffectorStack) are added by one line each, up to MaxAffectors:
+//   gravity = ax ay az
+//   drag = rate [wind_x wind_y wind_z]
+//   attractor = x y z strength radius
+//   vortex = x y z axis_x axis_y axis_z strength radius
+//   turbulence = strength scale speed
+//   interaction = radius separation [cohesion alignment]
+// Returns false and a message naming the line on the first error.
+bool compileParticleTemplates(const char *text, size_t length, std::vector<char> &blob, std::string &error);
+
+// Compiled templates in memory. open() maps a compiled file and uses it in place:
+// finding a template is a binary search over the records, nothing is parsed at startup.
+// With PE_PARTICLE_HOT_RELOAD, watchSource() names the text the file was built from and
+// reloadIfChanged() recompiles it when it was modified; emitters already running keep
+// their templates until ParticleEmitterCore::setTemplate() hands them the new ones
+// (ParticleTemplateWatcher and ParticleSystem::reloadTemplate() do that in the engine).
+struct ParticleTemplateLibrary
+{
+    static ParticleTemplateLibrary *Instance();
+
+    ParticleTemplateLibrary();
+    ~ParticleTemplateLibrary();
+
+    // maps a compiled file in place of the current contents
+    bool open(const char *path);
+    // uses a compiled blob that stays owned by the caller and must outlive its use here
+    bool openMemory(const void *pData, size_t bytes);
+    void close();
+
+    // fills particle from the named template; the texture name points into the library
+    // and stays valid until close(), m_pShapeMesh and m_pColliders are left as they were
+    bool find(const char *name, Particle &particle) const;
+
+    PrimitiveTypes::UInt32 getCount() const;
+    const char *getName(PrimitiveTypes::UInt32 index) const;
+
+    void watchSource(const char *sourcePath);
+    // true when the source changed and compiled; a source with errors keeps the old templates
+    bool reloadIfChanged();
+
+    PrimitiveTypes::UInt32 m_generation; // bumped whenever the contents change
+
+private:
+    ParticleTemplateLibrary(const ParticleTemplateLibrary &);
+    ParticleTemplateLibrary &operator=(const ParticleTemplateLibrary &);
+
+    bool use(const char *pData, size_t bytes);
+    void unmap();
+
+    const ParticleTemplateFileHeader *m_pHeader;
+    const ParticleTemplateRecord *m_pRecords;
+    const char *m_pStrings;
+    PrimitiveTypes::UInt32 m_stringBytes;
+
+    void *m_pMapping; // the mapped file, if open() was used
+    size_t m_mappingBytes;
+#if defined(_WIN32)
+    void *m_hFile;
+    void *m_hMapping;
+#endif
+
+    std::string m_sourcePath;
+    PrimitiveTypes::Int64 m_sourceTime;
+    PrimitiveTypes::Int64 m_sourceBytes;
+    // reloaded blobs; earlier ones are kept so texture names handed out stay valid
+    std::vector<std::vector<char> > m_compiled;
+};
+
+}; // namespace Components
+}; // namespace PE
+
+#endif